@@ -0,0 +1,275 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "Utils.h"
+
+#include <array>
+#include <cstring>
+#include <random>
+#include <unistd.h>
+
+#include <glm/glm.hpp>
+
+// Particles are moved and culled in a compute shader that appends the visible ones to a
+// vertex buffer and counts them in the arguments of an indirect draw. The number of particles
+// that are drawn is never read back on the CPU.
+
+nxt::Device device;
+nxt::Queue queue;
+
+nxt::Buffer modelBuffer;
+nxt::Buffer particleBuffer;
+nxt::Buffer visibleBuffer;
+nxt::Buffer indirectBuffer;
+
+nxt::Pipeline resetPipeline;
+nxt::Pipeline cullPipeline;
+nxt::BindGroup cullBindGroup;
+nxt::Pipeline renderPipeline;
+
+nxt::CommandBuffer commandBuffer;
+
+static const uint32_t kNumParticles = 1000;
+
+struct Particle {
+    glm::vec2 pos;
+    glm::vec2 vel;
+};
+
+// Same layout as the arguments of DrawArraysIndirect
+struct DrawArraysArgs {
+    uint32_t vertexCount;
+    uint32_t instanceCount;
+    uint32_t firstVertex;
+    uint32_t firstInstance;
+};
+
+void initBuffers() {
+    glm::vec2 model[3] = {
+        {-0.01, -0.02},
+        {0.01, -0.02},
+        {0.00, 0.02},
+    };
+    modelBuffer = device.CreateBufferBuilder()
+        .SetUsage(nxt::BufferUsageBit::Vertex | nxt::BufferUsageBit::Mapped)
+        .SetSize(sizeof(model))
+        .GetResult();
+    modelBuffer.SetSubData(0, sizeof(model) / sizeof(uint32_t),
+            reinterpret_cast<uint32_t*>(model));
+
+    std::vector<Particle> initialParticles(kNumParticles);
+    {
+        std::mt19937 generator;
+        std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+        for (auto& p : initialParticles)
+        {
+            p.pos = glm::vec2(dist(generator), dist(generator));
+            p.vel = glm::vec2(dist(generator), dist(generator)) * 0.01f;
+        }
+    }
+
+    particleBuffer = device.CreateBufferBuilder()
+        .SetUsage(nxt::BufferUsageBit::Storage | nxt::BufferUsageBit::Mapped)
+        .SetSize(sizeof(Particle) * kNumParticles)
+        .GetResult();
+    particleBuffer.SetSubData(0,
+        sizeof(Particle) * kNumParticles / sizeof(uint32_t),
+        reinterpret_cast<uint32_t*>(initialParticles.data()));
+
+    visibleBuffer = device.CreateBufferBuilder()
+        .SetUsage(nxt::BufferUsageBit::Vertex | nxt::BufferUsageBit::Storage)
+        .SetSize(sizeof(Particle) * kNumParticles)
+        .GetResult();
+
+    indirectBuffer = device.CreateBufferBuilder()
+        .SetUsage(nxt::BufferUsageBit::Indirect | nxt::BufferUsageBit::Storage)
+        .SetSize(sizeof(DrawArraysArgs))
+        .GetResult();
+}
+
+void initRender() {
+    nxt::ShaderModule vsModule = CreateShaderModule(device, nxt::ShaderStage::Vertex, R"(
+        #version 450
+        layout(location = 0) in vec2 a_particlePos;
+        layout(location = 1) in vec2 a_particleVel;
+        layout(location = 2) in vec2 a_pos;
+        void main() {
+            float angle = -atan(a_particleVel.x, a_particleVel.y);
+            vec2 pos = vec2(a_pos.x * cos(angle) - a_pos.y * sin(angle),
+                            a_pos.x * sin(angle) + a_pos.y * cos(angle));
+            gl_Position = vec4(pos + a_particlePos, 0, 1);
+        }
+    )");
+
+    nxt::ShaderModule fsModule = CreateShaderModule(device, nxt::ShaderStage::Fragment, R"(
+        #version 450
+        out vec4 fragColor;
+        void main() {
+            fragColor = vec4(1.0);
+        }
+    )");
+
+    nxt::InputState inputState = device.CreateInputStateBuilder()
+        .SetAttribute(0, 0, nxt::VertexFormat::FloatR32G32, offsetof(Particle, pos))
+        .SetAttribute(1, 0, nxt::VertexFormat::FloatR32G32, offsetof(Particle, vel))
+        .SetInput(0, sizeof(Particle), nxt::InputStepMode::Instance)
+        .SetAttribute(2, 1, nxt::VertexFormat::FloatR32G32, 0)
+        .SetInput(1, sizeof(glm::vec2), nxt::InputStepMode::Vertex)
+        .GetResult();
+
+    renderPipeline = device.CreatePipelineBuilder()
+        .SetStage(nxt::ShaderStage::Vertex, vsModule, "main")
+        .SetStage(nxt::ShaderStage::Fragment, fsModule, "main")
+        .SetInputState(inputState)
+        .GetResult();
+}
+
+void initCull() {
+    // Both compute shaders use the same bind group so it doesn't need to be set again.
+    static const char* kBindings = R"(
+        #version 450
+
+        struct Particle {
+            vec2 pos;
+            vec2 vel;
+        };
+
+        layout(std140, set = 0, binding = 0) buffer Particles {
+            Particle particles[1000];
+        };
+
+        layout(std140, set = 0, binding = 1) buffer Visible {
+            Particle visible[1000];
+        };
+
+        layout(std140, set = 0, binding = 2) buffer Args {
+            uint vertexCount;
+            uint instanceCount;
+            uint firstVertex;
+            uint firstInstance;
+        } args;
+    )";
+
+    nxt::ShaderModule resetModule = CreateShaderModule(device, nxt::ShaderStage::Compute,
+        (std::string(kBindings) + R"(
+        void main() {
+            args.vertexCount = 3;
+            args.instanceCount = 0;
+            args.firstVertex = 0;
+            args.firstInstance = 0;
+        }
+    )").c_str());
+
+    nxt::ShaderModule cullModule = CreateShaderModule(device, nxt::ShaderStage::Compute,
+        (std::string(kBindings) + R"(
+        void main() {
+            uint index = gl_GlobalInvocationID.x;
+            if (index >= 1000) { return; }
+
+            vec2 vPos = particles[index].pos + particles[index].vel;
+            vec2 vVel = particles[index].vel;
+
+            // Wrap around boundary
+            if (vPos.x < -1.0) vPos.x = 1.0;
+            if (vPos.x > 1.0) vPos.x = -1.0;
+            if (vPos.y < -1.0) vPos.y = 1.0;
+            if (vPos.y > 1.0) vPos.y = -1.0;
+
+            particles[index].pos = vPos;
+
+            // Only the particles in the circle are visible
+            if (length(vPos) < 0.75) {
+                uint slot = atomicAdd(args.instanceCount, 1);
+                visible[slot].pos = vPos;
+                visible[slot].vel = vVel;
+            }
+        }
+    )").c_str());
+
+    nxt::BindGroupLayout bgl = device.CreateBindGroupLayoutBuilder()
+        .SetBindingsType(nxt::ShaderStageBit::Compute, nxt::BindingType::StorageBuffer, 0, 3)
+        .GetResult();
+
+    nxt::PipelineLayout pl = device.CreatePipelineLayoutBuilder()
+        .SetBindGroupLayout(0, bgl)
+        .GetResult();
+
+    resetPipeline = device.CreatePipelineBuilder()
+        .SetLayout(pl)
+        .SetStage(nxt::ShaderStage::Compute, resetModule, "main")
+        .GetResult();
+
+    cullPipeline = device.CreatePipelineBuilder()
+        .SetLayout(pl)
+        .SetStage(nxt::ShaderStage::Compute, cullModule, "main")
+        .GetResult();
+
+    std::array<nxt::BufferView, 3> views;
+    views[0] = particleBuffer.CreateBufferViewBuilder()
+        .SetExtent(0, kNumParticles * sizeof(Particle))
+        .GetResult();
+    views[1] = visibleBuffer.CreateBufferViewBuilder()
+        .SetExtent(0, kNumParticles * sizeof(Particle))
+        .GetResult();
+    views[2] = indirectBuffer.CreateBufferViewBuilder()
+        .SetExtent(0, sizeof(DrawArraysArgs))
+        .GetResult();
+
+    cullBindGroup = device.CreateBindGroupBuilder()
+        .SetLayout(bgl)
+        .SetUsage(nxt::BindGroupUsage::Frozen)
+        .SetBufferViews(0, 3, views.data())
+        .GetResult();
+}
+
+void initCommandBuffers() {
+    static const uint32_t zeroOffsets[1] = {0};
+    commandBuffer = device.CreateCommandBufferBuilder()
+        .SetPipeline(resetPipeline)
+        .SetBindGroup(0, cullBindGroup)
+        .Dispatch(1, 1, 1)
+
+        .SetPipeline(cullPipeline)
+        .SetBindGroup(0, cullBindGroup)
+        .Dispatch(kNumParticles, 1, 1)
+
+        .SetPipeline(renderPipeline)
+        .SetVertexBuffers(0, 1, &visibleBuffer, zeroOffsets)
+        .SetVertexBuffers(1, 1, &modelBuffer, zeroOffsets)
+        .DrawArraysIndirect(indirectBuffer, 0)
+
+        .GetResult();
+}
+
+void init() {
+    nxtProcTable procs;
+    GetProcTableAndDevice(&procs, &device);
+    nxtSetProcs(&procs);
+
+    queue = device.CreateQueueBuilder().GetResult();
+
+    initBuffers();
+    initRender();
+    initCull();
+    initCommandBuffers();
+}
+
+void frame() {
+    queue.Submit(1, &commandBuffer);
+    SwapBuffers();
+}
+
+int main(int argc, const char* argv[]) {
+    if (!InitUtils(argc, argv)) {
+        return 1;
+    }
+    init();
+
+    while (!ShouldQuit()) {
+        frame();
+        usleep(16000);
+    }
+
+    // TODO release stuff
+}
@@ -4,6 +4,7 @@
 
 #include "Utils.h"
 
+#include <thread>
 #include <unistd.h>
 #include <vector>
 
@@ -19,6 +20,10 @@ nxt::Queue queue;
 nxt::Pipeline pipeline;
 nxt::BindGroup bindGroup;
 
+// Signaled with the number of the frame after each frame.
+nxt::Fence frameFence;
+uint64_t frameSerial = 0;
+
 void initBuffers() {
     static const uint32_t indexData[3] = {
         0, 1, 2,
@@ -149,18 +154,37 @@ void frame() {
         .GetResult();
 
     queue.Submit(1, &commands);
+    if (frameFence) {
+        queue.Signal(frameFence, ++frameSerial);
+    }
     SwapBuffers();
 }
 
+// Waits until the GPU finished the frame before the last one, so that the CPU is at most one
+// frame ahead.
+void waitForPreviousFrame() {
+    while (frameFence.GetCompletedValue() + 1 < frameSerial) {
+        device.Tick();
+        std::this_thread::yield();
+    }
+}
+
 int main(int argc, const char* argv[]) {
     if (!InitUtils(argc, argv)) {
         return 1;
     }
     init();
+    if (!UsesWire()) {
+        frameFence = device.CreateFenceBuilder().GetResult();
+    }
 
     while (!ShouldQuit()) {
         frame();
-        usleep(16000);
+        if (frameFence) {
+            waitForPreviousFrame();
+        } else {
+            usleep(16000);
+        }
     }
 
     // TODO release stuff
@@ -0,0 +1,116 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "Utils.h"
+
+#include "GLFW/glfw3.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+// Measures how submitting many large command buffers scales with the number of threads that
+// lower them in the OpenGL backend. New command buffers are recorded for each submit so that
+// they all have to be lowered, and the submit is timed with 1 to N threads. Run it with
+// "-c none" so that the submit is done by the backend instead of being serialized for the wire.
+
+nxt::Device device;
+nxt::Queue queue;
+nxt::Pipeline pipeline;
+
+static constexpr uint32_t kNumCommandBuffers = 48;
+static constexpr uint32_t kDrawsPerCommandBuffer = 2000;
+static constexpr int kSubmitsPerThreadCount = 20;
+
+void init() {
+    nxtProcTable procs;
+    GetProcTableAndDevice(&procs, &device);
+    nxtSetProcs(&procs);
+
+    queue = device.CreateQueueBuilder().GetResult();
+
+    nxt::ShaderModule vsModule = CreateShaderModule(device, nxt::ShaderStage::Vertex, R"(
+        #version 450
+        layout(push_constant) uniform ConstantsBlock {
+            float offsetX;
+            float offsetY;
+        } c;
+        const vec2 pos[3] = vec2[3](vec2(0.0f, 0.01f), vec2(-0.01f, -0.01f), vec2(0.01f, -0.01f));
+        void main() {
+            gl_Position = vec4(pos[gl_VertexIndex] + vec2(c.offsetX, c.offsetY), 0.0, 1.0);
+        })"
+    );
+
+    nxt::ShaderModule fsModule = CreateShaderModule(device, nxt::ShaderStage::Fragment, R"(
+        #version 450
+        out vec4 fragColor;
+        void main() {
+            fragColor = vec4(1.0, 1.0, 1.0, 1.0);
+        })"
+    );
+
+    pipeline = device.CreatePipelineBuilder()
+        .SetStage(nxt::ShaderStage::Vertex, vsModule, "main")
+        .SetStage(nxt::ShaderStage::Fragment, fsModule, "main")
+        .GetResult();
+}
+
+std::vector<nxt::CommandBuffer> recordCommandBuffers() {
+    std::vector<nxt::CommandBuffer> commands(kNumCommandBuffers);
+    for (uint32_t i = 0; i < kNumCommandBuffers; ++i) {
+        nxt::CommandBufferBuilder builder = device.CreateCommandBufferBuilder();
+        builder.SetCommandCountHint(2 * kDrawsPerCommandBuffer + 1);
+        builder.SetPipeline(pipeline);
+
+        for (uint32_t j = 0; j < kDrawsPerCommandBuffer; ++j) {
+            float offset[2] = {
+                (j % 100) / 50.0f - 1.0f,
+                (i * kDrawsPerCommandBuffer + j) / 100 % 100 / 50.0f - 1.0f,
+            };
+            builder.SetPushConstants(nxt::ShaderStageBit::Vertex, 0, 2, reinterpret_cast<uint32_t*>(offset))
+                   .DrawArrays(3, 1, 0, 0);
+        }
+
+        commands[i] = builder.GetResult();
+    }
+    return commands;
+}
+
+int main(int argc, const char* argv[]) {
+    if (!InitUtils(argc, argv)) {
+        return 1;
+    }
+    init();
+    glfwSwapInterval(0);
+
+    uint32_t maxThreads = std::max(std::thread::hardware_concurrency(), 1u);
+    double oneThreadTime = 0.0;
+
+    printf("%u command buffers of %u draws per submit\n", kNumCommandBuffers, kDrawsPerCommandBuffer);
+    for (uint32_t threads = 1; threads <= maxThreads; ++threads) {
+        // The GL thread lowers command buffers too.
+        SetLoweringThreads(threads - 1);
+
+        double bestTime = 0.0;
+        for (int i = 0; i < kSubmitsPerThreadCount; ++i) {
+            std::vector<nxt::CommandBuffer> commands = recordCommandBuffers();
+
+            auto start = std::chrono::steady_clock::now();
+            queue.Submit(kNumCommandBuffers, commands.data());
+            SwapBuffers();
+            std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+            if (i == 0 || time.count() < bestTime) {
+                bestTime = time.count();
+            }
+        }
+
+        if (threads == 1) {
+            oneThreadTime = bestTime;
+        }
+        printf("%2u threads: %.2f ms per submit, %.2fx\n", threads, bestTime * 1000.0, oneThreadTime / bestTime);
+    }
+}
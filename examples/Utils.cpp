@@ -8,8 +8,11 @@
 #include "GLFW/glfw3.h"
 
 #include "BackendBinding.h"
+#include "../src/wire/ChunkedCommandSerializer.h"
 #include "../src/wire/TerribleCommandBuffer.h"
+#include "../src/wire/ThreadedCommandSerializer.h"
 
+#include <cstdlib>
 #include <cstring>
 #include <iostream>
 #include <sstream>
@@ -23,9 +26,28 @@ namespace backend {
     namespace opengl {
         void Init(void* (*getProc)(const char*), nxtProcTable* procs, nxtDevice* device);
         void HACKCLEAR();
+        void SetAutoInstancing(nxtDevice device, bool enabled);
+        void SetStreamedPushConstants(nxtDevice device, bool enabled);
+        void SetLoweringThreads(nxtDevice device, uint32_t count);
+        void StartSubmitThread(nxtDevice device, void (*makeCurrent)(void*), void* userData);
+        void RunOnSubmitThread(nxtDevice device, void (*callback)(void*), void* userData);
+        void WaitForSubmitThreadIdle(nxtDevice device);
+    }
+
+    namespace null {
+        void Init(nxtProcTable* procs, nxtDevice* device);
+    }
+
+    namespace cpu {
+        void Init(nxtProcTable* procs, nxtDevice* device);
     }
 }
 
+static bool autoInstancing = false;
+static bool streamedPushConstants = false;
+static uint32_t loweringThreads = 0;
+static bool submitThread = false;
+
 class OpenGLBinding : public BackendBinding {
     public:
         void SetupGLFWWindowHints() override {
@@ -44,31 +66,87 @@ class OpenGLBinding : public BackendBinding {
         void GetProcAndDevice(nxtProcTable* procs, nxtDevice* device) override {
             glfwMakeContextCurrent(window);
             backend::opengl::Init(reinterpret_cast<void*(*)(const char*)>(glfwGetProcAddress), procs, device);
+            backend::opengl::SetAutoInstancing(*device, autoInstancing);
+            backend::opengl::SetStreamedPushConstants(*device, streamedPushConstants);
+            backend::opengl::SetLoweringThreads(*device, loweringThreads);
+
+            if (submitThread) {
+                // The context moves to the device's submission thread.
+                glfwMakeContextCurrent(nullptr);
+                backend::opengl::StartSubmitThread(*device, [](void* window) {
+                    glfwMakeContextCurrent(static_cast<GLFWwindow*>(window));
+                }, window);
+            }
+            this->device = *device;
         }
         void SwapBuffers() override {
+            if (submitThread) {
+                // Wait for the GL calls of this frame before presenting it, recording the next
+                // frame overlaps with the swap.
+                backend::opengl::WaitForSubmitThreadIdle(device);
+                backend::opengl::RunOnSubmitThread(device, [](void* window) {
+                    glfwSwapBuffers(static_cast<GLFWwindow*>(window));
+                    backend::opengl::HACKCLEAR();
+                }, window);
+                return;
+            }
+
             glfwSwapBuffers(window);
             backend::opengl::HACKCLEAR();
         }
+
+    private:
+        nxtDevice device = nullptr;
+};
+
+class NullBinding : public BackendBinding {
+    public:
+        void SetupGLFWWindowHints() override {
+            glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        }
+        void GetProcAndDevice(nxtProcTable* procs, nxtDevice* device) override {
+            backend::null::Init(procs, device);
+        }
+        void SwapBuffers() override {
+        }
+};
+
+class CPUBinding : public BackendBinding {
+    public:
+        void SetupGLFWWindowHints() override {
+            glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        }
+        void GetProcAndDevice(nxtProcTable* procs, nxtDevice* device) override {
+            backend::cpu::Init(procs, device);
+        }
+        void SwapBuffers() override {
+        }
 };
 
 enum class BackendType {
     OpenGL,
     Metal,
+    Null,
+    CPU,
 };
 
 enum class CmdBufType {
     None,
     Terrible,
+    Chunked,
+    Threaded,
 };
 
 static BackendType backendType = BackendType::OpenGL;
-static CmdBufType cmdBufType = CmdBufType::Terrible;
+static CmdBufType cmdBufType = CmdBufType::Chunked;
 static BackendBinding* binding = nullptr;
 
 static GLFWwindow* window = nullptr;
+static nxtDevice backendDevice = nullptr;
 
 static server::CommandHandler* wireServer = nullptr;
-static TerribleCommandBuffer* cmdBuf = nullptr;
+static client::CommandSerializer* cmdBuf = nullptr;
+static ThreadedCommandSerializer* threadedCmdBuf = nullptr;
 
 void HandleSynchronousError(const char* errorMessage, void* userData) {
     std::cerr << errorMessage << std::endl;
@@ -91,12 +169,24 @@ void GetProcTableAndDevice(nxtProcTable* procs, nxt::Device* device) {
                 fprintf(stderr, "Metal backend no present on this platform\n");
             #endif
             break;
+        case BackendType::Null:
+            binding = new NullBinding;
+            break;
+        case BackendType::CPU:
+            binding = new CPUBinding;
+            break;
     }
 
     if (!glfwInit()) {
         return;
     }
 
+    // The backend calls are made on the wire server thread so the GL context can't stay on this
+    // thread, all the GL calls go through the device's submission thread instead.
+    if (cmdBufType == CmdBufType::Threaded) {
+        submitThread = true;
+    }
+
     binding->SetupGLFWWindowHints();
     window = glfwCreateWindow(640, 480, "NXT window", nullptr, nullptr);
     if (!window) {
@@ -105,7 +195,6 @@ void GetProcTableAndDevice(nxtProcTable* procs, nxt::Device* device) {
 
     binding->SetWindow(window);
 
-    nxtDevice backendDevice;
     nxtProcTable backendProcs;
     binding->GetProcAndDevice(&backendProcs, &backendDevice);
 
@@ -116,13 +205,23 @@ void GetProcTableAndDevice(nxtProcTable* procs, nxt::Device* device) {
             break;
 
         case CmdBufType::Terrible:
+        case CmdBufType::Chunked:
+        case CmdBufType::Threaded:
             {
                 wireServer = server::CreateCommandHandler(backendDevice, backendProcs);
-                cmdBuf = new TerribleCommandBuffer(wireServer);
+                if (cmdBufType == CmdBufType::Terrible) {
+                    cmdBuf = new TerribleCommandBuffer(wireServer);
+                } else if (cmdBufType == CmdBufType::Chunked) {
+                    cmdBuf = new ChunkedCommandSerializer(wireServer);
+                } else {
+                    threadedCmdBuf = new ThreadedCommandSerializer(wireServer);
+                    cmdBuf = threadedCmdBuf;
+                }
 
                 nxtDevice clientDevice;
                 nxtProcTable clientProcs;
                 client::NewClientDevice(&clientProcs, &clientDevice, cmdBuf);
+                client::RegisterSynchronousErrorCallback(clientDevice, HandleSynchronousError, nullptr);
 
                 *procs = clientProcs;
                 *device = nxt::Device::Acquire(clientDevice);
@@ -203,7 +302,15 @@ extern "C" {
                     backendType = BackendType::Metal;
                     continue;
                 }
-                fprintf(stderr, "--backend expects a backend name (opengl, metal)\n");
+                if (i < argc && std::string("null") == argv[i]) {
+                    backendType = BackendType::Null;
+                    continue;
+                }
+                if (i < argc && std::string("cpu") == argv[i]) {
+                    backendType = BackendType::CPU;
+                    continue;
+                }
+                fprintf(stderr, "--backend expects a backend name (opengl, metal, null, cpu)\n");
                 return false;
             }
             if (std::string("-c") == argv[i] || std::string("--comand-buffer") == argv[i]) {
@@ -216,13 +323,46 @@ extern "C" {
                     cmdBufType = CmdBufType::Terrible;
                     continue;
                 }
-                fprintf(stderr, "--command-buffer expects a command buffer name (none, terrible)\n");
+                if (i < argc && std::string("chunked") == argv[i]) {
+                    cmdBufType = CmdBufType::Chunked;
+                    continue;
+                }
+                if (i < argc && std::string("threaded") == argv[i]) {
+                    cmdBufType = CmdBufType::Threaded;
+                    continue;
+                }
+                fprintf(stderr, "--command-buffer expects a command buffer name (none, terrible, chunked, threaded)\n");
+                return false;
+            }
+            if (std::string("--auto-instancing") == argv[i]) {
+                autoInstancing = true;
+                continue;
+            }
+            if (std::string("--streamed-push-constants") == argv[i]) {
+                streamedPushConstants = true;
+                continue;
+            }
+            if (std::string("--lowering-threads") == argv[i]) {
+                i++;
+                if (i < argc) {
+                    loweringThreads = static_cast<uint32_t>(atoi(argv[i]));
+                    continue;
+                }
+                fprintf(stderr, "--lowering-threads expects a number of threads\n");
                 return false;
             }
+            if (std::string("--submit-thread") == argv[i]) {
+                submitThread = true;
+                continue;
+            }
             if (std::string("-h") == argv[i] || std::string("--help") == argv[i]) {
-                printf("Usage: %s [-b BACKEND] [-c COMMAND_BUFFER]\n", argv[0]);
-                printf("  BACKEND is one of: opengl, metal\n");
-                printf("  COMMAND_BUFFER is one of: none, terrible\n");
+                printf("Usage: %s [-b BACKEND] [-c COMMAND_BUFFER] [--auto-instancing] [--streamed-push-constants] [--lowering-threads N] [--submit-thread]\n", argv[0]);
+                printf("  BACKEND is one of: opengl, metal, null, cpu\n");
+                printf("  COMMAND_BUFFER is one of: none, terrible, chunked, threaded\n");
+                printf("  --auto-instancing turns runs of push constant draws into instanced draws (opengl)\n");
+                printf("  --streamed-push-constants puts push constants in a streamed uniform buffer (opengl)\n");
+                printf("  --lowering-threads N lowers submitted command buffers on N more threads (opengl)\n");
+                printf("  --submit-thread makes the GL calls on a thread owned by the device (opengl)\n");
                 return false;
             }
         }
@@ -240,6 +380,16 @@ extern "C" {
     }
 
     void SwapBuffers() {
+        // Only the wire server thread calls the backend, so the frame is presented there after
+        // the commands of the frame.
+        if (threadedCmdBuf) {
+            threadedCmdBuf->RunOnServerThread([]() {
+                binding->SwapBuffers();
+            });
+            glfwPollEvents();
+            return;
+        }
+
         if (cmdBuf) {
             cmdBuf->Flush();
         }
@@ -247,10 +397,30 @@ extern "C" {
         binding->SwapBuffers();
     }
 
+    void SetLoweringThreads(uint32_t count) {
+        if (backendType != BackendType::OpenGL) {
+            return;
+        }
+
+        // Like the swap, the change goes through the wire server thread when it is the one
+        // using the backend device.
+        if (threadedCmdBuf) {
+            threadedCmdBuf->RunOnServerThread([count]() {
+                backend::opengl::SetLoweringThreads(backendDevice, count);
+            });
+            return;
+        }
+        backend::opengl::SetLoweringThreads(backendDevice, count);
+    }
+
     bool ShouldQuit() {
         return glfwWindowShouldClose(window);
     }
 
+    bool UsesWire() {
+        return cmdBufType != CmdBufType::None;
+    }
+
     GLFWwindow* GetWindow() {
         return window;
     }
@@ -10,6 +10,13 @@ extern "C" {
     bool InitUtils(int argc, const char** argv);
     void SwapBuffers();
     bool ShouldQuit();
+    // Fences can't be queried through the wire, examples pace their frames on fences only
+    // without it.
+    bool UsesWire();
+
+    // Threads that lower command buffers in addition to the submitting thread (opengl). The
+    // change applies to the submits made after the call.
+    void SetLoweringThreads(uint32_t count);
 
     struct GLFWwindow;
     struct GLFWwindow* GetWindow();
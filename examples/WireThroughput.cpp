@@ -0,0 +1,126 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "nxt/nxt.h"
+#include "nxt/nxtcpp.h"
+
+#include "../src/wire/ChunkedCommandSerializer.h"
+#include "../src/wire/TerribleCommandBuffer.h"
+#include "../src/wire/ThreadedCommandSerializer.h"
+#if defined(__linux__)
+    #include "../src/wire/SharedMemoryTransport.h"
+#endif
+
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+// Measures how many commands per second go through the wire with each command serializer.
+// Frames of push constants are recorded on a client device, serialized, then decoded by the
+// server and recorded by the null backend. Push constants are the most frequent command of
+// Animometer-style workloads and are valid without a pipeline, which the null backend can't
+// create without compiling shaders.
+
+namespace backend {
+    namespace null {
+        void Init(nxtProcTable* procs, nxtDevice* device);
+    }
+}
+
+static constexpr uint32_t kCommandsPerFrame = 40000;
+static constexpr int kFrames = 50;
+static constexpr int kRuns = 5;
+
+// Records the frames on a client device that sends its commands through serializer, and
+// returns the time it took. finish() is called before stopping the clock so that it includes
+// the commands the server hasn't handled yet.
+template<typename Finish>
+double RecordFrames(client::CommandSerializer* serializer, Finish finish) {
+    nxtProcTable procs;
+    nxtDevice clientDevice;
+    client::NewClientDevice(&procs, &clientDevice, serializer);
+    nxtSetProcs(&procs);
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        nxt::Device device = nxt::Device::Acquire(clientDevice);
+        nxt::Queue queue = device.CreateQueueBuilder().GetResult();
+
+        for (int frame = 0; frame < kFrames; ++frame) {
+            nxt::CommandBufferBuilder builder = device.CreateCommandBufferBuilder();
+            for (uint32_t i = 0; i < kCommandsPerFrame; ++i) {
+                uint32_t offset[2] = {i, static_cast<uint32_t>(frame)};
+                builder.SetPushConstants(nxt::ShaderStageBit::Vertex, 0, 2, offset);
+            }
+            nxt::CommandBuffer commands = builder.GetResult();
+            queue.Submit(1, &commands);
+            serializer->Flush();
+        }
+    }
+    finish();
+    std::chrono::duration<double> time = std::chrono::steady_clock::now() - start;
+
+    nxtSetProcs(nullptr);
+    return time.count();
+}
+
+template<typename Run>
+void Measure(const char* name, Run run) {
+    double bestTime = 0.0;
+    for (int i = 0; i < kRuns; ++i) {
+        nxtProcTable backendProcs;
+        nxtDevice backendDevice;
+        backend::null::Init(&backendProcs, &backendDevice);
+        std::unique_ptr<server::CommandHandler> wireServer(server::CreateCommandHandler(backendDevice, backendProcs));
+
+        double time = run(wireServer.get());
+        if (i == 0 || time < bestTime) {
+            bestTime = time;
+        }
+    }
+
+    double commands = double(kCommandsPerFrame) * kFrames;
+    printf("%-10s %6.1f ns per command, %5.1f M commands per second\n", name,
+           bestTime * 1e9 / commands, commands / bestTime * 1e-6);
+}
+
+int main() {
+    printf("%d frames of %u commands\n", kFrames, kCommandsPerFrame);
+
+    Measure("terrible", [](server::CommandHandler* wireServer) {
+        // The buffer of TerribleCommandBuffer is too big for the stack.
+        std::unique_ptr<TerribleCommandBuffer> serializer(new TerribleCommandBuffer(wireServer));
+        return RecordFrames(serializer.get(), []() {});
+    });
+
+    Measure("chunked", [](server::CommandHandler* wireServer) {
+        ChunkedCommandSerializer serializer(wireServer);
+        return RecordFrames(&serializer, []() {});
+    });
+
+    Measure("threaded", [](server::CommandHandler* wireServer) {
+        ThreadedCommandSerializer serializer(wireServer);
+        return RecordFrames(&serializer, [&serializer]() {
+            serializer.WaitForIdle();
+        });
+    });
+
+#if defined(__linux__)
+    // The server runs on a thread of this process, which is enough to measure the ring.
+    Measure("shm ring", [](server::CommandHandler* wireServer) {
+        std::unique_ptr<SharedMemoryRing> ring(SharedMemoryRing::Create(4 * 1024 * 1024));
+        SharedMemoryServer server(ring.get(), wireServer);
+        std::thread serverThread([&server]() {
+            server.Run();
+        });
+
+        SharedMemoryCommandSerializer serializer(ring.get());
+        return RecordFrames(&serializer, [&serializer, &serverThread]() {
+            serializer.Close();
+            serverThread.join();
+        });
+    });
+#endif
+}
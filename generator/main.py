@@ -70,7 +70,7 @@ class MethodArgument:
         self.annotation = annotation
         self.length = None
 
-Method = namedtuple('Method', ['name', 'return_type', 'arguments'])
+Method = namedtuple('Method', ['name', 'return_type', 'arguments', 'forwarded_by_wire'])
 class ObjectType(Type):
     def __init__(self, name, record):
         Type.__init__(self, name, record)
@@ -97,7 +97,11 @@ def link_object(obj, types):
                 else:
                     arg.length = arguments_by_name[a['length']]
 
-        return Method(Name(record['name']), types[record.get('returns', 'void')], arguments)
+        method = Method(Name(record['name']), types[record.get('returns', 'void')], arguments,
+                        record.get('forwarded by wire', True))
+        # The client can't give IDs to objects the server doesn't create.
+        assert(method.forwarded_by_wire or method.return_type.category != 'object')
+        return method
 
     obj.methods = [make_method(m) for m in obj.record.get('methods', [])]
 
@@ -287,15 +291,19 @@ def as_backendType(typ):
 
 def native_methods(types, typ):
     return [
-        Method(Name('reference'), types['void'], []),
-        Method(Name('release'), types['void'], []),
+        Method(Name('reference'), types['void'], [], True),
+        Method(Name('release'), types['void'], [], True),
     ] + typ.methods
 
+# The methods the wire serializes, the client procs of the others do nothing.
+def wire_methods(typ):
+    return [method for method in typ.methods if method.forwarded_by_wire]
+
 def debug(text):
     print(text)
 
 def main():
-    targets = ['nxt', 'nxtcpp', 'mock_nxt', 'opengl', 'metal', 'wire', 'blink']
+    targets = ['nxt', 'nxtcpp', 'mock_nxt', 'opengl', 'metal', 'null', 'cpu', 'wire', 'blink']
 
     parser = argparse.ArgumentParser(
         description = 'Generates code for various target for NXT.',
@@ -338,7 +346,8 @@ def main():
         'as_cppType': as_cppType,
         'as_varName': as_varName,
         'decorate': decorate,
-        'native_methods': lambda typ: native_methods(api_params['types'], typ)
+        'native_methods': lambda typ: native_methods(api_params['types'], typ),
+        'wire_methods': wire_methods
     }
 
     renders = []
@@ -376,6 +385,18 @@ def main():
         }
         renders.append(FileRender('BackendProcTable.cpp', 'metal/ProcTable.mm', base_backend_params + [metal_params]))
 
+    if 'null' in targets:
+        null_params = {
+            'namespace': 'null',
+        }
+        renders.append(FileRender('BackendProcTable.cpp', 'null/ProcTable.cpp', base_backend_params + [null_params]))
+
+    if 'cpu' in targets:
+        cpu_params = {
+            'namespace': 'cpu',
+        }
+        renders.append(FileRender('BackendProcTable.cpp', 'cpu/ProcTable.cpp', base_backend_params + [cpu_params]))
+
     if 'wire' in targets:
         renders.append(FileRender('wire.cpp', 'wire/autogen.cpp', base_backend_params))
 
@@ -38,6 +38,7 @@ namespace {{namespace}} {
 
         {% set methodsWithExtraValidation = (
             "CommandBufferBuilderGetResult",
+            "RenderBundleBuilderGetResult",
         ) %}
 
         {% for type in by_category["object"] %}
@@ -79,7 +80,7 @@ namespace {{namespace}} {
                         , {{as_annotated_backendType(arg)}}
                     {%- endfor -%}
                 ) {
-                    {% if type.is_builder and method.name.canonical_case() not in ("release", "reference") %}
+                    {% if type.is_builder and method.name.canonical_case() not in ("release", "reference", "reset") %}
                         if (self->WasConsumed()) return false;
                     {% else %}
                         (void) self;
@@ -23,6 +23,12 @@
 
 {% endfor %}
 
+// Callbacks are called on the thread of nxtDeviceTick, userdata is big enough for a pointer.
+// The wire doesn't forward nxtFenceOnCompletion or nxtFenceGetCompletedValue, through the wire
+// they report an error to the client device's error callback instead.
+typedef uint64_t nxtCallbackUserdata;
+typedef void (*nxtFenceOnCompletionCallback)(nxtCallbackUserdata userdata);
+
 #ifdef __cplusplus
 extern "C" {
 #endif
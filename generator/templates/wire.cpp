@@ -4,6 +4,7 @@
 
 #include "Wire.h"
 
+#include <algorithm>
 #include <cstring>
 #include <vector>
 
@@ -13,7 +14,7 @@ namespace wire {
     //* Enum used to know which command is which.
     enum class WireCmd : uint32_t {
         {% for type in by_category["object"] %}
-            {% for method in type.methods %}
+            {% for method in wire_methods(type) %}
                 {{as_MethodSuffix(type.name, method.name)}},
             {% endfor %}
             {{as_MethodSuffix(type.name, Name("destroy"))}},
@@ -21,7 +22,7 @@ namespace wire {
     };
 
     {% for type in by_category["object"] %}
-        {% for method in type.methods %}
+        {% for method in wire_methods(type) %}
             {% set Suffix = as_MethodSuffix(type.name, method.name) %}
 
             //* Structure for the wire format of each of the commands
@@ -150,12 +151,35 @@ namespace client {
 
             uint32_t id = 0;
 
+            //* Commands the serializer can't take, for example when the server died, are
+            //* written in scratch memory and dropped.
             void* GetCmdSpace(size_t size) {
-                return serializer->GetCmdSpace(size);
+                void* space = serializer->GetCmdSpace(size);
+                if (space != nullptr) {
+                    return space;
+                }
+
+                if (!serializerFailed) {
+                    serializerFailed = true;
+                    HandleError("The command serializer failed, commands are dropped");
+                }
+                scratch.resize(std::max(scratch.size(), size));
+                return scratch.data();
+            }
+
+            void HandleError(const char* message) {
+                if (errorCallback) {
+                    errorCallback(message, errorUserData);
+                }
             }
 
+            ErrorCallback errorCallback = nullptr;
+            void* errorUserData = nullptr;
+
         private:
            CommandSerializer* serializer = nullptr;
+           bool serializerFailed = false;
+           std::vector<uint8_t> scratch;
 
         {% for type in by_category["object"] if not type.name.canonical_case() == "device" %}
             {% set Type = type.name.CamelCase() %}
@@ -181,7 +205,7 @@ namespace client {
     {% for type in by_category["object"] %}
         {% set Type = type.name.CamelCase() %}
 
-        {% for method in type.methods %}
+        {% for method in wire_methods(type) %}
             {% set Suffix = as_MethodSuffix(type.name, method.name) %}
 
             {{as_backendType(method.return_type)}} Client{{Suffix}}(
@@ -236,6 +260,21 @@ namespace client {
             }
         {% endfor %}
 
+        //* The methods that aren't forwarded report an error and return a default value.
+        {% for method in type.methods if not method.forwarded_by_wire %}
+            {{as_backendType(method.return_type)}} Client{{as_MethodSuffix(type.name, method.name)}}(
+                {{-as_backendType(type)}} self
+                {%- for arg in method.arguments -%}
+                    , {{as_annotated_backendType(arg)}}
+                {%- endfor -%}
+            ) {
+                self->device->HandleError("{{as_cMethod(type.name, method.name)}} isn't forwarded by the wire");
+                {% if method.return_type.name.canonical_case() != "void" %}
+                    return {};
+                {% endif %}
+            }
+        {% endfor %}
+
         {% if not type.name.canonical_case() == "device" %}
             //* When an object's refcount reaches 0, notify the server side of it.
             void Client{{as_MethodSuffix(type.name, Name("release"))}}({{Type}}* obj) {
@@ -276,6 +315,12 @@ namespace client {
         *device = reinterpret_cast<nxtDeviceImpl*>(new Device(serializer));
         *procs = GetProcs();
     }
+
+    void RegisterSynchronousErrorCallback(nxtDevice device, ErrorCallback callback, void* userData) {
+        auto clientDevice = reinterpret_cast<Device*>(device);
+        clientDevice->errorCallback = callback;
+        clientDevice->errorUserData = userData;
+    }
 }
 
 namespace server {
@@ -313,7 +358,7 @@ namespace server {
                     bool success = false;
                     switch (cmdId) {
                         {% for type in by_category["object"] %}
-                            {% for method in type.methods %}
+                            {% for method in wire_methods(type) %}
                                 {% set Suffix = as_MethodSuffix(type.name, method.name) %}
                                 case wire::WireCmd::{{Suffix}}:
                                     success = Handle{{Suffix}}(&commands, &size);
@@ -346,7 +391,7 @@ namespace server {
             bool gotError = false;
 
             {% for type in by_category["object"] %}
-                {% for method in type.methods %}
+                {% for method in wire_methods(type) %}
                     {% set Suffix = as_MethodSuffix(type.name, method.name) %}
                     bool Handle{{Suffix}}(const uint8_t** commands, size_t* size) {
                         //* Get command ptr, and check it fits in the buffer.
@@ -373,7 +418,13 @@ namespace server {
                             if (selfData == nullptr) {
                                 return false;
                             }
-                            valid = valid && selfData->valid;
+                            {% if type.is_builder and method.name.canonical_case() == "reset" %}
+                                //* Reset is how a builder recovers from an error, so it is called even
+                                //* on builders that were marked invalid.
+                                valid = valid && selfData->ptr != nullptr;
+                            {% else %}
+                                valid = valid && selfData->valid;
+                            {% endif %}
                             self = selfData->ptr;
                         }
 
@@ -447,6 +498,9 @@ namespace server {
                                 resultData->ptr = result;
                                 resultData->valid = result != nullptr;
                             {% endif %}
+                            {% if type.is_builder and method.name.canonical_case() == "reset" %}
+                                selfData->valid = true;
+                            {% endif %}
                             if (gotError) {
                                 {% if type.is_builder %}
                                     selfData->valid = false;
@@ -0,0 +1,64 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "BarrierTracker.h"
+
+namespace backend {
+
+    namespace {
+        constexpr nxt::BufferUsageBit kNoUsage = static_cast<nxt::BufferUsageBit>(0);
+    }
+
+    BarrierTracker::BarrierTracker()
+        : pendingUsages(kNoUsage), requiredBarrier(kNoUsage) {
+    }
+
+    bool BarrierTracker::HasPendingWrites(nxt::BufferUsageBit usages) const {
+        return pendingUsages & usages;
+    }
+
+    void BarrierTracker::Read(BufferBase* buffer, nxt::BufferUsageBit usage) {
+        if (!(pendingUsages & usage)) {
+            return;
+        }
+
+        auto it = unsynchronizedUsages.find(buffer);
+        if (it != unsynchronizedUsages.end() && (it->second & usage)) {
+            requiredBarrier |= usage;
+        }
+    }
+
+    void BarrierTracker::WriteStorage(BufferBase* buffer, nxt::BufferUsageBit usages) {
+        unsynchronizedUsages[buffer] = usages;
+        pendingUsages |= usages;
+    }
+
+    nxt::BufferUsageBit BarrierTracker::AcquireBarrier() {
+        nxt::BufferUsageBit barrier = requiredBarrier;
+        if (barrier == kNoUsage) {
+            return kNoUsage;
+        }
+
+        // The barrier isn't per buffer: it synchronizes all the writes for these usages.
+        pendingUsages = kNoUsage;
+        for (auto it = unsynchronizedUsages.begin(); it != unsynchronizedUsages.end();) {
+            it->second &= ~barrier;
+            if (it->second == kNoUsage) {
+                it = unsynchronizedUsages.erase(it);
+            } else {
+                pendingUsages |= it->second;
+                ++it;
+            }
+        }
+
+        requiredBarrier = kNoUsage;
+        return barrier;
+    }
+
+    void BarrierTracker::Forget(BufferBase* buffer) {
+        // pendingUsages is only a filter, it is recomputed at the next barrier.
+        unsynchronizedUsages.erase(buffer);
+    }
+
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_COMMON_BARRIERTRACKER_H_
+#define BACKEND_COMMON_BARRIERTRACKER_H_
+
+#include "nxt/nxtcpp.h"
+
+#include <unordered_map>
+
+namespace backend {
+
+    class BufferBase;
+
+    // Shader writes to storage buffers aren't coherent in some APIs (OpenGL): a barrier is needed
+    // before the data can be read another way, or as storage by another command. The tracker
+    // remembers the buffers written as storage that no barrier has synchronized yet, and the
+    // usages they can still be read with, so that barriers are only issued for real hazards.
+    // Before each command, Read is called for the buffers it reads, AcquireBarrier returns the
+    // usages that need a barrier, then WriteStorage is called for the buffers it can write.
+    // The buffers are only used as keys.
+    class BarrierTracker {
+        public:
+            BarrierTracker();
+
+            // Whether some buffer written as storage needs a barrier to be read with one of
+            // these usages. Lets backends skip calling Read in the common case.
+            bool HasPendingWrites(nxt::BufferUsageBit usages) const;
+
+            void Read(BufferBase* buffer, nxt::BufferUsageBit usage);
+            // The usages are the ways the buffer can be read later, its usage bits.
+            void WriteStorage(BufferBase* buffer, nxt::BufferUsageBit usages);
+
+            // Returns the usages that need a barrier before the command, or no bits. The writes
+            // are then considered visible to these usages.
+            nxt::BufferUsageBit AcquireBarrier();
+
+            // Called when a buffer is destroyed.
+            void Forget(BufferBase* buffer);
+
+        private:
+            // The usages that still need a barrier after the last storage write of each buffer.
+            std::unordered_map<BufferBase*, nxt::BufferUsageBit> unsynchronizedUsages;
+            // The union of the usages above.
+            nxt::BufferUsageBit pendingUsages;
+            nxt::BufferUsageBit requiredBarrier;
+    };
+
+}
+
+#endif // BACKEND_COMMON_BARRIERTRACKER_H_
@@ -9,12 +9,20 @@
 #include <cassert>
 #include <climits>
 #include <cstdlib>
+#include <cstring>
 #define ASSERT assert
 
 namespace backend {
 
     constexpr uint32_t EndOfBlock = UINT_MAX;//std::numeric_limits<uint32_t>::max();
-    constexpr uint32_t AdditionalData = UINT_MAX - 1;//std::numeric_limits<uint32_t>::max();
+    // Fills the gaps between the blocks that were packed together by CommandAllocator::Compact.
+    // It is next to EndOfBlock so that NextCommandId checks for both with a single comparison.
+    constexpr uint32_t Padding = UINT_MAX - 1;
+    constexpr uint32_t AdditionalData = UINT_MAX - 2;
+
+    // Blocks come from malloc so commands have the same address modulo this alignment in any
+    // block, which is what lets Compact copy them without looking at them.
+    constexpr size_t kMaxCommandAlignment = alignof(std::max_align_t);
 
     // TODO(cwallez@chromium.org): figure out a way to have more type safety for the iterator
 
@@ -25,16 +33,11 @@ namespace backend {
 
     CommandIterator::~CommandIterator() {
         ASSERT(dataWasDestroyed);
-
-        if (!IsEmpty()) {
-            for (auto& block : blocks) {
-                free(block.block);
-            }
-        }
+        FreeBlocks();
     }
 
     CommandIterator::CommandIterator(CommandIterator&& other)
-        : endOfBlock(EndOfBlock) {
+        : pool(other.pool), endOfBlock(EndOfBlock) {
         if (!other.IsEmpty()) {
             blocks = std::move(other.blocks);
             other.Reset();
@@ -44,28 +47,47 @@ namespace backend {
     }
 
     CommandIterator& CommandIterator::operator=(CommandIterator&& other) {
+        FreeBlocks();
         if (!other.IsEmpty()) {
             blocks = std::move(other.blocks);
             other.Reset();
         } else {
             blocks.clear();
         }
+        pool = other.pool;
         other.DataWasDestroyed();
         Reset();
         return *this;
     }
 
     CommandIterator::CommandIterator(CommandAllocator&& allocator)
-        : blocks(allocator.AcquireBlocks()), endOfBlock(EndOfBlock) {
+        : blocks(allocator.AcquireBlocks()), pool(allocator.pool), endOfBlock(EndOfBlock) {
         Reset();
     }
 
     CommandIterator& CommandIterator::operator=(CommandAllocator&& allocator) {
+        FreeBlocks();
         blocks = allocator.AcquireBlocks();
+        pool = allocator.pool;
         Reset();
         return *this;
     }
 
+    void CommandIterator::FreeBlocks() {
+        if (blocks.empty() || IsEmpty()) {
+            return;
+        }
+
+        for (auto& block : blocks) {
+            if (pool != nullptr) {
+                pool->ReleaseBlock(block);
+            } else {
+                free(block.block);
+            }
+        }
+        blocks.clear();
+    }
+
     void CommandIterator::Reset() {
         currentBlock = 0;
 
@@ -86,6 +108,13 @@ namespace backend {
         dataWasDestroyed = true;
     }
 
+    size_t CommandIterator::GetBlockCount() const {
+        if (blocks.empty() || IsEmpty()) {
+            return 0;
+        }
+        return blocks.size();
+    }
+
     bool CommandIterator::IsEmpty() const {
         return blocks[0].block == reinterpret_cast<const uint8_t*>(&endOfBlock);
     }
@@ -96,14 +125,20 @@ namespace backend {
 
         uint32_t id = *reinterpret_cast<uint32_t*>(idPtr);
 
-        if (id == EndOfBlock) {
-            currentBlock++;
-            if (currentBlock >= blocks.size()) {
-                Reset();
-                return false;
+        // Skip over the padding and move to the next block until a command is found.
+        while (id >= Padding) {
+            if (id == Padding) {
+                idPtr += sizeof(uint32_t);
+            } else {
+                currentBlock++;
+                if (currentBlock >= blocks.size()) {
+                    Reset();
+                    return false;
+                }
+                idPtr = Align(blocks[currentBlock].block, alignof(uint32_t));
             }
-            currentPtr = Align(blocks[currentBlock].block, alignof(uint32_t));
-            return NextCommandId(commandId);
+            ASSERT(idPtr + sizeof(uint32_t) <= blocks[currentBlock].block + blocks[currentBlock].size);
+            id = *reinterpret_cast<uint32_t*>(idPtr);
         }
 
         currentPtr = idPtr + sizeof(uint32_t);
@@ -131,11 +166,12 @@ namespace backend {
     // Potential TODO(cwallez@chromium.org):
     //  - Host the size and pointer to next block in the block itself to avoid having an allocation in the vector
     //  - Assume T's alignof is, say 64bits, static assert it, and make commandAlignment a constant in Allocate
-    //  - Be able to optimize allocation to one block, for command buffers expected to live long to avoid cache misses
-    //  - Better block allocation, maybe have NXT API to say command buffer is going to have size close to another
 
-    CommandAllocator::CommandAllocator()
-        : currentPtr(reinterpret_cast<uint8_t*>(&dummyEnum[0])), endPtr(reinterpret_cast<uint8_t*>(&dummyEnum[1])) {
+    constexpr size_t CommandAllocator::kInitialBlockSize;
+    constexpr size_t CommandAllocator::kMaxBlockSize;
+
+    CommandAllocator::CommandAllocator(CommandBlockPool* pool)
+        : pool(pool), currentPtr(reinterpret_cast<uint8_t*>(&dummyEnum[0])), endPtr(reinterpret_cast<uint8_t*>(&dummyEnum[1])) {
     }
 
     CommandAllocator::~CommandAllocator() {
@@ -148,11 +184,98 @@ namespace backend {
         ASSERT(currentPtr + sizeof(uint32_t) <= endPtr);
         *reinterpret_cast<uint32_t*>(currentPtr) = EndOfBlock;
 
+        usedSizeInPreviousBlocks = GetUsedSize();
+        blockUsedSizes.clear();
         currentPtr = nullptr;
         endPtr = nullptr;
         return std::move(blocks);
     }
 
+    void CommandAllocator::Reset() {
+        size_t usedSize = GetUsedSize();
+
+        if (currentPtr != nullptr) {
+            for (auto& block : blocks) {
+                if (pool != nullptr) {
+                    pool->ReleaseBlock(block);
+                } else {
+                    free(block.block);
+                }
+            }
+        }
+        blocks.clear();
+        blockUsedSizes.clear();
+
+        lastAllocationSize = kInitialBlockSize;
+        usedSizeInPreviousBlocks = 0;
+        expectedSize = usedSize;
+        currentPtr = reinterpret_cast<uint8_t*>(&dummyEnum[0]);
+        endPtr = reinterpret_cast<uint8_t*>(&dummyEnum[1]);
+    }
+
+    void CommandAllocator::SetSizeHint(size_t size) {
+        expectedSize = size;
+    }
+
+    void CommandAllocator::Compact() {
+        ASSERT(currentPtr != nullptr);
+        if (blocks.size() <= 1) {
+            return;
+        }
+
+        // Each block is copied at an offset aligned to kMaxCommandAlignment, which can leave a
+        // gap of a few ids after the previous one.
+        size_t usedSize = GetUsedSize();
+        size_t packedSize = usedSize + blocks.size() * kMaxCommandAlignment + sizeof(uint32_t);
+
+        BlockDef packed;
+        if (pool != nullptr) {
+            packed = pool->AllocateBlock(packedSize);
+        } else {
+            packed.size = packedSize;
+            packed.block = reinterpret_cast<uint8_t*>(malloc(packedSize));
+        }
+        // Compaction is only an optimization, keep the blocks if we can't get memory.
+        if (packed.block == nullptr) {
+            return;
+        }
+        ASSERT(IsAligned(packed.block, kMaxCommandAlignment));
+
+        blockUsedSizes.push_back(currentPtr - blocks.back().block);
+
+        uint8_t* packedPtr = packed.block;
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            uint8_t* alignedPtr = Align(packedPtr, kMaxCommandAlignment);
+            for (; packedPtr < alignedPtr; packedPtr += sizeof(uint32_t)) {
+                *reinterpret_cast<uint32_t*>(packedPtr) = Padding;
+            }
+
+            memcpy(packedPtr, blocks[i].block, blockUsedSizes[i]);
+            packedPtr += blockUsedSizes[i];
+
+            if (pool != nullptr) {
+                pool->ReleaseBlock(blocks[i]);
+            } else {
+                free(blocks[i].block);
+            }
+        }
+
+        blocks.clear();
+        blocks.push_back(packed);
+        blockUsedSizes.clear();
+        usedSizeInPreviousBlocks = 0;
+        currentPtr = packedPtr;
+        endPtr = packed.block + packed.size;
+        ASSERT(currentPtr + sizeof(uint32_t) <= endPtr);
+    }
+
+    size_t CommandAllocator::GetUsedSize() const {
+        if (currentPtr == nullptr || blocks.empty()) {
+            return usedSizeInPreviousBlocks;
+        }
+        return usedSizeInPreviousBlocks + (currentPtr - blocks.back().block);
+    }
+
     uint8_t* CommandAllocator::Allocate(uint32_t commandId, size_t commandSize, size_t commandAlignment) {
         ASSERT(currentPtr != nullptr);
         ASSERT(endPtr != nullptr);
@@ -192,18 +315,122 @@ namespace backend {
     }
 
     bool CommandAllocator::GetNewBlock(size_t minimumSize) {
-        // Allocate blocks doubling sizes each time, to a maximum of 16k (or at least minimumSize).
-        lastAllocationSize = std::max(minimumSize, std::min(lastAllocationSize * 2, size_t(16384)));
+        if (!blocks.empty()) {
+            blockUsedSizes.push_back(currentPtr - blocks.back().block);
+            usedSizeInPreviousBlocks += blockUsedSizes.back();
+        }
 
-        uint8_t* block = reinterpret_cast<uint8_t*>(malloc(lastAllocationSize));
-        if (block == nullptr) {
+        // Allocate blocks doubling sizes each time, to a maximum of kMaxBlockSize, unless the
+        // expected size of the recording tells us how much memory the rest of it needs. In both
+        // cases the block is at least minimumSize.
+        lastAllocationSize = std::min(lastAllocationSize * 2, kMaxBlockSize);
+        if (expectedSize > usedSizeInPreviousBlocks) {
+            // Leave room for the EndOfBlock and the alignment of the first id.
+            size_t remainingSize = expectedSize - usedSizeInPreviousBlocks + sizeof(uint32_t) + alignof(uint32_t);
+            lastAllocationSize = std::max(lastAllocationSize, remainingSize);
+        }
+        lastAllocationSize = std::max(minimumSize, lastAllocationSize);
+
+        BlockDef block;
+        if (pool != nullptr) {
+            block = pool->AllocateBlock(lastAllocationSize);
+        } else {
+            block.size = lastAllocationSize;
+            block.block = reinterpret_cast<uint8_t*>(malloc(lastAllocationSize));
+        }
+        if (block.block == nullptr) {
             return false;
         }
 
-        blocks.push_back({lastAllocationSize, block});
-        currentPtr = Align(block, alignof(uint32_t));
-        endPtr = block + lastAllocationSize;
+        blocks.push_back(block);
+        currentPtr = Align(block.block, alignof(uint32_t));
+        endPtr = block.block + block.size;
         return true;
     }
 
+    // CommandBlockPool
+
+    CommandBlockPool::CommandBlockPool(size_t highWaterMark)
+        : highWaterMark(highWaterMark) {
+    }
+
+    CommandBlockPool::~CommandBlockPool() {
+        Trim(0);
+        ASSERT(bytesRetained == 0);
+    }
+
+    BlockDef CommandBlockPool::AllocateBlock(size_t minimumSize) {
+        size_t bucket = 0;
+        size_t size = kMinBlockSize;
+        while (size < minimumSize && bucket < kNumBuckets) {
+            size <<= 1;
+            bucket ++;
+        }
+
+        if (bucket == kNumBuckets) {
+            misses ++;
+            return {minimumSize, reinterpret_cast<uint8_t*>(malloc(minimumSize))};
+        }
+
+        auto& freeBlocks = buckets[bucket];
+        if (!freeBlocks.empty()) {
+            uint8_t* block = freeBlocks.back();
+            freeBlocks.pop_back();
+            bytesRetained -= size;
+            hits ++;
+            return {size, block};
+        }
+
+        misses ++;
+        return {size, reinterpret_cast<uint8_t*>(malloc(size))};
+    }
+
+    void CommandBlockPool::ReleaseBlock(BlockDef block) {
+        size_t bucket = 0;
+        size_t size = kMinBlockSize;
+        while (size < block.size && bucket < kNumBuckets) {
+            size <<= 1;
+            bucket ++;
+        }
+
+        // Only blocks that were allocated by the pool are kept, up to the high-water mark.
+        if (bucket == kNumBuckets || size != block.size || bytesRetained + size > highWaterMark) {
+            free(block.block);
+            return;
+        }
+
+        buckets[bucket].push_back(block.block);
+        bytesRetained += size;
+    }
+
+    void CommandBlockPool::SetHighWaterMark(size_t highWaterMark) {
+        this->highWaterMark = highWaterMark;
+        Trim(highWaterMark);
+    }
+
+    void CommandBlockPool::Trim(size_t targetSize) {
+        for (size_t bucket = kNumBuckets; bucket > 0 && bytesRetained > targetSize; --bucket) {
+            auto& freeBlocks = buckets[bucket - 1];
+            size_t size = kMinBlockSize << (bucket - 1);
+
+            while (!freeBlocks.empty() && bytesRetained > targetSize) {
+                free(freeBlocks.back());
+                freeBlocks.pop_back();
+                bytesRetained -= size;
+            }
+        }
+    }
+
+    uint64_t CommandBlockPool::GetHits() const {
+        return hits;
+    }
+
+    uint64_t CommandBlockPool::GetMisses() const {
+        return misses;
+    }
+
+    size_t CommandBlockPool::GetBytesRetained() const {
+        return bytesRetained;
+    }
+
 }
@@ -5,6 +5,7 @@
 #ifndef BACKEND_COMMON_COMMAND_ALLOCATOR_H_
 #define BACKEND_COMMON_COMMAND_ALLOCATOR_H_
 
+#include <array>
 #include <cstdint>
 #include <cstddef>
 #include <vector>
@@ -49,6 +50,44 @@ namespace backend {
 
     class CommandAllocator;
 
+    // Recording and freeing command buffers every frame would otherwise do a malloc/free pair for
+    // every block. The pool keeps the blocks of destroyed CommandIterators, bucketed by their
+    // power-of-two size, and hands them back to CommandAllocators so that steady-state recording
+    // doesn't hit the heap. A device owns one pool shared by all its command buffers.
+    class CommandBlockPool {
+        public:
+            static constexpr size_t kDefaultHighWaterMark = 8 * 1024 * 1024;
+
+            CommandBlockPool(size_t highWaterMark = kDefaultHighWaterMark);
+            ~CommandBlockPool();
+
+            // Returns a block of at least minimumSize bytes, or a block with a nullptr pointer
+            // if the allocation failed.
+            BlockDef AllocateBlock(size_t minimumSize);
+            void ReleaseBlock(BlockDef block);
+
+            // The pool never retains more than highWaterMark bytes, extra blocks are freed when
+            // they are released. Setting a lower high-water mark trims the pool to it.
+            void SetHighWaterMark(size_t highWaterMark);
+            // Frees retained blocks, largest first, until at most targetSize bytes are retained.
+            void Trim(size_t targetSize);
+
+            uint64_t GetHits() const;
+            uint64_t GetMisses() const;
+            size_t GetBytesRetained() const;
+
+        private:
+            // Blocks are kMinBlockSize << bucket bytes, larger allocations aren't pooled.
+            static constexpr size_t kMinBlockSize = 2048;
+            static constexpr size_t kNumBuckets = 16;
+
+            std::array<std::vector<uint8_t*>, kNumBuckets> buckets;
+            size_t highWaterMark;
+            size_t bytesRetained = 0;
+            uint64_t hits = 0;
+            uint64_t misses = 0;
+    };
+
     // TODO(cwallez@chromium.org): prevent copy for both iterator and allocator
     class CommandIterator {
         public:
@@ -77,6 +116,9 @@ namespace backend {
             // Needs to be called if iteration was stopped early.
             void Reset();
 
+            // The number of blocks the commands are in, 0 when there are no commands.
+            size_t GetBlockCount() const;
+
             void DataWasDestroyed();
 
         private:
@@ -86,7 +128,10 @@ namespace backend {
             void* NextCommand(size_t commandSize, size_t commandAlignment);
             void* NextData(size_t dataSize, size_t dataAlignment);
 
+            void FreeBlocks();
+
             CommandBlocks blocks;
+            CommandBlockPool* pool = nullptr;
             uint8_t* currentPtr = nullptr;
             size_t currentBlock = 0;
             // Used to avoid a special case for empty iterators.
@@ -96,7 +141,7 @@ namespace backend {
 
     class CommandAllocator {
         public:
-            CommandAllocator();
+            CommandAllocator(CommandBlockPool* pool = nullptr);
             ~CommandAllocator();
 
             template<typename T, typename E>
@@ -111,7 +156,28 @@ namespace backend {
                 return reinterpret_cast<T*>(AllocateData(sizeof(T) * count, alignof(T)));
             }
 
+            // Makes the allocator usable again after its blocks were acquired by a CommandIterator,
+            // or releases the blocks it still owns. The size of the previous recording is kept so
+            // that the first block of the next one is big enough to contain all of it.
+            void Reset();
+
+            // Hints that the recording will use about size bytes in total, the next block is sized
+            // so that it contains the rest of the recording.
+            void SetSizeHint(size_t size);
+
+            // Packs the commands allocated so far in a single contiguous block so that iterating
+            // over them doesn't hop between blocks. Allocation can continue after compaction.
+            void Compact();
+
+            // The number of bytes used by the commands allocated so far, including padding.
+            size_t GetUsedSize() const;
+
         private:
+            // Blocks double in size each time, so that a recording of N bytes uses O(log(N)) blocks,
+            // until they reach kMaxBlockSize.
+            static constexpr size_t kInitialBlockSize = 2048;
+            static constexpr size_t kMaxBlockSize = 1024 * 1024;
+
             friend CommandIterator;
             CommandBlocks&& AcquireBlocks();
 
@@ -120,7 +186,12 @@ namespace backend {
             bool GetNewBlock(size_t minimumSize);
 
             CommandBlocks blocks;
-            size_t lastAllocationSize = 2048;
+            // The number of bytes used in each block but the last one.
+            std::vector<size_t> blockUsedSizes;
+            CommandBlockPool* pool = nullptr;
+            size_t lastAllocationSize = kInitialBlockSize;
+            size_t usedSizeInPreviousBlocks = 0;
+            size_t expectedSize = 0;
 
             // Pointers to the current range of allocation in the block. Guaranteed to allow
             // for at least one uint32_t is not nullptr, so that the special EndOfBlock command id
@@ -8,91 +8,27 @@
 #include "Buffer.h"
 #include "Commands.h"
 #include "Device.h"
-#include "InputState.h"
 #include "Pipeline.h"
-#include "PipelineLayout.h"
+#include "RenderBundle.h"
 #include "Texture.h"
 
 #include <cstring>
 
 namespace backend {
 
-    void FreeCommands(CommandIterator* commands) {
-        Command type;
-        while(commands->NextCommandId(&type)) {
-            switch (type) {
-                case Command::CopyBufferToTexture:
-                    {
-                        CopyBufferToTextureCmd* copy = commands->NextCommand<CopyBufferToTextureCmd>();
-                        copy->~CopyBufferToTextureCmd();
-                    }
-                    break;
-                case Command::Dispatch:
-                    {
-                        DispatchCmd* dispatch = commands->NextCommand<DispatchCmd>();
-                        dispatch->~DispatchCmd();
-                    }
-                    break;
-                case Command::DrawArrays:
-                    {
-                        DrawArraysCmd* draw = commands->NextCommand<DrawArraysCmd>();
-                        draw->~DrawArraysCmd();
-                    }
-                    break;
-                case Command::DrawElements:
-                    {
-                        DrawElementsCmd* draw = commands->NextCommand<DrawElementsCmd>();
-                        draw->~DrawElementsCmd();
-                    }
-                    break;
-                case Command::SetPipeline:
-                    {
-                        SetPipelineCmd* cmd = commands->NextCommand<SetPipelineCmd>();
-                        cmd->~SetPipelineCmd();
-                    }
-                    break;
-                case Command::SetPushConstants:
-                    {
-                        SetPushConstantsCmd* cmd = commands->NextCommand<SetPushConstantsCmd>();
-                        commands->NextData<uint32_t>(cmd->count);
-                        cmd->~SetPushConstantsCmd();
-                    }
-                    break;
-                case Command::SetBindGroup:
-                    {
-                        SetBindGroupCmd* cmd = commands->NextCommand<SetBindGroupCmd>();
-                        cmd->~SetBindGroupCmd();
-                    }
-                    break;
-                case Command::SetIndexBuffer:
-                    {
-                        SetIndexBufferCmd* cmd = commands->NextCommand<SetIndexBufferCmd>();
-                        cmd->~SetIndexBufferCmd();
-                    }
-                    break;
-                case Command::SetVertexBuffers:
-                    {
-                        SetVertexBuffersCmd* cmd = commands->NextCommand<SetVertexBuffersCmd>();
-                        auto buffers = commands->NextData<Ref<BufferBase>>(cmd->count);
-                        for (size_t i = 0; i < cmd->count; ++i) {
-                            (&buffers[i])->~Ref<BufferBase>();
-                        }
-                        commands->NextData<uint32_t>(cmd->count);
-                        cmd->~SetVertexBuffersCmd();
-                    }
-                    break;
-            }
-        }
+    void FreeCommands(CommandIterator* commands, CommandReferences* references) {
         commands->DataWasDestroyed();
+        references->ReleaseAll();
     }
 
-    CommandBufferBuilder::CommandBufferBuilder(DeviceBase* device) : device(device) {
+    CommandBufferBuilder::CommandBufferBuilder(DeviceBase* device)
+        : device(device), allocator(device->GetCommandBlockPool()), state(device) {
     }
 
     CommandBufferBuilder::~CommandBufferBuilder() {
         if (!consumed) {
             MoveToIterator();
-            FreeCommands(&iterator);
+            FreeCommands(&iterator, &references);
         }
     }
 
@@ -100,249 +36,72 @@ namespace backend {
         return consumed;
     }
 
-    enum ValidationAspect {
-        VALIDATION_ASPECT_RENDER_PIPELINE,
-        VALIDATION_ASPECT_COMPUTE_PIPELINE,
-        VALIDATION_ASPECT_BINDGROUPS,
-        VALIDATION_ASPECT_VERTEX_BUFFERS,
-        VALIDATION_ASPECT_INDEX_BUFFER,
-
-        VALIDATION_ASPECT_COUNT,
-    };
-
-    using ValidationAspects = std::bitset<VALIDATION_ASPECT_COUNT>;
-
     bool CommandBufferBuilder::ValidateGetResult() {
-        MoveToIterator();
-
-        ValidationAspects aspects;
-        std::bitset<kMaxBindGroups> bindgroupsSet;
-        std::bitset<kMaxVertexInputs> inputsSet;
-        PipelineBase* lastPipeline = nullptr;
-
-        Command type;
-        while(iterator.NextCommandId(&type)) {
-            switch (type) {
-                case Command::CopyBufferToTexture:
-                    {
-                        CopyBufferToTextureCmd* copy = iterator.NextCommand<CopyBufferToTextureCmd>();
-                        BufferBase* buffer = copy->buffer.Get();
-                        TextureBase* texture = copy->texture.Get();
-                        uint64_t width = copy->width;
-                        uint64_t height = copy->height;
-                        uint64_t depth = copy->depth;
-                        uint64_t x = copy->x;
-                        uint64_t y = copy->y;
-                        uint64_t z = copy->z;
-
-                        if (!(buffer->GetUsage() & nxt::BufferUsageBit::TransferSrc)) {
-                            device->HandleError("Buffer needs the transfer source usage bit");
-                            return false;
-                        }
-
-                        if (!(texture->GetUsage() & nxt::TextureUsageBit::TransferDst)) {
-                            device->HandleError("Texture needs the transfer destination usage bit");
-                            return false;
-                        }
-
-                        if (width == 0 || height == 0 || depth == 0) {
-                            device->HandleError("Empty copy");
-                            return false;
-                        }
-
-                        // TODO(cwallez@chromium.org): check for overflows
-                        uint64_t pixelSize = TextureFormatPixelSize(texture->GetFormat());
-                        uint64_t dataSize = width * height * depth * pixelSize;
-
-                        // TODO(cwallez@chromium.org): handle buffer offset when it is in the command.
-                        if (dataSize > static_cast<uint64_t>(buffer->GetSize())) {
-                            device->HandleError("Copy would read after end of the buffer");
-                            return false;
-                        }
-
-                        if (x + width > static_cast<uint64_t>(texture->GetWidth()) ||
-                            y + height > static_cast<uint64_t>(texture->GetHeight()) ||
-                            z + depth > static_cast<uint64_t>(texture->GetDepth()) ||
-                            copy->level > texture->GetNumMipLevels()) {
-                            device->HandleError("Copy would write outside of the texture");
-                            return false;
-                        }
-                    }
-                    break;
-
-                case Command::Dispatch:
-                    {
-                        DispatchCmd* cmd = iterator.NextCommand<DispatchCmd>();
-
-                        constexpr ValidationAspects requiredDispatchAspects =
-                            1 << VALIDATION_ASPECT_COMPUTE_PIPELINE |
-                            1 << VALIDATION_ASPECT_BINDGROUPS |
-                            1 << VALIDATION_ASPECT_VERTEX_BUFFERS;
-
-                        if ((requiredDispatchAspects & ~aspects).any()) {
-                            // Compute the lazily computed aspects
-                            if (bindgroupsSet.all()) {
-                                aspects.set(VALIDATION_ASPECT_BINDGROUPS);
-                            }
-
-                            auto requiredInputs = lastPipeline->GetInputState()->GetInputsSetMask();
-                            if ((inputsSet & ~requiredInputs).none()) {
-                                aspects.set(VALIDATION_ASPECT_VERTEX_BUFFERS);
-                            }
-
-                            // Check again if anything is missing
-                            if ((requiredDispatchAspects & ~aspects).any()) {
-                                device->HandleError("Some dispatch state is missing");
-                                return false;
-                            }
-                        }
-                    }
-                    break;
-
-                case Command::DrawArrays:
-                case Command::DrawElements:
-                    {
-                        constexpr ValidationAspects requiredDrawAspects =
-                            1 << VALIDATION_ASPECT_RENDER_PIPELINE |
-                            1 << VALIDATION_ASPECT_BINDGROUPS |
-                            1 << VALIDATION_ASPECT_VERTEX_BUFFERS;
-
-                        if ((requiredDrawAspects & ~aspects).any()) {
-                            // Compute the lazily computed aspects
-                            if (bindgroupsSet.all()) {
-                                aspects.set(VALIDATION_ASPECT_BINDGROUPS);
-                            }
-
-                            auto requiredInputs = lastPipeline->GetInputState()->GetInputsSetMask();
-                            if ((inputsSet & ~requiredInputs).none()) {
-                                aspects.set(VALIDATION_ASPECT_VERTEX_BUFFERS);
-                            }
-
-                            // Check again if anything is missing
-                            if ((requiredDrawAspects & ~aspects).any()) {
-                                device->HandleError("Some draw state is missing");
-                                return false;
-                            }
-                        }
-
-                        if (type == Command::DrawArrays) {
-                            DrawArraysCmd* draw = iterator.NextCommand<DrawArraysCmd>();
-                        } else {
-                            ASSERT(type == Command::DrawElements);
-                            DrawElementsCmd* draw = iterator.NextCommand<DrawElementsCmd>();
-
-                            if (!aspects[VALIDATION_ASPECT_INDEX_BUFFER]) {
-                                device->HandleError("Draw elements requires an index buffer");
-                                return false;
-                            }
-                        }
-                    }
-                    break;
-
-                case Command::SetPipeline:
-                    {
-                        SetPipelineCmd* cmd = iterator.NextCommand<SetPipelineCmd>();
-                        PipelineBase* pipeline = cmd->pipeline.Get();
-                        PipelineLayoutBase* layout = pipeline->GetLayout();
-
-                        if (pipeline->IsCompute()) {
-                            aspects.set(VALIDATION_ASPECT_COMPUTE_PIPELINE);
-                            aspects.reset(VALIDATION_ASPECT_RENDER_PIPELINE);
-                        } else {
-                            aspects.set(VALIDATION_ASPECT_RENDER_PIPELINE);
-                            aspects.reset(VALIDATION_ASPECT_COMPUTE_PIPELINE);
-                        }
-                        aspects.reset(VALIDATION_ASPECT_BINDGROUPS);
-                        aspects.reset(VALIDATION_ASPECT_VERTEX_BUFFERS);
-                        bindgroupsSet = ~layout->GetBindGroupsLayoutMask();
-
-                        // Only bindgroups that were not the same layout in the last pipeline need to be set again.
-                        if (lastPipeline) {
-                            PipelineLayoutBase* lastLayout = lastPipeline->GetLayout();
-                            for (uint32_t i = 0; i < kMaxBindGroups; ++i) {
-                                if (lastLayout->GetBindGroupLayout(i) == layout->GetBindGroupLayout(i)) {
-                                    bindgroupsSet |= uint64_t(1) << i;
-                                }
-                            }
-                        }
-
-                        lastPipeline = pipeline;
-                    }
-                    break;
-
-                case Command::SetPushConstants:
-                    {
-                        SetPushConstantsCmd* cmd = iterator.NextCommand<SetPushConstantsCmd>();
-                        iterator.NextData<uint32_t>(cmd->count);
-                        if (cmd->count + cmd->offset > kMaxPushConstants) {
-                            device->HandleError("Setting pushconstants past the limit");
-                            return false;
-                        }
-                    }
-                    break;
-
-                case Command::SetBindGroup:
-                    {
-                        SetBindGroupCmd* cmd = iterator.NextCommand<SetBindGroupCmd>();
-                        uint32_t index = cmd->index;
-
-                        if (cmd->group->GetLayout() != lastPipeline->GetLayout()->GetBindGroupLayout(index)) {
-                            device->HandleError("Bind group layout mismatch");
-                            return false;
-                        }
-                        bindgroupsSet |= uint64_t(1) << index;
-                    }
-                    break;
-
-                case Command::SetIndexBuffer:
-                    {
-                        SetIndexBufferCmd* cmd = iterator.NextCommand<SetIndexBufferCmd>();
-                        if (!(cmd->buffer->GetUsage() & nxt::BufferUsageBit::Index)) {
-                            device->HandleError("Buffer needs the index usage bit");
-                            return false;
-                        }
-
-                        aspects.set(VALIDATION_ASPECT_INDEX_BUFFER);
-                    }
-                    break;
-
-                case Command::SetVertexBuffers:
-                    {
-                        SetVertexBuffersCmd* cmd = iterator.NextCommand<SetVertexBuffersCmd>();
-                        auto buffers = iterator.NextData<Ref<BufferBase>>(cmd->count);
-                        iterator.NextData<uint32_t>(cmd->count);
-
-                        for (uint32_t i = 0; i < cmd->count; ++i) {
-                            if (!(buffers[i]->GetUsage() & nxt::BufferUsageBit::Vertex)) {
-                                device->HandleError("Buffer needs the vertex usage bit");
-                                return false;
-                            }
-                            inputsSet.set(cmd->startSlot + i);
-                        }
-                    }
-                    break;
-            }
-        }
+        // Each command was validated when it was recorded. The commands stay in the allocator
+        // so that GetResult can pack them, a builder with an error frees them when it is reset
+        // or destroyed.
+        return !state.HasError();
+    }
 
-        return true;
+    const CommandBufferStateTracker::ElidedCommandCounts& CommandBufferBuilder::GetElidedCommandCounts() const {
+        return state.GetElidedCommandCounts();
     }
 
     CommandIterator CommandBufferBuilder::AcquireCommands() {
         return std::move(iterator);
     }
 
+    CommandReferences CommandBufferBuilder::AcquireReferences() {
+        return std::move(references);
+    }
+
     CommandBufferBase* CommandBufferBuilder::GetResult() {
+        // Command buffers are usually iterated more than once (validation, execution), so the
+        // cost of packing the blocks is amortized by not hopping between them. The commands of
+        // a builder with an error are about to be freed so they aren't packed.
+        if (!state.HasError()) {
+            allocator.Compact();
+        }
         MoveToIterator();
         consumed = true;
         return device->CreateCommandBuffer(this);
     }
 
+    void CommandBufferBuilder::Reset() {
+        // Destroy the commands that weren't given to a command buffer. The blocks that were
+        // acquired by a command buffer come back through the device's block pool when it dies.
+        if (!consumed) {
+            MoveToIterator();
+            iterator.Reset();
+            FreeCommands(&iterator, &references);
+        }
+        iterator = CommandIterator();
+        allocator.Reset();
+
+        state = CommandBufferStateTracker(device);
+        consumed = false;
+        movedToIterator = false;
+    }
+
+    void CommandBufferBuilder::SetCommandCountHint(uint32_t count) {
+        // Most commands are a draw or a state change, with their id they fit in this size.
+        constexpr size_t kEstimatedCommandSize = 32;
+        allocator.SetSizeHint(count * kEstimatedCommandSize);
+    }
+
     void CommandBufferBuilder::CopyBufferToTexture(BufferBase* buffer, TextureBase* texture, uint32_t x, uint32_t y, uint32_t z,
                                                    uint32_t width, uint32_t height, uint32_t depth, uint32_t level) {
+        if (!state.ValidateCanCopy(buffer, texture, x, y, z, width, height, depth, level)) {
+            return;
+        }
+        state.ForgetBoundObjects();
+
         CopyBufferToTextureCmd* copy = allocator.Allocate<CopyBufferToTextureCmd>(Command::CopyBufferToTexture);
         new(copy) CopyBufferToTextureCmd;
         copy->buffer = buffer;
+        references.Add(buffer);
         copy->texture = texture;
+        references.Add(texture);
         copy->x = x;
         copy->y = y;
         copy->z = z;
@@ -353,6 +112,10 @@ namespace backend {
     }
 
     void CommandBufferBuilder::Dispatch(uint32_t x, uint32_t y, uint32_t z) {
+        if (!state.ValidateCanDispatch()) {
+            return;
+        }
+
         DispatchCmd* dispatch = allocator.Allocate<DispatchCmd>(Command::Dispatch);
         new(dispatch) DispatchCmd;
         dispatch->x = x;
@@ -360,7 +123,23 @@ namespace backend {
         dispatch->z = z;
     }
 
+    void CommandBufferBuilder::DispatchIndirect(BufferBase* buffer, uint32_t offset) {
+        if (!state.ValidateCanDispatchIndirect(buffer, offset)) {
+            return;
+        }
+
+        DispatchIndirectCmd* dispatch = allocator.Allocate<DispatchIndirectCmd>(Command::DispatchIndirect);
+        new(dispatch) DispatchIndirectCmd;
+        dispatch->buffer = buffer;
+        references.Add(buffer);
+        dispatch->offset = offset;
+    }
+
     void CommandBufferBuilder::DrawArrays(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+        if (!state.ValidateCanDrawArrays()) {
+            return;
+        }
+
         DrawArraysCmd* draw = allocator.Allocate<DrawArraysCmd>(Command::DrawArrays);
         new(draw) DrawArraysCmd;
         draw->vertexCount = vertexCount;
@@ -369,7 +148,23 @@ namespace backend {
         draw->firstInstance = firstInstance;
     }
 
+    void CommandBufferBuilder::DrawArraysIndirect(BufferBase* buffer, uint32_t offset) {
+        if (!state.ValidateCanDrawArraysIndirect(buffer, offset)) {
+            return;
+        }
+
+        DrawArraysIndirectCmd* draw = allocator.Allocate<DrawArraysIndirectCmd>(Command::DrawArraysIndirect);
+        new(draw) DrawArraysIndirectCmd;
+        draw->buffer = buffer;
+        references.Add(buffer);
+        draw->offset = offset;
+    }
+
     void CommandBufferBuilder::DrawElements(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, uint32_t firstInstance) {
+        if (!state.ValidateCanDrawElements()) {
+            return;
+        }
+
         DrawElementsCmd* draw = allocator.Allocate<DrawElementsCmd>(Command::DrawElements);
         new(draw) DrawElementsCmd;
         draw->indexCount = indexCount;
@@ -378,15 +173,45 @@ namespace backend {
         draw->firstInstance = firstInstance;
     }
 
+    void CommandBufferBuilder::DrawElementsIndirect(BufferBase* buffer, uint32_t offset) {
+        if (!state.ValidateCanDrawElementsIndirect(buffer, offset)) {
+            return;
+        }
+
+        DrawElementsIndirectCmd* draw = allocator.Allocate<DrawElementsIndirectCmd>(Command::DrawElementsIndirect);
+        new(draw) DrawElementsIndirectCmd;
+        draw->buffer = buffer;
+        references.Add(buffer);
+        draw->offset = offset;
+    }
+
+    void CommandBufferBuilder::ExecuteBundle(RenderBundleBase* bundle) {
+        if (state.HasError()) {
+            return;
+        }
+        // The bundle was validated when it was built, starting from an empty state. The state
+        // it leaves behind isn't tracked so it must be set again.
+        state.Reset();
+
+        ExecuteBundleCmd* cmd = allocator.Allocate<ExecuteBundleCmd>(Command::ExecuteBundle);
+        new(cmd) ExecuteBundleCmd;
+        cmd->bundle = bundle;
+        references.Add(bundle);
+    }
+
     void CommandBufferBuilder::SetPipeline(PipelineBase* pipeline) {
+        if (state.ElidePipeline(pipeline) || !state.SetPipeline(pipeline)) {
+            return;
+        }
+
         SetPipelineCmd* cmd = allocator.Allocate<SetPipelineCmd>(Command::SetPipeline);
         new(cmd) SetPipelineCmd;
         cmd->pipeline = pipeline;
+        references.Add(pipeline);
     }
 
     void CommandBufferBuilder::SetPushConstants(nxt::ShaderStageBit stage, uint32_t offset, uint32_t count, const void* data) {
-        if (offset + count > kMaxPushConstants) {
-            device->HandleError("Setting too many push constants");
+        if (!state.ValidateSetPushConstants(offset, count)) {
             return;
         }
 
@@ -401,8 +226,7 @@ namespace backend {
     }
 
     void CommandBufferBuilder::SetBindGroup(uint32_t groupIndex, BindGroupBase* group) {
-        if (groupIndex >= kMaxBindGroups) {
-            device->HandleError("Setting bind group over the max");
+        if (state.ElideBindGroup(groupIndex, group) || !state.SetBindGroup(groupIndex, group)) {
             return;
         }
 
@@ -410,29 +234,37 @@ namespace backend {
         new(cmd) SetBindGroupCmd;
         cmd->index = groupIndex;
         cmd->group = group;
+        references.Add(group);
     }
 
     void CommandBufferBuilder::SetIndexBuffer(BufferBase* buffer, uint32_t offset, nxt::IndexFormat format) {
-        // TODO(kainino@chromium.org): validation
+        if (state.ElideIndexBuffer(buffer, offset, format) || !state.SetIndexBuffer(buffer, offset, format)) {
+            return;
+        }
 
         SetIndexBufferCmd* cmd = allocator.Allocate<SetIndexBufferCmd>(Command::SetIndexBuffer);
         new(cmd) SetIndexBufferCmd;
         cmd->buffer = buffer;
+        references.Add(buffer);
         cmd->offset = offset;
         cmd->format = format;
     }
 
     void CommandBufferBuilder::SetVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, uint32_t const* offsets){
-        // TODO(kainino@chromium.org): validation
+        if (state.ElideVertexBuffers(startSlot, count, buffers, offsets) ||
+            !state.SetVertexBuffers(startSlot, count, buffers, offsets)) {
+            return;
+        }
 
         SetVertexBuffersCmd* cmd = allocator.Allocate<SetVertexBuffersCmd>(Command::SetVertexBuffers);
         new(cmd) SetVertexBuffersCmd;
         cmd->startSlot = startSlot;
         cmd->count = count;
 
-        Ref<BufferBase>* cmdBuffers = allocator.AllocateData<Ref<BufferBase>>(count);
+        BufferBase** cmdBuffers = allocator.AllocateData<BufferBase*>(count);
         for (size_t i = 0; i < count; ++i) {
-            new(&cmdBuffers[i]) Ref<BufferBase>(buffers[i]);
+            cmdBuffers[i] = buffers[i];
+            references.Add(buffers[i]);
         }
 
         uint32_t* cmdOffsets = allocator.AllocateData<uint32_t>(count);
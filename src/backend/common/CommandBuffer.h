@@ -8,6 +8,8 @@
 #include "nxt/nxtcpp.h"
 
 #include "CommandAllocator.h"
+#include "CommandBufferStateTracker.h"
+#include "CommandReferences.h"
 #include "RefCounted.h"
 
 namespace backend {
@@ -16,6 +18,7 @@ namespace backend {
     class BufferBase;
     class DeviceBase;
     class PipelineBase;
+    class RenderBundleBase;
     class TextureBase;
 
     class CommandBufferBase : public RefCounted {
@@ -29,16 +32,26 @@ namespace backend {
             bool WasConsumed() const;
             bool ValidateGetResult();
 
+            // The number of state changes that were dropped because they didn't change anything.
+            const CommandBufferStateTracker::ElidedCommandCounts& GetElidedCommandCounts() const;
+
             CommandIterator AcquireCommands();
+            CommandReferences AcquireReferences();
 
             // NXT API
             CommandBufferBase* GetResult();
+            void Reset();
+            void SetCommandCountHint(uint32_t count);
 
             void CopyBufferToTexture(BufferBase* buffer, TextureBase* texture, uint32_t x, uint32_t y, uint32_t z,
                                      uint32_t width, uint32_t height, uint32_t depth, uint32_t level);
             void Dispatch(uint32_t x, uint32_t y, uint32_t z);
+            void DispatchIndirect(BufferBase* buffer, uint32_t offset);
             void DrawArrays(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance);
+            void DrawArraysIndirect(BufferBase* buffer, uint32_t offset);
             void DrawElements(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstIndex, uint32_t firstInstance);
+            void DrawElementsIndirect(BufferBase* buffer, uint32_t offset);
+            void ExecuteBundle(RenderBundleBase* bundle);
             void SetPushConstants(nxt::ShaderStageBit stage, uint32_t offset, uint32_t count, const void* data);
             void SetPipeline(PipelineBase* pipeline);
             void SetBindGroup(uint32_t groupIndex, BindGroupBase* group);
@@ -52,11 +65,14 @@ namespace backend {
             void SetVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, uint32_t const* offsets);
 
         private:
+            // Packs the commands in a single block and gives them to the iterator.
             void MoveToIterator();
 
             DeviceBase* device;
             CommandAllocator allocator;
             CommandIterator iterator;
+            CommandReferences references;
+            CommandBufferStateTracker state;
             bool consumed = false;
             bool movedToIterator = false;
     };
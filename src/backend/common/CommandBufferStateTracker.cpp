@@ -0,0 +1,338 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "CommandBufferStateTracker.h"
+
+#include "BindGroup.h"
+#include "Buffer.h"
+#include "Device.h"
+#include "InputState.h"
+#include "Pipeline.h"
+#include "PipelineLayout.h"
+#include "Texture.h"
+
+namespace backend {
+
+    CommandBufferStateTracker::CommandBufferStateTracker(DeviceBase* device)
+        : device(device) {
+        ForgetBoundObjects();
+    }
+
+    const CommandBufferStateTracker::ElidedCommandCounts& CommandBufferStateTracker::GetElidedCommandCounts() const {
+        return elidedCounts;
+    }
+
+    bool CommandBufferStateTracker::HasError() const {
+        return hasError;
+    }
+
+    bool CommandBufferStateTracker::HandleError(const char* message) {
+        if (!hasError) {
+            device->HandleError(message);
+            hasError = true;
+        }
+        return false;
+    }
+
+    void CommandBufferStateTracker::Reset() {
+        aspects.reset();
+        bindgroupsSet.reset();
+        inputsSet.reset();
+        lastPipeline = nullptr;
+        indexBufferOffset = 0;
+        ForgetBoundObjects();
+    }
+
+    bool CommandBufferStateTracker::ElidePipeline(PipelineBase* pipeline) {
+        if (hasError || pipeline != boundPipeline) {
+            return false;
+        }
+        elidedCounts.pipelines++;
+        return true;
+    }
+
+    bool CommandBufferStateTracker::ElideBindGroup(uint32_t index, BindGroupBase* group) {
+        if (hasError || index >= kMaxBindGroups || group != boundBindGroups[index]) {
+            return false;
+        }
+        elidedCounts.bindGroups++;
+        return true;
+    }
+
+    bool CommandBufferStateTracker::ElideIndexBuffer(BufferBase* buffer, uint32_t offset, nxt::IndexFormat format) {
+        if (hasError || buffer != boundIndexBuffer || offset != boundIndexBufferOffset ||
+            format != boundIndexBufferFormat) {
+            return false;
+        }
+        elidedCounts.indexBuffers++;
+        return true;
+    }
+
+    bool CommandBufferStateTracker::ElideVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, uint32_t const* offsets) {
+        if (hasError || uint64_t(startSlot) + count > kMaxVertexInputs) {
+            return false;
+        }
+
+        for (uint32_t i = 0; i < count; ++i) {
+            if (buffers[i] != boundVertexBuffers[startSlot + i] ||
+                offsets[i] != boundVertexBufferOffsets[startSlot + i]) {
+                return false;
+            }
+        }
+        elidedCounts.vertexBuffers++;
+        return true;
+    }
+
+    void CommandBufferStateTracker::ForgetBoundObjects() {
+        boundPipeline = nullptr;
+        boundBindGroups.fill(nullptr);
+        boundIndexBuffer = nullptr;
+        boundIndexBufferOffset = 0;
+        boundIndexBufferFormat = nxt::IndexFormat::Uint16;
+        boundVertexBuffers.fill(nullptr);
+        boundVertexBufferOffsets.fill(0);
+    }
+
+    bool CommandBufferStateTracker::ValidateCanCopy(BufferBase* buffer, TextureBase* texture, uint32_t x, uint32_t y, uint32_t z,
+                                                    uint32_t width, uint32_t height, uint32_t depth, uint32_t level) {
+        if (hasError) {
+            return false;
+        }
+
+        if (!(buffer->GetUsage() & nxt::BufferUsageBit::TransferSrc)) {
+            return HandleError("Buffer needs the transfer source usage bit");
+        }
+
+        if (!(texture->GetUsage() & nxt::TextureUsageBit::TransferDst)) {
+            return HandleError("Texture needs the transfer destination usage bit");
+        }
+
+        if (width == 0 || height == 0 || depth == 0) {
+            return HandleError("Empty copy");
+        }
+
+        // TODO(cwallez@chromium.org): check for overflows
+        uint64_t pixelSize = TextureFormatPixelSize(texture->GetFormat());
+        uint64_t dataSize = uint64_t(width) * height * depth * pixelSize;
+
+        // TODO(cwallez@chromium.org): handle buffer offset when it is in the command.
+        if (dataSize > static_cast<uint64_t>(buffer->GetSize())) {
+            return HandleError("Copy would read after end of the buffer");
+        }
+
+        if (uint64_t(x) + width > static_cast<uint64_t>(texture->GetWidth()) ||
+            uint64_t(y) + height > static_cast<uint64_t>(texture->GetHeight()) ||
+            uint64_t(z) + depth > static_cast<uint64_t>(texture->GetDepth()) ||
+            level > texture->GetNumMipLevels()) {
+            return HandleError("Copy would write outside of the texture");
+        }
+
+        return true;
+    }
+
+    bool CommandBufferStateTracker::ValidateCanDispatch() {
+        constexpr ValidationAspects requiredDispatchAspects =
+            1 << VALIDATION_ASPECT_COMPUTE_PIPELINE |
+            1 << VALIDATION_ASPECT_BINDGROUPS |
+            1 << VALIDATION_ASPECT_VERTEX_BUFFERS;
+
+        return ValidateRequiredAspects(requiredDispatchAspects, "Some dispatch state is missing");
+    }
+
+    bool CommandBufferStateTracker::ValidateCanDispatchIndirect(BufferBase* buffer, uint32_t offset) {
+        // x, y, z
+        constexpr uint32_t kDispatchIndirectSize = 3 * sizeof(uint32_t);
+        return ValidateCanDispatch() && ValidateIndirectBuffer(buffer, offset, kDispatchIndirectSize);
+    }
+
+    bool CommandBufferStateTracker::ValidateCanDrawArrays() {
+        constexpr ValidationAspects requiredDrawAspects =
+            1 << VALIDATION_ASPECT_RENDER_PIPELINE |
+            1 << VALIDATION_ASPECT_BINDGROUPS |
+            1 << VALIDATION_ASPECT_VERTEX_BUFFERS;
+
+        return ValidateRequiredAspects(requiredDrawAspects, "Some draw state is missing");
+    }
+
+    bool CommandBufferStateTracker::ValidateCanDrawArraysIndirect(BufferBase* buffer, uint32_t offset) {
+        // vertexCount, instanceCount, firstVertex, firstInstance
+        constexpr uint32_t kDrawArraysIndirectSize = 4 * sizeof(uint32_t);
+        return ValidateCanDrawArrays() && ValidateIndirectBuffer(buffer, offset, kDrawArraysIndirectSize);
+    }
+
+    bool CommandBufferStateTracker::ValidateCanDrawElements() {
+        if (!ValidateCanDrawArrays()) {
+            return false;
+        }
+
+        if (!aspects[VALIDATION_ASPECT_INDEX_BUFFER]) {
+            return HandleError("Draw elements requires an index buffer");
+        }
+        return true;
+    }
+
+    bool CommandBufferStateTracker::ValidateCanDrawElementsIndirect(BufferBase* buffer, uint32_t offset) {
+        // indexCount, instanceCount, firstIndex, baseVertex, firstInstance
+        constexpr uint32_t kDrawElementsIndirectSize = 5 * sizeof(uint32_t);
+
+        // The first index is read from the indirect buffer and OpenGL can't add the index buffer
+        // offset to it, so the offset is rejected for all backends to draw the same indices.
+        if (!hasError && indexBufferOffset != 0) {
+            return HandleError("Indexed indirect draws require an index buffer offset of 0");
+        }
+        return ValidateCanDrawElements() && ValidateIndirectBuffer(buffer, offset, kDrawElementsIndirectSize);
+    }
+
+    bool CommandBufferStateTracker::ValidateSetPushConstants(uint32_t offset, uint32_t count) {
+        if (hasError) {
+            return false;
+        }
+
+        if (uint64_t(offset) + count > kMaxPushConstants) {
+            return HandleError("Setting too many push constants");
+        }
+        return true;
+    }
+
+    bool CommandBufferStateTracker::SetPipeline(PipelineBase* pipeline) {
+        if (hasError) {
+            return false;
+        }
+
+        PipelineLayoutBase* layout = pipeline->GetLayout();
+
+        if (pipeline->IsCompute()) {
+            aspects.set(VALIDATION_ASPECT_COMPUTE_PIPELINE);
+            aspects.reset(VALIDATION_ASPECT_RENDER_PIPELINE);
+        } else {
+            aspects.set(VALIDATION_ASPECT_RENDER_PIPELINE);
+            aspects.reset(VALIDATION_ASPECT_COMPUTE_PIPELINE);
+        }
+        aspects.reset(VALIDATION_ASPECT_BINDGROUPS);
+        aspects.reset(VALIDATION_ASPECT_VERTEX_BUFFERS);
+        bindgroupsSet = ~layout->GetBindGroupsLayoutMask();
+
+        // Only bindgroups that were not the same layout in the last pipeline need to be set again.
+        if (lastPipeline) {
+            PipelineLayoutBase* lastLayout = lastPipeline->GetLayout();
+            for (uint32_t i = 0; i < kMaxBindGroups; ++i) {
+                if (lastLayout->GetBindGroupLayout(i) == layout->GetBindGroupLayout(i)) {
+                    bindgroupsSet |= uint64_t(1) << i;
+                }
+            }
+        }
+
+        lastPipeline = pipeline;
+
+        // Backends apply bind groups and buffers relative to the pipeline (its layout, or its
+        // vertex array object in OpenGL) so they have to be set again after a pipeline change.
+        ForgetBoundObjects();
+        boundPipeline = pipeline;
+        return true;
+    }
+
+    bool CommandBufferStateTracker::SetBindGroup(uint32_t index, BindGroupBase* group) {
+        if (hasError) {
+            return false;
+        }
+
+        if (index >= kMaxBindGroups) {
+            return HandleError("Setting bind group over the max");
+        }
+
+        if (lastPipeline == nullptr) {
+            return HandleError("Bind group set without a pipeline");
+        }
+
+        if (group->GetLayout() != lastPipeline->GetLayout()->GetBindGroupLayout(index)) {
+            return HandleError("Bind group layout mismatch");
+        }
+        bindgroupsSet |= uint64_t(1) << index;
+        boundBindGroups[index] = group;
+        return true;
+    }
+
+    bool CommandBufferStateTracker::SetIndexBuffer(BufferBase* buffer, uint32_t offset, nxt::IndexFormat format) {
+        if (hasError) {
+            return false;
+        }
+
+        if (!(buffer->GetUsage() & nxt::BufferUsageBit::Index)) {
+            return HandleError("Buffer needs the index usage bit");
+        }
+
+        aspects.set(VALIDATION_ASPECT_INDEX_BUFFER);
+        boundIndexBuffer = buffer;
+        boundIndexBufferOffset = offset;
+        boundIndexBufferFormat = format;
+        indexBufferOffset = offset;
+        return true;
+    }
+
+    bool CommandBufferStateTracker::SetVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, uint32_t const* offsets) {
+        if (hasError) {
+            return false;
+        }
+
+        if (uint64_t(startSlot) + count > kMaxVertexInputs) {
+            return HandleError("Setting vertex buffers over the max");
+        }
+
+        for (uint32_t i = 0; i < count; ++i) {
+            if (!(buffers[i]->GetUsage() & nxt::BufferUsageBit::Vertex)) {
+                return HandleError("Buffer needs the vertex usage bit");
+            }
+        }
+
+        for (uint32_t i = 0; i < count; ++i) {
+            inputsSet.set(startSlot + i);
+            boundVertexBuffers[startSlot + i] = buffers[i];
+            boundVertexBufferOffsets[startSlot + i] = offsets[i];
+        }
+        return true;
+    }
+
+    bool CommandBufferStateTracker::ValidateRequiredAspects(ValidationAspects requiredAspects, const char* error) {
+        if (hasError) {
+            return false;
+        }
+
+        if ((requiredAspects & ~aspects).any()) {
+            // Compute the lazily computed aspects
+            if (bindgroupsSet.all()) {
+                aspects.set(VALIDATION_ASPECT_BINDGROUPS);
+            }
+
+            if (lastPipeline != nullptr) {
+                auto requiredInputs = lastPipeline->GetInputState()->GetInputsSetMask();
+                if ((inputsSet & ~requiredInputs).none()) {
+                    aspects.set(VALIDATION_ASPECT_VERTEX_BUFFERS);
+                }
+            }
+
+            // Check again if anything is missing
+            if ((requiredAspects & ~aspects).any()) {
+                return HandleError(error);
+            }
+        }
+
+        return true;
+    }
+
+    bool CommandBufferStateTracker::ValidateIndirectBuffer(BufferBase* buffer, uint32_t offset, uint32_t argumentsSize) {
+        if (!(buffer->GetUsage() & nxt::BufferUsageBit::Indirect)) {
+            return HandleError("Buffer needs the indirect usage bit");
+        }
+
+        if (offset % sizeof(uint32_t) != 0) {
+            return HandleError("Indirect offset must be a multiple of 4");
+        }
+
+        if (uint64_t(offset) + argumentsSize > static_cast<uint64_t>(buffer->GetSize())) {
+            return HandleError("Indirect arguments would read after end of the buffer");
+        }
+        return true;
+    }
+
+}
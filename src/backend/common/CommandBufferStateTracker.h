@@ -0,0 +1,110 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_COMMON_COMMANDBUFFERSTATETRACKER_H_
+#define BACKEND_COMMON_COMMANDBUFFERSTATETRACKER_H_
+
+#include "Forward.h"
+
+#include "nxt/nxtcpp.h"
+
+#include <array>
+#include <bitset>
+
+namespace backend {
+
+    // Tracks the state set while recording a command buffer or a render bundle so that each
+    // command is validated when it is recorded, instead of in a second pass over the commands.
+    // The first error is given to the device and all the following validations fail, so that
+    // builders can stop recording and fail GetResult.
+    // It also remembers the objects that are bound so that commands that wouldn't change them can
+    // be dropped instead of being recorded and replayed in the backends.
+    class CommandBufferStateTracker {
+        public:
+            CommandBufferStateTracker(DeviceBase* device);
+
+            struct ElidedCommandCounts {
+                uint32_t pipelines = 0;
+                uint32_t bindGroups = 0;
+                uint32_t indexBuffers = 0;
+                uint32_t vertexBuffers = 0;
+            };
+            const ElidedCommandCounts& GetElidedCommandCounts() const;
+
+            bool HasError() const;
+            // Reports an error that doesn't depend on the tracked state, returns false.
+            bool HandleError(const char* message);
+
+            // Forgets the state that was set, for example after executing a render bundle.
+            void Reset();
+
+            // Redundant state elimination: returns true, and counts the command as elided, if
+            // the command would set the objects that are already bound.
+            bool ElidePipeline(PipelineBase* pipeline);
+            bool ElideBindGroup(uint32_t index, BindGroupBase* group);
+            bool ElideIndexBuffer(BufferBase* buffer, uint32_t offset, nxt::IndexFormat format);
+            bool ElideVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, uint32_t const* offsets);
+            // Called when the backends might lose the bound objects, for example copies use
+            // another encoder in Metal and texture unit 0 in OpenGL.
+            void ForgetBoundObjects();
+
+            // Validation of the commands that use the state
+            bool ValidateCanCopy(BufferBase* buffer, TextureBase* texture, uint32_t x, uint32_t y, uint32_t z,
+                                 uint32_t width, uint32_t height, uint32_t depth, uint32_t level);
+            bool ValidateCanDispatch();
+            bool ValidateCanDispatchIndirect(BufferBase* buffer, uint32_t offset);
+            bool ValidateCanDrawArrays();
+            bool ValidateCanDrawArraysIndirect(BufferBase* buffer, uint32_t offset);
+            bool ValidateCanDrawElements();
+            bool ValidateCanDrawElementsIndirect(BufferBase* buffer, uint32_t offset);
+            bool ValidateSetPushConstants(uint32_t offset, uint32_t count);
+
+            // State changes
+            bool SetPipeline(PipelineBase* pipeline);
+            bool SetBindGroup(uint32_t index, BindGroupBase* group);
+            bool SetIndexBuffer(BufferBase* buffer, uint32_t offset, nxt::IndexFormat format);
+            bool SetVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, uint32_t const* offsets);
+
+        private:
+            enum ValidationAspect {
+                VALIDATION_ASPECT_RENDER_PIPELINE,
+                VALIDATION_ASPECT_COMPUTE_PIPELINE,
+                VALIDATION_ASPECT_BINDGROUPS,
+                VALIDATION_ASPECT_VERTEX_BUFFERS,
+                VALIDATION_ASPECT_INDEX_BUFFER,
+
+                VALIDATION_ASPECT_COUNT,
+            };
+            using ValidationAspects = std::bitset<VALIDATION_ASPECT_COUNT>;
+
+            bool ValidateRequiredAspects(ValidationAspects requiredAspects, const char* error);
+            // Checks that the arguments of an indirect command can be read from the buffer
+            bool ValidateIndirectBuffer(BufferBase* buffer, uint32_t offset, uint32_t argumentsSize);
+
+            DeviceBase* device;
+            bool hasError = false;
+
+            ValidationAspects aspects;
+            std::bitset<kMaxBindGroups> bindgroupsSet;
+            std::bitset<kMaxVertexInputs> inputsSet;
+            PipelineBase* lastPipeline = nullptr;
+            // The offset of the index buffer used by the draws, unlike the bound objects it isn't
+            // forgotten when the pipeline changes.
+            uint32_t indexBufferOffset = 0;
+
+            // The objects that are bound. They are kept alive by the Refs in the recorded commands.
+            PipelineBase* boundPipeline;
+            std::array<BindGroupBase*, kMaxBindGroups> boundBindGroups;
+            BufferBase* boundIndexBuffer;
+            uint32_t boundIndexBufferOffset;
+            nxt::IndexFormat boundIndexBufferFormat;
+            std::array<BufferBase*, kMaxVertexInputs> boundVertexBuffers;
+            std::array<uint32_t, kMaxVertexInputs> boundVertexBufferOffsets;
+
+            ElidedCommandCounts elidedCounts;
+    };
+
+}
+
+#endif // BACKEND_COMMON_COMMANDBUFFERSTATETRACKER_H_
@@ -0,0 +1,57 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "CommandReferences.h"
+
+#include "RefCounted.h"
+
+#include <cassert>
+#define ASSERT assert
+
+namespace backend {
+
+    CommandReferences::~CommandReferences() {
+        ASSERT(objects.empty());
+    }
+
+    CommandReferences::CommandReferences(CommandReferences&& other)
+        : objects(std::move(other.objects)), objectSet(std::move(other.objectSet)), lastAdded(other.lastAdded) {
+        other.objects.clear();
+        other.objectSet.clear();
+        other.lastAdded = nullptr;
+    }
+
+    CommandReferences& CommandReferences::operator=(CommandReferences&& other) {
+        ReleaseAll();
+        objects = std::move(other.objects);
+        objectSet = std::move(other.objectSet);
+        lastAdded = other.lastAdded;
+        other.objects.clear();
+        other.objectSet.clear();
+        other.lastAdded = nullptr;
+        return *this;
+    }
+
+    void CommandReferences::Add(RefCounted* object) {
+        if (object == lastAdded) {
+            return;
+        }
+        lastAdded = object;
+
+        if (objectSet.insert(object).second) {
+            object->ReferenceInternal();
+            objects.push_back(object);
+        }
+    }
+
+    void CommandReferences::ReleaseAll() {
+        for (RefCounted* object : objects) {
+            object->ReleaseInternal();
+        }
+        objects.clear();
+        objectSet.clear();
+        lastAdded = nullptr;
+    }
+
+}
@@ -0,0 +1,42 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_COMMON_COMMANDREFERENCES_H_
+#define BACKEND_COMMON_COMMANDREFERENCES_H_
+
+#include <unordered_set>
+#include <vector>
+
+namespace backend {
+
+    class RefCounted;
+
+    // The objects used by the commands of a command buffer or a render bundle. Commands only
+    // store raw pointers: a single internal reference is taken on each unique object when it is
+    // first recorded, and all of them are released at once when the commands are freed, instead
+    // of one reference per command that has to be released by walking the commands.
+    class CommandReferences {
+        public:
+            CommandReferences() = default;
+            ~CommandReferences();
+
+            CommandReferences(CommandReferences&& other);
+            CommandReferences& operator=(CommandReferences&& other);
+
+            void Add(RefCounted* object);
+            void ReleaseAll();
+
+        private:
+            CommandReferences(const CommandReferences&) = delete;
+            CommandReferences& operator=(const CommandReferences&) = delete;
+
+            std::vector<RefCounted*> objects;
+            std::unordered_set<RefCounted*> objectSet;
+            // Consecutive commands often use the same object, this avoids looking it up.
+            RefCounted* lastAdded = nullptr;
+    };
+
+}
+
+#endif // BACKEND_COMMON_COMMANDREFERENCES_H_
@@ -5,6 +5,7 @@
 #ifndef BACKEND_COMMON_COMMANDS_H_
 #define BACKEND_COMMON_COMMANDS_H_
 
+#include "CommandReferences.h"
 #include "Texture.h"
 
 #include "nxt/nxtcpp.h"
@@ -12,14 +13,19 @@
 namespace backend {
 
     // Definition of the commands that are present in the CommandIterator given by the
-    // CommandBufferBuilder. There are not defined in CommandBuffer.h to break some header
-    // dependencies: Ref<Object> needs Object to be defined.
+    // CommandBufferBuilder. They only store raw pointers to objects: the objects are kept alive
+    // by the CommandReferences of the command buffer or render bundle, so commands are never
+    // destroyed one by one.
 
     enum class Command {
         CopyBufferToTexture,
         Dispatch,
+        DispatchIndirect,
         DrawArrays,
+        DrawArraysIndirect,
         DrawElements,
+        DrawElementsIndirect,
+        ExecuteBundle,
         SetPipeline,
         SetPushConstants,
         SetBindGroup,
@@ -28,8 +34,8 @@ namespace backend {
     };
 
     struct CopyBufferToTextureCmd {
-        Ref<BufferBase> buffer;
-        Ref<TextureBase> texture;
+        BufferBase* buffer;
+        TextureBase* texture;
         uint32_t x, y, z;
         uint32_t width, height, depth;
         uint32_t level;
@@ -41,6 +47,11 @@ namespace backend {
         uint32_t z;
     };
 
+    struct DispatchIndirectCmd {
+        BufferBase* buffer;
+        uint32_t offset;
+    };
+
     struct DrawArraysCmd {
         uint32_t vertexCount;
         uint32_t instanceCount;
@@ -48,6 +59,11 @@ namespace backend {
         uint32_t firstInstance;
     };
 
+    struct DrawArraysIndirectCmd {
+        BufferBase* buffer;
+        uint32_t offset;
+    };
+
     struct DrawElementsCmd {
         uint32_t indexCount;
         uint32_t instanceCount;
@@ -55,8 +71,17 @@ namespace backend {
         uint32_t firstInstance;
     };
 
+    struct DrawElementsIndirectCmd {
+        BufferBase* buffer;
+        uint32_t offset;
+    };
+
+    struct ExecuteBundleCmd {
+        RenderBundleBase* bundle;
+    };
+
     struct SetPipelineCmd {
-        Ref<PipelineBase> pipeline;
+        PipelineBase* pipeline;
     };
 
     struct SetPushConstantsCmd {
@@ -67,11 +92,11 @@ namespace backend {
 
     struct SetBindGroupCmd {
         uint32_t index;
-        Ref<BindGroupBase> group;
+        BindGroupBase* group;
     };
 
     struct SetIndexBufferCmd {
-        Ref<BufferBase> buffer;
+        BufferBase* buffer;
         uint32_t offset;
         nxt::IndexFormat format;
     };
@@ -81,9 +106,9 @@ namespace backend {
         uint32_t count;
     };
 
-    // This needs to be called before the CommandIterator is freed so that the Ref<> present in
-    // the commands have a chance to run their destructor and remove internal references.
-    void FreeCommands(CommandIterator* commands);
+    // This needs to be called before the CommandIterator is freed. Commands don't need to be
+    // destroyed so this only releases the references to the objects that they used.
+    void FreeCommands(CommandIterator* commands, CommandReferences* references);
 
 }
 
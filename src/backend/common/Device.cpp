@@ -8,10 +8,12 @@
 #include "BindGroupLayout.h"
 #include "Buffer.h"
 #include "CommandBuffer.h"
+#include "Fence.h"
 #include "InputState.h"
 #include "Pipeline.h"
 #include "PipelineLayout.h"
 #include "Queue.h"
+#include "RenderBundle.h"
 #include "Sampler.h"
 #include "ShaderModule.h"
 #include "Texture.h"
@@ -75,6 +77,14 @@ namespace backend {
         caches->bindGroupLayouts.erase(obj);
     }
 
+    CommandBlockPool* DeviceBase::GetCommandBlockPool() {
+        return &commandBlockPool;
+    }
+
+    void DeviceBase::AddFenceWithCallbacks(FenceBase* fence) {
+        fencesWithCallbacks.emplace_back(fence);
+    }
+
     BindGroupBuilder* DeviceBase::CreateBindGroupBuilder() {
         return new BindGroupBuilder(this);
     }
@@ -87,6 +97,9 @@ namespace backend {
     CommandBufferBuilder* DeviceBase::CreateCommandBufferBuilder() {
         return new CommandBufferBuilder(this);
     }
+    FenceBuilder* DeviceBase::CreateFenceBuilder() {
+        return new FenceBuilder(this);
+    }
     InputStateBuilder* DeviceBase::CreateInputStateBuilder() {
         return new InputStateBuilder(this);
     }
@@ -99,6 +112,9 @@ namespace backend {
     QueueBuilder* DeviceBase::CreateQueueBuilder() {
         return new QueueBuilder(this);
     }
+    RenderBundleBuilder* DeviceBase::CreateRenderBundleBuilder() {
+        return new RenderBundleBuilder(this);
+    }
     SamplerBuilder* DeviceBase::CreateSamplerBuilder() {
         return new SamplerBuilder(this);
     }
@@ -113,4 +129,18 @@ namespace backend {
         // TODO(cwallez@chromium.org): update state tracking then call the backend
     }
 
+    void DeviceBase::Tick() {
+        TickImpl();
+
+        // A fence stays in the list while it has callbacks, callbacks added by the calls for a
+        // fence that had none put it back in the list.
+        std::vector<Ref<FenceBase>> fences;
+        std::swap(fences, fencesWithCallbacks);
+        for (auto& fence : fences) {
+            if (fence->CallCompletedCallbacks()) {
+                fencesWithCallbacks.push_back(std::move(fence));
+            }
+        }
+    }
+
 }
@@ -5,11 +5,14 @@
 #ifndef BACKEND_COMMON_DEVICEBASE_H_
 #define BACKEND_COMMON_DEVICEBASE_H_
 
+#include "common/CommandAllocator.h"
 #include "common/Forward.h"
 #include "common/RefCounted.h"
 
 #include "nxt/nxtcpp.h"
 
+#include <vector>
+
 namespace backend {
 
     using ErrorCallback = void (*)(const char* errorMessage, void* userData);
@@ -27,10 +30,12 @@ namespace backend {
             virtual BufferBase* CreateBuffer(BufferBuilder* builder) = 0;
             virtual BufferViewBase* CreateBufferView(BufferViewBuilder* builder) = 0;
             virtual CommandBufferBase* CreateCommandBuffer(CommandBufferBuilder* builder) = 0;
+            virtual FenceBase* CreateFence(FenceBuilder* builder) = 0;
             virtual InputStateBase* CreateInputState(InputStateBuilder* builder) = 0;
             virtual PipelineBase* CreatePipeline(PipelineBuilder* builder) = 0;
             virtual PipelineLayoutBase* CreatePipelineLayout(PipelineLayoutBuilder* builder) = 0;
             virtual QueueBase* CreateQueue(QueueBuilder* builder) = 0;
+            virtual RenderBundleBase* CreateRenderBundle(RenderBundleBuilder* builder) = 0;
             virtual SamplerBase* CreateSampler(SamplerBuilder* builder) = 0;
             virtual ShaderModuleBase* CreateShaderModule(ShaderModuleBuilder* builder) = 0;
             virtual TextureBase* CreateTexture(TextureBuilder* builder) = 0;
@@ -53,21 +58,35 @@ namespace backend {
             BindGroupLayoutBase* GetOrCreateBindGroupLayout(const BindGroupLayoutBase* blueprint, BindGroupLayoutBuilder* builder);
             void UncacheBindGroupLayout(BindGroupLayoutBase* obj);
 
+            // All the command buffers of the device allocate their commands from this pool.
+            CommandBlockPool* GetCommandBlockPool();
+
+            // The fences with completion callbacks are looked at on each tick.
+            void AddFenceWithCallbacks(FenceBase* fence);
+
             // NXT API
             BindGroupBuilder* CreateBindGroupBuilder();
             BindGroupLayoutBuilder* CreateBindGroupLayoutBuilder();
             BufferBuilder* CreateBufferBuilder();
             BufferViewBuilder* CreateBufferViewBuilder();
             CommandBufferBuilder* CreateCommandBufferBuilder();
+            FenceBuilder* CreateFenceBuilder();
             InputStateBuilder* CreateInputStateBuilder();
             PipelineBuilder* CreatePipelineBuilder();
             PipelineLayoutBuilder* CreatePipelineLayoutBuilder();
             QueueBuilder* CreateQueueBuilder();
+            RenderBundleBuilder* CreateRenderBundleBuilder();
             SamplerBuilder* CreateSamplerBuilder();
             ShaderModuleBuilder* CreateShaderModuleBuilder();
             TextureBuilder* CreateTextureBuilder();
 
             void CopyBindGroups(uint32_t start, uint32_t count, BindGroupBase* source, BindGroupBase* target);
+            void Tick();
+
+        protected:
+            // Updates the completed values of the fences from the progress of the GPU, without
+            // blocking.
+            virtual void TickImpl() = 0;
 
         private:
             // The object caches aren't exposed in the header as they would require a lot of
@@ -75,6 +94,9 @@ namespace backend {
             struct Caches;
             Caches* caches = nullptr;
 
+            CommandBlockPool commandBlockPool;
+            std::vector<Ref<FenceBase>> fencesWithCallbacks;
+
             ErrorCallback errorCallback = nullptr;
             void* errorUserData = nullptr;
     };
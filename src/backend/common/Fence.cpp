@@ -0,0 +1,98 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "Fence.h"
+
+#include "Device.h"
+
+#include <algorithm>
+
+namespace backend {
+
+    // FenceBase
+
+    FenceBase::FenceBase(FenceBuilder* builder)
+        : device(builder->device), signaledValue(builder->initialValue), completedValue(builder->initialValue) {
+    }
+
+    uint64_t FenceBase::GetSignaledValue() const {
+        return signaledValue;
+    }
+
+    uint64_t FenceBase::GetCompletedValue() const {
+        return completedValue;
+    }
+
+    void FenceBase::SetSignaledValue(uint64_t value) {
+        ASSERT(value > signaledValue);
+        signaledValue = value;
+    }
+
+    void FenceBase::SetCompletedValue(uint64_t value) {
+        ASSERT(value > completedValue && value <= signaledValue);
+        completedValue = value;
+    }
+
+    bool FenceBase::CallCompletedCallbacks() {
+        // The callbacks can add callbacks to this fence so they are removed before being called.
+        auto firstWaiting = std::stable_partition(callbacks.begin(), callbacks.end(), [this](const Callback& callback) {
+            return callback.value <= completedValue;
+        });
+        std::vector<Callback> completed(callbacks.begin(), firstWaiting);
+        callbacks.erase(callbacks.begin(), firstWaiting);
+        bool waiting = !callbacks.empty();
+
+        std::stable_sort(completed.begin(), completed.end(), [](const Callback& a, const Callback& b) {
+            return a.value < b.value;
+        });
+        for (const auto& callback : completed) {
+            callback.callback(callback.userdata);
+        }
+
+        return waiting;
+    }
+
+    void FenceBase::OnCompletion(uint64_t value, nxtFenceOnCompletionCallback callback, nxtCallbackUserdata userdata) {
+        if (value > signaledValue) {
+            device->HandleError("Fence completion callback set for a value that wasn't signaled");
+            return;
+        }
+
+        // The device ticks the fences that have callbacks, even when they are already completed
+        // so that callbacks are never called synchronously.
+        if (callbacks.empty()) {
+            device->AddFenceWithCallbacks(this);
+        }
+        callbacks.push_back({value, callback, userdata});
+    }
+
+    // FenceBuilder
+
+    enum FenceSetProperties {
+        FENCE_PROPERTY_INITIAL_VALUE = 0x1,
+    };
+
+    FenceBuilder::FenceBuilder(DeviceBase* device) : device(device) {
+    }
+
+    bool FenceBuilder::WasConsumed() const {
+        return consumed;
+    }
+
+    FenceBase* FenceBuilder::GetResult() {
+        consumed = true;
+        return device->CreateFence(this);
+    }
+
+    void FenceBuilder::SetInitialValue(uint64_t value) {
+        if ((propertiesSet & FENCE_PROPERTY_INITIAL_VALUE) != 0) {
+            device->HandleError("Fence initial value property set multiple times");
+            return;
+        }
+
+        initialValue = value;
+        propertiesSet |= FENCE_PROPERTY_INITIAL_VALUE;
+    }
+
+}
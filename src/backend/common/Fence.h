@@ -0,0 +1,73 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_COMMON_FENCE_H_
+#define BACKEND_COMMON_FENCE_H_
+
+#include "Forward.h"
+#include "RefCounted.h"
+
+#include "nxt/nxtcpp.h"
+
+#include <vector>
+
+namespace backend {
+
+    // A value that is signaled by queues and completed once the GPU finished the work submitted
+    // before the signal. Completion callbacks are called from DeviceBase::Tick.
+    class FenceBase : public RefCounted {
+        public:
+            FenceBase(FenceBuilder* builder);
+
+            uint64_t GetSignaledValue() const;
+            uint64_t GetCompletedValue() const;
+
+            // Called by the backends when a queue signals the fence and when the GPU reaches the
+            // signal.
+            void SetSignaledValue(uint64_t value);
+            void SetCompletedValue(uint64_t value);
+
+            // Calls the callbacks of the completed values, in the order of the values. Returns
+            // whether callbacks are still waiting, not counting the ones the calls added.
+            bool CallCompletedCallbacks();
+
+            // NXT API
+            void OnCompletion(uint64_t value, nxtFenceOnCompletionCallback callback, nxtCallbackUserdata userdata);
+
+        private:
+            DeviceBase* device;
+            uint64_t signaledValue;
+            uint64_t completedValue;
+
+            struct Callback {
+                uint64_t value;
+                nxtFenceOnCompletionCallback callback;
+                nxtCallbackUserdata userdata;
+            };
+            std::vector<Callback> callbacks;
+    };
+
+    class FenceBuilder : public RefCounted {
+        public:
+            FenceBuilder(DeviceBase* device);
+
+            bool WasConsumed() const;
+
+            // NXT API
+            FenceBase* GetResult();
+            void SetInitialValue(uint64_t value);
+
+        private:
+            friend class FenceBase;
+
+            DeviceBase* device;
+            int propertiesSet = 0;
+            bool consumed = false;
+
+            uint64_t initialValue = 0;
+    };
+
+}
+
+#endif // BACKEND_COMMON_FENCE_H_
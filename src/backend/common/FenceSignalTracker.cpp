@@ -0,0 +1,22 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "FenceSignalTracker.h"
+
+namespace backend {
+
+    void FenceSignalTracker::AddSignal(FenceBase* fence, uint64_t value, uint64_t serial) {
+        ASSERT(signalsInFlight.empty() || signalsInFlight.back().serial < serial);
+        signalsInFlight.push_back({fence, value, serial});
+    }
+
+    void FenceSignalTracker::CompleteSignals(uint64_t completedSerial) {
+        while (!signalsInFlight.empty() && signalsInFlight.front().serial <= completedSerial) {
+            Signal& signal = signalsInFlight.front();
+            signal.fence->SetCompletedValue(signal.value);
+            signalsInFlight.pop_front();
+        }
+    }
+
+}
@@ -0,0 +1,33 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_COMMON_FENCESIGNALTRACKER_H_
+#define BACKEND_COMMON_FENCESIGNALTRACKER_H_
+
+#include "Fence.h"
+
+#include <deque>
+
+namespace backend {
+
+    // Keeps the fences signaled by a queue until the GPU is done with the work submitted before
+    // the signal. Backends give each signal an increasing serial and only need to know the last
+    // serial the GPU completed, which completes all the signals before it too.
+    class FenceSignalTracker {
+        public:
+            void AddSignal(FenceBase* fence, uint64_t value, uint64_t serial);
+            void CompleteSignals(uint64_t completedSerial);
+
+        private:
+            struct Signal {
+                Ref<FenceBase> fence;
+                uint64_t value;
+                uint64_t serial;
+            };
+            std::deque<Signal> signalsInFlight;
+    };
+
+}
+
+#endif // BACKEND_COMMON_FENCESIGNALTRACKER_H_
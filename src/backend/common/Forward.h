@@ -22,6 +22,8 @@ namespace backend {
     class BufferViewBuilder;
     class CommandBufferBase;
     class CommandBufferBuilder;
+    class FenceBase;
+    class FenceBuilder;
     class InputStateBase;
     class InputStateBuilder;
     class PipelineBase;
@@ -30,6 +32,8 @@ namespace backend {
     class PipelineLayoutBuilder;
     class QueueBase;
     class QueueBuilder;
+    class RenderBundleBase;
+    class RenderBundleBuilder;
     class SamplerBase;
     class SamplerBuilder;
     class ShaderModuleBase;
@@ -0,0 +1,211 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "RenderBundle.h"
+
+#include "BindGroup.h"
+#include "Buffer.h"
+#include "Commands.h"
+#include "Device.h"
+#include "Pipeline.h"
+
+#include <cstring>
+
+namespace backend {
+
+    // RenderBundleBase
+
+    RenderBundleBase::RenderBundleBase(RenderBundleBuilder* builder)
+        : commands(builder->AcquireCommands()), references(builder->AcquireReferences()) {
+    }
+
+    RenderBundleBase::~RenderBundleBase() {
+        FreeCommands(&commands, &references);
+    }
+
+    CommandIterator* RenderBundleBase::GetCommands() {
+        return &commands;
+    }
+
+    // RenderBundleBuilder
+
+    RenderBundleBuilder::RenderBundleBuilder(DeviceBase* device)
+        : device(device), allocator(device->GetCommandBlockPool()), state(device) {
+    }
+
+    RenderBundleBuilder::~RenderBundleBuilder() {
+        if (!consumed) {
+            MoveToIterator();
+            FreeCommands(&iterator, &references);
+        }
+    }
+
+    bool RenderBundleBuilder::WasConsumed() const {
+        return consumed;
+    }
+
+    bool RenderBundleBuilder::ValidateGetResult() {
+        // Each command was validated when it was recorded. The commands stay in the allocator
+        // so that GetResult can pack them, a builder with an error frees them when it is reset
+        // or destroyed.
+        return !state.HasError();
+    }
+
+    const CommandBufferStateTracker::ElidedCommandCounts& RenderBundleBuilder::GetElidedCommandCounts() const {
+        return state.GetElidedCommandCounts();
+    }
+
+    CommandIterator RenderBundleBuilder::AcquireCommands() {
+        return std::move(iterator);
+    }
+
+    CommandReferences RenderBundleBuilder::AcquireReferences() {
+        return std::move(references);
+    }
+
+    RenderBundleBase* RenderBundleBuilder::GetResult() {
+        // Bundles are executed many times, keep them in a single block. The commands of a
+        // builder with an error are about to be freed so they aren't packed.
+        if (!state.HasError()) {
+            allocator.Compact();
+        }
+        MoveToIterator();
+        consumed = true;
+        return device->CreateRenderBundle(this);
+    }
+
+    void RenderBundleBuilder::DrawArrays(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+        if (!state.ValidateCanDrawArrays()) {
+            return;
+        }
+
+        DrawArraysCmd* draw = allocator.Allocate<DrawArraysCmd>(Command::DrawArrays);
+        new(draw) DrawArraysCmd;
+        draw->vertexCount = vertexCount;
+        draw->instanceCount = instanceCount;
+        draw->firstVertex = firstVertex;
+        draw->firstInstance = firstInstance;
+    }
+
+    void RenderBundleBuilder::DrawArraysIndirect(BufferBase* buffer, uint32_t offset) {
+        if (!state.ValidateCanDrawArraysIndirect(buffer, offset)) {
+            return;
+        }
+
+        DrawArraysIndirectCmd* draw = allocator.Allocate<DrawArraysIndirectCmd>(Command::DrawArraysIndirect);
+        new(draw) DrawArraysIndirectCmd;
+        draw->buffer = buffer;
+        references.Add(buffer);
+        draw->offset = offset;
+    }
+
+    void RenderBundleBuilder::DrawElements(uint32_t indexCount, uint32_t instanceCount, uint32_t firstIndex, uint32_t firstInstance) {
+        if (!state.ValidateCanDrawElements()) {
+            return;
+        }
+
+        DrawElementsCmd* draw = allocator.Allocate<DrawElementsCmd>(Command::DrawElements);
+        new(draw) DrawElementsCmd;
+        draw->indexCount = indexCount;
+        draw->instanceCount = instanceCount;
+        draw->firstIndex = firstIndex;
+        draw->firstInstance = firstInstance;
+    }
+
+    void RenderBundleBuilder::DrawElementsIndirect(BufferBase* buffer, uint32_t offset) {
+        if (!state.ValidateCanDrawElementsIndirect(buffer, offset)) {
+            return;
+        }
+
+        DrawElementsIndirectCmd* draw = allocator.Allocate<DrawElementsIndirectCmd>(Command::DrawElementsIndirect);
+        new(draw) DrawElementsIndirectCmd;
+        draw->buffer = buffer;
+        references.Add(buffer);
+        draw->offset = offset;
+    }
+
+    void RenderBundleBuilder::SetPipeline(PipelineBase* pipeline) {
+        if (pipeline->IsCompute()) {
+            state.HandleError("Render bundles can only use render pipelines");
+            return;
+        }
+        if (state.ElidePipeline(pipeline) || !state.SetPipeline(pipeline)) {
+            return;
+        }
+
+        SetPipelineCmd* cmd = allocator.Allocate<SetPipelineCmd>(Command::SetPipeline);
+        new(cmd) SetPipelineCmd;
+        cmd->pipeline = pipeline;
+        references.Add(pipeline);
+    }
+
+    void RenderBundleBuilder::SetPushConstants(nxt::ShaderStageBit stage, uint32_t offset, uint32_t count, const void* data) {
+        if (!state.ValidateSetPushConstants(offset, count)) {
+            return;
+        }
+
+        SetPushConstantsCmd* cmd = allocator.Allocate<SetPushConstantsCmd>(Command::SetPushConstants);
+        new(cmd) SetPushConstantsCmd;
+        cmd->stage = stage;
+        cmd->offset = offset;
+        cmd->count = count;
+
+        uint32_t* values = allocator.AllocateData<uint32_t>(count);
+        memcpy(values, data, count * sizeof(uint32_t));
+    }
+
+    void RenderBundleBuilder::SetBindGroup(uint32_t groupIndex, BindGroupBase* group) {
+        if (state.ElideBindGroup(groupIndex, group) || !state.SetBindGroup(groupIndex, group)) {
+            return;
+        }
+
+        SetBindGroupCmd* cmd = allocator.Allocate<SetBindGroupCmd>(Command::SetBindGroup);
+        new(cmd) SetBindGroupCmd;
+        cmd->index = groupIndex;
+        cmd->group = group;
+        references.Add(group);
+    }
+
+    void RenderBundleBuilder::SetIndexBuffer(BufferBase* buffer, uint32_t offset, nxt::IndexFormat format) {
+        if (state.ElideIndexBuffer(buffer, offset, format) || !state.SetIndexBuffer(buffer, offset, format)) {
+            return;
+        }
+
+        SetIndexBufferCmd* cmd = allocator.Allocate<SetIndexBufferCmd>(Command::SetIndexBuffer);
+        new(cmd) SetIndexBufferCmd;
+        cmd->buffer = buffer;
+        references.Add(buffer);
+        cmd->offset = offset;
+        cmd->format = format;
+    }
+
+    void RenderBundleBuilder::SetVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, uint32_t const* offsets){
+        if (state.ElideVertexBuffers(startSlot, count, buffers, offsets) ||
+            !state.SetVertexBuffers(startSlot, count, buffers, offsets)) {
+            return;
+        }
+
+        SetVertexBuffersCmd* cmd = allocator.Allocate<SetVertexBuffersCmd>(Command::SetVertexBuffers);
+        new(cmd) SetVertexBuffersCmd;
+        cmd->startSlot = startSlot;
+        cmd->count = count;
+
+        BufferBase** cmdBuffers = allocator.AllocateData<BufferBase*>(count);
+        for (size_t i = 0; i < count; ++i) {
+            cmdBuffers[i] = buffers[i];
+            references.Add(buffers[i]);
+        }
+
+        uint32_t* cmdOffsets = allocator.AllocateData<uint32_t>(count);
+        memcpy(cmdOffsets, offsets, count * sizeof(uint32_t));
+    }
+
+    void RenderBundleBuilder::MoveToIterator() {
+        if (!movedToIterator) {
+            iterator = std::move(allocator);
+            movedToIterator = true;
+        }
+    }
+
+}
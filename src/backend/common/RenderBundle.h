@@ -0,0 +1,84 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_COMMON_RENDERBUNDLE_H_
+#define BACKEND_COMMON_RENDERBUNDLE_H_
+
+#include "CommandAllocator.h"
+#include "CommandBufferStateTracker.h"
+#include "CommandReferences.h"
+#include "Forward.h"
+#include "RefCounted.h"
+
+#include "nxt/nxtcpp.h"
+
+#include <type_traits>
+
+namespace backend {
+
+    // A render bundle is a list of render commands that is recorded and validated once, then
+    // executed from any number of command buffers with an ExecuteBundle command. Bundles start
+    // from an empty state: they must set their own pipeline, bind groups and buffers.
+    class RenderBundleBase : public RefCounted {
+        public:
+            RenderBundleBase(RenderBundleBuilder* builder);
+            ~RenderBundleBase();
+
+            // Backends replay the bundle by iterating over these commands, the iterator is reset
+            // at the end of the iteration so the bundle can be executed again.
+            CommandIterator* GetCommands();
+
+        private:
+            CommandIterator commands;
+            CommandReferences references;
+    };
+
+    class RenderBundleBuilder : public RefCounted {
+        public:
+            RenderBundleBuilder(DeviceBase* device);
+            ~RenderBundleBuilder();
+
+            bool WasConsumed() const;
+            bool ValidateGetResult();
+
+            // The number of state changes that were dropped because they didn't change anything.
+            const CommandBufferStateTracker::ElidedCommandCounts& GetElidedCommandCounts() const;
+
+            CommandIterator AcquireCommands();
+            CommandReferences AcquireReferences();
+
+            // NXT API
+            RenderBundleBase* GetResult();
+
+            void DrawArrays(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance);
+            void DrawArraysIndirect(BufferBase* buffer, uint32_t offset);
+            void DrawElements(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstIndex, uint32_t firstInstance);
+            void DrawElementsIndirect(BufferBase* buffer, uint32_t offset);
+            void SetPushConstants(nxt::ShaderStageBit stage, uint32_t offset, uint32_t count, const void* data);
+            void SetPipeline(PipelineBase* pipeline);
+            void SetBindGroup(uint32_t groupIndex, BindGroupBase* group);
+            void SetIndexBuffer(BufferBase* buffer, uint32_t offset, nxt::IndexFormat format);
+
+            template<typename T>
+            void SetVertexBuffers(uint32_t startSlot, uint32_t count, T* const* buffers, uint32_t const* offsets) {
+                static_assert(std::is_base_of<BufferBase, T>::value, "");
+                SetVertexBuffers(startSlot, count, reinterpret_cast<BufferBase* const*>(buffers), offsets);
+            }
+            void SetVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, uint32_t const* offsets);
+
+        private:
+            void MoveToIterator();
+
+            DeviceBase* device;
+            CommandAllocator allocator;
+            CommandIterator iterator;
+            CommandReferences references;
+            CommandBufferStateTracker state;
+            bool consumed = false;
+            bool movedToIterator = false;
+    };
+
+}
+
+#endif // BACKEND_COMMON_RENDERBUNDLE_H_
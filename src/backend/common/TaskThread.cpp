@@ -0,0 +1,115 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "TaskThread.h"
+
+#include "RefCounted.h"
+
+#include <cassert>
+#define ASSERT assert
+
+namespace backend {
+
+    constexpr uint64_t TaskThread::kCapacity;
+
+    TaskThread::TaskThread()
+        : tasks(kCapacity), posted(0), executed(0), sleeping(false) {
+        thread = std::thread(&TaskThread::ThreadMain, this);
+    }
+
+    TaskThread::~TaskThread() {
+        // Only the task thread looks at stopping, so it is set by the last task.
+        Post([this]() {
+            stopping = true;
+        });
+        thread.join();
+        ReleaseExecutedTasks();
+    }
+
+    bool TaskThread::IsCurrentThread() const {
+        return std::this_thread::get_id() == thread.get_id();
+    }
+
+    void TaskThread::Post(std::function<void()> task, std::vector<RefCounted*> references) {
+        ASSERT(!IsCurrentThread());
+
+        ReleaseExecutedTasks();
+        while (posted.load(std::memory_order_relaxed) - released == kCapacity) {
+            std::this_thread::yield();
+            ReleaseExecutedTasks();
+        }
+
+        for (RefCounted* object : references) {
+            object->ReferenceInternal();
+        }
+
+        // Releasing tasks can post more tasks, so the serial is only read once there is room.
+        uint64_t serial = posted.load(std::memory_order_relaxed);
+        Task& slot = tasks[serial % kCapacity];
+        slot.function = std::move(task);
+        slot.references = std::move(references);
+
+        // Sequentially consistent with the load of sleeping so that either the task thread sees
+        // the task before going to sleep, or this thread sees it sleeping and wakes it up.
+        posted.store(serial + 1);
+        if (sleeping.load()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            condition.notify_all();
+        }
+    }
+
+    void TaskThread::WaitForIdle() {
+        bool idle = false;
+        Post([this, &idle]() {
+            std::lock_guard<std::mutex> lock(mutex);
+            idle = true;
+            condition.notify_all();
+        });
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [&idle]() {
+                return idle;
+            });
+        }
+        ReleaseExecutedTasks();
+    }
+
+    void TaskThread::ThreadMain() {
+        while (!stopping) {
+            uint64_t serial = executed.load(std::memory_order_relaxed);
+
+            if (posted.load(std::memory_order_acquire) == serial) {
+                std::unique_lock<std::mutex> lock(mutex);
+                sleeping.store(true);
+                condition.wait(lock, [this, serial]() {
+                    return posted.load() != serial;
+                });
+                sleeping.store(false);
+                continue;
+            }
+
+            tasks[serial % kCapacity].function();
+            executed.store(serial + 1, std::memory_order_release);
+        }
+    }
+
+    void TaskThread::ReleaseExecutedTasks() {
+        // Destroying a task or releasing its references can post other tasks, which release
+        // executed tasks too, so released is read again for each task.
+        while (released != executed.load(std::memory_order_acquire)) {
+            Task& slot = tasks[released % kCapacity];
+            std::function<void()> function = std::move(slot.function);
+            std::vector<RefCounted*> references = std::move(slot.references);
+            slot.function = nullptr;
+            slot.references.clear();
+            released ++;
+
+            for (RefCounted* object : references) {
+                object->ReleaseInternal();
+            }
+        }
+    }
+
+}
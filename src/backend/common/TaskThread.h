@@ -0,0 +1,70 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_COMMON_TASKTHREAD_H_
+#define BACKEND_COMMON_TASKTHREAD_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace backend {
+
+    class RefCounted;
+
+    // A thread that runs the tasks posted by a single other thread, in order. Backends use it to
+    // move all the calls to a native API that is bound to a thread (like a GL context) off the
+    // application thread.
+    //
+    // Tasks go through a fixed size ring that is lock-free unless the task thread is asleep.
+    // The objects a task uses are referenced until it ran, and both the task and the references
+    // are released on the posting thread so that destructors never run on the task thread.
+    class TaskThread {
+        public:
+            TaskThread();
+            // Runs the tasks that were posted then joins the thread.
+            ~TaskThread();
+
+            bool IsCurrentThread() const;
+
+            // Must be called from the posting thread. Blocks if the ring is full.
+            void Post(std::function<void()> task, std::vector<RefCounted*> references = {});
+
+            // Returns when all the tasks posted so far ran, and releases them.
+            void WaitForIdle();
+
+        private:
+            void ThreadMain();
+            void ReleaseExecutedTasks();
+
+            struct Task {
+                std::function<void()> function;
+                std::vector<RefCounted*> references;
+            };
+            static constexpr uint64_t kCapacity = 1024;
+            std::vector<Task> tasks;
+
+            // Serials of tasks, a task is in tasks[serial % kCapacity]. Tasks in [released, executed)
+            // ran and wait to be released by the posting thread, the ones in [executed, posted)
+            // wait to run.
+            std::atomic<uint64_t> posted;
+            std::atomic<uint64_t> executed;
+            uint64_t released = 0;
+
+            // The task thread sleeps when the ring is empty.
+            std::mutex mutex;
+            std::condition_variable condition;
+            std::atomic<bool> sleeping;
+            bool stopping = false;
+
+            std::thread thread;
+    };
+
+}
+
+#endif // BACKEND_COMMON_TASKTHREAD_H_
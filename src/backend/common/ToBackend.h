@@ -38,6 +38,11 @@ namespace backend {
         using BackendType = typename BackendTraits::CommandBufferType;
     };
 
+    template<typename BackendTraits>
+    struct ToBackendTraits<FenceBase, BackendTraits> {
+        using BackendType = typename BackendTraits::FenceType;
+    };
+
     template<typename BackendTraits>
     struct ToBackendTraits<InputStateBase, BackendTraits> {
         using BackendType = typename BackendTraits::InputStateType;
@@ -58,6 +63,11 @@ namespace backend {
         using BackendType = typename BackendTraits::QueueType;
     };
 
+    template<typename BackendTraits>
+    struct ToBackendTraits<RenderBundleBase, BackendTraits> {
+        using BackendType = typename BackendTraits::RenderBundleType;
+    };
+
     template<typename BackendTraits>
     struct ToBackendTraits<SamplerBase, BackendTraits> {
         using BackendType = typename BackendTraits::SamplerType;
@@ -0,0 +1,89 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "WorkerPool.h"
+
+namespace backend {
+
+    WorkerPool::WorkerPool(uint32_t numThreads) : nextIndex(0) {
+        for (uint32_t i = 0; i < numThreads; ++i) {
+            threads.emplace_back(&WorkerPool::WorkerMain, this);
+        }
+    }
+
+    WorkerPool::~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        workAvailable.notify_all();
+
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    uint32_t WorkerPool::GetNumThreads() const {
+        return static_cast<uint32_t>(threads.size());
+    }
+
+    void WorkerPool::ParallelFor(size_t count, const std::function<void(size_t)>& task) {
+        if (threads.empty() || count <= 1) {
+            for (size_t i = 0; i < count; ++i) {
+                task(i);
+            }
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            this->task = &task;
+            this->count = count;
+            nextIndex = 0;
+            busyWorkers = static_cast<uint32_t>(threads.size());
+            generation++;
+        }
+        workAvailable.notify_all();
+
+        RunTasks();
+
+        // All the workers have to be done with the loop before the task goes away.
+        std::unique_lock<std::mutex> lock(mutex);
+        workDone.wait(lock, [this]() { return busyWorkers == 0; });
+        this->task = nullptr;
+    }
+
+    void WorkerPool::WorkerMain() {
+        uint64_t lastGeneration = 0;
+
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                workAvailable.wait(lock, [&]() { return stopping || generation != lastGeneration; });
+                if (stopping) {
+                    return;
+                }
+                lastGeneration = generation;
+            }
+
+            RunTasks();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busyWorkers == 0) {
+                workDone.notify_one();
+            }
+        }
+    }
+
+    void WorkerPool::RunTasks() {
+        while (true) {
+            size_t index = nextIndex++;
+            if (index >= count) {
+                return;
+            }
+            (*task)(index);
+        }
+    }
+
+}
@@ -0,0 +1,55 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_COMMON_WORKERPOOL_H_
+#define BACKEND_COMMON_WORKERPOOL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace backend {
+
+    // A fixed set of threads that run the iterations of a loop along with the calling thread.
+    // Backends use it for CPU work that doesn't call the native API, which stays on the calling
+    // thread.
+    class WorkerPool {
+        public:
+            // The number of threads in addition to the calling thread, 0 runs everything inline.
+            WorkerPool(uint32_t numThreads);
+            ~WorkerPool();
+
+            uint32_t GetNumThreads() const;
+
+            // Calls task(i) for each i in [0, count) and returns when all the calls are done.
+            // The calls run concurrently, in any order.
+            void ParallelFor(size_t count, const std::function<void(size_t)>& task);
+
+        private:
+            void WorkerMain();
+            void RunTasks();
+
+            std::vector<std::thread> threads;
+
+            std::mutex mutex;
+            std::condition_variable workAvailable;
+            std::condition_variable workDone;
+            // Incremented for each loop so that workers run each of them once.
+            uint64_t generation = 0;
+            uint32_t busyWorkers = 0;
+            bool stopping = false;
+
+            // The current loop, the next iteration is taken with an atomic increment.
+            const std::function<void(size_t)>* task = nullptr;
+            size_t count = 0;
+            std::atomic<size_t> nextIndex;
+    };
+
+}
+
+#endif // BACKEND_COMMON_WORKERPOOL_H_
@@ -0,0 +1,305 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "CPUBackend.h"
+
+#include "ShaderModuleCPU.h"
+#include "common/Commands.h"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace backend {
+namespace cpu {
+    nxtProcTable GetNonValidatingProcs();
+    nxtProcTable GetValidatingProcs();
+
+    void Init(nxtProcTable* procs, nxtDevice* device) {
+        *procs = GetValidatingProcs();
+        *device = reinterpret_cast<nxtDevice>(new Device);
+    }
+
+    // Device
+
+    Device::Device()
+        : workerPool(std::max(std::thread::hardware_concurrency(), 1u) - 1) {
+    }
+
+    BindGroupBase* Device::CreateBindGroup(BindGroupBuilder* builder) {
+        return new BindGroup(builder);
+    }
+    BindGroupLayoutBase* Device::CreateBindGroupLayout(BindGroupLayoutBuilder* builder) {
+        return new BindGroupLayout(builder);
+    }
+    BufferBase* Device::CreateBuffer(BufferBuilder* builder) {
+        return new Buffer(builder);
+    }
+    BufferViewBase* Device::CreateBufferView(BufferViewBuilder* builder) {
+        return new BufferView(builder);
+    }
+    CommandBufferBase* Device::CreateCommandBuffer(CommandBufferBuilder* builder) {
+        return new CommandBuffer(this, builder);
+    }
+    FenceBase* Device::CreateFence(FenceBuilder* builder) {
+        return new Fence(builder);
+    }
+    InputStateBase* Device::CreateInputState(InputStateBuilder* builder) {
+        return new InputState(builder);
+    }
+    PipelineBase* Device::CreatePipeline(PipelineBuilder* builder) {
+        return new Pipeline(this, builder);
+    }
+    PipelineLayoutBase* Device::CreatePipelineLayout(PipelineLayoutBuilder* builder) {
+        return new PipelineLayout(builder);
+    }
+    QueueBase* Device::CreateQueue(QueueBuilder* builder) {
+        return new Queue(this, builder);
+    }
+    RenderBundleBase* Device::CreateRenderBundle(RenderBundleBuilder* builder) {
+        return new RenderBundle(builder);
+    }
+    SamplerBase* Device::CreateSampler(SamplerBuilder* builder) {
+        return new Sampler(builder);
+    }
+    ShaderModuleBase* Device::CreateShaderModule(ShaderModuleBuilder* builder) {
+        return new ShaderModule(this, builder);
+    }
+    TextureBase* Device::CreateTexture(TextureBuilder* builder) {
+        return new Texture(builder);
+    }
+    TextureViewBase* Device::CreateTextureView(TextureViewBuilder* builder) {
+        return new TextureView(builder);
+    }
+
+    void Device::TickImpl() {
+        fenceSignalTracker.CompleteSignals(lastSignalSerial);
+    }
+
+    WorkerPool* Device::GetWorkerPool() {
+        return &workerPool;
+    }
+
+    void Device::SignalFence(FenceBase* fence, uint64_t value) {
+        fenceSignalTracker.AddSignal(fence, value, ++lastSignalSerial);
+    }
+
+    void Device::Reference() {
+    }
+
+    void Device::Release() {
+    }
+
+    // Buffer
+
+    Buffer::Buffer(BufferBuilder* builder)
+        : BufferBase(builder), data(GetSize(), 0) {
+    }
+
+    uint8_t* Buffer::GetData() {
+        return data.data();
+    }
+
+    void Buffer::SetSubDataImpl(uint32_t start, uint32_t count, const uint32_t* source) {
+        memcpy(data.data() + start * sizeof(uint32_t), source, count * sizeof(uint32_t));
+    }
+
+    // CommandBuffer
+
+    CommandBuffer::CommandBuffer(Device* device, CommandBufferBuilder* builder)
+        : device(device), commands(builder->AcquireCommands()), references(builder->AcquireReferences()) {
+    }
+
+    CommandBuffer::~CommandBuffer() {
+        FreeCommands(&commands, &references);
+    }
+
+    namespace {
+
+        // The compute state set by the commands, it carries over into render bundles.
+        struct ComputeState {
+            Pipeline* pipeline = nullptr;
+            std::array<BindGroupBase*, kMaxBindGroups> bindGroups = {};
+            std::array<uint32_t, kMaxPushConstants> pushConstants = {};
+        };
+
+        void RunDispatch(Device* device, ComputeState* state, uint32_t x, uint32_t y, uint32_t z) {
+            if (state->pipeline == nullptr || state->pipeline->GetComputeEntryPoint() < 0) {
+                return;
+            }
+
+            SpirvResources resources;
+            for (uint32_t group = 0; group < kMaxBindGroups; ++group) {
+                BindGroupBase* bindGroup = state->bindGroups[group];
+                if (bindGroup == nullptr) {
+                    continue;
+                }
+
+                const auto& layout = bindGroup->GetLayout()->GetBindingInfo();
+                for (uint32_t binding = 0; binding < kMaxBindingsPerGroup; ++binding) {
+                    if (!layout.mask[binding] ||
+                        (layout.types[binding] != nxt::BindingType::UniformBuffer &&
+                         layout.types[binding] != nxt::BindingType::StorageBuffer)) {
+                        continue;
+                    }
+
+                    BufferViewBase* view = bindGroup->GetBindingAsBufferView(binding);
+                    Buffer* buffer = ToBackend(view->GetBuffer());
+                    resources.buffers[group][binding].data = buffer->GetData() + view->GetOffset();
+                    resources.buffers[group][binding].size = view->GetSize();
+                }
+            }
+            resources.pushConstants.data = reinterpret_cast<uint8_t*>(state->pushConstants.data());
+            resources.pushConstants.size = sizeof(state->pushConstants);
+
+            const ShaderModule* module = state->pipeline->GetComputeModule();
+            module->GetProgram().Dispatch(state->pipeline->GetComputeEntryPoint(), resources, x, y, z,
+                                          device->GetWorkerPool());
+        }
+
+        // Only the compute commands are executed, the render commands are read and skipped.
+        void ExecuteCommands(Device* device, CommandIterator* commands, ComputeState* state) {
+            Command type;
+            while (commands->NextCommandId(&type)) {
+                switch (type) {
+                    case Command::CopyBufferToTexture:
+                        commands->NextCommand<CopyBufferToTextureCmd>();
+                        break;
+
+                    case Command::Dispatch:
+                        {
+                            DispatchCmd* dispatch = commands->NextCommand<DispatchCmd>();
+                            RunDispatch(device, state, dispatch->x, dispatch->y, dispatch->z);
+                        }
+                        break;
+
+                    case Command::DispatchIndirect:
+                        {
+                            DispatchIndirectCmd* dispatch = commands->NextCommand<DispatchIndirectCmd>();
+                            Buffer* buffer = ToBackend(dispatch->buffer);
+
+                            uint32_t size[3];
+                            if (uint64_t(dispatch->offset) + sizeof(size) <= buffer->GetSize()) {
+                                memcpy(size, buffer->GetData() + dispatch->offset, sizeof(size));
+                                RunDispatch(device, state, size[0], size[1], size[2]);
+                            }
+                        }
+                        break;
+
+                    case Command::DrawArrays:
+                        commands->NextCommand<DrawArraysCmd>();
+                        break;
+
+                    case Command::DrawArraysIndirect:
+                        commands->NextCommand<DrawArraysIndirectCmd>();
+                        break;
+
+                    case Command::DrawElements:
+                        commands->NextCommand<DrawElementsCmd>();
+                        break;
+
+                    case Command::DrawElementsIndirect:
+                        commands->NextCommand<DrawElementsIndirectCmd>();
+                        break;
+
+                    case Command::ExecuteBundle:
+                        {
+                            ExecuteBundleCmd* cmd = commands->NextCommand<ExecuteBundleCmd>();
+                            ExecuteCommands(device, ToBackend(cmd->bundle)->GetCommands(), state);
+                        }
+                        break;
+
+                    case Command::SetPipeline:
+                        {
+                            SetPipelineCmd* cmd = commands->NextCommand<SetPipelineCmd>();
+                            state->pipeline = ToBackend(cmd->pipeline);
+                        }
+                        break;
+
+                    case Command::SetPushConstants:
+                        {
+                            SetPushConstantsCmd* cmd = commands->NextCommand<SetPushConstantsCmd>();
+                            uint32_t* values = commands->NextData<uint32_t>(cmd->count);
+                            if (cmd->stage & nxt::ShaderStageBit::Compute) {
+                                memcpy(&state->pushConstants[cmd->offset], values, cmd->count * sizeof(uint32_t));
+                            }
+                        }
+                        break;
+
+                    case Command::SetBindGroup:
+                        {
+                            SetBindGroupCmd* cmd = commands->NextCommand<SetBindGroupCmd>();
+                            state->bindGroups[cmd->index] = cmd->group;
+                        }
+                        break;
+
+                    case Command::SetIndexBuffer:
+                        commands->NextCommand<SetIndexBufferCmd>();
+                        break;
+
+                    case Command::SetVertexBuffers:
+                        {
+                            SetVertexBuffersCmd* cmd = commands->NextCommand<SetVertexBuffersCmd>();
+                            commands->NextData<BufferBase*>(cmd->count);
+                            commands->NextData<uint32_t>(cmd->count);
+                        }
+                        break;
+                }
+            }
+        }
+
+    }
+
+    void CommandBuffer::Execute() {
+        ComputeState state;
+        ExecuteCommands(device, &commands, &state);
+    }
+
+    // Pipeline
+
+    Pipeline::Pipeline(Device* device, PipelineBuilder* builder)
+        : PipelineBase(builder) {
+        if (!IsCompute()) {
+            return;
+        }
+
+        // A module the interpreter doesn't support already produced an error, its dispatches
+        // are skipped.
+        const auto& stageInfo = builder->GetStageInfo(nxt::ShaderStage::Compute);
+        computeModule = const_cast<ShaderModule*>(ToBackend(stageInfo.module.Get()));
+        computeEntryPoint = computeModule->GetProgram().FindEntryPoint(stageInfo.entryPoint);
+    }
+
+    const ShaderModule* Pipeline::GetComputeModule() const {
+        return computeModule.Get();
+    }
+
+    int Pipeline::GetComputeEntryPoint() const {
+        return computeEntryPoint;
+    }
+
+    // Queue
+
+    Queue::Queue(Device* device, QueueBuilder* builder)
+        : device(device) {
+    }
+
+    void Queue::Signal(Fence* fence, uint64_t value) {
+        if (value <= fence->GetSignaledValue()) {
+            device->HandleError("Fence signaled with a value that isn't greater than the signaled value");
+            return;
+        }
+
+        fence->SetSignaledValue(value);
+        device->SignalFence(fence, value);
+    }
+
+    void Queue::Submit(uint32_t numCommands, CommandBuffer* const * commands) {
+        for (uint32_t i = 0; i < numCommands; ++i) {
+            commands[i]->Execute();
+        }
+    }
+
+}
+}
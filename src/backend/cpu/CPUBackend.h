@@ -0,0 +1,171 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_CPU_CPUBACKEND_H_
+#define BACKEND_CPU_CPUBACKEND_H_
+
+#include "nxt/nxtcpp.h"
+
+#include "common/Buffer.h"
+#include "common/BindGroup.h"
+#include "common/BindGroupLayout.h"
+#include "common/Device.h"
+#include "common/CommandAllocator.h"
+#include "common/CommandBuffer.h"
+#include "common/CommandReferences.h"
+#include "common/Fence.h"
+#include "common/FenceSignalTracker.h"
+#include "common/InputState.h"
+#include "common/Pipeline.h"
+#include "common/PipelineLayout.h"
+#include "common/Queue.h"
+#include "common/RenderBundle.h"
+#include "common/Sampler.h"
+#include "common/Texture.h"
+#include "common/ToBackend.h"
+#include "common/WorkerPool.h"
+
+#include <memory>
+#include <vector>
+
+// The CPU backend is a reference implementation of compute: buffers live in host memory and
+// compute pipelines run by interpreting their SPIR-V, so results can be checked without a GPU.
+// Render commands and copies are validated but not executed.
+
+namespace backend {
+namespace cpu {
+
+    using BindGroup = BindGroupBase;
+    using BindGroupLayout = BindGroupLayoutBase;
+    class Buffer;
+    using BufferView = BufferViewBase;
+    class CommandBuffer;
+    class Device;
+    using Fence = FenceBase;
+    using InputState = InputStateBase;
+    class Pipeline;
+    using PipelineLayout = PipelineLayoutBase;
+    class Queue;
+    using RenderBundle = RenderBundleBase;
+    using Sampler = SamplerBase;
+    class ShaderModule;
+    using Texture = TextureBase;
+    using TextureView = TextureViewBase;
+
+    struct CPUBackendTraits {
+        using BindGroupType = BindGroup;
+        using BindGroupLayoutType = BindGroupLayout;
+        using BufferType = Buffer;
+        using BufferViewType = BufferView;
+        using CommandBufferType = CommandBuffer;
+        using FenceType = Fence;
+        using InputStateType = InputState;
+        using PipelineType = Pipeline;
+        using PipelineLayoutType = PipelineLayout;
+        using QueueType = Queue;
+        using RenderBundleType = RenderBundle;
+        using SamplerType = Sampler;
+        using ShaderModuleType = ShaderModule;
+        using TextureType = Texture;
+        using TextureViewType = TextureView;
+    };
+
+    template<typename T>
+    auto ToBackend(T&& common) -> decltype(ToBackendBase<CPUBackendTraits>(common)) {
+        return ToBackendBase<CPUBackendTraits>(common);
+    }
+
+    class Device : public DeviceBase {
+        public:
+            Device();
+
+            BindGroupBase* CreateBindGroup(BindGroupBuilder* builder) override;
+            BindGroupLayoutBase* CreateBindGroupLayout(BindGroupLayoutBuilder* builder) override;
+            BufferBase* CreateBuffer(BufferBuilder* builder) override;
+            BufferViewBase* CreateBufferView(BufferViewBuilder* builder) override;
+            CommandBufferBase* CreateCommandBuffer(CommandBufferBuilder* builder) override;
+            FenceBase* CreateFence(FenceBuilder* builder) override;
+            InputStateBase* CreateInputState(InputStateBuilder* builder) override;
+            PipelineBase* CreatePipeline(PipelineBuilder* builder) override;
+            PipelineLayoutBase* CreatePipelineLayout(PipelineLayoutBuilder* builder) override;
+            QueueBase* CreateQueue(QueueBuilder* builder) override;
+            RenderBundleBase* CreateRenderBundle(RenderBundleBuilder* builder) override;
+            SamplerBase* CreateSampler(SamplerBuilder* builder) override;
+            ShaderModuleBase* CreateShaderModule(ShaderModuleBuilder* builder) override;
+            TextureBase* CreateTexture(TextureBuilder* builder) override;
+            TextureViewBase* CreateTextureView(TextureViewBuilder* builder) override;
+
+            void TickImpl() override;
+
+            // Dispatches run on all the cores, the calling thread included.
+            WorkerPool* GetWorkerPool();
+
+            // Submit runs the commands before returning, so the signal completes on the next
+            // tick.
+            void SignalFence(FenceBase* fence, uint64_t value);
+
+            // NXT API
+            void Reference();
+            void Release();
+
+        private:
+            WorkerPool workerPool;
+            FenceSignalTracker fenceSignalTracker;
+            uint64_t lastSignalSerial = 0;
+    };
+
+    class Buffer : public BufferBase {
+        public:
+            Buffer(BufferBuilder* builder);
+
+            uint8_t* GetData();
+
+        private:
+            void SetSubDataImpl(uint32_t start, uint32_t count, const uint32_t* data) override;
+
+            std::vector<uint8_t> data;
+    };
+
+    class CommandBuffer : public CommandBufferBase {
+        public:
+            CommandBuffer(Device* device, CommandBufferBuilder* builder);
+            ~CommandBuffer();
+
+            void Execute();
+
+        private:
+            Device* device;
+            CommandIterator commands;
+            CommandReferences references;
+    };
+
+    class Pipeline : public PipelineBase {
+        public:
+            Pipeline(Device* device, PipelineBuilder* builder);
+
+            // Only compute pipelines have a program, -1 is returned for render pipelines.
+            const ShaderModule* GetComputeModule() const;
+            int GetComputeEntryPoint() const;
+
+        private:
+            Ref<ShaderModule> computeModule;
+            int computeEntryPoint = -1;
+    };
+
+    class Queue : public QueueBase {
+        public:
+            Queue(Device* device, QueueBuilder* builder);
+
+            // NXT API
+            void Signal(Fence* fence, uint64_t value);
+            void Submit(uint32_t numCommands, CommandBuffer* const * commands);
+
+        private:
+            Device* device;
+    };
+
+}
+}
+
+#endif // BACKEND_CPU_CPUBACKEND_H_
@@ -0,0 +1,6 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "CPUBackend.h"
+#include "ShaderModuleCPU.h"
@@ -0,0 +1,37 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ShaderModuleCPU.h"
+
+#include "CPUBackend.h"
+
+#include <spirv-cross/spirv_cross.hpp>
+
+namespace backend {
+namespace cpu {
+
+    ShaderModule::ShaderModule(Device* device, ShaderModuleBuilder* builder)
+        : ShaderModuleBase(builder) {
+        std::vector<uint32_t> spirv = builder->AcquireSpirv();
+
+        spirv_cross::Compiler compiler(spirv);
+        ExtractSpirvInfo(compiler);
+
+        // Render stages are never executed so their SPIR-V isn't kept.
+        if (GetExecutionModel() != nxt::ShaderStage::Compute) {
+            return;
+        }
+
+        std::string error;
+        if (!program.Initialize(std::move(spirv), &error)) {
+            device->HandleError(error.c_str());
+        }
+    }
+
+    const SpirvProgram& ShaderModule::GetProgram() const {
+        return program;
+    }
+
+}
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_CPU_SHADERMODULECPU_H_
+#define BACKEND_CPU_SHADERMODULECPU_H_
+
+#include "common/ShaderModule.h"
+
+#include "SpirvInterpreterCPU.h"
+
+namespace backend {
+namespace cpu {
+
+    class Device;
+
+    class ShaderModule : public ShaderModuleBase {
+        public:
+            ShaderModule(Device* device, ShaderModuleBuilder* builder);
+
+            // Only set for compute shaders.
+            const SpirvProgram& GetProgram() const;
+
+        private:
+            SpirvProgram program;
+    };
+
+}
+}
+
+#endif // BACKEND_CPU_SHADERMODULECPU_H_
@@ -0,0 +1,2322 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "SpirvInterpreterCPU.h"
+
+#include "common/WorkerPool.h"
+
+#include <spirv-cross/spirv.hpp>
+#include <spirv-cross/GLSL.std.450.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <map>
+#include <sstream>
+
+namespace backend {
+namespace cpu {
+
+    namespace {
+        constexpr uint32_t kNoRegister = 0xFFFFFFFF;
+        constexpr uint32_t kUnsetOffset = 0xFFFFFFFF;
+        constexpr uint32_t kOutOfBoundsOffset = 0xFFFFFFFF;
+        constexpr uint32_t kDone = 0xFFFFFFFF;
+
+        // Workgroups are put in the same batch of lanes until there are this many invocations.
+        constexpr uint32_t kBatchInvocations = 64;
+
+        float AsFloat(uint32_t value) {
+            float result;
+            memcpy(&result, &value, sizeof(result));
+            return result;
+        }
+
+        uint32_t FromFloat(float value) {
+            uint32_t result;
+            memcpy(&result, &value, sizeof(result));
+            return result;
+        }
+
+        int32_t AsInt(uint32_t value) {
+            return static_cast<int32_t>(value);
+        }
+
+        uint32_t FromInt(int32_t value) {
+            return static_cast<uint32_t>(value);
+        }
+
+        uint32_t Align4(uint32_t value) {
+            return (value + 3) & ~3u;
+        }
+
+        // Float to integer conversions are undefined in C++ outside of the range of the integer.
+        int32_t ConvertToInt(float value) {
+            if (std::isnan(value)) {
+                return 0;
+            }
+            if (value <= -2147483648.0f) {
+                return std::numeric_limits<int32_t>::min();
+            }
+            if (value >= 2147483648.0f) {
+                return std::numeric_limits<int32_t>::max();
+            }
+            return static_cast<int32_t>(value);
+        }
+
+        uint32_t ConvertToUInt(float value) {
+            if (std::isnan(value) || value <= 0.0f) {
+                return 0;
+            }
+            if (value >= 4294967296.0f) {
+                return std::numeric_limits<uint32_t>::max();
+            }
+            return static_cast<uint32_t>(value);
+        }
+
+        std::string DecodeString(const uint32_t* words, uint32_t count) {
+            std::string result;
+            for (uint32_t i = 0; i < count; ++i) {
+                for (uint32_t byte = 0; byte < 4; ++byte) {
+                    char c = static_cast<char>((words[i] >> (byte * 8)) & 0xFF);
+                    if (c == '\0') {
+                        return result;
+                    }
+                    result.push_back(c);
+                }
+            }
+            return result;
+        }
+
+        bool IsSupportedExtInst(uint32_t instruction) {
+            switch (instruction) {
+                case GLSLstd450Round:
+                case GLSLstd450RoundEven:
+                case GLSLstd450Trunc:
+                case GLSLstd450FAbs:
+                case GLSLstd450SAbs:
+                case GLSLstd450FSign:
+                case GLSLstd450SSign:
+                case GLSLstd450Floor:
+                case GLSLstd450Ceil:
+                case GLSLstd450Fract:
+                case GLSLstd450Radians:
+                case GLSLstd450Degrees:
+                case GLSLstd450Sin:
+                case GLSLstd450Cos:
+                case GLSLstd450Tan:
+                case GLSLstd450Asin:
+                case GLSLstd450Acos:
+                case GLSLstd450Atan:
+                case GLSLstd450Atan2:
+                case GLSLstd450Pow:
+                case GLSLstd450Exp:
+                case GLSLstd450Log:
+                case GLSLstd450Exp2:
+                case GLSLstd450Log2:
+                case GLSLstd450Sqrt:
+                case GLSLstd450InverseSqrt:
+                case GLSLstd450FMin:
+                case GLSLstd450UMin:
+                case GLSLstd450SMin:
+                case GLSLstd450FMax:
+                case GLSLstd450UMax:
+                case GLSLstd450SMax:
+                case GLSLstd450FClamp:
+                case GLSLstd450UClamp:
+                case GLSLstd450SClamp:
+                case GLSLstd450FMix:
+                case GLSLstd450Step:
+                case GLSLstd450SmoothStep:
+                case GLSLstd450Fma:
+                case GLSLstd450Length:
+                case GLSLstd450Distance:
+                case GLSLstd450Cross:
+                case GLSLstd450Normalize:
+                case GLSLstd450FaceForward:
+                case GLSLstd450Reflect:
+                    return true;
+                default:
+                    return false;
+            }
+        }
+    }
+
+    // Initialization
+
+    bool SpirvProgram::Initialize(std::vector<uint32_t> spirvIn, std::string* error) {
+        spirv = std::move(spirvIn);
+        if (spirv.size() < 5 || spirv[0] != spv::MagicNumber) {
+            *error = "Invalid SPIR-V module header";
+            return false;
+        }
+
+        uint32_t bound = spirv[3];
+        types.assign(bound, Type());
+        valueTypes.assign(bound, 0);
+        registerOffsets.assign(bound, kNoRegister);
+        functionIndices.assign(bound, -1);
+        labelBlocks.assign(bound, 0);
+        variableOffsets.assign(bound, 0);
+        constantIndices.assign(bound, -1);
+
+        // Decorations come before the types and variables they apply to.
+        std::vector<int> builtinDecorations(bound, -1);
+        std::vector<int> setDecorations(bound, -1);
+        std::vector<int> bindingDecorations(bound, -1);
+        std::map<std::pair<uint32_t, uint32_t>, uint32_t> memberMatrixStrides;
+
+        Function* currentFunction = nullptr;
+
+        auto Fail = [error](const std::string& message) {
+            *error = message;
+            return false;
+        };
+
+        size_t offset = 5;
+        while (offset < spirv.size()) {
+            const uint32_t* words = &spirv[offset];
+            uint32_t opcode = words[0] & spv::OpCodeMask;
+            uint32_t wordCount = words[0] >> spv::WordCountShift;
+            if (wordCount == 0 || offset + wordCount > spirv.size()) {
+                return Fail("Invalid SPIR-V instruction size");
+            }
+
+            // Ids are checked against the bound once instead of for each use.
+            auto CheckIds = [&](uint32_t first, uint32_t last) {
+                for (uint32_t i = first; i < std::min(last, wordCount); ++i) {
+                    if (words[i] >= bound) {
+                        return false;
+                    }
+                }
+                return true;
+            };
+
+            if (currentFunction != nullptr && opcode != spv::OpFunctionEnd && opcode != spv::OpFunctionParameter &&
+                opcode != spv::OpLabel && opcode != spv::OpLine && opcode != spv::OpNoLine) {
+                if (currentFunction->blocks.empty()) {
+                    return Fail("SPIR-V instruction outside of a block");
+                }
+                if (!IsSupported(opcode)) {
+                    std::ostringstream message;
+                    message << "SPIR-V instruction " << opcode << " isn't supported by the CPU backend";
+                    return Fail(message.str());
+                }
+                if (opcode == spv::OpExtInst && (words[3] != glslStd450 || glslStd450 == 0 || !IsSupportedExtInst(words[4]))) {
+                    std::ostringstream message;
+                    message << "GLSL.std.450 instruction " << words[4] << " isn't supported by the CPU backend";
+                    return Fail(message.str());
+                }
+            }
+
+            switch (opcode) {
+                case spv::OpExtInstImport:
+                    if (DecodeString(words + 2, wordCount - 2) == "GLSL.std.450") {
+                        glslStd450 = words[1];
+                    }
+                    break;
+
+                case spv::OpEntryPoint:
+                    if (words[1] == spv::ExecutionModelGLCompute) {
+                        EntryPoint entryPoint;
+                        entryPoint.name = DecodeString(words + 3, wordCount - 3);
+                        entryPoint.function = words[2];
+                        entryPoint.localSize = {{1, 1, 1}};
+                        entryPoints.push_back(entryPoint);
+                    }
+                    break;
+
+                case spv::OpExecutionMode:
+                    if (words[2] == spv::ExecutionModeLocalSize && wordCount == 6) {
+                        for (auto& entryPoint : entryPoints) {
+                            if (entryPoint.function == words[1]) {
+                                entryPoint.localSize = {{words[3], words[4], words[5]}};
+                            }
+                        }
+                    }
+                    break;
+
+                case spv::OpDecorate:
+                    if (!CheckIds(1, 2) || wordCount < 3) {
+                        return Fail("Invalid SPIR-V decoration");
+                    }
+                    switch (words[2]) {
+                        case spv::DecorationBuiltIn:
+                            builtinDecorations[words[1]] = static_cast<int>(words[3]);
+                            break;
+                        case spv::DecorationDescriptorSet:
+                            setDecorations[words[1]] = static_cast<int>(words[3]);
+                            break;
+                        case spv::DecorationBinding:
+                            bindingDecorations[words[1]] = static_cast<int>(words[3]);
+                            break;
+                        case spv::DecorationArrayStride:
+                            types[words[1]].stride = words[3];
+                            break;
+                    }
+                    break;
+
+                case spv::OpMemberDecorate:
+                    if (!CheckIds(1, 2) || wordCount < 4) {
+                        return Fail("Invalid SPIR-V decoration");
+                    }
+                    if (words[3] == spv::DecorationOffset) {
+                        auto& offsets = types[words[1]].memberOffsets;
+                        if (offsets.size() <= words[2]) {
+                            offsets.resize(words[2] + 1, kUnsetOffset);
+                        }
+                        offsets[words[2]] = words[4];
+                    } else if (words[3] == spv::DecorationMatrixStride) {
+                        memberMatrixStrides[{words[1], words[2]}] = words[4];
+                    }
+                    break;
+
+                case spv::OpTypeVoid:
+                case spv::OpTypeFunction:
+                    types[words[1]].kind = TypeKind::Void;
+                    break;
+
+                case spv::OpTypeBool:
+                    types[words[1]].kind = TypeKind::Bool;
+                    break;
+
+                case spv::OpTypeInt:
+                case spv::OpTypeFloat:
+                    if (words[2] != 32) {
+                        return Fail("Only 32 bit scalars are supported by the CPU backend");
+                    }
+                    types[words[1]].kind = opcode == spv::OpTypeInt ? TypeKind::Int : TypeKind::Float;
+                    types[words[1]].isSigned = opcode == spv::OpTypeInt && words[3] != 0;
+                    break;
+
+                case spv::OpTypeVector:
+                case spv::OpTypeMatrix:
+                    if (!CheckIds(1, 3)) {
+                        return Fail("Invalid SPIR-V id");
+                    }
+                    types[words[1]].kind = opcode == spv::OpTypeVector ? TypeKind::Vector : TypeKind::Matrix;
+                    types[words[1]].element = words[2];
+                    types[words[1]].count = words[3];
+                    break;
+
+                case spv::OpTypeArray:
+                    if (!CheckIds(1, 4) || constantIndices[words[3]] < 0) {
+                        return Fail("Invalid SPIR-V array length");
+                    }
+                    types[words[1]].kind = TypeKind::Array;
+                    types[words[1]].element = words[2];
+                    types[words[1]].count = GetConstantScalar(words[3]);
+                    break;
+
+                case spv::OpTypeRuntimeArray:
+                    if (!CheckIds(1, 3)) {
+                        return Fail("Invalid SPIR-V id");
+                    }
+                    types[words[1]].kind = TypeKind::RuntimeArray;
+                    types[words[1]].element = words[2];
+                    break;
+
+                case spv::OpTypeStruct:
+                    if (!CheckIds(1, wordCount)) {
+                        return Fail("Invalid SPIR-V id");
+                    }
+                    types[words[1]].kind = TypeKind::Struct;
+                    types[words[1]].members.assign(words + 2, words + wordCount);
+                    for (uint32_t i = 2; i < wordCount; ++i) {
+                        auto matrixStride = memberMatrixStrides.find({words[1], i - 2});
+                        Type& member = types[words[i]];
+                        if (matrixStride != memberMatrixStrides.end() && member.kind == TypeKind::Matrix &&
+                            member.stride != matrixStride->second) {
+                            member.stride = matrixStride->second;
+                            ComputeLayout(words[i]);
+                        }
+                    }
+                    break;
+
+                case spv::OpTypePointer:
+                    if (!CheckIds(1, 2) || !CheckIds(3, 4)) {
+                        return Fail("Invalid SPIR-V id");
+                    }
+                    types[words[1]].kind = TypeKind::Pointer;
+                    types[words[1]].storageClass = words[2];
+                    types[words[1]].element = words[3];
+                    break;
+
+                case spv::OpTypeImage:
+                case spv::OpTypeSampler:
+                case spv::OpTypeSampledImage:
+                    // Only the compute modules are interpreted, this is reported if they use
+                    // them.
+                    types[words[1]].kind = TypeKind::Other;
+                    break;
+
+                case spv::OpConstant:
+                case spv::OpSpecConstant:
+                case spv::OpConstantTrue:
+                case spv::OpConstantFalse:
+                case spv::OpSpecConstantTrue:
+                case spv::OpSpecConstantFalse:
+                case spv::OpConstantNull:
+                case spv::OpConstantComposite:
+                case spv::OpSpecConstantComposite:
+                case spv::OpUndef:
+                    {
+                        // The operands of composites are ids, the ones of scalars are literals.
+                        bool isComposite = opcode == spv::OpConstantComposite || opcode == spv::OpSpecConstantComposite;
+                        if (!CheckIds(1, isComposite ? wordCount : 3)) {
+                            return Fail("Invalid SPIR-V id");
+                        }
+                        if (opcode == spv::OpUndef && currentFunction != nullptr) {
+                            AllocateRegister(words[2], words[1]);
+                            currentFunction->instructions.push_back({opcode, wordCount, static_cast<uint32_t>(offset)});
+                            break;
+                        }
+
+                        Constant constant;
+                        constant.id = words[2];
+                        const Type& type = types[words[1]];
+                        switch (opcode) {
+                            case spv::OpConstant:
+                            case spv::OpSpecConstant:
+                                if (wordCount != 4) {
+                                    return Fail("Only 32 bit constants are supported by the CPU backend");
+                                }
+                                constant.words.push_back(words[3]);
+                                break;
+                            case spv::OpConstantTrue:
+                            case spv::OpSpecConstantTrue:
+                                constant.words.push_back(1);
+                                break;
+                            case spv::OpConstantFalse:
+                            case spv::OpSpecConstantFalse:
+                                constant.words.push_back(0);
+                                break;
+                            case spv::OpConstantComposite:
+                            case spv::OpSpecConstantComposite:
+                                for (uint32_t i = 3; i < wordCount; ++i) {
+                                    if (constantIndices[words[i]] < 0) {
+                                        return Fail("Invalid SPIR-V constant composite");
+                                    }
+                                    const auto& part = constants[constantIndices[words[i]]].words;
+                                    constant.words.insert(constant.words.end(), part.begin(), part.end());
+                                }
+                                break;
+                            default:
+                                constant.words.assign(type.words, 0);
+                                break;
+                        }
+                        if (constant.words.size() != type.words) {
+                            return Fail("Invalid SPIR-V constant");
+                        }
+
+                        if (builtinDecorations[constant.id] == spv::BuiltInWorkgroupSize) {
+                            workgroupSizeConstant = constant.id;
+                        }
+                        constantIndices[constant.id] = static_cast<int>(constants.size());
+                        constants.push_back(constant);
+                        AllocateRegister(constant.id, words[1]);
+                    }
+                    break;
+
+                case spv::OpVariable:
+                    {
+                        if (!CheckIds(1, wordCount) || types[words[1]].kind != TypeKind::Pointer) {
+                            return Fail("Invalid SPIR-V variable");
+                        }
+                        uint32_t id = words[2];
+                        uint32_t storageClass = words[3];
+                        const Type& pointee = types[types[words[1]].element];
+                        AllocateRegister(id, words[1]);
+
+                        if (currentFunction != nullptr) {
+                            if (pointee.kind == TypeKind::RuntimeArray) {
+                                return Fail("Invalid SPIR-V variable");
+                            }
+                            variableOffsets[id] = privateSize;
+                            privateSize += Align4(pointee.size);
+                            currentFunction->instructions.push_back({opcode, wordCount, static_cast<uint32_t>(offset)});
+                            break;
+                        }
+
+                        Constant pointer;
+                        pointer.id = id;
+                        switch (storageClass) {
+                            case spv::StorageClassInput:
+                                if (builtinDecorations[id] < 0) {
+                                    return Fail("Compute shader inputs must be builtins");
+                                }
+                                pointer.words = {MemorySlotPrivate, privateSize};
+                                builtins.push_back({static_cast<uint32_t>(builtinDecorations[id]), privateSize});
+                                privateSize += Align4(pointee.size);
+                                break;
+
+                            case spv::StorageClassPrivate:
+                            case spv::StorageClassOutput:
+                                pointer.words = {MemorySlotPrivate, privateSize};
+                                if (wordCount > 4) {
+                                    if (constantIndices[words[4]] < 0) {
+                                        return Fail("Only constant initializers are supported by the CPU backend");
+                                    }
+                                    privateInitializers.push_back({privateSize, types[words[1]].element, words[4]});
+                                }
+                                privateSize += Align4(pointee.size);
+                                break;
+
+                            case spv::StorageClassWorkgroup:
+                                pointer.words = {MemorySlotWorkgroup, workgroupSize};
+                                workgroupSize += Align4(pointee.size);
+                                usesWorkgroupMemory = true;
+                                break;
+
+                            default:
+                                {
+                                    Resource resource;
+                                    resource.isPushConstants = storageClass == spv::StorageClassPushConstant;
+                                    if (!resource.isPushConstants) {
+                                        if (setDecorations[id] < 0 || bindingDecorations[id] < 0 ||
+                                            setDecorations[id] >= static_cast<int>(kMaxBindGroups) ||
+                                            bindingDecorations[id] >= static_cast<int>(kMaxBindingsPerGroup)) {
+                                            return Fail("Invalid resource binding");
+                                        }
+                                        if (pointee.kind != TypeKind::Struct) {
+                                            return Fail("Only buffers are supported by the CPU backend");
+                                        }
+                                        resource.set = static_cast<uint32_t>(setDecorations[id]);
+                                        resource.binding = static_cast<uint32_t>(bindingDecorations[id]);
+                                    }
+                                    pointer.words = {MemorySlotFirstResource + static_cast<uint32_t>(resources.size()), 0};
+                                    resources.push_back(resource);
+                                }
+                                break;
+                        }
+                        variablePointers.push_back(pointer);
+                    }
+                    break;
+
+                case spv::OpFunction:
+                    if (currentFunction != nullptr || !CheckIds(1, 3)) {
+                        return Fail("Invalid SPIR-V function");
+                    }
+                    functionIndices[words[2]] = static_cast<int>(functions.size());
+                    functions.emplace_back();
+                    currentFunction = &functions.back();
+                    break;
+
+                case spv::OpFunctionParameter:
+                    if (currentFunction == nullptr || !CheckIds(1, 3)) {
+                        return Fail("Invalid SPIR-V function parameter");
+                    }
+                    currentFunction->parameters.push_back(words[2]);
+                    AllocateRegister(words[2], words[1]);
+                    break;
+
+                case spv::OpLabel:
+                    if (currentFunction == nullptr || !CheckIds(1, 2)) {
+                        return Fail("Invalid SPIR-V label");
+                    }
+                    if (!currentFunction->blocks.empty()) {
+                        currentFunction->blocks.back().end = static_cast<uint32_t>(currentFunction->instructions.size());
+                    }
+                    labelBlocks[words[1]] = static_cast<uint32_t>(currentFunction->blocks.size());
+                    currentFunction->blocks.push_back({words[1], static_cast<uint32_t>(currentFunction->instructions.size()), 0});
+                    break;
+
+                case spv::OpFunctionEnd:
+                    if (currentFunction == nullptr || currentFunction->blocks.empty()) {
+                        return Fail("Invalid SPIR-V function");
+                    }
+                    currentFunction->blocks.back().end = static_cast<uint32_t>(currentFunction->instructions.size());
+                    currentFunction = nullptr;
+                    break;
+
+                default:
+                    if (currentFunction == nullptr || currentFunction->blocks.empty()) {
+                        // Debug instructions and the other declarations don't matter.
+                        break;
+                    }
+
+                    switch (opcode) {
+                        case spv::OpStore:
+                        case spv::OpCopyMemory:
+                        case spv::OpBranch:
+                        case spv::OpBranchConditional:
+                        case spv::OpSwitch:
+                        case spv::OpReturn:
+                        case spv::OpReturnValue:
+                        case spv::OpKill:
+                        case spv::OpUnreachable:
+                        case spv::OpControlBarrier:
+                        case spv::OpMemoryBarrier:
+                        case spv::OpLoopMerge:
+                        case spv::OpSelectionMerge:
+                        case spv::OpLine:
+                        case spv::OpNoLine:
+                        case spv::OpNop:
+                            break;
+                        default:
+                            if (wordCount < 3 || !CheckIds(1, 3)) {
+                                return Fail("Invalid SPIR-V instruction");
+                            }
+                            AllocateRegister(words[2], words[1]);
+                            break;
+                    }
+                    currentFunction->instructions.push_back({opcode, wordCount, static_cast<uint32_t>(offset)});
+                    break;
+            }
+
+            // The layout of types is known once they are declared.
+            switch (opcode) {
+                case spv::OpTypeBool:
+                case spv::OpTypeInt:
+                case spv::OpTypeFloat:
+                case spv::OpTypeVector:
+                case spv::OpTypeMatrix:
+                case spv::OpTypeArray:
+                case spv::OpTypeRuntimeArray:
+                case spv::OpTypeStruct:
+                case spv::OpTypePointer:
+                    ComputeLayout(words[1]);
+                    break;
+                default:
+                    break;
+            }
+
+            offset += wordCount;
+        }
+
+        if (currentFunction != nullptr) {
+            return Fail("Unterminated SPIR-V function");
+        }
+
+        for (auto& entryPoint : entryPoints) {
+            if (entryPoint.function >= bound || functionIndices[entryPoint.function] < 0) {
+                return Fail("Invalid SPIR-V entry point");
+            }
+            if (workgroupSizeConstant != 0) {
+                const auto& size = constants[constantIndices[workgroupSizeConstant]].words;
+                if (size.size() == 3) {
+                    entryPoint.localSize = {{size[0], size[1], size[2]}};
+                }
+            }
+            if (entryPoint.localSize[0] == 0 || entryPoint.localSize[1] == 0 || entryPoint.localSize[2] == 0) {
+                return Fail("Invalid workgroup size");
+            }
+        }
+
+        // Checks the ids used by the function bodies so that execution doesn't have to.
+        for (const auto& function : functions) {
+            for (const auto& instruction : function.instructions) {
+                const uint32_t* words = &spirv[instruction.offset];
+                uint32_t first = 1;
+                switch (instruction.opcode) {
+                    case spv::OpLoopMerge:
+                    case spv::OpSelectionMerge:
+                    case spv::OpLine:
+                    case spv::OpNoLine:
+                    case spv::OpNop:
+                    case spv::OpMemoryBarrier:
+                    case spv::OpControlBarrier:
+                        continue;
+                    case spv::OpSwitch:
+                        if (instruction.wordCount < 3 || words[1] >= bound || registerOffsets[words[1]] == kNoRegister) {
+                            return Fail("Invalid SPIR-V switch");
+                        }
+                        if (words[2] >= bound) {
+                            return Fail("Invalid SPIR-V switch");
+                        }
+                        for (uint32_t i = 3; i + 1 < instruction.wordCount; i += 2) {
+                            if (words[i + 1] >= bound) {
+                                return Fail("Invalid SPIR-V switch");
+                            }
+                        }
+                        continue;
+                    case spv::OpVectorShuffle:
+                        if (instruction.wordCount < 5) {
+                            return Fail("Invalid SPIR-V instruction");
+                        }
+                        for (uint32_t i = 3; i < 5; ++i) {
+                            if (words[i] >= bound || registerOffsets[words[i]] == kNoRegister) {
+                                return Fail("Invalid SPIR-V operand");
+                            }
+                        }
+                        continue;
+                    case spv::OpCompositeExtract:
+                    case spv::OpCompositeInsert:
+                    case spv::OpArrayLength:
+                        if (instruction.wordCount < 4) {
+                            return Fail("Invalid SPIR-V instruction");
+                        }
+                        if (words[3] >= bound || registerOffsets[words[3]] == kNoRegister ||
+                            (instruction.opcode == spv::OpCompositeInsert &&
+                             (instruction.wordCount < 5 || words[4] >= bound || registerOffsets[words[4]] == kNoRegister))) {
+                            return Fail("Invalid SPIR-V operand");
+                        }
+                        continue;
+                    case spv::OpExtInst:
+                        if (instruction.wordCount < 6) {
+                            return Fail("Invalid SPIR-V instruction");
+                        }
+                        for (uint32_t i = 5; i < instruction.wordCount; ++i) {
+                            if (words[i] >= bound || registerOffsets[words[i]] == kNoRegister) {
+                                return Fail("Invalid SPIR-V operand");
+                            }
+                        }
+                        continue;
+                    case spv::OpFunctionCall:
+                        if (instruction.wordCount < 4 || words[3] >= bound || functionIndices[words[3]] < 0 ||
+                            functions[functionIndices[words[3]]].parameters.size() != instruction.wordCount - 4) {
+                            return Fail("Invalid SPIR-V function call");
+                        }
+                        first = 4;
+                        break;
+                    case spv::OpPhi:
+                        for (uint32_t i = 3; i + 1 < instruction.wordCount; i += 2) {
+                            if (words[i] >= bound || registerOffsets[words[i]] == kNoRegister || words[i + 1] >= bound) {
+                                return Fail("Invalid SPIR-V operand");
+                            }
+                        }
+                        continue;
+                    case spv::OpBranch:
+                        if (instruction.wordCount < 2 || words[1] >= bound) {
+                            return Fail("Invalid SPIR-V branch");
+                        }
+                        continue;
+                    case spv::OpBranchConditional:
+                        if (instruction.wordCount < 4 || words[1] >= bound || registerOffsets[words[1]] == kNoRegister ||
+                            words[2] >= bound || words[3] >= bound) {
+                            return Fail("Invalid SPIR-V branch");
+                        }
+                        continue;
+                    case spv::OpStore:
+                    case spv::OpCopyMemory:
+                    case spv::OpReturnValue:
+                    case spv::OpReturn:
+                    case spv::OpKill:
+                    case spv::OpUnreachable:
+                        break;
+                    case spv::OpVariable:
+                        first = 4;
+                        break;
+                    default:
+                        first = 3;
+                        break;
+                }
+
+                // The literal operands of the remaining instructions are checked when they are
+                // used.
+                uint32_t last = instruction.wordCount;
+                if (instruction.opcode == spv::OpStore || instruction.opcode == spv::OpCopyMemory) {
+                    last = std::min(last, 3u);
+                } else if (instruction.opcode == spv::OpLoad) {
+                    last = std::min(last, 4u);
+                }
+                for (uint32_t i = first; i < last; ++i) {
+                    if (words[i] >= bound || registerOffsets[words[i]] == kNoRegister) {
+                        return Fail("Invalid SPIR-V operand");
+                    }
+                }
+            }
+        }
+
+        return true;
+    }
+
+    void SpirvProgram::ComputeLayout(uint32_t id) {
+        Type& type = types[id];
+        type.wordOffsets.clear();
+
+        switch (type.kind) {
+            case TypeKind::Bool:
+            case TypeKind::Int:
+            case TypeKind::Float:
+                type.words = 1;
+                type.wordOffsets = {0};
+                type.size = 4;
+                break;
+
+            case TypeKind::Vector:
+                type.words = type.count;
+                for (uint32_t i = 0; i < type.count; ++i) {
+                    type.wordOffsets.push_back(i * 4);
+                }
+                type.size = type.count * 4;
+                break;
+
+            case TypeKind::Matrix:
+            case TypeKind::Array:
+                {
+                    const Type& element = types[type.element];
+                    if (type.stride == 0) {
+                        type.stride = element.size;
+                    }
+                    type.words = type.count * element.words;
+                    for (uint32_t i = 0; i < type.count; ++i) {
+                        for (uint32_t wordOffset : element.wordOffsets) {
+                            type.wordOffsets.push_back(i * type.stride + wordOffset);
+                        }
+                    }
+                    type.size = type.count * type.stride;
+                }
+                break;
+
+            case TypeKind::RuntimeArray:
+                if (type.stride == 0) {
+                    type.stride = types[type.element].size;
+                }
+                type.words = 0;
+                type.size = 0;
+                break;
+
+            case TypeKind::Struct:
+                {
+                    type.memberOffsets.resize(type.members.size(), kUnsetOffset);
+                    type.words = 0;
+                    type.size = 0;
+                    uint32_t packedOffset = 0;
+                    for (size_t i = 0; i < type.members.size(); ++i) {
+                        const Type& member = types[type.members[i]];
+                        if (type.memberOffsets[i] == kUnsetOffset) {
+                            type.memberOffsets[i] = packedOffset;
+                        }
+                        packedOffset = type.memberOffsets[i] + member.size;
+
+                        type.words += member.words;
+                        for (uint32_t wordOffset : member.wordOffsets) {
+                            type.wordOffsets.push_back(type.memberOffsets[i] + wordOffset);
+                        }
+                        type.size = std::max(type.size, packedOffset);
+                    }
+                }
+                break;
+
+            case TypeKind::Pointer:
+                // A slot and an offset, pointers can't be stored in memory.
+                type.words = 2;
+                type.size = 0;
+                break;
+
+            default:
+                type.words = 0;
+                type.size = 0;
+                break;
+        }
+    }
+
+    void SpirvProgram::AllocateRegister(uint32_t id, uint32_t typeId) {
+        valueTypes[id] = typeId;
+        if (types[typeId].words == 0) {
+            return;
+        }
+        registerOffsets[id] = registerWords;
+        registerWords += types[typeId].words;
+    }
+
+    uint32_t SpirvProgram::GetConstantScalar(uint32_t id) const {
+        return constants[constantIndices[id]].words[0];
+    }
+
+    bool SpirvProgram::IsSupported(uint32_t opcode) const {
+        switch (opcode) {
+            case spv::OpNop:
+            case spv::OpUndef:
+            case spv::OpLine:
+            case spv::OpNoLine:
+            case spv::OpExtInst:
+            case spv::OpFunctionCall:
+            case spv::OpVariable:
+            case spv::OpLoad:
+            case spv::OpStore:
+            case spv::OpCopyMemory:
+            case spv::OpAccessChain:
+            case spv::OpInBoundsAccessChain:
+            case spv::OpArrayLength:
+            case spv::OpVectorExtractDynamic:
+            case spv::OpVectorInsertDynamic:
+            case spv::OpVectorShuffle:
+            case spv::OpCompositeConstruct:
+            case spv::OpCompositeExtract:
+            case spv::OpCompositeInsert:
+            case spv::OpCopyObject:
+            case spv::OpTranspose:
+            case spv::OpConvertFToU:
+            case spv::OpConvertFToS:
+            case spv::OpConvertSToF:
+            case spv::OpConvertUToF:
+            case spv::OpUConvert:
+            case spv::OpSConvert:
+            case spv::OpFConvert:
+            case spv::OpBitcast:
+            case spv::OpSNegate:
+            case spv::OpFNegate:
+            case spv::OpIAdd:
+            case spv::OpFAdd:
+            case spv::OpISub:
+            case spv::OpFSub:
+            case spv::OpIMul:
+            case spv::OpFMul:
+            case spv::OpUDiv:
+            case spv::OpSDiv:
+            case spv::OpFDiv:
+            case spv::OpUMod:
+            case spv::OpSRem:
+            case spv::OpSMod:
+            case spv::OpFRem:
+            case spv::OpFMod:
+            case spv::OpVectorTimesScalar:
+            case spv::OpMatrixTimesScalar:
+            case spv::OpVectorTimesMatrix:
+            case spv::OpMatrixTimesVector:
+            case spv::OpMatrixTimesMatrix:
+            case spv::OpDot:
+            case spv::OpAny:
+            case spv::OpAll:
+            case spv::OpIsNan:
+            case spv::OpIsInf:
+            case spv::OpLogicalEqual:
+            case spv::OpLogicalNotEqual:
+            case spv::OpLogicalOr:
+            case spv::OpLogicalAnd:
+            case spv::OpLogicalNot:
+            case spv::OpSelect:
+            case spv::OpIEqual:
+            case spv::OpINotEqual:
+            case spv::OpUGreaterThan:
+            case spv::OpSGreaterThan:
+            case spv::OpUGreaterThanEqual:
+            case spv::OpSGreaterThanEqual:
+            case spv::OpULessThan:
+            case spv::OpSLessThan:
+            case spv::OpULessThanEqual:
+            case spv::OpSLessThanEqual:
+            case spv::OpFOrdEqual:
+            case spv::OpFUnordEqual:
+            case spv::OpFOrdNotEqual:
+            case spv::OpFUnordNotEqual:
+            case spv::OpFOrdLessThan:
+            case spv::OpFUnordLessThan:
+            case spv::OpFOrdGreaterThan:
+            case spv::OpFUnordGreaterThan:
+            case spv::OpFOrdLessThanEqual:
+            case spv::OpFUnordLessThanEqual:
+            case spv::OpFOrdGreaterThanEqual:
+            case spv::OpFUnordGreaterThanEqual:
+            case spv::OpShiftRightLogical:
+            case spv::OpShiftRightArithmetic:
+            case spv::OpShiftLeftLogical:
+            case spv::OpBitwiseOr:
+            case spv::OpBitwiseXor:
+            case spv::OpBitwiseAnd:
+            case spv::OpNot:
+            case spv::OpControlBarrier:
+            case spv::OpMemoryBarrier:
+            case spv::OpPhi:
+            case spv::OpLoopMerge:
+            case spv::OpSelectionMerge:
+            case spv::OpBranch:
+            case spv::OpBranchConditional:
+            case spv::OpSwitch:
+            case spv::OpKill:
+            case spv::OpReturn:
+            case spv::OpReturnValue:
+            case spv::OpUnreachable:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    int SpirvProgram::FindEntryPoint(const std::string& name) const {
+        for (size_t i = 0; i < entryPoints.size(); ++i) {
+            if (entryPoints[i].name == name) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    // Executor
+
+    // Runs batches of workgroups, each worker thread has its own so that they don't share the
+    // registers and private memory.
+    class SpirvProgram::Executor {
+        public:
+            Executor(const SpirvProgram& program, const EntryPoint& entryPoint, const SpirvResources& resources,
+                     std::array<uint32_t, 3> numWorkgroups, uint32_t workgroupsPerBatch);
+
+            void RunBatch(uint64_t batch);
+
+        private:
+            // The lanes that execute an instruction, they often are a range of lanes which
+            // allows loops without indirection.
+            struct Lanes {
+                const uint32_t* indices;
+                uint32_t count;
+                uint32_t begin;
+                bool isRange;
+            };
+
+            template<typename F>
+            void ForEachLane(const Lanes& lanes, F f) {
+                if (lanes.isRange) {
+                    uint32_t end = lanes.begin + lanes.count;
+                    for (uint32_t lane = lanes.begin; lane < end; ++lane) {
+                        f(lane);
+                    }
+                } else {
+                    for (uint32_t i = 0; i < lanes.count; ++i) {
+                        f(lanes.indices[i]);
+                    }
+                }
+            }
+
+            uint32_t* Register(uint32_t id) {
+                return registers.data() + program.registerOffsets[id] * laneCapacity;
+            }
+            const Type& TypeOf(uint32_t id) const {
+                return program.types[program.valueTypes[id]];
+            }
+
+            uint8_t* Resolve(uint32_t lane, uint32_t slot, uint32_t offset, uint32_t size);
+            void Load(uint32_t* destination, const Type& type, uint32_t lane, const uint8_t* memory);
+            void Store(uint8_t* memory, const Type& type, uint32_t lane, const uint32_t* source);
+
+            void ExecuteFunction(uint32_t functionIndex, const std::vector<uint32_t>& lanes, uint32_t returnId);
+            void ExecutePhis(const Function& function, uint32_t* position, const std::vector<uint32_t>& group,
+                             const std::vector<uint32_t>& groupIndices, const std::vector<uint32_t>& from);
+            void ExecuteInstruction(const uint32_t* words, uint32_t wordCount, const Lanes& lanes);
+            void ExecuteExtInst(const uint32_t* words, uint32_t wordCount, const Lanes& lanes);
+            void ExecuteAccessChain(const uint32_t* words, uint32_t wordCount, const Lanes& lanes);
+
+            // Apply f to each component of the operands.
+            template<typename F>
+            void Componentwise1(uint32_t typeId, uint32_t resultId, uint32_t a, const Lanes& lanes, F f);
+            template<typename F>
+            void Componentwise2(uint32_t typeId, uint32_t resultId, uint32_t a, uint32_t b, const Lanes& lanes, F f);
+            template<typename F>
+            void Componentwise3(uint32_t typeId, uint32_t resultId, uint32_t a, uint32_t b, uint32_t c,
+                                const Lanes& lanes, F f);
+
+            const SpirvProgram& program;
+            const EntryPoint& entryPoint;
+            std::array<uint32_t, 3> numWorkgroups;
+            uint64_t totalWorkgroups;
+            uint32_t invocationsPerWorkgroup;
+            uint32_t workgroupsPerBatch;
+            uint32_t laneCapacity;
+
+            std::vector<uint32_t> registers;
+            std::vector<uint8_t> privateMemory;
+            std::vector<uint8_t> workgroupMemory;
+            std::vector<SpirvMemory> resourceMemories;
+            std::vector<uint64_t> chainOffsets;
+    };
+
+    SpirvProgram::Executor::Executor(const SpirvProgram& program, const EntryPoint& entryPoint, const SpirvResources& resources,
+                                     std::array<uint32_t, 3> numWorkgroups, uint32_t workgroupsPerBatch)
+        : program(program), entryPoint(entryPoint), numWorkgroups(numWorkgroups), workgroupsPerBatch(workgroupsPerBatch) {
+        totalWorkgroups = uint64_t(numWorkgroups[0]) * numWorkgroups[1] * numWorkgroups[2];
+        invocationsPerWorkgroup = entryPoint.localSize[0] * entryPoint.localSize[1] * entryPoint.localSize[2];
+        laneCapacity = invocationsPerWorkgroup * workgroupsPerBatch;
+
+        registers.resize(size_t(program.registerWords) * laneCapacity);
+        privateMemory.resize(size_t(program.privateSize) * laneCapacity);
+        workgroupMemory.resize(program.workgroupSize);
+        chainOffsets.resize(laneCapacity);
+
+        for (const auto& resource : program.resources) {
+            if (resource.isPushConstants) {
+                resourceMemories.push_back(resources.pushConstants);
+            } else {
+                resourceMemories.push_back(resources.buffers[resource.set][resource.binding]);
+            }
+        }
+
+        // Constants and the pointers to module scope variables are the same in all the lanes.
+        auto Broadcast = [this](const Constant& constant) {
+            uint32_t* destination = Register(constant.id);
+            for (size_t word = 0; word < constant.words.size(); ++word) {
+                std::fill_n(destination + word * laneCapacity, laneCapacity, constant.words[word]);
+            }
+        };
+        for (const auto& constant : program.constants) {
+            Broadcast(constant);
+        }
+        for (const auto& pointer : program.variablePointers) {
+            Broadcast(pointer);
+        }
+    }
+
+    void SpirvProgram::Executor::RunBatch(uint64_t batch) {
+        uint64_t firstWorkgroup = batch * workgroupsPerBatch;
+        uint32_t workgroups = static_cast<uint32_t>(std::min<uint64_t>(workgroupsPerBatch, totalWorkgroups - firstWorkgroup));
+        uint32_t laneCount = workgroups * invocationsPerWorkgroup;
+
+        std::fill(privateMemory.begin(), privateMemory.end(), 0);
+        std::fill(workgroupMemory.begin(), workgroupMemory.end(), 0);
+
+        const auto& localSize = entryPoint.localSize;
+        for (uint32_t lane = 0; lane < laneCount; ++lane) {
+            uint8_t* memory = privateMemory.data() + size_t(lane) * program.privateSize;
+
+            uint32_t localIndex = lane % invocationsPerWorkgroup;
+            uint64_t workgroup = firstWorkgroup + lane / invocationsPerWorkgroup;
+            std::array<uint32_t, 3> localId = {{
+                localIndex % localSize[0],
+                (localIndex / localSize[0]) % localSize[1],
+                localIndex / (localSize[0] * localSize[1]),
+            }};
+            std::array<uint32_t, 3> workgroupId = {{
+                static_cast<uint32_t>(workgroup % numWorkgroups[0]),
+                static_cast<uint32_t>((workgroup / numWorkgroups[0]) % numWorkgroups[1]),
+                static_cast<uint32_t>(workgroup / (uint64_t(numWorkgroups[0]) * numWorkgroups[1])),
+            }};
+
+            for (const auto& builtin : program.builtins) {
+                std::array<uint32_t, 3> value = {{0, 0, 0}};
+                switch (builtin.builtin) {
+                    case spv::BuiltInNumWorkgroups:
+                        value = numWorkgroups;
+                        break;
+                    case spv::BuiltInWorkgroupSize:
+                        value = localSize;
+                        break;
+                    case spv::BuiltInWorkgroupId:
+                        value = workgroupId;
+                        break;
+                    case spv::BuiltInLocalInvocationId:
+                        value = localId;
+                        break;
+                    case spv::BuiltInGlobalInvocationId:
+                        for (uint32_t i = 0; i < 3; ++i) {
+                            value[i] = workgroupId[i] * localSize[i] + localId[i];
+                        }
+                        break;
+                    case spv::BuiltInLocalInvocationIndex:
+                        value[0] = localIndex;
+                        break;
+                }
+
+                uint32_t size = builtin.builtin == spv::BuiltInLocalInvocationIndex ? 4 : 12;
+                if (builtin.offset + size <= program.privateSize) {
+                    memcpy(memory + builtin.offset, value.data(), size);
+                }
+            }
+
+            for (const auto& initializer : program.privateInitializers) {
+                const Type& type = program.types[initializer.type];
+                const auto& words = program.constants[program.constantIndices[initializer.constant]].words;
+                for (uint32_t word = 0; word < type.words && word < words.size(); ++word) {
+                    memcpy(memory + initializer.offset + type.wordOffsets[word], &words[word], sizeof(uint32_t));
+                }
+            }
+        }
+
+        std::vector<uint32_t> lanes(laneCount);
+        for (uint32_t lane = 0; lane < laneCount; ++lane) {
+            lanes[lane] = lane;
+        }
+        ExecuteFunction(static_cast<uint32_t>(program.functionIndices[entryPoint.function]), lanes, 0);
+    }
+
+    uint8_t* SpirvProgram::Executor::Resolve(uint32_t lane, uint32_t slot, uint32_t offset, uint32_t size) {
+        uint8_t* base = nullptr;
+        size_t limit = 0;
+        if (slot == MemorySlotPrivate) {
+            base = privateMemory.data() + size_t(lane) * program.privateSize;
+            limit = program.privateSize;
+        } else if (slot == MemorySlotWorkgroup) {
+            base = workgroupMemory.data();
+            limit = workgroupMemory.size();
+        } else if (slot - MemorySlotFirstResource < resourceMemories.size()) {
+            base = resourceMemories[slot - MemorySlotFirstResource].data;
+            limit = resourceMemories[slot - MemorySlotFirstResource].size;
+        }
+
+        if (base == nullptr || offset > limit || size > limit - offset) {
+            return nullptr;
+        }
+        return base + offset;
+    }
+
+    void SpirvProgram::Executor::Load(uint32_t* destination, const Type& type, uint32_t lane, const uint8_t* memory) {
+        for (uint32_t word = 0; word < type.words; ++word) {
+            uint32_t value = 0;
+            if (memory != nullptr) {
+                memcpy(&value, memory + type.wordOffsets[word], sizeof(value));
+            }
+            destination[word * laneCapacity + lane] = value;
+        }
+    }
+
+    void SpirvProgram::Executor::Store(uint8_t* memory, const Type& type, uint32_t lane, const uint32_t* source) {
+        if (memory == nullptr) {
+            return;
+        }
+        for (uint32_t word = 0; word < type.words; ++word) {
+            memcpy(memory + type.wordOffsets[word], &source[word * laneCapacity + lane], sizeof(uint32_t));
+        }
+    }
+
+    // Runs the function for the lanes until they all returned. Each iteration runs the lanes at
+    // the earliest instruction until they branch, so lanes wait for the ones behind them at the
+    // merge blocks that follow the constructs in the function.
+    void SpirvProgram::Executor::ExecuteFunction(uint32_t functionIndex, const std::vector<uint32_t>& lanes, uint32_t returnId) {
+        const Function& function = program.functions[functionIndex];
+        const uint32_t* spirv = program.spirv.data();
+
+        std::vector<uint32_t> positions(lanes.size(), function.blocks[0].begin);
+        std::vector<uint32_t> from(lanes.size(), 0);
+        std::vector<uint32_t> group;
+        std::vector<uint32_t> groupIndices;
+
+        while (true) {
+            uint32_t position = *std::min_element(positions.begin(), positions.end());
+            if (position == kDone) {
+                return;
+            }
+
+            group.clear();
+            groupIndices.clear();
+            for (size_t i = 0; i < lanes.size(); ++i) {
+                if (positions[i] == position) {
+                    group.push_back(lanes[i]);
+                    groupIndices.push_back(static_cast<uint32_t>(i));
+                }
+            }
+
+            Lanes groupLanes;
+            groupLanes.indices = group.data();
+            groupLanes.count = static_cast<uint32_t>(group.size());
+            groupLanes.begin = group.front();
+            groupLanes.isRange = group.back() - group.front() + 1 == group.size();
+
+            auto block = std::upper_bound(function.blocks.begin(), function.blocks.end(), position,
+                                          [](uint32_t position, const Block& block) {
+                                              return position < block.begin;
+                                          }) - 1;
+            uint32_t label = block->label;
+
+            if (position == block->begin && position < block->end && function.instructions[position].opcode == spv::OpPhi) {
+                ExecutePhis(function, &position, group, groupIndices, from);
+            }
+
+            auto BranchTo = [&](uint32_t index, uint32_t target) {
+                positions[index] = function.blocks[program.labelBlocks[target]].begin;
+                from[index] = label;
+            };
+
+            bool branched = false;
+            while (!branched) {
+                if (position >= block->end) {
+                    // Blocks end with a terminator, this only happens with invalid modules.
+                    for (uint32_t index : groupIndices) {
+                        positions[index] = kDone;
+                    }
+                    break;
+                }
+
+                const Instruction& instruction = function.instructions[position];
+                const uint32_t* words = spirv + instruction.offset;
+
+                switch (instruction.opcode) {
+                    case spv::OpBranch:
+                        for (uint32_t index : groupIndices) {
+                            BranchTo(index, words[1]);
+                        }
+                        branched = true;
+                        break;
+
+                    case spv::OpBranchConditional:
+                        {
+                            const uint32_t* condition = Register(words[1]);
+                            for (uint32_t index : groupIndices) {
+                                BranchTo(index, condition[lanes[index]] != 0 ? words[2] : words[3]);
+                            }
+                            branched = true;
+                        }
+                        break;
+
+                    case spv::OpSwitch:
+                        {
+                            const uint32_t* selector = Register(words[1]);
+                            for (uint32_t index : groupIndices) {
+                                uint32_t target = words[2];
+                                for (uint32_t i = 3; i + 1 < instruction.wordCount; i += 2) {
+                                    if (words[i] == selector[lanes[index]]) {
+                                        target = words[i + 1];
+                                        break;
+                                    }
+                                }
+                                BranchTo(index, target);
+                            }
+                            branched = true;
+                        }
+                        break;
+
+                    case spv::OpReturnValue:
+                        if (returnId != 0 && program.registerOffsets[returnId] != kNoRegister) {
+                            uint32_t* destination = Register(returnId);
+                            const uint32_t* value = Register(words[1]);
+                            uint32_t count = TypeOf(returnId).words;
+                            for (uint32_t word = 0; word < count; ++word) {
+                                ForEachLane(groupLanes, [&](uint32_t lane) {
+                                    destination[word * laneCapacity + lane] = value[word * laneCapacity + lane];
+                                });
+                            }
+                        }
+                        // Fallthrough
+                    case spv::OpReturn:
+                    case spv::OpKill:
+                    case spv::OpUnreachable:
+                        for (uint32_t index : groupIndices) {
+                            positions[index] = kDone;
+                        }
+                        branched = true;
+                        break;
+
+                    case spv::OpControlBarrier:
+                        // The lanes wait here for the ones that didn't reach the barrier yet.
+                        for (uint32_t index : groupIndices) {
+                            positions[index] = position + 1;
+                        }
+                        branched = true;
+                        break;
+
+                    case spv::OpFunctionCall:
+                        {
+                            uint32_t callee = static_cast<uint32_t>(program.functionIndices[words[3]]);
+                            const auto& parameters = program.functions[callee].parameters;
+                            for (size_t i = 0; i < parameters.size(); ++i) {
+                                uint32_t* destination = Register(parameters[i]);
+                                const uint32_t* argument = Register(words[4 + i]);
+                                uint32_t count = TypeOf(parameters[i]).words;
+                                for (uint32_t word = 0; word < count; ++word) {
+                                    ForEachLane(groupLanes, [&](uint32_t lane) {
+                                        destination[word * laneCapacity + lane] = argument[word * laneCapacity + lane];
+                                    });
+                                }
+                            }
+                            ExecuteFunction(callee, group, words[2]);
+                            position++;
+                        }
+                        break;
+
+                    default:
+                        ExecuteInstruction(words, instruction.wordCount, groupLanes);
+                        position++;
+                        break;
+                }
+            }
+        }
+    }
+
+    // The phis of a block read the values from the predecessor of each lane. They all read
+    // before any of them is written since they can use each other.
+    void SpirvProgram::Executor::ExecutePhis(const Function& function, uint32_t* position, const std::vector<uint32_t>& group,
+                                             const std::vector<uint32_t>& groupIndices, const std::vector<uint32_t>& from) {
+        const uint32_t* spirv = program.spirv.data();
+
+        uint32_t end = *position;
+        while (end < function.instructions.size() && function.instructions[end].opcode == spv::OpPhi) {
+            end++;
+        }
+
+        std::vector<uint32_t> values;
+        for (uint32_t phi = *position; phi < end; ++phi) {
+            const Instruction& instruction = function.instructions[phi];
+            const uint32_t* words = spirv + instruction.offset;
+            uint32_t count = program.types[words[1]].words;
+
+            for (size_t i = 0; i < group.size(); ++i) {
+                uint32_t source = 0;
+                for (uint32_t operand = 3; operand + 1 < instruction.wordCount; operand += 2) {
+                    if (words[operand + 1] == from[groupIndices[i]]) {
+                        source = words[operand];
+                        break;
+                    }
+                }
+                for (uint32_t word = 0; word < count; ++word) {
+                    values.push_back(source == 0 ? 0 : Register(source)[word * laneCapacity + group[i]]);
+                }
+            }
+        }
+
+        size_t next = 0;
+        for (uint32_t phi = *position; phi < end; ++phi) {
+            const uint32_t* words = spirv + function.instructions[phi].offset;
+            uint32_t count = program.types[words[1]].words;
+            uint32_t* destination = Register(words[2]);
+            for (uint32_t lane : group) {
+                for (uint32_t word = 0; word < count; ++word) {
+                    destination[word * laneCapacity + lane] = values[next++];
+                }
+            }
+        }
+
+        *position = end;
+    }
+
+    template<typename F>
+    void SpirvProgram::Executor::Componentwise1(uint32_t typeId, uint32_t resultId, uint32_t a, const Lanes& lanes, F f) {
+        uint32_t count = program.types[typeId].words;
+        for (uint32_t word = 0; word < count; ++word) {
+            uint32_t* d = Register(resultId) + word * laneCapacity;
+            const uint32_t* x = Register(a) + word * laneCapacity;
+            ForEachLane(lanes, [&](uint32_t lane) {
+                d[lane] = f(x[lane]);
+            });
+        }
+    }
+
+    template<typename F>
+    void SpirvProgram::Executor::Componentwise2(uint32_t typeId, uint32_t resultId, uint32_t a, uint32_t b, const Lanes& lanes, F f) {
+        uint32_t count = program.types[typeId].words;
+        for (uint32_t word = 0; word < count; ++word) {
+            uint32_t* d = Register(resultId) + word * laneCapacity;
+            const uint32_t* x = Register(a) + word * laneCapacity;
+            const uint32_t* y = Register(b) + word * laneCapacity;
+            ForEachLane(lanes, [&](uint32_t lane) {
+                d[lane] = f(x[lane], y[lane]);
+            });
+        }
+    }
+
+    template<typename F>
+    void SpirvProgram::Executor::Componentwise3(uint32_t typeId, uint32_t resultId, uint32_t a, uint32_t b, uint32_t c,
+                                                const Lanes& lanes, F f) {
+        uint32_t count = program.types[typeId].words;
+        for (uint32_t word = 0; word < count; ++word) {
+            uint32_t* d = Register(resultId) + word * laneCapacity;
+            const uint32_t* x = Register(a) + word * laneCapacity;
+            const uint32_t* y = Register(b) + word * laneCapacity;
+            const uint32_t* z = Register(c) + word * laneCapacity;
+            ForEachLane(lanes, [&](uint32_t lane) {
+                d[lane] = f(x[lane], y[lane], z[lane]);
+            });
+        }
+    }
+
+    void SpirvProgram::Executor::ExecuteAccessChain(const uint32_t* words, uint32_t wordCount, const Lanes& lanes) {
+        uint32_t* destination = Register(words[2]);
+        const uint32_t* base = Register(words[3]);
+
+        // The offsets are computed in 64 bits so that overflows are out of bounds.
+        std::vector<uint64_t>& offsets = chainOffsets;
+        ForEachLane(lanes, [&](uint32_t lane) {
+            destination[lane] = base[lane];
+            offsets[lane] = base[laneCapacity + lane];
+        });
+
+        uint32_t typeId = program.types[program.valueTypes[words[3]]].element;
+        for (uint32_t i = 4; i < wordCount; ++i) {
+            const Type& type = program.types[typeId];
+            if (type.kind == TypeKind::Struct) {
+                uint32_t member = program.constantIndices[words[i]] >= 0 ? program.GetConstantScalar(words[i]) : 0;
+                if (member >= type.members.size()) {
+                    member = 0;
+                }
+                ForEachLane(lanes, [&](uint32_t lane) {
+                    offsets[lane] += type.memberOffsets[member];
+                });
+                typeId = type.members[member];
+                continue;
+            }
+
+            uint32_t stride = type.kind == TypeKind::Vector ? 4 : type.stride;
+            const uint32_t* index = Register(words[i]);
+            if (TypeOf(words[i]).isSigned) {
+                ForEachLane(lanes, [&](uint32_t lane) {
+                    offsets[lane] += static_cast<uint64_t>(int64_t(AsInt(index[lane])) * stride);
+                });
+            } else {
+                ForEachLane(lanes, [&](uint32_t lane) {
+                    offsets[lane] += uint64_t(index[lane]) * stride;
+                });
+            }
+            typeId = type.element;
+        }
+
+        ForEachLane(lanes, [&](uint32_t lane) {
+            destination[laneCapacity + lane] = offsets[lane] < kOutOfBoundsOffset ? static_cast<uint32_t>(offsets[lane]) : kOutOfBoundsOffset;
+        });
+    }
+
+    void SpirvProgram::Executor::ExecuteInstruction(const uint32_t* words, uint32_t wordCount, const Lanes& lanes) {
+        uint32_t opcode = words[0] & spv::OpCodeMask;
+        uint32_t n = laneCapacity;
+
+        switch (opcode) {
+            case spv::OpNop:
+            case spv::OpLine:
+            case spv::OpNoLine:
+            case spv::OpLoopMerge:
+            case spv::OpSelectionMerge:
+            case spv::OpMemoryBarrier:
+                break;
+
+            case spv::OpUndef:
+                {
+                    uint32_t* destination = Register(words[2]);
+                    for (uint32_t word = 0; word < program.types[words[1]].words; ++word) {
+                        ForEachLane(lanes, [&](uint32_t lane) {
+                            destination[word * n + lane] = 0;
+                        });
+                    }
+                }
+                break;
+
+            case spv::OpExtInst:
+                ExecuteExtInst(words, wordCount, lanes);
+                break;
+
+            case spv::OpVariable:
+                {
+                    uint32_t* destination = Register(words[2]);
+                    uint32_t offset = program.variableOffsets[words[2]];
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        destination[lane] = MemorySlotPrivate;
+                        destination[n + lane] = offset;
+                    });
+                    if (wordCount > 4) {
+                        const Type& type = program.types[program.types[words[1]].element];
+                        const uint32_t* initializer = Register(words[4]);
+                        ForEachLane(lanes, [&](uint32_t lane) {
+                            Store(Resolve(lane, MemorySlotPrivate, offset, type.size), type, lane, initializer);
+                        });
+                    }
+                }
+                break;
+
+            case spv::OpLoad:
+                {
+                    const Type& type = program.types[words[1]];
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* pointer = Register(words[3]);
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        Load(destination, type, lane, Resolve(lane, pointer[lane], pointer[n + lane], type.size));
+                    });
+                }
+                break;
+
+            case spv::OpStore:
+                {
+                    const Type& type = TypeOf(words[2]);
+                    const uint32_t* pointer = Register(words[1]);
+                    const uint32_t* value = Register(words[2]);
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        Store(Resolve(lane, pointer[lane], pointer[n + lane], type.size), type, lane, value);
+                    });
+                }
+                break;
+
+            case spv::OpCopyMemory:
+                {
+                    uint32_t size = program.types[TypeOf(words[1]).element].size;
+                    const uint32_t* target = Register(words[1]);
+                    const uint32_t* source = Register(words[2]);
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        uint8_t* to = Resolve(lane, target[lane], target[n + lane], size);
+                        uint8_t* from = Resolve(lane, source[lane], source[n + lane], size);
+                        if (to != nullptr && from != nullptr) {
+                            memmove(to, from, size);
+                        }
+                    });
+                }
+                break;
+
+            case spv::OpAccessChain:
+            case spv::OpInBoundsAccessChain:
+                ExecuteAccessChain(words, wordCount, lanes);
+                break;
+
+            case spv::OpArrayLength:
+                {
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* pointer = Register(words[3]);
+                    const Type& structure = program.types[TypeOf(words[3]).element];
+                    uint32_t member = wordCount > 4 && words[4] < structure.members.size() ? words[4] : 0;
+                    uint32_t stride = program.types[structure.members[member]].stride;
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        uint32_t slot = pointer[lane];
+                        uint64_t begin = uint64_t(pointer[n + lane]) + structure.memberOffsets[member];
+                        uint64_t size = 0;
+                        if (slot >= MemorySlotFirstResource && slot - MemorySlotFirstResource < resourceMemories.size()) {
+                            size = resourceMemories[slot - MemorySlotFirstResource].size;
+                        }
+                        destination[lane] = size > begin && stride != 0 ? static_cast<uint32_t>((size - begin) / stride) : 0;
+                    });
+                }
+                break;
+
+            case spv::OpVectorExtractDynamic:
+                {
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* vector = Register(words[3]);
+                    const uint32_t* index = Register(words[4]);
+                    uint32_t count = TypeOf(words[3]).words;
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        destination[lane] = index[lane] < count ? vector[index[lane] * n + lane] : 0;
+                    });
+                }
+                break;
+
+            case spv::OpVectorInsertDynamic:
+                {
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* vector = Register(words[3]);
+                    const uint32_t* component = Register(words[4]);
+                    const uint32_t* index = Register(words[5]);
+                    uint32_t count = program.types[words[1]].words;
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        for (uint32_t word = 0; word < count; ++word) {
+                            destination[word * n + lane] = word == index[lane] ? component[lane] : vector[word * n + lane];
+                        }
+                    });
+                }
+                break;
+
+            case spv::OpVectorShuffle:
+                {
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* first = Register(words[3]);
+                    const uint32_t* second = Register(words[4]);
+                    uint32_t firstCount = TypeOf(words[3]).words;
+                    uint32_t secondCount = TypeOf(words[4]).words;
+
+                    // The result may be one of the operands, so it is computed before being written.
+                    std::vector<uint32_t> result(size_t(wordCount - 5) * n);
+                    for (uint32_t i = 5; i < wordCount; ++i) {
+                        uint32_t component = words[i];
+                        uint32_t* d = result.data() + (i - 5) * n;
+                        if (component < firstCount) {
+                            const uint32_t* s = first + component * n;
+                            ForEachLane(lanes, [&](uint32_t lane) { d[lane] = s[lane]; });
+                        } else if (component - firstCount < secondCount) {
+                            const uint32_t* s = second + (component - firstCount) * n;
+                            ForEachLane(lanes, [&](uint32_t lane) { d[lane] = s[lane]; });
+                        } else {
+                            ForEachLane(lanes, [&](uint32_t lane) { d[lane] = 0; });
+                        }
+                    }
+                    for (uint32_t word = 0; word < wordCount - 5; ++word) {
+                        ForEachLane(lanes, [&](uint32_t lane) {
+                            destination[word * n + lane] = result[word * n + lane];
+                        });
+                    }
+                }
+                break;
+
+            case spv::OpCompositeConstruct:
+                {
+                    // Composites are the concatenation of their constituents.
+                    uint32_t* destination = Register(words[2]);
+                    uint32_t total = program.types[words[1]].words;
+                    uint32_t next = 0;
+                    for (uint32_t i = 3; i < wordCount; ++i) {
+                        const uint32_t* constituent = Register(words[i]);
+                        uint32_t count = TypeOf(words[i]).words;
+                        for (uint32_t word = 0; word < count && next < total; ++word, ++next) {
+                            ForEachLane(lanes, [&](uint32_t lane) {
+                                destination[next * n + lane] = constituent[word * n + lane];
+                            });
+                        }
+                    }
+                }
+                break;
+
+            case spv::OpCompositeExtract:
+            case spv::OpCompositeInsert:
+                {
+                    bool isInsert = opcode == spv::OpCompositeInsert;
+                    uint32_t composite = isInsert ? words[4] : words[3];
+                    uint32_t firstIndex = isInsert ? 5 : 4;
+
+                    // Finds the words of the part of the composite.
+                    uint32_t typeId = program.valueTypes[composite];
+                    uint32_t start = 0;
+                    for (uint32_t i = firstIndex; i < wordCount; ++i) {
+                        const Type& type = program.types[typeId];
+                        uint32_t index = words[i];
+                        if (type.kind == TypeKind::Struct) {
+                            if (index >= type.members.size()) {
+                                break;
+                            }
+                            for (uint32_t member = 0; member < index; ++member) {
+                                start += program.types[type.members[member]].words;
+                            }
+                            typeId = type.members[index];
+                        } else {
+                            if (index >= type.count) {
+                                break;
+                            }
+                            uint32_t elementWords = type.kind == TypeKind::Vector ? 1 : program.types[type.element].words;
+                            start += index * elementWords;
+                            typeId = type.element;
+                        }
+                    }
+                    uint32_t partWords = program.types[typeId].words;
+
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* source = Register(composite);
+                    if (!isInsert) {
+                        for (uint32_t word = 0; word < partWords; ++word) {
+                            ForEachLane(lanes, [&](uint32_t lane) {
+                                destination[word * n + lane] = source[(start + word) * n + lane];
+                            });
+                        }
+                    } else {
+                        const uint32_t* object = Register(words[3]);
+                        uint32_t total = program.types[words[1]].words;
+                        for (uint32_t word = 0; word < total; ++word) {
+                            const uint32_t* s = word >= start && word < start + partWords ? object + (word - start) * n : source + word * n;
+                            ForEachLane(lanes, [&](uint32_t lane) {
+                                destination[word * n + lane] = s[lane];
+                            });
+                        }
+                    }
+                }
+                break;
+
+            case spv::OpCopyObject:
+            case spv::OpBitcast:
+            case spv::OpUConvert:
+            case spv::OpSConvert:
+            case spv::OpFConvert:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return a; });
+                break;
+
+            case spv::OpTranspose:
+                {
+                    const Type& resultType = program.types[words[1]];
+                    uint32_t columns = resultType.count;
+                    uint32_t rows = program.types[resultType.element].count;
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* matrix = Register(words[3]);
+                    for (uint32_t column = 0; column < columns; ++column) {
+                        for (uint32_t row = 0; row < rows; ++row) {
+                            const uint32_t* s = matrix + (row * columns + column) * n;
+                            uint32_t* d = destination + (column * rows + row) * n;
+                            ForEachLane(lanes, [&](uint32_t lane) { d[lane] = s[lane]; });
+                        }
+                    }
+                }
+                break;
+
+            case spv::OpConvertFToU:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return ConvertToUInt(AsFloat(a)); });
+                break;
+            case spv::OpConvertFToS:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return FromInt(ConvertToInt(AsFloat(a))); });
+                break;
+            case spv::OpConvertSToF:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return FromFloat(static_cast<float>(AsInt(a))); });
+                break;
+            case spv::OpConvertUToF:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return FromFloat(static_cast<float>(a)); });
+                break;
+
+            case spv::OpSNegate:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return 0u - a; });
+                break;
+            case spv::OpFNegate:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return a ^ 0x80000000u; });
+                break;
+            case spv::OpNot:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return ~a; });
+                break;
+            case spv::OpLogicalNot:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return a == 0 ? 1u : 0u; });
+                break;
+            case spv::OpIsNan:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return std::isnan(AsFloat(a)) ? 1u : 0u; });
+                break;
+            case spv::OpIsInf:
+                Componentwise1(words[1], words[2], words[3], lanes, [](uint32_t a) { return std::isinf(AsFloat(a)) ? 1u : 0u; });
+                break;
+
+            case spv::OpIAdd:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a + b; });
+                break;
+            case spv::OpISub:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a - b; });
+                break;
+            case spv::OpIMul:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a * b; });
+                break;
+            case spv::OpUDiv:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return b == 0 ? 0u : a / b; });
+                break;
+            case spv::OpUMod:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return b == 0 ? 0u : a % b; });
+                break;
+            case spv::OpSDiv:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) {
+                    if (b == 0 || (AsInt(a) == std::numeric_limits<int32_t>::min() && AsInt(b) == -1)) {
+                        return b == 0 ? 0u : a;
+                    }
+                    return FromInt(AsInt(a) / AsInt(b));
+                });
+                break;
+            case spv::OpSRem:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) {
+                    if (b == 0 || AsInt(b) == -1) {
+                        return 0u;
+                    }
+                    return FromInt(AsInt(a) % AsInt(b));
+                });
+                break;
+            case spv::OpSMod:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) {
+                    if (b == 0 || AsInt(b) == -1) {
+                        return 0u;
+                    }
+                    int32_t remainder = AsInt(a) % AsInt(b);
+                    if (remainder != 0 && (remainder < 0) != (AsInt(b) < 0)) {
+                        remainder += AsInt(b);
+                    }
+                    return FromInt(remainder);
+                });
+                break;
+
+            case spv::OpFAdd:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return FromFloat(AsFloat(a) + AsFloat(b)); });
+                break;
+            case spv::OpFSub:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return FromFloat(AsFloat(a) - AsFloat(b)); });
+                break;
+            case spv::OpFMul:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return FromFloat(AsFloat(a) * AsFloat(b)); });
+                break;
+            case spv::OpFDiv:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return FromFloat(AsFloat(a) / AsFloat(b)); });
+                break;
+            case spv::OpFRem:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return FromFloat(std::fmod(AsFloat(a), AsFloat(b))); });
+                break;
+            case spv::OpFMod:
+                // The result has the sign of b, like GLSL's mod.
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) {
+                    float x = AsFloat(a);
+                    float y = AsFloat(b);
+                    return FromFloat(x - y * std::floor(x / y));
+                });
+                break;
+
+            case spv::OpShiftRightLogical:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a >> (b & 31); });
+                break;
+            case spv::OpShiftRightArithmetic:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) {
+                    return FromInt(AsInt(a) < 0 ? ~(~AsInt(a) >> (b & 31)) : AsInt(a) >> (b & 31));
+                });
+                break;
+            case spv::OpShiftLeftLogical:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a << (b & 31); });
+                break;
+            case spv::OpBitwiseOr:
+            case spv::OpLogicalOr:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a | b; });
+                break;
+            case spv::OpBitwiseXor:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a ^ b; });
+                break;
+            case spv::OpBitwiseAnd:
+            case spv::OpLogicalAnd:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a & b; });
+                break;
+
+            case spv::OpLogicalEqual:
+            case spv::OpIEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a == b ? 1u : 0u; });
+                break;
+            case spv::OpLogicalNotEqual:
+            case spv::OpINotEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a != b ? 1u : 0u; });
+                break;
+            case spv::OpUGreaterThan:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a > b ? 1u : 0u; });
+                break;
+            case spv::OpSGreaterThan:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsInt(a) > AsInt(b) ? 1u : 0u; });
+                break;
+            case spv::OpUGreaterThanEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a >= b ? 1u : 0u; });
+                break;
+            case spv::OpSGreaterThanEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsInt(a) >= AsInt(b) ? 1u : 0u; });
+                break;
+            case spv::OpULessThan:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a < b ? 1u : 0u; });
+                break;
+            case spv::OpSLessThan:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsInt(a) < AsInt(b) ? 1u : 0u; });
+                break;
+            case spv::OpULessThanEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return a <= b ? 1u : 0u; });
+                break;
+            case spv::OpSLessThanEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsInt(a) <= AsInt(b) ? 1u : 0u; });
+                break;
+
+            // The ordered comparisons are false when an operand is NaN, the unordered ones true.
+            case spv::OpFOrdEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsFloat(a) == AsFloat(b) ? 1u : 0u; });
+                break;
+            case spv::OpFUnordEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsFloat(a) == AsFloat(b) || std::isnan(AsFloat(a)) || std::isnan(AsFloat(b)) ? 1u : 0u; });
+                break;
+            case spv::OpFOrdNotEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsFloat(a) < AsFloat(b) || AsFloat(a) > AsFloat(b) ? 1u : 0u; });
+                break;
+            case spv::OpFUnordNotEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsFloat(a) != AsFloat(b) ? 1u : 0u; });
+                break;
+            case spv::OpFOrdLessThan:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsFloat(a) < AsFloat(b) ? 1u : 0u; });
+                break;
+            case spv::OpFUnordLessThan:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return !(AsFloat(a) >= AsFloat(b)) ? 1u : 0u; });
+                break;
+            case spv::OpFOrdGreaterThan:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsFloat(a) > AsFloat(b) ? 1u : 0u; });
+                break;
+            case spv::OpFUnordGreaterThan:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return !(AsFloat(a) <= AsFloat(b)) ? 1u : 0u; });
+                break;
+            case spv::OpFOrdLessThanEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsFloat(a) <= AsFloat(b) ? 1u : 0u; });
+                break;
+            case spv::OpFUnordLessThanEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return !(AsFloat(a) > AsFloat(b)) ? 1u : 0u; });
+                break;
+            case spv::OpFOrdGreaterThanEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return AsFloat(a) >= AsFloat(b) ? 1u : 0u; });
+                break;
+            case spv::OpFUnordGreaterThanEqual:
+                Componentwise2(words[1], words[2], words[3], words[4], lanes, [](uint32_t a, uint32_t b) { return !(AsFloat(a) < AsFloat(b)) ? 1u : 0u; });
+                break;
+
+            case spv::OpVectorTimesScalar:
+            case spv::OpMatrixTimesScalar:
+                {
+                    uint32_t count = program.types[words[1]].words;
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* vector = Register(words[3]);
+                    const uint32_t* scalar = Register(words[4]);
+                    for (uint32_t word = 0; word < count; ++word) {
+                        uint32_t* d = destination + word * n;
+                        const uint32_t* v = vector + word * n;
+                        ForEachLane(lanes, [&](uint32_t lane) {
+                            d[lane] = FromFloat(AsFloat(v[lane]) * AsFloat(scalar[lane]));
+                        });
+                    }
+                }
+                break;
+
+            case spv::OpDot:
+                {
+                    uint32_t count = TypeOf(words[3]).words;
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* a = Register(words[3]);
+                    const uint32_t* b = Register(words[4]);
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        float sum = 0.0f;
+                        for (uint32_t word = 0; word < count; ++word) {
+                            sum += AsFloat(a[word * n + lane]) * AsFloat(b[word * n + lane]);
+                        }
+                        destination[lane] = FromFloat(sum);
+                    });
+                }
+                break;
+
+            case spv::OpVectorTimesMatrix:
+            case spv::OpMatrixTimesVector:
+            case spv::OpMatrixTimesMatrix:
+                {
+                    // Matrices are stored column after column. A vector on the left is a row
+                    // and one on the right a column.
+                    const Type& left = TypeOf(words[3]);
+                    const Type& right = TypeOf(words[4]);
+                    uint32_t leftRows = left.kind == TypeKind::Matrix ? program.types[left.element].count : 1;
+                    uint32_t inner = left.count;
+                    uint32_t rightColumns = right.kind == TypeKind::Matrix ? right.count : 1;
+                    uint32_t rightRows = right.kind == TypeKind::Matrix ? program.types[right.element].count : right.count;
+
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* a = Register(words[3]);
+                    const uint32_t* b = Register(words[4]);
+                    std::vector<uint32_t> result(size_t(leftRows) * rightColumns * n);
+                    for (uint32_t column = 0; column < rightColumns; ++column) {
+                        for (uint32_t row = 0; row < leftRows; ++row) {
+                            ForEachLane(lanes, [&](uint32_t lane) {
+                                float sum = 0.0f;
+                                for (uint32_t k = 0; k < inner && k < rightRows; ++k) {
+                                    float x = AsFloat(a[(k * leftRows + row) * n + lane]);
+                                    float y = AsFloat(b[(column * rightRows + k) * n + lane]);
+                                    sum += x * y;
+                                }
+                                result[(column * leftRows + row) * n + lane] = FromFloat(sum);
+                            });
+                        }
+                    }
+                    uint32_t count = program.types[words[1]].words;
+                    for (uint32_t word = 0; word < count; ++word) {
+                        ForEachLane(lanes, [&](uint32_t lane) {
+                            destination[word * n + lane] = result[word * n + lane];
+                        });
+                    }
+                }
+                break;
+
+            case spv::OpAny:
+            case spv::OpAll:
+                {
+                    bool isAll = opcode == spv::OpAll;
+                    uint32_t count = TypeOf(words[3]).words;
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* vector = Register(words[3]);
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        bool result = isAll;
+                        for (uint32_t word = 0; word < count; ++word) {
+                            bool component = vector[word * n + lane] != 0;
+                            result = isAll ? result && component : result || component;
+                        }
+                        destination[lane] = result ? 1 : 0;
+                    });
+                }
+                break;
+
+            case spv::OpSelect:
+                {
+                    uint32_t count = program.types[words[1]].words;
+                    bool perComponent = TypeOf(words[3]).kind == TypeKind::Vector;
+                    uint32_t* destination = Register(words[2]);
+                    const uint32_t* condition = Register(words[3]);
+                    const uint32_t* a = Register(words[4]);
+                    const uint32_t* b = Register(words[5]);
+                    for (uint32_t word = 0; word < count; ++word) {
+                        const uint32_t* c = condition + (perComponent ? word * n : 0);
+                        ForEachLane(lanes, [&](uint32_t lane) {
+                            destination[word * n + lane] = c[lane] != 0 ? a[word * n + lane] : b[word * n + lane];
+                        });
+                    }
+                }
+                break;
+
+            default:
+                // Instructions are checked by Initialize.
+                break;
+        }
+    }
+
+    void SpirvProgram::Executor::ExecuteExtInst(const uint32_t* words, uint32_t wordCount, const Lanes& lanes) {
+        uint32_t n = laneCapacity;
+        uint32_t* destination = Register(words[2]);
+
+        // Componentwise instructions
+        auto Float1 = [&](float (*f)(float)) {
+            uint32_t count = program.types[words[1]].words;
+            const uint32_t* a = Register(words[5]);
+            for (uint32_t word = 0; word < count; ++word) {
+                ForEachLane(lanes, [&](uint32_t lane) {
+                    destination[word * n + lane] = FromFloat(f(AsFloat(a[word * n + lane])));
+                });
+            }
+        };
+        auto Float2 = [&](float (*f)(float, float)) {
+            uint32_t count = program.types[words[1]].words;
+            const uint32_t* a = Register(words[5]);
+            const uint32_t* b = Register(words[6]);
+            for (uint32_t word = 0; word < count; ++word) {
+                ForEachLane(lanes, [&](uint32_t lane) {
+                    destination[word * n + lane] = FromFloat(f(AsFloat(a[word * n + lane]), AsFloat(b[word * n + lane])));
+                });
+            }
+        };
+        auto Length = [&](const uint32_t* a, const uint32_t* b, uint32_t count, uint32_t lane) {
+            float sum = 0.0f;
+            for (uint32_t word = 0; word < count; ++word) {
+                float x = AsFloat(a[word * n + lane]);
+                if (b != nullptr) {
+                    x -= AsFloat(b[word * n + lane]);
+                }
+                sum += x * x;
+            }
+            return std::sqrt(sum);
+        };
+        auto Dot = [&](const uint32_t* a, const uint32_t* b, uint32_t count, uint32_t lane) {
+            float sum = 0.0f;
+            for (uint32_t word = 0; word < count; ++word) {
+                sum += AsFloat(a[word * n + lane]) * AsFloat(b[word * n + lane]);
+            }
+            return sum;
+        };
+
+        switch (words[4]) {
+            case GLSLstd450Round:
+                Float1([](float x) { return std::round(x); });
+                break;
+            case GLSLstd450RoundEven:
+                Float1([](float x) { return std::nearbyint(x); });
+                break;
+            case GLSLstd450Trunc:
+                Float1([](float x) { return std::trunc(x); });
+                break;
+            case GLSLstd450FAbs:
+                Float1([](float x) { return std::fabs(x); });
+                break;
+            case GLSLstd450FSign:
+                Float1([](float x) { return x > 0.0f ? 1.0f : (x < 0.0f ? -1.0f : 0.0f); });
+                break;
+            case GLSLstd450Floor:
+                Float1([](float x) { return std::floor(x); });
+                break;
+            case GLSLstd450Ceil:
+                Float1([](float x) { return std::ceil(x); });
+                break;
+            case GLSLstd450Fract:
+                Float1([](float x) { return x - std::floor(x); });
+                break;
+            case GLSLstd450Radians:
+                Float1([](float x) { return x * 0.01745329251994329577f; });
+                break;
+            case GLSLstd450Degrees:
+                Float1([](float x) { return x * 57.2957795130823208768f; });
+                break;
+            case GLSLstd450Sin:
+                Float1([](float x) { return std::sin(x); });
+                break;
+            case GLSLstd450Cos:
+                Float1([](float x) { return std::cos(x); });
+                break;
+            case GLSLstd450Tan:
+                Float1([](float x) { return std::tan(x); });
+                break;
+            case GLSLstd450Asin:
+                Float1([](float x) { return std::asin(x); });
+                break;
+            case GLSLstd450Acos:
+                Float1([](float x) { return std::acos(x); });
+                break;
+            case GLSLstd450Atan:
+                Float1([](float x) { return std::atan(x); });
+                break;
+            case GLSLstd450Exp:
+                Float1([](float x) { return std::exp(x); });
+                break;
+            case GLSLstd450Log:
+                Float1([](float x) { return std::log(x); });
+                break;
+            case GLSLstd450Exp2:
+                Float1([](float x) { return std::exp2(x); });
+                break;
+            case GLSLstd450Log2:
+                Float1([](float x) { return std::log2(x); });
+                break;
+            case GLSLstd450Sqrt:
+                Float1([](float x) { return std::sqrt(x); });
+                break;
+            case GLSLstd450InverseSqrt:
+                Float1([](float x) { return 1.0f / std::sqrt(x); });
+                break;
+
+            case GLSLstd450Atan2:
+                Float2([](float y, float x) { return std::atan2(y, x); });
+                break;
+            case GLSLstd450Pow:
+                Float2([](float x, float y) { return std::pow(x, y); });
+                break;
+            case GLSLstd450FMin:
+                Float2([](float x, float y) { return y < x ? y : x; });
+                break;
+            case GLSLstd450FMax:
+                Float2([](float x, float y) { return x < y ? y : x; });
+                break;
+            case GLSLstd450Step:
+                Float2([](float edge, float x) { return x < edge ? 0.0f : 1.0f; });
+                break;
+
+            case GLSLstd450SAbs:
+                Componentwise1(words[1], words[2], words[5], lanes, [](uint32_t a) { return AsInt(a) < 0 ? 0u - a : a; });
+                break;
+            case GLSLstd450SSign:
+                Componentwise1(words[1], words[2], words[5], lanes, [](uint32_t a) { return FromInt(AsInt(a) > 0 ? 1 : (AsInt(a) < 0 ? -1 : 0)); });
+                break;
+            case GLSLstd450UMin:
+                Componentwise2(words[1], words[2], words[5], words[6], lanes, [](uint32_t a, uint32_t b) { return std::min(a, b); });
+                break;
+            case GLSLstd450UMax:
+                Componentwise2(words[1], words[2], words[5], words[6], lanes, [](uint32_t a, uint32_t b) { return std::max(a, b); });
+                break;
+            case GLSLstd450SMin:
+                Componentwise2(words[1], words[2], words[5], words[6], lanes, [](uint32_t a, uint32_t b) { return FromInt(std::min(AsInt(a), AsInt(b))); });
+                break;
+            case GLSLstd450SMax:
+                Componentwise2(words[1], words[2], words[5], words[6], lanes, [](uint32_t a, uint32_t b) { return FromInt(std::max(AsInt(a), AsInt(b))); });
+                break;
+
+            case GLSLstd450FClamp:
+                Componentwise3(words[1], words[2], words[5], words[6], words[7], lanes, [](uint32_t a, uint32_t b, uint32_t c) {
+                    float x = AsFloat(a);
+                    float low = AsFloat(b);
+                    float high = AsFloat(c);
+                    float clamped = x < low ? low : x;
+                    return FromFloat(high < clamped ? high : clamped);
+                });
+                break;
+            case GLSLstd450UClamp:
+                Componentwise3(words[1], words[2], words[5], words[6], words[7], lanes, [](uint32_t a, uint32_t b, uint32_t c) {
+                    return std::min(std::max(a, b), c);
+                });
+                break;
+            case GLSLstd450SClamp:
+                Componentwise3(words[1], words[2], words[5], words[6], words[7], lanes, [](uint32_t a, uint32_t b, uint32_t c) {
+                    return FromInt(std::min(std::max(AsInt(a), AsInt(b)), AsInt(c)));
+                });
+                break;
+            case GLSLstd450FMix:
+                Componentwise3(words[1], words[2], words[5], words[6], words[7], lanes, [](uint32_t a, uint32_t b, uint32_t c) {
+                    float x = AsFloat(a);
+                    float y = AsFloat(b);
+                    float t = AsFloat(c);
+                    return FromFloat(x * (1.0f - t) + y * t);
+                });
+                break;
+            case GLSLstd450SmoothStep:
+                Componentwise3(words[1], words[2], words[5], words[6], words[7], lanes, [](uint32_t a, uint32_t b, uint32_t c) {
+                    float edge0 = AsFloat(a);
+                    float edge1 = AsFloat(b);
+                    float t = (AsFloat(c) - edge0) / (edge1 - edge0);
+                    t = t < 0.0f ? 0.0f : (t > 1.0f ? 1.0f : t);
+                    return FromFloat(t * t * (3.0f - 2.0f * t));
+                });
+                break;
+            case GLSLstd450Fma:
+                Componentwise3(words[1], words[2], words[5], words[6], words[7], lanes, [](uint32_t a, uint32_t b, uint32_t c) {
+                    return FromFloat(std::fma(AsFloat(a), AsFloat(b), AsFloat(c)));
+                });
+                break;
+
+            case GLSLstd450Length:
+            case GLSLstd450Distance:
+                {
+                    const uint32_t* a = Register(words[5]);
+                    const uint32_t* b = words[4] == GLSLstd450Distance ? Register(words[6]) : nullptr;
+                    uint32_t count = TypeOf(words[5]).words;
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        destination[lane] = FromFloat(Length(a, b, count, lane));
+                    });
+                }
+                break;
+
+            case GLSLstd450Normalize:
+                {
+                    const uint32_t* a = Register(words[5]);
+                    uint32_t count = TypeOf(words[5]).words;
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        float length = Length(a, nullptr, count, lane);
+                        for (uint32_t word = 0; word < count; ++word) {
+                            destination[word * n + lane] = FromFloat(AsFloat(a[word * n + lane]) / length);
+                        }
+                    });
+                }
+                break;
+
+            case GLSLstd450Cross:
+                {
+                    const uint32_t* a = Register(words[5]);
+                    const uint32_t* b = Register(words[6]);
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        float x[3];
+                        float y[3];
+                        for (uint32_t i = 0; i < 3; ++i) {
+                            x[i] = AsFloat(a[i * n + lane]);
+                            y[i] = AsFloat(b[i * n + lane]);
+                        }
+                        destination[lane] = FromFloat(x[1] * y[2] - y[1] * x[2]);
+                        destination[n + lane] = FromFloat(x[2] * y[0] - y[2] * x[0]);
+                        destination[2 * n + lane] = FromFloat(x[0] * y[1] - y[0] * x[1]);
+                    });
+                }
+                break;
+
+            case GLSLstd450FaceForward:
+                {
+                    const uint32_t* normal = Register(words[5]);
+                    const uint32_t* incident = Register(words[6]);
+                    const uint32_t* reference = Register(words[7]);
+                    uint32_t count = program.types[words[1]].words;
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        bool keep = Dot(reference, incident, count, lane) < 0.0f;
+                        for (uint32_t word = 0; word < count; ++word) {
+                            uint32_t value = normal[word * n + lane];
+                            destination[word * n + lane] = keep ? value : value ^ 0x80000000u;
+                        }
+                    });
+                }
+                break;
+
+            case GLSLstd450Reflect:
+                {
+                    const uint32_t* incident = Register(words[5]);
+                    const uint32_t* normal = Register(words[6]);
+                    uint32_t count = program.types[words[1]].words;
+                    ForEachLane(lanes, [&](uint32_t lane) {
+                        float dot = Dot(normal, incident, count, lane);
+                        for (uint32_t word = 0; word < count; ++word) {
+                            float i = AsFloat(incident[word * n + lane]);
+                            float normalComponent = AsFloat(normal[word * n + lane]);
+                            destination[word * n + lane] = FromFloat(i - 2.0f * dot * normalComponent);
+                        }
+                    });
+                }
+                break;
+        }
+    }
+
+    // Dispatch
+
+    void SpirvProgram::Dispatch(int entryPointIndex, const SpirvResources& resources,
+                                uint32_t x, uint32_t y, uint32_t z, WorkerPool* pool) const {
+        if (x == 0 || y == 0 || z == 0 || entryPointIndex < 0 ||
+            static_cast<size_t>(entryPointIndex) >= entryPoints.size()) {
+            return;
+        }
+
+        const EntryPoint& entryPoint = entryPoints[entryPointIndex];
+        uint32_t invocations = entryPoint.localSize[0] * entryPoint.localSize[1] * entryPoint.localSize[2];
+
+        // Workgroups can only share lanes when they don't share memory.
+        uint32_t workgroupsPerBatch = 1;
+        if (!usesWorkgroupMemory && invocations < kBatchInvocations) {
+            workgroupsPerBatch = kBatchInvocations / invocations;
+        }
+
+        uint64_t workgroups = uint64_t(x) * y * z;
+        uint64_t batches = (workgroups + workgroupsPerBatch - 1) / workgroupsPerBatch;
+
+        uint64_t chunks = 1;
+        if (pool != nullptr) {
+            chunks = std::min<uint64_t>(batches, (pool->GetNumThreads() + 1) * 4);
+        }
+
+        auto RunChunk = [&](size_t chunk) {
+            Executor executor(*this, entryPoint, resources, {{x, y, z}}, workgroupsPerBatch);
+            uint64_t begin = batches * chunk / chunks;
+            uint64_t end = batches * (chunk + 1) / chunks;
+            for (uint64_t batch = begin; batch < end; ++batch) {
+                executor.RunBatch(batch);
+            }
+        };
+
+        if (pool != nullptr) {
+            pool->ParallelFor(static_cast<size_t>(chunks), RunChunk);
+        } else {
+            RunChunk(0);
+        }
+    }
+
+}
+}
@@ -0,0 +1,190 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_CPU_SPIRVINTERPRETERCPU_H_
+#define BACKEND_CPU_SPIRVINTERPRETERCPU_H_
+
+#include "common/Forward.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace backend {
+    class WorkerPool;
+}
+
+namespace backend {
+namespace cpu {
+
+    // Memory bound to a resource of a compute shader.
+    struct SpirvMemory {
+        uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+
+    struct SpirvResources {
+        std::array<std::array<SpirvMemory, kMaxBindingsPerGroup>, kMaxBindGroups> buffers;
+        SpirvMemory pushConstants;
+    };
+
+    // Runs the compute entry points of a SPIR-V module on the CPU by interpreting it.
+    //
+    // The invocations of a workgroup run in lockstep as lanes: each instruction is executed for
+    // all the lanes at the same point of the program before moving to the next one, with values
+    // stored lane after lane so that the loops over the lanes can be vectorized. Lanes that
+    // diverge are scheduled by position in the function, so they wait at merge blocks and
+    // barriers for the lanes that are behind. Shaders that don't use workgroup memory put
+    // several workgroups in the lanes. Batches of lanes run in parallel on a WorkerPool.
+    //
+    // Floating point operations are done in single precision in program order, so results only
+    // depend on the inputs. Accesses outside of the memory bound to a resource read zeros and
+    // drop writes.
+    class SpirvProgram {
+        public:
+            // Returns false, and describes the problem in error, when the module uses something
+            // the interpreter doesn't support. Only the compute entry points are kept.
+            bool Initialize(std::vector<uint32_t> spirv, std::string* error);
+
+            // Returns the index of the compute entry point with this name, or -1.
+            int FindEntryPoint(const std::string& name) const;
+
+            void Dispatch(int entryPoint, const SpirvResources& resources,
+                          uint32_t x, uint32_t y, uint32_t z, WorkerPool* pool) const;
+
+        private:
+            class Executor;
+
+            enum class TypeKind {
+                Other,
+                Void,
+                Bool,
+                Int,
+                Float,
+                Vector,
+                Matrix,
+                Array,
+                RuntimeArray,
+                Struct,
+                Pointer,
+            };
+
+            struct Type {
+                TypeKind kind = TypeKind::Other;
+                bool isSigned = false;
+                // The component, column, element or pointee type.
+                uint32_t element = 0;
+                // The number of components, columns or elements.
+                uint32_t count = 0;
+                std::vector<uint32_t> members;
+                uint32_t storageClass = 0;
+
+                // The strides and offsets are the ones of the decorations, or tightly packed
+                // when there are none.
+                uint32_t stride = 0;
+                std::vector<uint32_t> memberOffsets;
+
+                // The number of 32 bit words of a value of this type, and for each of them the
+                // byte offset in memory.
+                uint32_t words = 0;
+                std::vector<uint32_t> wordOffsets;
+                uint32_t size = 0;
+            };
+
+            struct Instruction {
+                uint32_t opcode;
+                uint32_t wordCount;
+                // Index of the first word of the instruction.
+                uint32_t offset;
+            };
+
+            struct Block {
+                uint32_t label;
+                uint32_t begin;
+                uint32_t end;
+            };
+
+            struct Function {
+                std::vector<uint32_t> parameters;
+                std::vector<Instruction> instructions;
+                std::vector<Block> blocks;
+            };
+
+            struct EntryPoint {
+                std::string name;
+                uint32_t function;
+                std::array<uint32_t, 3> localSize;
+            };
+
+            // The variables of the module are in these memories. Pointers are stored as a slot
+            // and a byte offset in it.
+            enum MemorySlot : uint32_t {
+                MemorySlotPrivate = 0,
+                MemorySlotWorkgroup = 1,
+                MemorySlotFirstResource = 2,
+            };
+
+            struct Resource {
+                bool isPushConstants;
+                uint32_t set;
+                uint32_t binding;
+            };
+
+            struct BuiltinVariable {
+                uint32_t builtin;
+                uint32_t offset;
+            };
+
+            struct Constant {
+                uint32_t id;
+                std::vector<uint32_t> words;
+            };
+
+            struct VariableInitializer {
+                uint32_t offset;
+                uint32_t type;
+                uint32_t constant;
+            };
+
+            // Called by Initialize.
+            void ComputeLayout(uint32_t id);
+            void AllocateRegister(uint32_t id, uint32_t typeId);
+            uint32_t GetConstantScalar(uint32_t id) const;
+            bool IsSupported(uint32_t opcode) const;
+
+            std::vector<uint32_t> spirv;
+
+            // Indexed by id.
+            std::vector<Type> types;
+            std::vector<uint32_t> valueTypes;
+            std::vector<uint32_t> registerOffsets;
+            std::vector<int> functionIndices;
+            std::vector<uint32_t> labelBlocks;
+            std::vector<uint32_t> variableOffsets;
+            std::vector<int> constantIndices;
+
+            std::vector<Constant> constants;
+            std::vector<Function> functions;
+            std::vector<EntryPoint> entryPoints;
+            std::vector<Resource> resources;
+
+            // Module scope variables, their pointer is set once for all the lanes.
+            std::vector<Constant> variablePointers;
+            std::vector<VariableInitializer> privateInitializers;
+            std::vector<BuiltinVariable> builtins;
+            uint32_t workgroupSizeConstant = 0;
+
+            uint32_t registerWords = 0;
+            uint32_t privateSize = 0;
+            uint32_t workgroupSize = 0;
+            bool usesWorkgroupMemory = false;
+            uint32_t glslStd450 = 0;
+    };
+
+}
+}
+
+#endif // BACKEND_CPU_SPIRVINTERPRETERCPU_H_
@@ -6,3 +6,4 @@
 
 #include "common/Device.h"
 #include "common/CommandBuffer.h"
+#include "common/RenderBundle.h"
@@ -9,6 +9,7 @@
 
 #include <map>
 #include <mutex>
+#include <set>
 #include <unordered_set>
 
 #include "common/Buffer.h"
@@ -16,10 +17,13 @@
 #include "common/BindGroupLayout.h"
 #include "common/Device.h"
 #include "common/CommandBuffer.h"
+#include "common/Fence.h"
+#include "common/FenceSignalTracker.h"
 #include "common/InputState.h"
 #include "common/Pipeline.h"
 #include "common/PipelineLayout.h"
 #include "common/Queue.h"
+#include "common/RenderBundle.h"
 #include "common/Sampler.h"
 #include "common/ShaderModule.h"
 #include "common/Texture.h"
@@ -41,10 +45,12 @@ namespace metal {
     class Buffer;
     class BufferView;
     class CommandBuffer;
+    class Fence;
     class InputState;
     class Pipeline;
     class PipelineLayout;
     class Queue;
+    class RenderBundle;
     class Sampler;
     class ShaderModule;
     class Texture;
@@ -56,10 +62,12 @@ namespace metal {
         using BufferType = Buffer;
         using BufferViewType = BufferView;
         using CommandBufferType = CommandBuffer;
+        using FenceType = Fence;
         using InputStateType = InputState;
         using PipelineType = Pipeline;
         using PipelineLayoutType = PipelineLayout;
         using QueueType = Queue;
+        using RenderBundleType = RenderBundle;
         using SamplerType = Sampler;
         using ShaderModuleType = ShaderModule;
         using TextureType = Texture;
@@ -81,15 +89,19 @@ namespace metal {
             BufferBase* CreateBuffer(BufferBuilder* builder) override;
             BufferViewBase* CreateBufferView(BufferViewBuilder* builder) override;
             CommandBufferBase* CreateCommandBuffer(CommandBufferBuilder* builder) override;
+            FenceBase* CreateFence(FenceBuilder* builder) override;
             InputStateBase* CreateInputState(InputStateBuilder* builder) override;
             PipelineBase* CreatePipeline(PipelineBuilder* builder) override;
             PipelineLayoutBase* CreatePipelineLayout(PipelineLayoutBuilder* builder) override;
             QueueBase* CreateQueue(QueueBuilder* builder) override;
+            RenderBundleBase* CreateRenderBundle(RenderBundleBuilder* builder) override;
             SamplerBase* CreateSampler(SamplerBuilder* builder) override;
             ShaderModuleBase* CreateShaderModule(ShaderModuleBuilder* builder) override;
             TextureBase* CreateTexture(TextureBuilder* builder) override;
             TextureViewBase* CreateTextureView(TextureViewBuilder* builder) override;
 
+            void TickImpl() override;
+
             void SetNextDrawable(id<CAMetalDrawable> drawable);
             void Present();
 
@@ -97,6 +109,10 @@ namespace metal {
             id<MTLTexture> GetCurrentTexture();
             id<MTLTexture> GetCurrentDepthTexture();
 
+            // Commits a command buffer on the queue that completes the signal once the GPU is done
+            // with the work committed before it.
+            void SignalFence(id<MTLCommandQueue> queue, FenceBase* fence, uint64_t value);
+
             // NXT API
             void Reference();
             void Release();
@@ -108,6 +124,15 @@ namespace metal {
             id<CAMetalDrawable> currentDrawable = nil;
             id<MTLTexture> currentTexture = nil;
             id<MTLTexture> currentDepthTexture = nil;
+
+            FenceSignalTracker fenceSignalTracker;
+            uint64_t lastSignalSerial = 0;
+            uint64_t completedSignalSerial = 0;
+            // Filled by the completion handlers that run on a Metal thread. Queues complete their
+            // signals in any order relative to each other so a serial is only completed once all
+            // the serials before it are.
+            std::mutex handledSignalsMutex;
+            std::set<uint64_t> handledSignalSerials;
     };
 
     class BindGroup : public BindGroupBase {
@@ -160,6 +185,15 @@ namespace metal {
         private:
             Device* device;
             CommandIterator commands;
+            CommandReferences references;
+    };
+
+    class Fence : public FenceBase {
+        public:
+            Fence(Device* device, FenceBuilder* builder);
+
+        private:
+            Device* device;
     };
 
     class InputState : public InputStateBase {
@@ -213,6 +247,7 @@ namespace metal {
             id<MTLCommandQueue> GetMTLCommandQueue();
 
             // NXT API
+            void Signal(Fence* fence, uint64_t value);
             void Submit(uint32_t numCommands, CommandBuffer* const * commands);
 
         private:
@@ -220,6 +255,14 @@ namespace metal {
             id<MTLCommandQueue> commandQueue = nil;
     };
 
+    class RenderBundle : public RenderBundleBase {
+        public:
+            RenderBundle(Device* device, RenderBundleBuilder* builder);
+
+        private:
+            Device* device;
+    };
+
     class Sampler : public SamplerBase {
         public:
             Sampler(Device* device, SamplerBuilder* builder);
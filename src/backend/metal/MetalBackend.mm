@@ -68,6 +68,9 @@ namespace metal {
     CommandBufferBase* Device::CreateCommandBuffer(CommandBufferBuilder* builder) {
         return new CommandBuffer(this, builder);
     }
+    FenceBase* Device::CreateFence(FenceBuilder* builder) {
+        return new Fence(this, builder);
+    }
     InputStateBase* Device::CreateInputState(InputStateBuilder* builder) {
         return new InputState(this, builder);
     }
@@ -80,6 +83,9 @@ namespace metal {
     QueueBase* Device::CreateQueue(QueueBuilder* builder) {
         return new Queue(this, builder);
     }
+    RenderBundleBase* Device::CreateRenderBundle(RenderBundleBuilder* builder) {
+        return new RenderBundle(this, builder);
+    }
     SamplerBase* Device::CreateSampler(SamplerBuilder* builder) {
         return new Sampler(this, builder);
     }
@@ -93,6 +99,18 @@ namespace metal {
         return new TextureView(this, builder);
     }
 
+    void Device::TickImpl() {
+        {
+            std::lock_guard<std::mutex> lock(handledSignalsMutex);
+            while (!handledSignalSerials.empty() && *handledSignalSerials.begin() == completedSignalSerial + 1) {
+                completedSignalSerial ++;
+                handledSignalSerials.erase(handledSignalSerials.begin());
+            }
+        }
+
+        fenceSignalTracker.CompleteSignals(completedSignalSerial);
+    }
+
     void Device::SetNextDrawable(id<CAMetalDrawable> drawable) {
         [currentDrawable release];
         currentDrawable = drawable;
@@ -155,6 +173,19 @@ namespace metal {
         return currentDepthTexture;
     }
 
+    void Device::SignalFence(id<MTLCommandQueue> queue, FenceBase* fence, uint64_t value) {
+        uint64_t serial = ++lastSignalSerial;
+        fenceSignalTracker.AddSignal(fence, value, serial);
+
+        // The command buffers of a queue complete in order, after the work committed before them.
+        id<MTLCommandBuffer> commandBuffer = [queue commandBuffer];
+        [commandBuffer addCompletedHandler:^(id<MTLCommandBuffer>) {
+            std::lock_guard<std::mutex> lock(handledSignalsMutex);
+            handledSignalSerials.insert(serial);
+        }];
+        [commandBuffer commit];
+    }
+
     void Device::Reference() {
     }
 
@@ -222,11 +253,11 @@ namespace metal {
     }
 
     CommandBuffer::CommandBuffer(Device* device, CommandBufferBuilder* builder)
-        : device(device), commands(builder->AcquireCommands()) {
+        : device(device), commands(builder->AcquireCommands()), references(builder->AcquireReferences()) {
     }
 
     CommandBuffer::~CommandBuffer() {
-        FreeCommands(&commands);
+        FreeCommands(&commands, &references);
     }
 
     namespace {
@@ -287,23 +318,23 @@ namespace metal {
 
     }
 
-    void CommandBuffer::FillCommands(id<MTLCommandBuffer> commandBuffer, std::unordered_set<std::mutex*>* mutexes) {
+    // Encodes the commands in the current encoders. Render bundles are encoded inline by
+    // recursing on their commands.
+    static void EncodeCommands(CommandIterator* commands, id<MTLCommandBuffer> commandBuffer,
+                               CurrentEncoders* encoders, std::unordered_set<std::mutex*>* mutexes) {
         Command type;
         Pipeline* lastPipeline = nullptr;
         id<MTLBuffer> indexBuffer = nil;
         uint32_t indexBufferOffset = 0;
         MTLIndexType indexType = MTLIndexTypeUInt32;
 
-        CurrentEncoders encoders;
-        encoders.device = device;
-
-        while (commands.NextCommandId(&type)) {
+        while (commands->NextCommandId(&type)) {
             switch (type) {
                 case Command::CopyBufferToTexture:
                     {
-                        CopyBufferToTextureCmd* copy = commands.NextCommand<CopyBufferToTextureCmd>();
-                        Buffer* buffer = ToBackend(copy->buffer.Get());
-                        Texture* texture = ToBackend(copy->texture.Get());
+                        CopyBufferToTextureCmd* copy = commands->NextCommand<CopyBufferToTextureCmd>();
+                        Buffer* buffer = ToBackend(copy->buffer);
+                        Texture* texture = ToBackend(copy->texture);
 
                         // TODO(kainino@chromium.org): this has to be in a Blit encoder, not a Render encoder, so ordering is lost here
                         unsigned rowSize = copy->width * TextureFormatPixelSize(texture->GetFormat());
@@ -317,8 +348,8 @@ namespace metal {
                         size.height = copy->height;
                         size.depth = copy->depth;
 
-                        encoders.EnsureBlit(commandBuffer);
-                        [encoders.blit
+                        encoders->EnsureBlit(commandBuffer);
+                        [encoders->blit
                             copyFromBuffer:buffer->GetMTLBuffer()
                             sourceOffset:0
                             sourceBytesPerRow:rowSize
@@ -333,21 +364,34 @@ namespace metal {
 
                 case Command::Dispatch:
                     {
-                        DispatchCmd* dispatch = commands.NextCommand<DispatchCmd>();
-                        encoders.EnsureCompute(commandBuffer);
+                        DispatchCmd* dispatch = commands->NextCommand<DispatchCmd>();
+                        encoders->EnsureCompute(commandBuffer);
                         ASSERT(lastPipeline->IsCompute());
 
-                        [encoders.compute dispatchThreadgroups:MTLSizeMake(dispatch->x, dispatch->y, dispatch->z)
+                        [encoders->compute dispatchThreadgroups:MTLSizeMake(dispatch->x, dispatch->y, dispatch->z)
+                            threadsPerThreadgroup: lastPipeline->GetLocalWorkGroupSize()];
+                    }
+                    break;
+
+                case Command::DispatchIndirect:
+                    {
+                        DispatchIndirectCmd* dispatch = commands->NextCommand<DispatchIndirectCmd>();
+                        Buffer* buffer = ToBackend(dispatch->buffer);
+                        encoders->EnsureCompute(commandBuffer);
+                        ASSERT(lastPipeline->IsCompute());
+
+                        [encoders->compute dispatchThreadgroupsWithIndirectBuffer:buffer->GetMTLBuffer()
+                            indirectBufferOffset:dispatch->offset
                             threadsPerThreadgroup: lastPipeline->GetLocalWorkGroupSize()];
                     }
                     break;
 
                 case Command::DrawArrays:
                     {
-                        DrawArraysCmd* draw = commands.NextCommand<DrawArraysCmd>();
+                        DrawArraysCmd* draw = commands->NextCommand<DrawArraysCmd>();
 
-                        encoders.EnsureRender(commandBuffer);
-                        [encoders.render
+                        encoders->EnsureRender(commandBuffer);
+                        [encoders->render
                             drawPrimitives:MTLPrimitiveTypeTriangle
                             vertexStart:draw->firstVertex
                             vertexCount:draw->vertexCount
@@ -356,12 +400,25 @@ namespace metal {
                     }
                     break;
 
+                case Command::DrawArraysIndirect:
+                    {
+                        DrawArraysIndirectCmd* draw = commands->NextCommand<DrawArraysIndirectCmd>();
+                        Buffer* buffer = ToBackend(draw->buffer);
+
+                        encoders->EnsureRender(commandBuffer);
+                        [encoders->render
+                            drawPrimitives:MTLPrimitiveTypeTriangle
+                            indirectBuffer:buffer->GetMTLBuffer()
+                            indirectBufferOffset:draw->offset];
+                    }
+                    break;
+
                 case Command::DrawElements:
                     {
-                        DrawElementsCmd* draw = commands.NextCommand<DrawElementsCmd>();
+                        DrawElementsCmd* draw = commands->NextCommand<DrawElementsCmd>();
 
-                        encoders.EnsureRender(commandBuffer);
-                        [encoders.render
+                        encoders->EnsureRender(commandBuffer);
+                        [encoders->render
                             drawIndexedPrimitives:MTLPrimitiveTypeTriangle
                             indexCount:draw->indexCount
                             indexType:indexType
@@ -373,25 +430,54 @@ namespace metal {
                     }
                     break;
 
+                case Command::DrawElementsIndirect:
+                    {
+                        DrawElementsIndirectCmd* draw = commands->NextCommand<DrawElementsIndirectCmd>();
+                        Buffer* buffer = ToBackend(draw->buffer);
+
+                        encoders->EnsureRender(commandBuffer);
+                        [encoders->render
+                            drawIndexedPrimitives:MTLPrimitiveTypeTriangle
+                            indexType:indexType
+                            indexBuffer:indexBuffer
+                            indexBufferOffset:indexBufferOffset
+                            indirectBuffer:buffer->GetMTLBuffer()
+                            indirectBufferOffset:draw->offset];
+                    }
+                    break;
+
+                case Command::ExecuteBundle:
+                    {
+                        ExecuteBundleCmd* cmd = commands->NextCommand<ExecuteBundleCmd>();
+                        EncodeCommands(ToBackend(cmd->bundle)->GetCommands(), commandBuffer, encoders, mutexes);
+
+                        // The bundle starts and ends with an unknown state, it is set again afterwards.
+                        lastPipeline = nullptr;
+                        indexBuffer = nil;
+                        indexBufferOffset = 0;
+                        indexType = MTLIndexTypeUInt32;
+                    }
+                    break;
+
                 case Command::SetPipeline:
                     {
-                        SetPipelineCmd* cmd = commands.NextCommand<SetPipelineCmd>();
-                        lastPipeline = ToBackend(cmd->pipeline).Get();
+                        SetPipelineCmd* cmd = commands->NextCommand<SetPipelineCmd>();
+                        lastPipeline = ToBackend(cmd->pipeline);
 
                         if (lastPipeline->IsCompute()) {
-                            encoders.EnsureCompute(commandBuffer);
-                            lastPipeline->Encode(encoders.compute);
+                            encoders->EnsureCompute(commandBuffer);
+                            lastPipeline->Encode(encoders->compute);
                         } else {
-                            encoders.EnsureRender(commandBuffer);
-                            lastPipeline->Encode(encoders.render);
+                            encoders->EnsureRender(commandBuffer);
+                            lastPipeline->Encode(encoders->render);
                         }
                     }
                     break;
 
                 case Command::SetPushConstants:
                     {
-                        SetPushConstantsCmd* cmd = commands.NextCommand<SetPushConstantsCmd>();
-                        uint32_t* valuesUInt = commands.NextData<uint32_t>(cmd->count);
+                        SetPushConstantsCmd* cmd = commands->NextCommand<SetPushConstantsCmd>();
+                        uint32_t* valuesUInt = commands->NextData<uint32_t>(cmd->count);
                         int32_t* valuesInt = reinterpret_cast<int32_t*>(valuesUInt);
                         float* valuesFloat = reinterpret_cast<float*>(valuesUInt);
 
@@ -401,16 +487,16 @@ namespace metal {
 
                 case Command::SetBindGroup:
                     {
-                        SetBindGroupCmd* cmd = commands.NextCommand<SetBindGroupCmd>();
-                        BindGroup* group = ToBackend(cmd->group.Get());
+                        SetBindGroupCmd* cmd = commands->NextCommand<SetBindGroupCmd>();
+                        BindGroup* group = ToBackend(cmd->group);
                         uint32_t groupIndex = cmd->index;
 
                         const auto& layout = group->GetLayout()->GetBindingInfo();
 
                         if (lastPipeline->IsCompute()) {
-                            encoders.EnsureCompute(commandBuffer);
+                            encoders->EnsureCompute(commandBuffer);
                         } else {
-                            encoders.EnsureRender(commandBuffer);
+                            encoders->EnsureRender(commandBuffer);
                         }
 
                         // TODO(kainino@chromium.org): Maintain buffers and offsets arrays in BindGroup so that we
@@ -450,19 +536,19 @@ namespace metal {
                                         const id<MTLBuffer> buffer = b->GetMTLBuffer();
                                         const NSUInteger offset = view->GetOffset();
                                         if (vertStage) {
-                                            [encoders.render
+                                            [encoders->render
                                                 setVertexBuffers:&buffer
                                                 offsets:&offset
                                                 withRange:NSMakeRange(vertIndex, 1)];
                                         }
                                         if (fragStage) {
-                                            [encoders.render
+                                            [encoders->render
                                                 setFragmentBuffers:&buffer
                                                 offsets:&offset
                                                 withRange:NSMakeRange(fragIndex, 1)];
                                         }
                                         if (computeStage) {
-                                            [encoders.compute
+                                            [encoders->compute
                                                 setBuffers:&buffer
                                                 offsets:&offset
                                                 withRange:NSMakeRange(computeIndex, 1)];
@@ -475,17 +561,17 @@ namespace metal {
                                     {
                                         auto sampler = ToBackend(group->GetBindingAsSampler(binding));
                                         if (vertStage) {
-                                            [encoders.render
+                                            [encoders->render
                                                 setVertexSamplerState:sampler->GetMTLSamplerState()
                                                 atIndex:vertIndex];
                                         }
                                         if (fragStage) {
-                                            [encoders.render
+                                            [encoders->render
                                                 setFragmentSamplerState:sampler->GetMTLSamplerState()
                                                 atIndex:fragIndex];
                                         }
                                         if (computeStage) {
-                                            [encoders.compute
+                                            [encoders->compute
                                                 setSamplerState:sampler->GetMTLSamplerState()
                                                 atIndex:computeIndex];
                                         }
@@ -496,17 +582,17 @@ namespace metal {
                                     {
                                         auto texture = ToBackend(group->GetBindingAsTextureView(binding)->GetTexture());
                                         if (vertStage) {
-                                            [encoders.render
+                                            [encoders->render
                                                 setVertexTexture:texture->GetMTLTexture()
                                                 atIndex:vertIndex];
                                         }
                                         if (fragStage) {
-                                            [encoders.render
+                                            [encoders->render
                                                 setFragmentTexture:texture->GetMTLTexture()
                                                 atIndex:fragIndex];
                                         }
                                         if (computeStage) {
-                                            [encoders.compute
+                                            [encoders->compute
                                                 setTexture:texture->GetMTLTexture()
                                                 atIndex:computeIndex];
                                         }
@@ -519,8 +605,8 @@ namespace metal {
 
                 case Command::SetIndexBuffer:
                     {
-                        SetIndexBufferCmd* cmd = commands.NextCommand<SetIndexBufferCmd>();
-                        auto b = ToBackend(cmd->buffer.Get());
+                        SetIndexBufferCmd* cmd = commands->NextCommand<SetIndexBufferCmd>();
+                        auto b = ToBackend(cmd->buffer);
                         mutexes->insert(&b->GetMutex());
                         indexBuffer = b->GetMTLBuffer();
                         indexBufferOffset = cmd->offset;
@@ -530,9 +616,9 @@ namespace metal {
 
                 case Command::SetVertexBuffers:
                     {
-                        SetVertexBuffersCmd* cmd = commands.NextCommand<SetVertexBuffersCmd>();
-                        auto buffers = commands.NextData<Ref<BufferBase>>(cmd->count);
-                        auto offsets = commands.NextData<uint32_t>(cmd->count);
+                        SetVertexBuffersCmd* cmd = commands->NextCommand<SetVertexBuffersCmd>();
+                        auto buffers = commands->NextData<BufferBase*>(cmd->count);
+                        auto offsets = commands->NextData<uint32_t>(cmd->count);
 
                         auto inputState = lastPipeline->GetInputState();
 
@@ -542,14 +628,14 @@ namespace metal {
                         // Perhaps an "array of vertex buffers(+offsets?)" should be
                         // a NXT API primitive to avoid reconstructing this array?
                         for (uint32_t i = 0; i < cmd->count; ++i) {
-                            Buffer* buffer = ToBackend(buffers[i].Get());
+                            Buffer* buffer = ToBackend(buffers[i]);
                             mutexes->insert(&buffer->GetMutex());
                             mtlBuffers[i] = buffer->GetMTLBuffer();
                             mtlOffsets[i] = offsets[i];
                         }
 
-                        encoders.EnsureRender(commandBuffer);
-                        [encoders.render
+                        encoders->EnsureRender(commandBuffer);
+                        [encoders->render
                             setVertexBuffers:mtlBuffers.data()
                             offsets:mtlOffsets.data()
                             withRange:NSMakeRange(kMaxBindingsPerGroup + cmd->startSlot, cmd->count)];
@@ -558,9 +644,29 @@ namespace metal {
             }
         }
 
+    }
+
+    void CommandBuffer::FillCommands(id<MTLCommandBuffer> commandBuffer, std::unordered_set<std::mutex*>* mutexes) {
+        CurrentEncoders encoders;
+        encoders.device = device;
+
+        EncodeCommands(&commands, commandBuffer, &encoders, mutexes);
+
         encoders.FinishEncoders();
     }
 
+    // RenderBundle
+
+    RenderBundle::RenderBundle(Device* device, RenderBundleBuilder* builder)
+        : RenderBundleBase(builder), device(device) {
+    }
+
+    // Fence
+
+    Fence::Fence(Device* device, FenceBuilder* builder)
+        : FenceBase(builder), device(device) {
+    }
+
     // InputState
 
     static MTLVertexFormat VertexFormatType(nxt::VertexFormat format) {
@@ -789,6 +895,16 @@ namespace metal {
         return commandQueue;
     }
 
+    void Queue::Signal(Fence* fence, uint64_t value) {
+        if (value <= fence->GetSignaledValue()) {
+            device->HandleError("Fence signaled with a value that isn't greater than the signaled value");
+            return;
+        }
+
+        fence->SetSignaledValue(value);
+        device->SignalFence(commandQueue, fence, value);
+    }
+
     void Queue::Submit(uint32_t numCommands, CommandBuffer* const * commands) {
         id<MTLCommandBuffer> commandBuffer = [commandQueue commandBuffer];
 
@@ -0,0 +1,202 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "NullBackend.h"
+
+#include "common/Commands.h"
+
+namespace backend {
+namespace null {
+    nxtProcTable GetNonValidatingProcs();
+    nxtProcTable GetValidatingProcs();
+
+    void Init(nxtProcTable* procs, nxtDevice* device) {
+        *procs = GetValidatingProcs();
+        *device = reinterpret_cast<nxtDevice>(new Device);
+    }
+
+    // Device
+
+    BindGroupBase* Device::CreateBindGroup(BindGroupBuilder* builder) {
+        return new BindGroup(builder);
+    }
+    BindGroupLayoutBase* Device::CreateBindGroupLayout(BindGroupLayoutBuilder* builder) {
+        return new BindGroupLayout(builder);
+    }
+    BufferBase* Device::CreateBuffer(BufferBuilder* builder) {
+        return new Buffer(builder);
+    }
+    BufferViewBase* Device::CreateBufferView(BufferViewBuilder* builder) {
+        return new BufferView(builder);
+    }
+    CommandBufferBase* Device::CreateCommandBuffer(CommandBufferBuilder* builder) {
+        return new CommandBuffer(builder);
+    }
+    FenceBase* Device::CreateFence(FenceBuilder* builder) {
+        return new Fence(builder);
+    }
+    InputStateBase* Device::CreateInputState(InputStateBuilder* builder) {
+        return new InputState(builder);
+    }
+    PipelineBase* Device::CreatePipeline(PipelineBuilder* builder) {
+        return new Pipeline(builder);
+    }
+    PipelineLayoutBase* Device::CreatePipelineLayout(PipelineLayoutBuilder* builder) {
+        return new PipelineLayout(builder);
+    }
+    QueueBase* Device::CreateQueue(QueueBuilder* builder) {
+        return new Queue(this, builder);
+    }
+    RenderBundleBase* Device::CreateRenderBundle(RenderBundleBuilder* builder) {
+        return new RenderBundle(builder);
+    }
+    SamplerBase* Device::CreateSampler(SamplerBuilder* builder) {
+        return new Sampler(builder);
+    }
+    ShaderModuleBase* Device::CreateShaderModule(ShaderModuleBuilder* builder) {
+        return new ShaderModule(builder);
+    }
+    TextureBase* Device::CreateTexture(TextureBuilder* builder) {
+        return new Texture(builder);
+    }
+    TextureViewBase* Device::CreateTextureView(TextureViewBuilder* builder) {
+        return new TextureView(builder);
+    }
+
+    void Device::TickImpl() {
+        fenceSignalTracker.CompleteSignals(lastSignalSerial);
+    }
+
+    void Device::SignalFence(FenceBase* fence, uint64_t value) {
+        fenceSignalTracker.AddSignal(fence, value, ++lastSignalSerial);
+    }
+
+    void Device::Reference() {
+    }
+
+    void Device::Release() {
+    }
+
+    // Buffer
+
+    Buffer::Buffer(BufferBuilder* builder)
+        : BufferBase(builder) {
+    }
+
+    void Buffer::SetSubDataImpl(uint32_t, uint32_t, const uint32_t*) {
+    }
+
+    // CommandBuffer
+
+    CommandBuffer::CommandBuffer(CommandBufferBuilder* builder)
+        : commands(builder->AcquireCommands()), references(builder->AcquireReferences()) {
+    }
+
+    CommandBuffer::~CommandBuffer() {
+        FreeCommands(&commands, &references);
+    }
+
+    CommandIterator* CommandBuffer::GetCommands() {
+        return &commands;
+    }
+
+    // Reads every command and its data like a backend replaying them would. Render bundles are
+    // walked inline by recursing on their commands.
+    static void WalkCommands(CommandIterator* commands) {
+        Command type;
+        while (commands->NextCommandId(&type)) {
+            switch (type) {
+                case Command::CopyBufferToTexture:
+                    commands->NextCommand<CopyBufferToTextureCmd>();
+                    break;
+
+                case Command::Dispatch:
+                    commands->NextCommand<DispatchCmd>();
+                    break;
+
+                case Command::DispatchIndirect:
+                    commands->NextCommand<DispatchIndirectCmd>();
+                    break;
+
+                case Command::DrawArrays:
+                    commands->NextCommand<DrawArraysCmd>();
+                    break;
+
+                case Command::DrawArraysIndirect:
+                    commands->NextCommand<DrawArraysIndirectCmd>();
+                    break;
+
+                case Command::DrawElements:
+                    commands->NextCommand<DrawElementsCmd>();
+                    break;
+
+                case Command::DrawElementsIndirect:
+                    commands->NextCommand<DrawElementsIndirectCmd>();
+                    break;
+
+                case Command::ExecuteBundle:
+                    {
+                        ExecuteBundleCmd* cmd = commands->NextCommand<ExecuteBundleCmd>();
+                        WalkCommands(ToBackend(cmd->bundle)->GetCommands());
+                    }
+                    break;
+
+                case Command::SetPipeline:
+                    commands->NextCommand<SetPipelineCmd>();
+                    break;
+
+                case Command::SetPushConstants:
+                    {
+                        SetPushConstantsCmd* cmd = commands->NextCommand<SetPushConstantsCmd>();
+                        commands->NextData<uint32_t>(cmd->count);
+                    }
+                    break;
+
+                case Command::SetBindGroup:
+                    commands->NextCommand<SetBindGroupCmd>();
+                    break;
+
+                case Command::SetIndexBuffer:
+                    commands->NextCommand<SetIndexBufferCmd>();
+                    break;
+
+                case Command::SetVertexBuffers:
+                    {
+                        SetVertexBuffersCmd* cmd = commands->NextCommand<SetVertexBuffersCmd>();
+                        commands->NextData<BufferBase*>(cmd->count);
+                        commands->NextData<uint32_t>(cmd->count);
+                    }
+                    break;
+            }
+        }
+    }
+
+    void CommandBuffer::Execute() {
+        WalkCommands(&commands);
+    }
+
+    // Queue
+
+    Queue::Queue(Device* device, QueueBuilder* builder)
+        : device(device) {
+    }
+
+    void Queue::Signal(Fence* fence, uint64_t value) {
+        if (value <= fence->GetSignaledValue()) {
+            device->HandleError("Fence signaled with a value that isn't greater than the signaled value");
+            return;
+        }
+
+        fence->SetSignaledValue(value);
+        device->SignalFence(fence, value);
+    }
+
+    void Queue::Submit(uint32_t numCommands, CommandBuffer* const * commands) {
+        for (uint32_t i = 0; i < numCommands; ++i) {
+            commands[i]->Execute();
+        }
+    }
+
+}
+}
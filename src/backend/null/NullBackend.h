@@ -0,0 +1,145 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_NULL_NULLBACKEND_H_
+#define BACKEND_NULL_NULLBACKEND_H_
+
+#include "nxt/nxtcpp.h"
+
+#include "common/Buffer.h"
+#include "common/BindGroup.h"
+#include "common/BindGroupLayout.h"
+#include "common/Device.h"
+#include "common/CommandAllocator.h"
+#include "common/CommandBuffer.h"
+#include "common/CommandReferences.h"
+#include "common/Fence.h"
+#include "common/FenceSignalTracker.h"
+#include "common/InputState.h"
+#include "common/Pipeline.h"
+#include "common/PipelineLayout.h"
+#include "common/Queue.h"
+#include "common/RenderBundle.h"
+#include "common/Sampler.h"
+#include "common/ShaderModule.h"
+#include "common/Texture.h"
+#include "common/ToBackend.h"
+
+// The null backend validates and records everything like the other backends but has no GPU
+// side: submitting walks the commands and fences complete on the next tick. It is used to
+// measure the cost of the frontend and the wire without a GPU context.
+
+namespace backend {
+namespace null {
+
+    using BindGroup = BindGroupBase;
+    using BindGroupLayout = BindGroupLayoutBase;
+    class Buffer;
+    using BufferView = BufferViewBase;
+    class CommandBuffer;
+    class Device;
+    using Fence = FenceBase;
+    using InputState = InputStateBase;
+    using Pipeline = PipelineBase;
+    using PipelineLayout = PipelineLayoutBase;
+    class Queue;
+    using RenderBundle = RenderBundleBase;
+    using Sampler = SamplerBase;
+    using ShaderModule = ShaderModuleBase;
+    using Texture = TextureBase;
+    using TextureView = TextureViewBase;
+
+    struct NullBackendTraits {
+        using BindGroupType = BindGroup;
+        using BindGroupLayoutType = BindGroupLayout;
+        using BufferType = Buffer;
+        using BufferViewType = BufferView;
+        using CommandBufferType = CommandBuffer;
+        using FenceType = Fence;
+        using InputStateType = InputState;
+        using PipelineType = Pipeline;
+        using PipelineLayoutType = PipelineLayout;
+        using QueueType = Queue;
+        using RenderBundleType = RenderBundle;
+        using SamplerType = Sampler;
+        using ShaderModuleType = ShaderModule;
+        using TextureType = Texture;
+        using TextureViewType = TextureView;
+    };
+
+    template<typename T>
+    auto ToBackend(T&& common) -> decltype(ToBackendBase<NullBackendTraits>(common)) {
+        return ToBackendBase<NullBackendTraits>(common);
+    }
+
+    class Device : public DeviceBase {
+        public:
+            BindGroupBase* CreateBindGroup(BindGroupBuilder* builder) override;
+            BindGroupLayoutBase* CreateBindGroupLayout(BindGroupLayoutBuilder* builder) override;
+            BufferBase* CreateBuffer(BufferBuilder* builder) override;
+            BufferViewBase* CreateBufferView(BufferViewBuilder* builder) override;
+            CommandBufferBase* CreateCommandBuffer(CommandBufferBuilder* builder) override;
+            FenceBase* CreateFence(FenceBuilder* builder) override;
+            InputStateBase* CreateInputState(InputStateBuilder* builder) override;
+            PipelineBase* CreatePipeline(PipelineBuilder* builder) override;
+            PipelineLayoutBase* CreatePipelineLayout(PipelineLayoutBuilder* builder) override;
+            QueueBase* CreateQueue(QueueBuilder* builder) override;
+            RenderBundleBase* CreateRenderBundle(RenderBundleBuilder* builder) override;
+            SamplerBase* CreateSampler(SamplerBuilder* builder) override;
+            ShaderModuleBase* CreateShaderModule(ShaderModuleBuilder* builder) override;
+            TextureBase* CreateTexture(TextureBuilder* builder) override;
+            TextureViewBase* CreateTextureView(TextureViewBuilder* builder) override;
+
+            void TickImpl() override;
+
+            // Everything submitted before the signal is done once Submit returns, so the signal
+            // completes on the next tick.
+            void SignalFence(FenceBase* fence, uint64_t value);
+
+            // NXT API
+            void Reference();
+            void Release();
+
+        private:
+            FenceSignalTracker fenceSignalTracker;
+            uint64_t lastSignalSerial = 0;
+    };
+
+    class Buffer : public BufferBase {
+        public:
+            Buffer(BufferBuilder* builder);
+
+        private:
+            void SetSubDataImpl(uint32_t start, uint32_t count, const uint32_t* data) override;
+    };
+
+    class CommandBuffer : public CommandBufferBase {
+        public:
+            CommandBuffer(CommandBufferBuilder* builder);
+            ~CommandBuffer();
+
+            void Execute();
+            CommandIterator* GetCommands();
+
+        private:
+            CommandIterator commands;
+            CommandReferences references;
+    };
+
+    class Queue : public QueueBase {
+        public:
+            Queue(Device* device, QueueBuilder* builder);
+
+            // NXT API
+            void Signal(Fence* fence, uint64_t value);
+            void Submit(uint32_t numCommands, CommandBuffer* const * commands);
+
+        private:
+            Device* device;
+    };
+
+}
+}
+
+#endif // BACKEND_NULL_NULLBACKEND_H_
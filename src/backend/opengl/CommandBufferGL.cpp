@@ -11,18 +11,13 @@
 #include "SamplerGL.h"
 #include "TextureGL.h"
 
+#include <bitset>
 #include <cstring>
+#include <vector>
 
 namespace backend {
 namespace opengl {
 
-    CommandBuffer::CommandBuffer(Device* device, CommandBufferBuilder* builder) : device(device), commands(builder->AcquireCommands()) {
-    }
-
-    CommandBuffer::~CommandBuffer() {
-        FreeCommands(&commands);
-    }
-
     static GLenum IndexFormatType(nxt::IndexFormat format) {
         switch (format) {
             case nxt::IndexFormat::Uint16:
@@ -32,244 +27,1141 @@ namespace opengl {
         }
     }
 
-    static GLenum VertexFormatType(nxt::VertexFormat format) {
-        switch (format) {
-            case nxt::VertexFormat::FloatR32G32B32A32:
-            case nxt::VertexFormat::FloatR32G32B32:
-            case nxt::VertexFormat::FloatR32G32:
-                return GL_FLOAT;
+    static void IssueDrawArrays(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+        if (firstInstance > 0) {
+            glDrawArraysInstancedBaseInstance(GL_TRIANGLES, firstVertex, vertexCount, instanceCount, firstInstance);
+        } else {
+            // This branch is only needed on OpenGL < 4.2
+            glDrawArraysInstanced(GL_TRIANGLES, firstVertex, vertexCount, instanceCount);
         }
     }
 
-    void CommandBuffer::Execute() {
-        Command type;
+    static void IssueDrawElements(uint32_t indexCount, uint32_t instanceCount, GLenum formatType, size_t offset,
+                                  uint32_t firstInstance) {
+        if (firstInstance > 0) {
+            glDrawElementsInstancedBaseInstance(GL_TRIANGLES, indexCount, formatType,
+                reinterpret_cast<void*>(offset), instanceCount, firstInstance);
+        } else {
+            // This branch is only needed on OpenGL < 4.2
+            glDrawElementsInstanced(GL_TRIANGLES, indexCount, formatType,
+                reinterpret_cast<void*>(offset), instanceCount);
+        }
+    }
+
+    namespace {
+
+        // Lowers push constants. The stages of the pipeline that have their push constants in a
+        // uniform block keep a copy of the values. It is written to the device's ring buffer and
+        // bound before the next draw or dispatch. The other stages set the uniforms of the
+        // program directly.
+        class PushConstantTracker {
+            public:
+                PushConstantTracker(Device* device) : device(device) {
+                    for (auto stage : IterateStages(kAllStages)) {
+                        values[stage].fill(0);
+                    }
+                }
+
+                void OnSetPipeline(Pipeline* pipeline) {
+                    this->pipeline = pipeline;
+                    // Nothing is bound for the blocks of the new pipeline yet.
+                    dirtyStages.set();
+                }
+
+                void SetPushConstants(nxt::ShaderStageBit stages, uint32_t offset, uint32_t count,
+                                      const uint32_t* valuesUInt) {
+                    const int32_t* valuesInt = reinterpret_cast<const int32_t*>(valuesUInt);
+                    const float* valuesFloat = reinterpret_cast<const float*>(valuesUInt);
+
+                    for (auto stage : IterateStages(stages)) {
+                        if (pipeline->GetPushConstantsBlockSize(stage) != 0) {
+                            memcpy(&values[stage][offset], valuesUInt, count * sizeof(uint32_t));
+                            dirtyStages.set(static_cast<uint32_t>(stage));
+                            continue;
+                        }
+
+                        const auto& pushConstants = pipeline->GetPushConstants(stage);
+                        const auto& glPushConstants = pipeline->GetGLPushConstants(stage);
+                        for (size_t i = 0; i < count; i++) {
+                            GLint location = glPushConstants[offset + i];
+
+                            switch (pushConstants.types[offset + i]) {
+                                case PushConstantType::Int:
+                                    glUniform1i(location, valuesInt[i]);
+                                    break;
+                                case PushConstantType::UInt:
+                                    glUniform1ui(location, valuesUInt[i]);
+                                    break;
+                                case PushConstantType::Float:
+                                    glUniform1f(location, valuesFloat[i]);
+                                    break;
+                            }
+                        }
+                    }
+                }
+
+                // Must be called before each draw and dispatch.
+                void Apply() {
+                    if (pipeline == nullptr || dirtyStages.none()) {
+                        return;
+                    }
+
+                    for (auto stage : IterateStages(kAllStages)) {
+                        uint32_t size = pipeline->GetPushConstantsBlockSize(stage);
+                        if (!dirtyStages[static_cast<uint32_t>(stage)] || size == 0) {
+                            continue;
+                        }
+
+                        RingBuffer* ringBuffer = device->GetPushConstantRingBuffer();
+                        size_t offset = ringBuffer->Write(values[stage].data(), size,
+                                                          device->GetUniformBufferOffsetAlignment());
+                        device->GetStateCache()->BindBufferRange(GL_UNIFORM_BUFFER,
+                                                                 pipeline->GetPushConstantsBlockBinding(stage),
+                                                                 ringBuffer->GetHandle(), offset, size);
+                    }
+                    dirtyStages.reset();
+                }
+
+            private:
+                Device* device;
+                Pipeline* pipeline = nullptr;
+                PerStage<std::array<uint32_t, kMaxPushConstants>> values;
+                std::bitset<kNumStages> dirtyStages;
+        };
+
+    }
+
+    namespace {
+
+        // Shader storage writes aren't coherent in OpenGL. The buffers used by each draw, dispatch
+        // and copy are given to the device's barrier tracker so that glMemoryBarrier is only
+        // called before the commands that read a buffer written as storage, with the bits for
+        // the way it is read. Writes are tracked across command buffers.
+        class BarrierEmitter {
+            public:
+                BarrierEmitter(Device* device) : device(device), tracker(device->GetBarrierTracker()) {
+                    Reset();
+                }
+
+                void Reset() {
+                    bindGroups.fill(nullptr);
+                    vertexBuffers.fill(nullptr);
+                    indexBuffer = nullptr;
+                }
+
+                void SetBindGroup(uint32_t index, BindGroup* group) {
+                    bindGroups[index] = group;
+                }
+
+                void SetIndexBuffer(BufferBase* buffer) {
+                    indexBuffer = buffer;
+                }
+
+                void SetVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers) {
+                    for (uint32_t i = 0; i < count; ++i) {
+                        vertexBuffers[startSlot + i] = buffers[i];
+                    }
+                }
+
+                // Return the glMemoryBarrier bits needed before the command, 0 if there is no
+                // hazard, and record the storage writes of the command.
+                GLbitfield AcquireDrawBarrier(Pipeline* pipeline, bool indexed, BufferBase* indirectBuffer) {
+                    nxt::BufferUsageBit kDrawReads = nxt::BufferUsageBit::Vertex |
+                        nxt::BufferUsageBit::Index | nxt::BufferUsageBit::Uniform |
+                        nxt::BufferUsageBit::Storage | nxt::BufferUsageBit::Indirect;
+
+                    if (tracker->HasPendingWrites(kDrawReads)) {
+                        ReadBindGroups(pipeline);
+                        for (uint32_t slot : IterateBitSet(pipeline->GetInputState()->GetInputsSetMask())) {
+                            if (vertexBuffers[slot] != nullptr) {
+                                tracker->Read(vertexBuffers[slot], nxt::BufferUsageBit::Vertex);
+                            }
+                        }
+                        if (indexed && indexBuffer != nullptr) {
+                            tracker->Read(indexBuffer, nxt::BufferUsageBit::Index);
+                        }
+                        if (indirectBuffer != nullptr) {
+                            tracker->Read(indirectBuffer, nxt::BufferUsageBit::Indirect);
+                        }
+                    }
+
+                    GLbitfield barrier = device->AcquireMemoryBarrierBits();
+                    WriteBindGroups(pipeline);
+                    return barrier;
+                }
+
+                GLbitfield AcquireDispatchBarrier(Pipeline* pipeline, BufferBase* indirectBuffer) {
+                    nxt::BufferUsageBit kDispatchReads = nxt::BufferUsageBit::Uniform |
+                        nxt::BufferUsageBit::Storage | nxt::BufferUsageBit::Indirect;
+
+                    if (tracker->HasPendingWrites(kDispatchReads)) {
+                        ReadBindGroups(pipeline);
+                        if (indirectBuffer != nullptr) {
+                            tracker->Read(indirectBuffer, nxt::BufferUsageBit::Indirect);
+                        }
+                    }
+
+                    GLbitfield barrier = device->AcquireMemoryBarrierBits();
+                    WriteBindGroups(pipeline);
+                    return barrier;
+                }
+
+                GLbitfield AcquireCopyBarrier(BufferBase* source) {
+                    tracker->Read(source, nxt::BufferUsageBit::TransferSrc);
+                    return device->AcquireMemoryBarrierBits();
+                }
+
+            private:
+                void ReadBindGroups(Pipeline* pipeline) {
+                    for (uint32_t index : IterateBitSet(pipeline->GetLayout()->GetBindGroupsLayoutMask())) {
+                        if (bindGroups[index] != nullptr) {
+                            bindGroups[index]->ReadBuffers(tracker);
+                        }
+                    }
+                }
+
+                void WriteBindGroups(Pipeline* pipeline) {
+                    for (uint32_t index : IterateBitSet(pipeline->GetLayout()->GetBindGroupsLayoutMask())) {
+                        if (bindGroups[index] != nullptr) {
+                            bindGroups[index]->WriteBuffers(tracker);
+                        }
+                    }
+                }
+
+                Device* device;
+                BarrierTracker* tracker;
+                std::array<BindGroup*, kMaxBindGroups> bindGroups;
+                std::array<BufferBase*, kMaxVertexInputs> vertexBuffers;
+                BufferBase* indexBuffer;
+        };
+
+        // Bind groups are applied relative to the pipeline: their binding indices come from its
+        // layout and their texture units from its sampler and texture combinations. SetBindGroup
+        // only records the group, the dirty groups are applied right before the next draw or
+        // dispatch. Groups that are bound the same way in the new pipeline aren't applied again.
+        class BindGroupTracker {
+            public:
+                BindGroupTracker() {
+                    Reset();
+                }
+
+                void Reset() {
+                    bindGroups.fill(nullptr);
+                    dirtyGroups.reset();
+                    appliedPipeline = nullptr;
+                }
+
+                void OnSetBindGroup(uint32_t index, BindGroup* group) {
+                    if (group != bindGroups[index]) {
+                        bindGroups[index] = group;
+                        dirtyGroups.set(index);
+                    }
+                }
+
+                void Apply(Pipeline* pipeline) {
+                    const auto& groupsMask = pipeline->GetLayout()->GetBindGroupsLayoutMask();
+                    if (pipeline == appliedPipeline && (dirtyGroups & groupsMask).none()) {
+                        return;
+                    }
+
+                    if (pipeline != appliedPipeline) {
+                        for (uint32_t index = 0; index < kMaxBindGroups; ++index) {
+                            // The bindings of groups the pipeline doesn't use can be overwritten.
+                            if (!groupsMask[index] || appliedPipeline == nullptr ||
+                                !pipeline->HasSameBindGroupBindings(appliedPipeline, index)) {
+                                dirtyGroups.set(index);
+                            }
+                        }
+                        appliedPipeline = pipeline;
+                    }
+
+                    for (uint32_t index : IterateBitSet(dirtyGroups & groupsMask)) {
+                        if (bindGroups[index] != nullptr) {
+                            bindGroups[index]->ApplyNow(pipeline, index);
+                            dirtyGroups.reset(index);
+                        }
+                    }
+                }
+
+            private:
+                std::array<BindGroup*, kMaxBindGroups> bindGroups;
+                std::bitset<kMaxBindGroups> dirtyGroups;
+                // The pipeline the clean groups are bound for.
+                Pipeline* appliedPipeline;
+        };
+
+        // Vertex buffers and the index buffer are state of the VAO of the input state. They are
+        // recorded and bound before the next draw, again if a pipeline changed the VAO.
+        class InputBufferTracker {
+            public:
+                InputBufferTracker(Device* device) : stateCache(device->GetStateCache()) {
+                    Reset();
+                }
+
+                void Reset() {
+                    indexBuffer = nullptr;
+                    indexBufferDirty = false;
+                    vertexBuffers.fill(nullptr);
+                    vertexBufferOffsets.fill(0);
+                    dirtyVertexBuffers.reset();
+                    appliedInputState = nullptr;
+                }
+
+                void OnSetIndexBuffer(BufferBase* buffer) {
+                    indexBuffer = buffer;
+                    indexBufferDirty = true;
+                }
+
+                void OnSetVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, uint32_t const* offsets) {
+                    for (uint32_t i = 0; i < count; ++i) {
+                        vertexBuffers[startSlot + i] = buffers[i];
+                        vertexBufferOffsets[startSlot + i] = offsets[i];
+                        dirtyVertexBuffers.set(startSlot + i);
+                    }
+                }
+
+                void Apply(Pipeline* pipeline) {
+                    InputState* inputState = ToBackend(pipeline->GetInputState());
+                    auto slotsToApply = dirtyVertexBuffers & inputState->GetInputsSetMask();
+                    if (inputState == appliedInputState && !indexBufferDirty && slotsToApply.none()) {
+                        return;
+                    }
+
+                    if (inputState != appliedInputState) {
+                        for (uint32_t slot = 0; slot < kMaxVertexInputs; ++slot) {
+                            if (vertexBuffers[slot] != nullptr) {
+                                dirtyVertexBuffers.set(slot);
+                            }
+                        }
+                        indexBufferDirty = indexBuffer != nullptr;
+                        appliedInputState = inputState;
+                    }
+
+                    if (indexBufferDirty) {
+                        stateCache->BindBuffer(GL_ELEMENT_ARRAY_BUFFER, ToBackend(indexBuffer)->GetHandle());
+                        indexBufferDirty = false;
+                    }
+
+                    // Slots are bound in runs of consecutive slots.
+                    slotsToApply = dirtyVertexBuffers & inputState->GetInputsSetMask();
+                    dirtyVertexBuffers &= ~slotsToApply;
+                    for (uint32_t slot = 0; slot < kMaxVertexInputs;) {
+                        if (!slotsToApply[slot]) {
+                            slot ++;
+                            continue;
+                        }
+                        uint32_t startSlot = slot;
+                        while (slot < kMaxVertexInputs && slotsToApply[slot]) {
+                            slot ++;
+                        }
+                        inputState->ApplyVertexBuffers(startSlot, slot - startSlot, &vertexBuffers[startSlot],
+                                                       &vertexBufferOffsets[startSlot]);
+                    }
+                }
+
+            private:
+                StateCache* stateCache;
+                BufferBase* indexBuffer;
+                bool indexBufferDirty;
+                std::array<BufferBase*, kMaxVertexInputs> vertexBuffers;
+                std::array<uint32_t, kMaxVertexInputs> vertexBufferOffsets;
+                std::bitset<kMaxVertexInputs> dirtyVertexBuffers;
+                // The input state the clean buffers are bound in.
+                InputState* appliedInputState;
+        };
+
+        // Layouts of the commands read by glMultiDraw*Indirect
+        struct DrawArraysIndirectCommand {
+            GLuint count;
+            GLuint instanceCount;
+            GLuint first;
+            GLuint baseInstance;
+        };
+
+        struct DrawElementsIndirectCommand {
+            GLuint count;
+            GLuint instanceCount;
+            GLuint firstIndex;
+            GLint baseVertex;
+            GLuint baseInstance;
+        };
+
+    }
+
+    // LoweredCommands
+
+    // The commands of a command buffer or render bundle are lowered once, when it is created, to
+    // a flat list of operations in which everything that doesn't depend on the GL state at
+    // submit time is resolved: index formats and offsets, runs of draws batched in a single
+    // glMultiDraw*Indirect and runs of push constants and draws that are instanced. Their
+    // indirect commands and per-instance push constants are uploaded once to static buffers.
+    // Executing replays the operations and only tracks what can change between submits: the
+    // bindings, the streamed push constants and the memory barriers.
+    // Lowering doesn't call GL so it can run on any thread, the static buffers are uploaded by
+    // the first Execute.
+    class LoweredCommands {
+        public:
+            LoweredCommands(Device* device, CommandIterator* commands, size_t storageBufferOffsetAlignment);
+            ~LoweredCommands();
+
+            void Execute();
+
+        private:
+            class Lowering;
+
+            void UploadBuffers();
+
+            enum class OpType {
+                CopyBufferToTexture,
+                Dispatch,
+                DispatchIndirect,
+                DrawArrays,
+                DrawArraysIndirect,
+                DrawElements,
+                DrawElementsIndirect,
+                MultiDrawArrays,
+                MultiDrawElements,
+                InstancedDrawArrays,
+                ExecuteBundle,
+                SetPipeline,
+                SetPushConstants,
+                SetBindGroup,
+                SetIndexBuffer,
+                SetVertexBuffers,
+            };
+
+            struct Op {
+                OpType type;
+                union {
+                    struct {
+                        Buffer* buffer;
+                        Texture* texture;
+                        uint32_t x, y, width, height, level;
+                    } copy;
+                    struct {
+                        uint32_t x, y, z;
+                    } dispatch;
+                    // Also the indirect draws, the index type is only used by DrawElementsIndirect.
+                    struct {
+                        Buffer* buffer;
+                        uint32_t offset;
+                        GLenum indexType;
+                    } indirect;
+                    struct {
+                        uint32_t vertexCount, instanceCount, firstVertex, firstInstance;
+                    } drawArrays;
+                    struct {
+                        uint32_t indexCount, instanceCount, firstInstance;
+                        GLenum indexType;
+                        // In bytes, with the offset of the index buffer.
+                        size_t offset;
+                    } drawElements;
+                    // The commands of the draws are at offset in the draw commands buffer.
+                    struct {
+                        size_t offset;
+                        uint32_t count;
+                        GLenum indexType;
+                    } multiDraw;
+                    // The push constants of the instances are at offset in the instance data buffer.
+                    struct {
+                        Pipeline* pipeline;
+                        size_t offset;
+                        size_t size;
+                        uint32_t vertexCount, firstVertex, instanceCount;
+                    } instanced;
+                    struct {
+                        RenderBundle* bundle;
+                    } executeBundle;
+                    struct {
+                        Pipeline* pipeline;
+                    } setPipeline;
+                    // The values start at index values of pushConstantValues.
+                    struct {
+                        nxt::ShaderStageBit stages;
+                        uint32_t offset, count, values;
+                    } pushConstants;
+                    struct {
+                        uint32_t index;
+                        BindGroup* group;
+                    } bindGroup;
+                    struct {
+                        BufferBase* buffer;
+                    } indexBuffer;
+                    // The buffers and offsets start at index first of vertexBuffers and vertexBufferOffsets.
+                    struct {
+                        uint32_t startSlot, count, first;
+                    } vertexBuffers;
+                };
+            };
+
+            Device* device;
+            std::vector<Op> ops;
+            std::vector<uint32_t> pushConstantValues;
+            std::vector<BufferBase*> vertexBuffers;
+            std::vector<uint32_t> vertexBufferOffsets;
+
+            // The commands of the batched draws and the push constants of the instanced draws,
+            // until they are uploaded.
+            bool uploaded = false;
+            std::vector<uint8_t> drawCommands;
+            std::vector<uint32_t> instanceData;
+            GLuint drawCommandsBuffer = 0;
+            GLuint instanceDataBuffer = 0;
+    };
+
+    // Walks the NXT commands once and appends their operations. Draws are only merged when
+    // nothing changes the state between them, and when the pipeline can't write to storage
+    // buffers since that would need barriers between the draws.
+    class LoweredCommands::Lowering {
+        public:
+            Lowering(LoweredCommands* lowered, size_t storageBufferOffsetAlignment)
+                : lowered(lowered), storageBufferOffsetAlignment(storageBufferOffsetAlignment),
+                  multiDraw(GLAD_GL_VERSION_4_3 != 0) {
+            }
+
+            void Lower(CommandIterator* commands) {
+                Command type;
+                while(commands->NextCommandId(&type)) {
+                    if (type != Command::DrawArrays && type != Command::DrawElements) {
+                        FlushDrawBatch();
+                    }
+                    if (type != Command::SetPushConstants && type != Command::DrawArrays) {
+                        FlushInstancedRun();
+                    }
+
+                    Op op;
+                    switch (type) {
+                        case Command::CopyBufferToTexture:
+                            {
+                                CopyBufferToTextureCmd* copy = commands->NextCommand<CopyBufferToTextureCmd>();
+                                op.type = OpType::CopyBufferToTexture;
+                                op.copy = {ToBackend(copy->buffer), ToBackend(copy->texture), copy->x, copy->y,
+                                           copy->width, copy->height, copy->level};
+                                AddOp(op);
+                            }
+                            break;
+
+                        case Command::Dispatch:
+                            {
+                                DispatchCmd* dispatch = commands->NextCommand<DispatchCmd>();
+                                op.type = OpType::Dispatch;
+                                op.dispatch = {dispatch->x, dispatch->y, dispatch->z};
+                                AddOp(op);
+                            }
+                            break;
+
+                        case Command::DispatchIndirect:
+                            {
+                                DispatchIndirectCmd* dispatch = commands->NextCommand<DispatchIndirectCmd>();
+                                op.type = OpType::DispatchIndirect;
+                                op.indirect = {ToBackend(dispatch->buffer), dispatch->offset, 0};
+                                AddOp(op);
+                            }
+                            break;
+
+                        case Command::DrawArrays:
+                            {
+                                DrawArraysCmd* draw = commands->NextCommand<DrawArraysCmd>();
+                                if (TakeInstancedDraw(draw)) {
+                                    break;
+                                }
+                                FlushInstancedRun();
+
+                                AddDrawArrays(draw->vertexCount, draw->instanceCount, draw->firstVertex, draw->firstInstance);
+                            }
+                            break;
+
+                        case Command::DrawArraysIndirect:
+                            {
+                                DrawArraysIndirectCmd* draw = commands->NextCommand<DrawArraysIndirectCmd>();
+                                op.type = OpType::DrawArraysIndirect;
+                                op.indirect = {ToBackend(draw->buffer), draw->offset, 0};
+                                AddOp(op);
+                            }
+                            break;
+
+                        case Command::DrawElements:
+                            {
+                                DrawElementsCmd* draw = commands->NextCommand<DrawElementsCmd>();
+                                AddDrawElements(draw);
+                            }
+                            break;
+
+                        case Command::DrawElementsIndirect:
+                            {
+                                DrawElementsIndirectCmd* draw = commands->NextCommand<DrawElementsIndirectCmd>();
+                                // Validation made sure the index buffer offset is 0.
+                                op.type = OpType::DrawElementsIndirect;
+                                op.indirect = {ToBackend(draw->buffer), draw->offset, IndexFormatType(indexBufferFormat)};
+                                AddOp(op);
+                            }
+                            break;
+
+                        case Command::ExecuteBundle:
+                            {
+                                ExecuteBundleCmd* cmd = commands->NextCommand<ExecuteBundleCmd>();
+                                op.type = OpType::ExecuteBundle;
+                                op.executeBundle = {ToBackend(cmd->bundle)};
+                                AddOp(op);
+
+                                // The bundle leaves an unknown state behind, it is set again afterwards.
+                                pipeline = nullptr;
+                                indexBufferOffset = 0;
+                                indexBufferFormat = nxt::IndexFormat::Uint16;
+                            }
+                            break;
+
+                        case Command::SetPipeline:
+                            {
+                                SetPipelineCmd* cmd = commands->NextCommand<SetPipelineCmd>();
+                                pipeline = ToBackend(cmd->pipeline);
+                                mergeDraws = !CanWriteStorage(pipeline);
+
+                                op.type = OpType::SetPipeline;
+                                op.setPipeline = {pipeline};
+                                AddOp(op);
+                            }
+                            break;
+
+                        case Command::SetPushConstants:
+                            {
+                                SetPushConstantsCmd* cmd = commands->NextCommand<SetPushConstantsCmd>();
+                                uint32_t* values = commands->NextData<uint32_t>(cmd->count);
+                                if (TakeInstancedPushConstants(cmd, values)) {
+                                    break;
+                                }
+                                FlushInstancedRun();
+
+                                AddPushConstants(cmd->stage, cmd->offset, cmd->count, values);
+                            }
+                            break;
+
+                        case Command::SetBindGroup:
+                            {
+                                SetBindGroupCmd* cmd = commands->NextCommand<SetBindGroupCmd>();
+                                op.type = OpType::SetBindGroup;
+                                op.bindGroup = {cmd->index, ToBackend(cmd->group)};
+                                AddOp(op);
+                            }
+                            break;
+
+                        case Command::SetIndexBuffer:
+                            {
+                                SetIndexBufferCmd* cmd = commands->NextCommand<SetIndexBufferCmd>();
+                                indexBufferOffset = cmd->offset;
+                                indexBufferFormat = cmd->format;
+
+                                op.type = OpType::SetIndexBuffer;
+                                op.indexBuffer = {cmd->buffer};
+                                AddOp(op);
+                            }
+                            break;
+
+                        case Command::SetVertexBuffers:
+                            {
+                                SetVertexBuffersCmd* cmd = commands->NextCommand<SetVertexBuffersCmd>();
+                                auto buffers = commands->NextData<BufferBase*>(cmd->count);
+                                auto offsets = commands->NextData<uint32_t>(cmd->count);
+
+                                op.type = OpType::SetVertexBuffers;
+                                op.vertexBuffers = {cmd->startSlot, cmd->count,
+                                                    static_cast<uint32_t>(lowered->vertexBuffers.size())};
+                                lowered->vertexBuffers.insert(lowered->vertexBuffers.end(), buffers, buffers + cmd->count);
+                                lowered->vertexBufferOffsets.insert(lowered->vertexBufferOffsets.end(), offsets, offsets + cmd->count);
+                                AddOp(op);
+                            }
+                            break;
+                    }
+                }
+
+                FlushDrawBatch();
+                FlushInstancedRun();
+            }
+
+        private:
+            static constexpr uint32_t kMinInstancedDraws = 2;
+
+            void AddOp(const Op& op) {
+                lowered->ops.push_back(op);
+            }
+
+            static bool CanWriteStorage(Pipeline* pipeline) {
+                PipelineLayoutBase* layout = pipeline->GetLayout();
+                for (uint32_t group : IterateBitSet(layout->GetBindGroupsLayoutMask())) {
+                    const auto& info = layout->GetBindGroupLayout(group)->GetBindingInfo();
+                    for (uint32_t binding : IterateBitSet(info.mask)) {
+                        if (info.types[binding] == nxt::BindingType::StorageBuffer) {
+                            return true;
+                        }
+                    }
+                }
+                return false;
+            }
+
+            void AddPushConstants(nxt::ShaderStageBit stages, uint32_t offset, uint32_t count, const uint32_t* values) {
+                Op op;
+                op.type = OpType::SetPushConstants;
+                op.pushConstants = {stages, offset, count, static_cast<uint32_t>(lowered->pushConstantValues.size())};
+                lowered->pushConstantValues.insert(lowered->pushConstantValues.end(), values, values + count);
+                AddOp(op);
+            }
+
+            void AddUnbatchedDrawArrays(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+                Op op;
+                op.type = OpType::DrawArrays;
+                op.drawArrays = {vertexCount, instanceCount, firstVertex, firstInstance};
+                AddOp(op);
+            }
+
+            // Draws are collected in the batch, which is flushed before the next command that
+            // isn't a draw.
+            void AddDrawArrays(uint32_t vertexCount, uint32_t instanceCount, uint32_t firstVertex, uint32_t firstInstance) {
+                if (!multiDraw || !mergeDraws) {
+                    AddUnbatchedDrawArrays(vertexCount, instanceCount, firstVertex, firstInstance);
+                    return;
+                }
+                if (!elementDraws.empty()) {
+                    FlushDrawBatch();
+                }
+                arrayDraws.push_back({vertexCount, instanceCount, firstVertex, firstInstance});
+            }
+
+            void AddDrawElements(DrawElementsCmd* draw) {
+                size_t formatSize = IndexFormatSize(indexBufferFormat);
+
+                // Indirect draws give the first index in indices, not in bytes.
+                if (multiDraw && mergeDraws && indexBufferOffset % formatSize == 0) {
+                    if (!arrayDraws.empty()) {
+                        FlushDrawBatch();
+                    }
+                    GLuint firstIndex = draw->firstIndex + static_cast<GLuint>(indexBufferOffset / formatSize);
+                    elementDraws.push_back({draw->indexCount, draw->instanceCount, firstIndex, 0, draw->firstInstance});
+                    return;
+                }
+
+                Op op;
+                op.type = OpType::DrawElements;
+                op.drawElements = {draw->indexCount, draw->instanceCount, draw->firstInstance,
+                                   IndexFormatType(indexBufferFormat), draw->firstIndex * formatSize + indexBufferOffset};
+                AddOp(op);
+            }
+
+            void FlushDrawBatch() {
+                Op op;
+                if (arrayDraws.size() == 1) {
+                    const auto& draw = arrayDraws[0];
+                    AddUnbatchedDrawArrays(draw.count, draw.instanceCount, draw.first, draw.baseInstance);
+                } else if (arrayDraws.size() > 1) {
+                    op.type = OpType::MultiDrawArrays;
+                    op.multiDraw = {AppendDrawCommands(arrayDraws), static_cast<uint32_t>(arrayDraws.size()), 0};
+                    AddOp(op);
+                }
+
+                GLenum indexType = IndexFormatType(indexBufferFormat);
+                if (elementDraws.size() == 1) {
+                    const auto& draw = elementDraws[0];
+                    op.type = OpType::DrawElements;
+                    op.drawElements = {draw.count, draw.instanceCount, draw.baseInstance, indexType,
+                                       draw.firstIndex * IndexFormatSize(indexBufferFormat)};
+                    AddOp(op);
+                } else if (elementDraws.size() > 1) {
+                    op.type = OpType::MultiDrawElements;
+                    op.multiDraw = {AppendDrawCommands(elementDraws), static_cast<uint32_t>(elementDraws.size()), indexType};
+                    AddOp(op);
+                }
+
+                arrayDraws.clear();
+                elementDraws.clear();
+            }
+
+            template<typename T>
+            size_t AppendDrawCommands(const std::vector<T>& draws) {
+                std::vector<uint8_t>& drawCommands = lowered->drawCommands;
+                size_t offset = drawCommands.size();
+                drawCommands.resize(offset + draws.size() * sizeof(T));
+                memcpy(&drawCommands[offset], draws.data(), draws.size() * sizeof(T));
+                return offset;
+            }
+
+            // Auto-instancing: collects runs of SetPushConstants + DrawArrays that use a pipeline
+            // with an instanced program and only differ by their push constants. The run is drawn
+            // with a single instanced draw, each instance reading its push constants from the
+            // instance data buffer.
+            bool TakeInstancedPushConstants(SetPushConstantsCmd* cmd, const uint32_t* values) {
+                if (pipeline == nullptr || !mergeDraws || !pipeline->HasInstancedProgram() ||
+                    !(cmd->stage & nxt::ShaderStageBit::Vertex) || cmd->offset != 0 ||
+                    cmd->count != pipeline->GetInstancedPushConstantCount()) {
+                    return false;
+                }
+
+                // Only the last values before a draw matter.
+                if (!hasPendingPushConstants) {
+                    runData.resize(runData.size() + cmd->count);
+                }
+                memcpy(&runData[runData.size() - cmd->count], values, cmd->count * sizeof(uint32_t));
+
+                runStages = cmd->stage;
+                hasPendingPushConstants = true;
+                return true;
+            }
+
+            bool TakeInstancedDraw(DrawArraysCmd* draw) {
+                if (!hasPendingPushConstants || draw->instanceCount != 1 || draw->firstInstance != 0) {
+                    return false;
+                }
+                if (runDraws > 0 && (draw->vertexCount != runVertexCount || draw->firstVertex != runFirstVertex)) {
+                    return false;
+                }
+
+                runVertexCount = draw->vertexCount;
+                runFirstVertex = draw->firstVertex;
+                runDraws++;
+                hasPendingPushConstants = false;
+                return true;
+            }
+
+            void FlushInstancedRun() {
+                if (runData.empty()) {
+                    return;
+                }
+
+                uint32_t count = pipeline->GetInstancedPushConstantCount();
+
+                if (runDraws >= kMinInstancedDraws) {
+                    // Each run is bound as a range of the buffer so it starts at an aligned offset.
+                    std::vector<uint32_t>& instanceData = lowered->instanceData;
+                    size_t alignment = storageBufferOffsetAlignment;
+                    size_t offset = (instanceData.size() * sizeof(uint32_t) + alignment - 1) / alignment * alignment;
+                    size_t size = runDraws * count * sizeof(uint32_t);
+                    instanceData.resize((offset + size) / sizeof(uint32_t));
+                    memcpy(&instanceData[offset / sizeof(uint32_t)], runData.data(), size);
+
+                    Op op;
+                    op.type = OpType::InstancedDrawArrays;
+                    op.instanced = {pipeline, offset, size, runVertexCount, runFirstVertex, runDraws};
+                    AddOp(op);
+                } else {
+                    for (uint32_t i = 0; i < runDraws; ++i) {
+                        AddPushConstants(runStages, 0, count, &runData[i * count]);
+                        AddUnbatchedDrawArrays(runVertexCount, 1, runFirstVertex, 0);
+                    }
+                }
+
+                // Leave the push constants of the regular program with the last values that were set.
+                if (hasPendingPushConstants || runDraws >= kMinInstancedDraws) {
+                    AddPushConstants(runStages, 0, count, &runData[runData.size() - count]);
+                }
+
+                runData.clear();
+                runDraws = 0;
+                hasPendingPushConstants = false;
+            }
+
+            LoweredCommands* lowered;
+            size_t storageBufferOffsetAlignment;
+            bool multiDraw;
+
+            // The state of the commands being lowered.
+            Pipeline* pipeline = nullptr;
+            bool mergeDraws = false;
+            uint32_t indexBufferOffset = 0;
+            nxt::IndexFormat indexBufferFormat = nxt::IndexFormat::Uint16;
+
+            // The current batch of draws.
+            std::vector<DrawArraysIndirectCommand> arrayDraws;
+            std::vector<DrawElementsIndirectCommand> elementDraws;
+
+            // The current run of instanced draws.
+            nxt::ShaderStageBit runStages;
+            std::vector<uint32_t> runData;
+            uint32_t runDraws = 0;
+            bool hasPendingPushConstants = false;
+            uint32_t runVertexCount = 0;
+            uint32_t runFirstVertex = 0;
+    };
+
+    LoweredCommands::LoweredCommands(Device* device, CommandIterator* commands, size_t storageBufferOffsetAlignment)
+        : device(device) {
+        Lowering lowering(this, storageBufferOffsetAlignment);
+        lowering.Lower(commands);
+    }
+
+    LoweredCommands::~LoweredCommands() {
+        if (drawCommandsBuffer != 0 || instanceDataBuffer != 0) {
+            GLuint buffers[2] = {drawCommandsBuffer, instanceDataBuffer};
+            device->GetStateCache()->DeleteBuffers(2, buffers);
+        }
+    }
+
+    void LoweredCommands::UploadBuffers() {
+        StateCache* stateCache = device->GetStateCache();
+
+        if (!drawCommands.empty()) {
+            glGenBuffers(1, &drawCommandsBuffer);
+            stateCache->BindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandsBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, drawCommands.size(), drawCommands.data(), GL_STATIC_DRAW);
+        }
+
+        if (!instanceData.empty()) {
+            glGenBuffers(1, &instanceDataBuffer);
+            stateCache->BindBuffer(GL_SHADER_STORAGE_BUFFER, instanceDataBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, instanceData.size() * sizeof(uint32_t),
+                         instanceData.data(), GL_STATIC_DRAW);
+        }
+
+        drawCommands = std::vector<uint8_t>();
+        instanceData = std::vector<uint32_t>();
+        uploaded = true;
+    }
+
+    void LoweredCommands::Execute() {
+        if (!uploaded) {
+            UploadBuffers();
+        }
+
+        StateCache* stateCache = device->GetStateCache();
         Pipeline* lastPipeline = nullptr;
-        uint32_t indexBufferOffset = 0;
-        nxt::IndexFormat indexBufferFormat = nxt::IndexFormat::Uint16;
+        PushConstantTracker pushConstants(device);
+        BarrierEmitter barriers(device);
+        BindGroupTracker bindGroups;
+        InputBufferTracker inputBuffers(device);
+
+        auto MemoryBarrier = [](GLbitfield barrier) {
+            if (barrier != 0) {
+                glMemoryBarrier(barrier);
+            }
+        };
 
-        while(commands.NextCommandId(&type)) {
-            switch (type) {
+        // The state that is applied before each draw.
+        auto PrepareDraw = [&](bool indexed, BufferBase* indirectBuffer) {
+            MemoryBarrier(barriers.AcquireDrawBarrier(lastPipeline, indexed, indirectBuffer));
+            bindGroups.Apply(lastPipeline);
+            inputBuffers.Apply(lastPipeline);
+            pushConstants.Apply();
+        };
 
-                case Command::CopyBufferToTexture:
+        for (const Op& op : ops) {
+            switch (op.type) {
+
+                case OpType::CopyBufferToTexture:
                     {
-                        CopyBufferToTextureCmd* copy = commands.NextCommand<CopyBufferToTextureCmd>();
-                        Buffer* buffer = ToBackend(copy->buffer.Get());
-                        Texture* texture = ToBackend(copy->texture.Get());
+                        Buffer* buffer = op.copy.buffer;
+                        Texture* texture = op.copy.texture;
                         GLenum target = texture->GetGLTarget();
                         auto format = texture->GetGLFormat();
 
-                        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->GetHandle());
-                        glActiveTexture(GL_TEXTURE0);
-                        glBindTexture(target, texture->GetHandle());
+                        MemoryBarrier(barriers.AcquireCopyBarrier(buffer));
+
+                        stateCache->BindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer->GetHandle());
+                        stateCache->BindTexture(0, target, texture->GetHandle());
 
-                        glTexSubImage2D(target, copy->level, copy->x, copy->y, copy->width, copy->height,
+                        glTexSubImage2D(target, op.copy.level, op.copy.x, op.copy.y, op.copy.width, op.copy.height,
                                         format.format, format.type, nullptr);
-                        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                        stateCache->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
                     }
                     break;
 
-                case Command::Dispatch:
+                case OpType::Dispatch:
                     {
-                        DispatchCmd* dispatch = commands.NextCommand<DispatchCmd>();
-                        glDispatchCompute(dispatch->x, dispatch->y, dispatch->z);
-                        // TODO(cwallez@chromium.org): add barriers to the API
-                        glMemoryBarrier(GL_ALL_BARRIER_BITS);
+                        MemoryBarrier(barriers.AcquireDispatchBarrier(lastPipeline, nullptr));
+                        bindGroups.Apply(lastPipeline);
+                        pushConstants.Apply();
+                        glDispatchCompute(op.dispatch.x, op.dispatch.y, op.dispatch.z);
                     }
                     break;
 
-                case Command::DrawArrays:
+                case OpType::DispatchIndirect:
                     {
-                        DrawArraysCmd* draw = commands.NextCommand<DrawArraysCmd>();
-                        if (draw->firstInstance > 0) {
-                            glDrawArraysInstancedBaseInstance(GL_TRIANGLES,
-                                draw->firstVertex, draw->vertexCount, draw->instanceCount, draw->firstInstance);
-                        } else {
-                            // This branch is only needed on OpenGL < 4.2
-                            glDrawArraysInstanced(GL_TRIANGLES,
-                                draw->firstVertex, draw->vertexCount, draw->instanceCount);
-                        }
+                        MemoryBarrier(barriers.AcquireDispatchBarrier(lastPipeline, op.indirect.buffer));
+                        bindGroups.Apply(lastPipeline);
+                        pushConstants.Apply();
+
+                        stateCache->BindBuffer(GL_DISPATCH_INDIRECT_BUFFER, op.indirect.buffer->GetHandle());
+                        glDispatchComputeIndirect(static_cast<GLintptr>(op.indirect.offset));
                     }
                     break;
 
-                case Command::DrawElements:
+                case OpType::DrawArrays:
                     {
-                        DrawElementsCmd* draw = commands.NextCommand<DrawElementsCmd>();
-                        size_t formatSize = IndexFormatSize(indexBufferFormat);
-                        GLenum formatType = IndexFormatType(indexBufferFormat);
-
-                        if (draw->firstInstance > 0) {
-                            glDrawElementsInstancedBaseInstance(GL_TRIANGLES,
-                                draw->indexCount, formatType,
-                                reinterpret_cast<void*>(draw->firstIndex * formatSize + indexBufferOffset),
-                                draw->instanceCount, draw->firstInstance);
-                        } else {
-                            // This branch is only needed on OpenGL < 4.2
-                            glDrawElementsInstanced(GL_TRIANGLES,
-                                draw->indexCount, formatType,
-                                reinterpret_cast<void*>(draw->firstIndex * formatSize + indexBufferOffset),
-                                draw->instanceCount);
-                        }
+                        PrepareDraw(false, nullptr);
+                        IssueDrawArrays(op.drawArrays.vertexCount, op.drawArrays.instanceCount,
+                                        op.drawArrays.firstVertex, op.drawArrays.firstInstance);
                     }
                     break;
 
-                case Command::SetPipeline:
+                case OpType::DrawArraysIndirect:
                     {
-                        SetPipelineCmd* cmd = commands.NextCommand<SetPipelineCmd>();
-                        ToBackend(cmd->pipeline)->ApplyNow();
-                        lastPipeline = ToBackend(cmd->pipeline).Get();
+                        PrepareDraw(false, op.indirect.buffer);
+                        stateCache->BindBuffer(GL_DRAW_INDIRECT_BUFFER, op.indirect.buffer->GetHandle());
+                        glDrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<void*>(static_cast<uintptr_t>(op.indirect.offset)));
                     }
                     break;
 
-                case Command::SetPushConstants:
+                case OpType::DrawElements:
                     {
-                        SetPushConstantsCmd* cmd = commands.NextCommand<SetPushConstantsCmd>();
-                        uint32_t* valuesUInt = commands.NextData<uint32_t>(cmd->count);
-                        int32_t* valuesInt = reinterpret_cast<int32_t*>(valuesUInt);
-                        float* valuesFloat = reinterpret_cast<float*>(valuesUInt);
-
-                        for (auto stage : IterateStages(cmd->stage)) {
-                            const auto& pushConstants = lastPipeline->GetPushConstants(stage);
-                            const auto& glPushConstants = lastPipeline->GetGLPushConstants(stage);
-                            for (size_t i = 0; i < cmd->count; i++) {
-                                GLint location = glPushConstants[cmd->offset + i];
-
-                                switch (pushConstants.types[cmd->offset + i]) {
-                                    case PushConstantType::Int:
-                                        glUniform1i(location, valuesInt[i]);
-                                        break;
-                                    case PushConstantType::UInt:
-                                        glUniform1ui(location, valuesUInt[i]);
-                                        break;
-                                    case PushConstantType::Float:
-                                        glUniform1f(location, valuesFloat[i]);
-                                        break;
-                                }
-                            }
-                        }
+                        PrepareDraw(true, nullptr);
+                        IssueDrawElements(op.drawElements.indexCount, op.drawElements.instanceCount,
+                                          op.drawElements.indexType, op.drawElements.offset,
+                                          op.drawElements.firstInstance);
                     }
                     break;
 
-                case Command::SetBindGroup:
+                case OpType::DrawElementsIndirect:
                     {
-                        SetBindGroupCmd* cmd = commands.NextCommand<SetBindGroupCmd>();
-                        size_t index = cmd->index;
-                        BindGroup* group = ToBackend(cmd->group.Get());
-
-                        const auto& indices = ToBackend(lastPipeline->GetLayout())->GetBindingIndexInfo()[index];
-                        const auto& layout = group->GetLayout()->GetBindingInfo();
-
-                        // TODO(cwallez@chromium.org): iterate over the layout bitmask instead
-                        for (size_t binding = 0; binding < kMaxBindingsPerGroup; ++binding) {
-                            if (!layout.mask[binding]) {
-                                continue;
-                            }
+                        PrepareDraw(true, op.indirect.buffer);
+                        stateCache->BindBuffer(GL_DRAW_INDIRECT_BUFFER, op.indirect.buffer->GetHandle());
+                        glDrawElementsIndirect(GL_TRIANGLES, op.indirect.indexType,
+                                               reinterpret_cast<void*>(static_cast<uintptr_t>(op.indirect.offset)));
+                    }
+                    break;
 
-                            switch (layout.types[binding]) {
-                                case nxt::BindingType::UniformBuffer:
-                                    {
-                                        BufferView* view = ToBackend(group->GetBindingAsBufferView(binding));
-                                        GLuint buffer = ToBackend(view->GetBuffer())->GetHandle();
-                                        GLuint index = indices[binding];
+                case OpType::MultiDrawArrays:
+                    {
+                        PrepareDraw(false, nullptr);
+                        stateCache->BindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandsBuffer);
+                        glMultiDrawArraysIndirect(GL_TRIANGLES, reinterpret_cast<void*>(op.multiDraw.offset),
+                                                  static_cast<GLsizei>(op.multiDraw.count), 0);
+                        device->RecordMultiDrawBatch(op.multiDraw.count);
+                    }
+                    break;
 
-                                        glBindBufferRange(GL_UNIFORM_BUFFER, index, buffer, view->GetOffset(), view->GetSize());
-                                    }
-                                    break;
+                case OpType::MultiDrawElements:
+                    {
+                        PrepareDraw(true, nullptr);
+                        stateCache->BindBuffer(GL_DRAW_INDIRECT_BUFFER, drawCommandsBuffer);
+                        glMultiDrawElementsIndirect(GL_TRIANGLES, op.multiDraw.indexType,
+                                                    reinterpret_cast<void*>(op.multiDraw.offset),
+                                                    static_cast<GLsizei>(op.multiDraw.count), 0);
+                        device->RecordMultiDrawBatch(op.multiDraw.count);
+                    }
+                    break;
 
-                                case nxt::BindingType::Sampler:
-                                    {
-                                        GLuint sampler = ToBackend(group->GetBindingAsSampler(binding))->GetHandle();
-                                        GLuint index = indices[binding];
+                case OpType::InstancedDrawArrays:
+                    {
+                        PrepareDraw(false, nullptr);
+                        Pipeline* pipeline = op.instanced.pipeline;
+                        pipeline->ApplyInstancedNow(instanceDataBuffer, op.instanced.offset, op.instanced.size);
+                        glDrawArraysInstanced(GL_TRIANGLES, op.instanced.firstVertex, op.instanced.vertexCount,
+                                              op.instanced.instanceCount);
+                        pipeline->ApplyNow();
+                    }
+                    break;
 
-                                        for (auto unit : lastPipeline->GetTextureUnitsForSampler(index)) {
-                                            glBindSampler(unit, sampler);
-                                        }
-                                    }
-                                    break;
+                case OpType::ExecuteBundle:
+                    {
+                        op.executeBundle.bundle->Execute();
 
-                                case nxt::BindingType::SampledTexture:
-                                    {
-                                        TextureView* view = ToBackend(group->GetBindingAsTextureView(binding));
-                                        Texture* texture = ToBackend(view->GetTexture());
-                                        GLuint handle = texture->GetHandle();
-                                        GLenum target = texture->GetGLTarget();
-                                        GLuint index = indices[binding];
-
-                                        for (auto unit : lastPipeline->GetTextureUnitsForTexture(index)) {
-                                            glActiveTexture(GL_TEXTURE0 + unit);
-                                            glBindTexture(target, handle);
-                                        }
-                                    }
-                                    break;
+                        // The bundle leaves an unknown state behind, it is set again afterwards.
+                        lastPipeline = nullptr;
+                        pushConstants.OnSetPipeline(nullptr);
+                        barriers.Reset();
+                        bindGroups.Reset();
+                        inputBuffers.Reset();
+                    }
+                    break;
 
-                                case nxt::BindingType::StorageBuffer:
-                                    {
-                                        BufferView* view = ToBackend(group->GetBindingAsBufferView(binding));
-                                        GLuint buffer = ToBackend(view->GetBuffer())->GetHandle();
-                                        GLuint index = indices[binding];
+                case OpType::SetPipeline:
+                    {
+                        lastPipeline = op.setPipeline.pipeline;
+                        lastPipeline->ApplyNow();
+                        pushConstants.OnSetPipeline(lastPipeline);
+                    }
+                    break;
 
-                                        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, index, buffer, view->GetOffset(), view->GetSize());
-                                    }
-                                    break;
-                            }
-                        }
+                case OpType::SetPushConstants:
+                    {
+                        pushConstants.SetPushConstants(op.pushConstants.stages, op.pushConstants.offset,
+                                                       op.pushConstants.count,
+                                                       &pushConstantValues[op.pushConstants.values]);
                     }
                     break;
 
-                case Command::SetIndexBuffer:
+                case OpType::SetBindGroup:
                     {
-                        SetIndexBufferCmd* cmd = commands.NextCommand<SetIndexBufferCmd>();
+                        bindGroups.OnSetBindGroup(op.bindGroup.index, op.bindGroup.group);
+                        barriers.SetBindGroup(op.bindGroup.index, op.bindGroup.group);
+                    }
+                    break;
 
-                        GLuint buffer = ToBackend(cmd->buffer.Get())->GetHandle();
-                        indexBufferOffset = cmd->offset;
-                        indexBufferFormat = cmd->format;
-                        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffer);
+                case OpType::SetIndexBuffer:
+                    {
+                        inputBuffers.OnSetIndexBuffer(op.indexBuffer.buffer);
+                        barriers.SetIndexBuffer(op.indexBuffer.buffer);
                     }
                     break;
 
-                case Command::SetVertexBuffers:
+                case OpType::SetVertexBuffers:
                     {
-                        SetVertexBuffersCmd* cmd = commands.NextCommand<SetVertexBuffersCmd>();
-                        auto buffers = commands.NextData<Ref<BufferBase>>(cmd->count);
-                        auto offsets = commands.NextData<uint32_t>(cmd->count);
+                        BufferBase* const* buffers = &vertexBuffers[op.vertexBuffers.first];
+                        const uint32_t* offsets = &vertexBufferOffsets[op.vertexBuffers.first];
+                        inputBuffers.OnSetVertexBuffers(op.vertexBuffers.startSlot, op.vertexBuffers.count, buffers, offsets);
+                        barriers.SetVertexBuffers(op.vertexBuffers.startSlot, op.vertexBuffers.count, buffers);
+                    }
+                    break;
+            }
+        }
+    }
 
-                        auto inputState = lastPipeline->GetInputState();
+    // CommandBuffer
 
-                        auto& attributesSetMask = inputState->GetAttributesSetMask();
-                        for (uint32_t location = 0; location < attributesSetMask.size(); ++location) {
-                            if (!attributesSetMask[location]) {
-                                // This slot is not used in the input state
-                                continue;
-                            }
-                            auto attribute = inputState->GetAttribute(location);
-                            auto slot = attribute.bindingSlot;
-                            ASSERT(slot < kMaxVertexInputs);
-                            if (slot < cmd->startSlot || slot >= cmd->startSlot + cmd->count) {
-                                // This slot is not affected by this call
-                                continue;
-                            }
-                            size_t bufferIndex = slot - cmd->startSlot;
-                            GLuint buffer = ToBackend(buffers[bufferIndex])->GetHandle();
-                            uint32_t bufferOffset = offsets[bufferIndex];
+    CommandBuffer::CommandBuffer(Device* device, CommandBufferBuilder* builder)
+        : device(device), commands(builder->AcquireCommands()), references(builder->AcquireReferences()) {
+    }
+
+    CommandBuffer::~CommandBuffer() {
+        FreeCommands(&commands, &references);
+
+        // The lowered commands own GL buffers. They don't point to the commands so they can be
+        // deleted after them.
+        LoweredCommands* loweredCommands = lowered.release();
+        if (loweredCommands != nullptr) {
+            device->RunGL([loweredCommands]() {
+                delete loweredCommands;
+            });
+        }
+    }
 
-                            auto input = inputState->GetInput(slot);
+    bool CommandBuffer::IsLowered() const {
+        return lowered != nullptr;
+    }
 
-                            auto components = VertexFormatNumComponents(attribute.format);
-                            auto formatType = VertexFormatType(attribute.format);
+    void CommandBuffer::Lower(size_t storageBufferOffsetAlignment) {
+        ASSERT(!IsLowered());
+        lowered.reset(new LoweredCommands(device, &commands, storageBufferOffsetAlignment));
+    }
 
-                            glBindBuffer(GL_ARRAY_BUFFER, buffer);
-                            glVertexAttribPointer(
-                                    location, components, formatType, GL_FALSE,
-                                    input.stride,
-                                    reinterpret_cast<void*>(static_cast<intptr_t>(bufferOffset + attribute.offset)));
-                        }
-                    }
-                    break;
-            }
+    void CommandBuffer::Execute() {
+        if (!IsLowered()) {
+            Lower(device->GetStorageBufferOffsetAlignment());
         }
+        lowered->Execute();
+
+        // Cleanup a tiny bit of state to make this work with virtualized contexts enabled in
+        // Chromium.
+        device->GetStateCache()->RestoreExternalState();
+    }
+
+    // RenderBundle
+
+    RenderBundle::RenderBundle(Device* device, RenderBundleBuilder* builder)
+        : RenderBundleBase(builder), device(device) {
+        // Lowering looks at the GL state of the pipelines so it is ordered after their creation.
+        device->RunGL([this, device]() {
+            lowered.reset(new LoweredCommands(device, GetCommands(), device->GetStorageBufferOffsetAlignment()));
+        }, {this});
+    }
+
+    RenderBundle::~RenderBundle() {
+        LoweredCommands* loweredCommands = lowered.release();
+        if (loweredCommands != nullptr) {
+            device->RunGL([loweredCommands]() {
+                delete loweredCommands;
+            });
+        }
+    }
 
-        // HACK: cleanup a tiny bit of state to make this work with
-        // virtualized contexts enabled in Chromium
-        glBindSampler(0, 0);
+    void RenderBundle::Execute() {
+        lowered->Execute();
     }
 
 }
@@ -7,6 +7,9 @@
 
 #include "common/CommandAllocator.h"
 #include "common/CommandBuffer.h"
+#include "common/RenderBundle.h"
+
+#include <memory>
 
 namespace backend {
     class CommandBufferBuilder;
@@ -16,17 +19,38 @@ namespace backend {
 namespace opengl {
 
     class  Device;
+    class LoweredCommands;
 
     class CommandBuffer : public CommandBufferBase {
         public:
             CommandBuffer(Device* device, CommandBufferBuilder* builder);
             ~CommandBuffer();
 
+            // The commands are lowered to GL operations before the first execution. Lowering
+            // doesn't call GL: the queue lowers the command buffers of a submit in parallel on
+            // the device's worker pool, then executes them in order on the GL thread.
+            bool IsLowered() const;
+            void Lower(size_t storageBufferOffsetAlignment);
             void Execute();
 
         private:
             Device* device;
             CommandIterator commands;
+            CommandReferences references;
+            std::unique_ptr<LoweredCommands> lowered;
+    };
+
+    class RenderBundle : public RenderBundleBase {
+        public:
+            RenderBundle(Device* device, RenderBundleBuilder* builder);
+            ~RenderBundle();
+
+            // Executes the commands inline in a command buffer.
+            void Execute();
+
+        private:
+            Device* device;
+            std::unique_ptr<LoweredCommands> lowered;
     };
 
 }
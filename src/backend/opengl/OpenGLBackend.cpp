@@ -11,6 +11,11 @@
 #include "SamplerGL.h"
 #include "TextureGL.h"
 
+#include "common/Math.h"
+
+#include <algorithm>
+#include <unordered_set>
+
 namespace backend {
 namespace opengl {
     nxtProcTable GetNonValidatingProcs();
@@ -33,6 +38,32 @@ namespace opengl {
         *device = reinterpret_cast<nxtDevice>(new Device);
     }
 
+    void SetAutoInstancing(nxtDevice device, bool enabled) {
+        reinterpret_cast<Device*>(device)->SetAutoInstancing(enabled);
+    }
+
+    void SetStreamedPushConstants(nxtDevice device, bool enabled) {
+        reinterpret_cast<Device*>(device)->SetStreamedPushConstants(enabled);
+    }
+
+    void SetLoweringThreads(nxtDevice device, uint32_t count) {
+        reinterpret_cast<Device*>(device)->SetLoweringThreads(count);
+    }
+
+    void StartSubmitThread(nxtDevice device, void (*makeCurrent)(void*), void* userData) {
+        reinterpret_cast<Device*>(device)->StartSubmitThread(makeCurrent, userData);
+    }
+
+    void RunOnSubmitThread(nxtDevice device, void (*callback)(void*), void* userData) {
+        reinterpret_cast<Device*>(device)->RunGL([callback, userData]() {
+            callback(userData);
+        });
+    }
+
+    void WaitForSubmitThreadIdle(nxtDevice device) {
+        reinterpret_cast<Device*>(device)->WaitForIdle();
+    }
+
     // Device
 
     BindGroupBase* Device::CreateBindGroup(BindGroupBuilder* builder) {
@@ -50,6 +81,9 @@ namespace opengl {
     CommandBufferBase* Device::CreateCommandBuffer(CommandBufferBuilder* builder) {
         return new CommandBuffer(this, builder);
     }
+    FenceBase* Device::CreateFence(FenceBuilder* builder) {
+        return new Fence(this, builder);
+    }
     InputStateBase* Device::CreateInputState(InputStateBuilder* builder) {
         return new InputState(this, builder);
     }
@@ -62,6 +96,9 @@ namespace opengl {
     QueueBase* Device::CreateQueue(QueueBuilder* builder) {
         return new Queue(this, builder);
     }
+    RenderBundleBase* Device::CreateRenderBundle(RenderBundleBuilder* builder) {
+        return new RenderBundle(this, builder);
+    }
     SamplerBase* Device::CreateSampler(SamplerBuilder* builder) {
         return new Sampler(this, builder);
     }
@@ -75,16 +112,290 @@ namespace opengl {
         return new TextureView(this, builder);
     }
 
+    void Device::TickImpl() {
+        // Polls the syncs without waiting. With a submission thread the result is only seen by
+        // the next tick.
+        RunGL([this]() {
+            while (!syncsInFlight.empty()) {
+                const SyncInFlight& front = syncsInFlight.front();
+                GLenum result = glClientWaitSync(front.sync, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+                if (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+                    break;
+                }
+
+                completedSignalSerial.store(front.serial, std::memory_order_release);
+                glDeleteSync(front.sync);
+                syncsInFlight.pop_front();
+            }
+        });
+
+        fenceSignalTracker.CompleteSignals(completedSignalSerial.load(std::memory_order_acquire));
+    }
+
     void Device::Reference() {
     }
 
     void Device::Release() {
     }
 
+    void Device::SetAutoInstancing(bool enabled) {
+        autoInstancing = enabled;
+    }
+
+    bool Device::IsAutoInstancingEnabled() const {
+        return autoInstancing;
+    }
+
+    void Device::SetStreamedPushConstants(bool enabled) {
+        streamedPushConstants = enabled;
+    }
+
+    bool Device::IsStreamedPushConstantsEnabled() const {
+        return streamedPushConstants && GLAD_GL_VERSION_4_4;
+    }
+
+    RingBuffer* Device::GetPushConstantRingBuffer() {
+        ASSERT(IsStreamedPushConstantsEnabled());
+        if (pushConstantRingBuffer == nullptr) {
+            // Room for a few frames of 10k draws with one stage of push constants each.
+            constexpr size_t kPushConstantRingBufferSize = 16 * 1024 * 1024;
+            pushConstantRingBuffer.reset(new RingBuffer(kPushConstantRingBufferSize));
+        }
+        return pushConstantRingBuffer.get();
+    }
+
+    size_t Device::GetUniformBufferOffsetAlignment() {
+        if (uniformBufferOffsetAlignment == 0) {
+            GLint alignment = 0;
+            glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            uniformBufferOffsetAlignment = std::max(alignment, 1);
+        }
+        return uniformBufferOffsetAlignment;
+    }
+
+    size_t Device::GetStorageBufferOffsetAlignment() {
+        if (storageBufferOffsetAlignment == 0) {
+            GLint alignment = 0;
+            glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+            storageBufferOffsetAlignment = std::max(alignment, 1);
+        }
+        return storageBufferOffsetAlignment;
+    }
+
+    const Device::MultiDrawStats& Device::GetMultiDrawStats() const {
+        return multiDrawStats;
+    }
+
+    void Device::RecordMultiDrawBatch(uint32_t size) {
+        ASSERT(size > 0);
+        multiDrawStats.batches++;
+        multiDrawStats.batchedDraws += size;
+        multiDrawStats.largestBatch = std::max(multiDrawStats.largestBatch, size);
+        multiDrawStats.batchSizeHistogram[Log2(size)]++;
+    }
+
+    void Device::SetLoweringThreads(uint32_t count) {
+        // Submits use the pool on the GL thread, so it is replaced there once the submits that
+        // were queued before are done with it.
+        RunGL([this, count]() {
+            workerPool.reset(new WorkerPool(count));
+        });
+    }
+
+    WorkerPool* Device::GetWorkerPool() {
+        if (workerPool == nullptr) {
+            workerPool.reset(new WorkerPool(0));
+        }
+        return workerPool.get();
+    }
+
+    void Device::StartSubmitThread(void (*makeCurrent)(void*), void* userData) {
+        ASSERT(submitThread == nullptr);
+        submitThread.reset(new TaskThread);
+        submitThread->Post([makeCurrent, userData]() {
+            makeCurrent(userData);
+        });
+    }
+
+    bool Device::HasSubmitThread() const {
+        return submitThread != nullptr;
+    }
+
+    void Device::RunGL(std::function<void()> task, std::vector<RefCounted*> references) {
+        if (submitThread == nullptr) {
+            task();
+            return;
+        }
+        submitThread->Post(std::move(task), std::move(references));
+    }
+
+    void Device::WaitForIdle() {
+        if (submitThread != nullptr) {
+            submitThread->WaitForIdle();
+        }
+    }
+
+    StateCache* Device::GetStateCache() {
+        return &stateCache;
+    }
+
+    BarrierTracker* Device::GetBarrierTracker() {
+        return &barrierTracker;
+    }
+
+    GLbitfield Device::AcquireMemoryBarrierBits() {
+        nxt::BufferUsageBit usages = barrierTracker.AcquireBarrier();
+
+        GLbitfield bits = 0;
+        if (usages & nxt::BufferUsageBit::Mapped) {
+            bits |= GL_BUFFER_UPDATE_BARRIER_BIT;
+        }
+        if (usages & nxt::BufferUsageBit::TransferSrc) {
+            bits |= GL_PIXEL_BUFFER_BARRIER_BIT;
+        }
+        if (usages & nxt::BufferUsageBit::TransferDst) {
+            bits |= GL_BUFFER_UPDATE_BARRIER_BIT;
+        }
+        if (usages & nxt::BufferUsageBit::Index) {
+            bits |= GL_ELEMENT_ARRAY_BARRIER_BIT;
+        }
+        if (usages & nxt::BufferUsageBit::Vertex) {
+            bits |= GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT;
+        }
+        if (usages & nxt::BufferUsageBit::Uniform) {
+            bits |= GL_UNIFORM_BARRIER_BIT;
+        }
+        if (usages & nxt::BufferUsageBit::Storage) {
+            bits |= GL_SHADER_STORAGE_BARRIER_BIT;
+        }
+        if (usages & nxt::BufferUsageBit::Indirect) {
+            bits |= GL_COMMAND_BARRIER_BIT;
+        }
+        return bits;
+    }
+
+    void Device::SignalFence(FenceBase* fence, uint64_t value) {
+        uint64_t serial = ++lastSignalSerial;
+        fenceSignalTracker.AddSignal(fence, value, serial);
+
+        RunGL([this, serial]() {
+            syncsInFlight.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), serial});
+        });
+    }
+
     // Bind Group
 
     BindGroup::BindGroup(Device* device, BindGroupBuilder* builder)
         : BindGroupBase(builder), device(device) {
+        samplers.fill(0);
+        textures.fill(0);
+        textureTargets.fill(GL_TEXTURE_2D);
+
+        // The handles of the objects are only known once their GL calls ran.
+        device->RunGL([this]() {
+            const auto& layout = GetLayout()->GetBindingInfo();
+            for (uint32_t binding = 0; binding < kMaxBindingsPerGroup; ++binding) {
+                if (!layout.mask[binding]) {
+                    continue;
+                }
+
+                switch (layout.types[binding]) {
+                    case nxt::BindingType::UniformBuffer:
+                    case nxt::BindingType::StorageBuffer:
+                        {
+                            BufferBindings* bindings = layout.types[binding] == nxt::BindingType::UniformBuffer ?
+                                &uniformBuffers : &storageBuffers;
+                            if (bindings->buffers.empty()) {
+                                bindings->firstBinding = binding;
+                            }
+
+                            BufferView* view = ToBackend(GetBindingAsBufferView(binding));
+                            bindings->objects.push_back(view->GetBuffer());
+                            bindings->buffers.push_back(ToBackend(view->GetBuffer())->GetHandle());
+                            bindings->offsets.push_back(view->GetOffset());
+                            bindings->sizes.push_back(view->GetSize());
+                        }
+                        break;
+
+                    case nxt::BindingType::Sampler:
+                        samplers[binding] = ToBackend(GetBindingAsSampler(binding))->GetHandle();
+                        break;
+
+                    case nxt::BindingType::SampledTexture:
+                        {
+                            Texture* texture = ToBackend(GetBindingAsTextureView(binding)->GetTexture());
+                            textures[binding] = texture->GetHandle();
+                            textureTargets[binding] = texture->GetGLTarget();
+                        }
+                        break;
+                }
+            }
+        }, {this});
+    }
+
+    void BindGroup::ApplyNow(Pipeline* pipeline, uint32_t index) {
+        StateCache* stateCache = device->GetStateCache();
+        const auto& indices = ToBackend(pipeline->GetLayout())->GetBindingIndexInfo()[index];
+
+        if (!uniformBuffers.buffers.empty()) {
+            stateCache->BindBuffersRange(GL_UNIFORM_BUFFER, indices[uniformBuffers.firstBinding],
+                                         static_cast<GLsizei>(uniformBuffers.buffers.size()),
+                                         uniformBuffers.buffers.data(), uniformBuffers.offsets.data(),
+                                         uniformBuffers.sizes.data());
+        }
+        if (!storageBuffers.buffers.empty()) {
+            stateCache->BindBuffersRange(GL_SHADER_STORAGE_BUFFER, indices[storageBuffers.firstBinding],
+                                         static_cast<GLsizei>(storageBuffers.buffers.size()),
+                                         storageBuffers.buffers.data(), storageBuffers.offsets.data(),
+                                         storageBuffers.sizes.data());
+        }
+
+        // Samplers and textures are bound on the units of their combinations in the pipeline,
+        // one call per run of consecutive units.
+        std::array<GLuint, kMaxBindingsPerGroup> runHandles;
+        std::array<GLenum, kMaxBindingsPerGroup> runTargets;
+
+        const auto& samplerUnits = pipeline->GetSamplerUnits(index);
+        for (size_t i = 0; i < samplerUnits.size();) {
+            GLuint firstUnit = samplerUnits[i].unit;
+            GLsizei count = 0;
+            while (i < samplerUnits.size() && count < static_cast<GLsizei>(kMaxBindingsPerGroup) &&
+                   samplerUnits[i].unit == firstUnit + count) {
+                runHandles[count] = samplers[samplerUnits[i].binding];
+                count ++;
+                i ++;
+            }
+            stateCache->BindSamplers(firstUnit, count, runHandles.data());
+        }
+
+        const auto& textureUnits = pipeline->GetTextureUnits(index);
+        for (size_t i = 0; i < textureUnits.size();) {
+            GLuint firstUnit = textureUnits[i].unit;
+            GLsizei count = 0;
+            while (i < textureUnits.size() && count < static_cast<GLsizei>(kMaxBindingsPerGroup) &&
+                   textureUnits[i].unit == firstUnit + count) {
+                runHandles[count] = textures[textureUnits[i].binding];
+                runTargets[count] = textureTargets[textureUnits[i].binding];
+                count ++;
+                i ++;
+            }
+            stateCache->BindTextures(firstUnit, count, runTargets.data(), runHandles.data());
+        }
+    }
+
+    void BindGroup::ReadBuffers(BarrierTracker* tracker) {
+        for (BufferBase* buffer : uniformBuffers.objects) {
+            tracker->Read(buffer, nxt::BufferUsageBit::Uniform);
+        }
+        for (BufferBase* buffer : storageBuffers.objects) {
+            tracker->Read(buffer, nxt::BufferUsageBit::Storage);
+        }
+    }
+
+    void BindGroup::WriteBuffers(BarrierTracker* tracker) {
+        for (BufferBase* buffer : storageBuffers.objects) {
+            tracker->WriteStorage(buffer, buffer->GetUsage());
+        }
     }
 
     // Bind Group Layout
@@ -97,9 +408,20 @@ namespace opengl {
 
     Buffer::Buffer(Device* device, BufferBuilder* builder)
         : BufferBase(builder), device(device) {
-        glGenBuffers(1, &buffer);
-        glBindBuffer(GL_ARRAY_BUFFER, buffer);
-        glBufferData(GL_ARRAY_BUFFER, GetSize(), nullptr, GL_STATIC_DRAW);
+        device->RunGL([this, device]() {
+            glGenBuffers(1, &buffer);
+            device->GetStateCache()->BindBuffer(GL_ARRAY_BUFFER, buffer);
+            glBufferData(GL_ARRAY_BUFFER, GetSize(), nullptr, GL_STATIC_DRAW);
+        }, {this});
+    }
+
+    Buffer::~Buffer() {
+        // The tracker is used on the submission thread, the buffer is only a key for it.
+        BarrierTracker* tracker = device->GetBarrierTracker();
+        BufferBase* key = this;
+        device->RunGL([tracker, key]() {
+            tracker->Forget(key);
+        });
     }
 
     GLuint Buffer::GetHandle() const {
@@ -107,7 +429,26 @@ namespace opengl {
     }
 
     void Buffer::SetSubDataImpl(uint32_t start, uint32_t count, const uint32_t* data) {
-        glBindBuffer(GL_ARRAY_BUFFER, buffer);
+        if (!device->HasSubmitThread()) {
+            SetSubDataNow(start, count, data);
+            return;
+        }
+
+        // The data only has to be valid for the duration of the call.
+        std::vector<uint32_t> copy(data, data + count);
+        device->RunGL([this, start, copy]() {
+            SetSubDataNow(start, static_cast<uint32_t>(copy.size()), copy.data());
+        }, {this});
+    }
+
+    void Buffer::SetSubDataNow(uint32_t start, uint32_t count, const uint32_t* data) {
+        device->GetBarrierTracker()->Read(this, nxt::BufferUsageBit::Mapped);
+        GLbitfield barrier = device->AcquireMemoryBarrierBits();
+        if (barrier != 0) {
+            glMemoryBarrier(barrier);
+        }
+
+        device->GetStateCache()->BindBuffer(GL_ARRAY_BUFFER, buffer);
         glBufferSubData(GL_ARRAY_BUFFER, start * sizeof(uint32_t), count * sizeof(uint32_t), data);
     }
 
@@ -117,52 +458,180 @@ namespace opengl {
         : BufferViewBase(builder), device(device) {
     }
 
+    // Fence
+
+    Fence::Fence(Device* device, FenceBuilder* builder)
+        : FenceBase(builder), device(device) {
+    }
+
     // InputState
 
+    static GLenum VertexFormatType(nxt::VertexFormat format) {
+        switch (format) {
+            case nxt::VertexFormat::FloatR32G32B32A32:
+            case nxt::VertexFormat::FloatR32G32B32:
+            case nxt::VertexFormat::FloatR32G32:
+                return GL_FLOAT;
+        }
+    }
+
     InputState::InputState(Device* device, InputStateBuilder* builder)
-        : InputStateBase(builder), device(device) {
-        glGenVertexArrays(1, &vertexArrayObject);
-        glBindVertexArray(vertexArrayObject);
-        auto& attributesSetMask = GetAttributesSetMask();
-        for (uint32_t location = 0; location < attributesSetMask.size(); ++location) {
-            if (!attributesSetMask[location]) {
-                continue;
+        : InputStateBase(builder), device(device), separateAttribFormat(GLAD_GL_VERSION_4_3 != 0) {
+        device->RunGL([this, device]() {
+            glGenVertexArrays(1, &vertexArrayObject);
+            device->GetStateCache()->BindVertexArray(vertexArrayObject);
+            auto& attributesSetMask = GetAttributesSetMask();
+            for (uint32_t location = 0; location < attributesSetMask.size(); ++location) {
+                if (!attributesSetMask[location]) {
+                    continue;
+                }
+                auto attribute = GetAttribute(location);
+                glEnableVertexAttribArray(location);
+
+                if (separateAttribFormat) {
+                    // The format is only set once, the buffers are bound to the binding slots.
+                    glVertexAttribFormat(location, VertexFormatNumComponents(attribute.format),
+                                         VertexFormatType(attribute.format), GL_FALSE, attribute.offset);
+                    glVertexAttribBinding(location, attribute.bindingSlot);
+                    continue;
+                }
+
+                auto input = GetInput(attribute.bindingSlot);
+                if (input.stride == 0) {
+                    // Emulate a stride of zero (constant vertex attribute) by
+                    // setting the attribute instance divisor to a huge number.
+                    glVertexAttribDivisor(location, 0xffffffff);
+                } else {
+                    switch (input.stepMode) {
+                        case nxt::InputStepMode::Vertex:
+                            break;
+                        case nxt::InputStepMode::Instance:
+                            glVertexAttribDivisor(location, 1);
+                            break;
+                        default:
+                            ASSERT(false);
+                            break;
+                    }
+                }
             }
-            auto attribute = GetAttribute(location);
-            glEnableVertexAttribArray(location);
 
-            auto input = GetInput(attribute.bindingSlot);
-            if (input.stride == 0) {
-                // Emulate a stride of zero (constant vertex attribute) by
-                // setting the attribute instance divisor to a huge number.
-                glVertexAttribDivisor(location, 0xffffffff);
-            } else {
-                switch (input.stepMode) {
-                    case nxt::InputStepMode::Vertex:
-                        break;
-                    case nxt::InputStepMode::Instance:
-                        glVertexAttribDivisor(location, 1);
-                        break;
-                    default:
-                        ASSERT(false);
-                        break;
+            if (separateAttribFormat) {
+                // Binding slots with a stride of zero read the same element for all the vertices
+                // so they don't need a divisor.
+                auto& inputsSetMask = GetInputsSetMask();
+                for (uint32_t slot = 0; slot < inputsSetMask.size(); ++slot) {
+                    if (inputsSetMask[slot] && GetInput(slot).stepMode == nxt::InputStepMode::Instance) {
+                        glVertexBindingDivisor(slot, 1);
+                    }
                 }
             }
-        }
+        }, {this});
     }
 
     GLuint InputState::GetVAO() {
         return vertexArrayObject;
     }
 
+    void InputState::ApplyVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, const uint32_t* offsets) {
+        if (separateAttribFormat) {
+            std::array<GLuint, kMaxVertexInputs> glBuffers;
+            std::array<GLintptr, kMaxVertexInputs> glOffsets;
+            std::array<GLsizei, kMaxVertexInputs> glStrides;
+            auto& inputsSetMask = GetInputsSetMask();
+            for (uint32_t i = 0; i < count; ++i) {
+                uint32_t slot = startSlot + i;
+                glBuffers[i] = ToBackend(buffers[i])->GetHandle();
+                glOffsets[i] = offsets[i];
+                // Slots that aren't used by the input state can still be given a buffer.
+                glStrides[i] = inputsSetMask[slot] ? GetInput(slot).stride : 0;
+            }
+
+            if (GLAD_GL_VERSION_4_4) {
+                glBindVertexBuffers(startSlot, count, glBuffers.data(), glOffsets.data(), glStrides.data());
+            } else {
+                for (uint32_t i = 0; i < count; ++i) {
+                    glBindVertexBuffer(startSlot + i, glBuffers[i], glOffsets[i], glStrides[i]);
+                }
+            }
+            return;
+        }
+
+        // Without separate attribute formats, each attribute of the slots has to be respecified.
+        auto& attributesSetMask = GetAttributesSetMask();
+        for (uint32_t location = 0; location < attributesSetMask.size(); ++location) {
+            if (!attributesSetMask[location]) {
+                // This slot is not used in the input state
+                continue;
+            }
+            auto attribute = GetAttribute(location);
+            auto slot = attribute.bindingSlot;
+            ASSERT(slot < kMaxVertexInputs);
+            if (slot < startSlot || slot >= startSlot + count) {
+                // This slot is not affected by this call
+                continue;
+            }
+            size_t bufferIndex = slot - startSlot;
+            GLuint buffer = ToBackend(buffers[bufferIndex])->GetHandle();
+            uint32_t bufferOffset = offsets[bufferIndex];
+
+            auto input = GetInput(slot);
+
+            auto components = VertexFormatNumComponents(attribute.format);
+            auto formatType = VertexFormatType(attribute.format);
+
+            device->GetStateCache()->BindBuffer(GL_ARRAY_BUFFER, buffer);
+            glVertexAttribPointer(
+                    location, components, formatType, GL_FALSE,
+                    input.stride,
+                    reinterpret_cast<void*>(static_cast<intptr_t>(bufferOffset + attribute.offset)));
+        }
+    }
+
     // Queue
 
     Queue::Queue(Device* device, QueueBuilder* builder) : device(device) {
     }
 
     void Queue::Submit(uint32_t numCommands, CommandBuffer* const * commands) {
-        for (uint32_t i = 0; i < numCommands; ++i) {
-            commands[i]->Execute();
+        std::vector<CommandBuffer*> commandBuffers(commands, commands + numCommands);
+        std::vector<RefCounted*> references(commands, commands + numCommands);
+        references.push_back(this);
+
+        device->RunGL([this, commandBuffers]() {
+            SubmitNow(commandBuffers);
+        }, std::move(references));
+    }
+
+    void Queue::Signal(Fence* fence, uint64_t value) {
+        if (value <= fence->GetSignaledValue()) {
+            device->HandleError("Fence signaled with a value that isn't greater than the signaled value");
+            return;
+        }
+
+        fence->SetSignaledValue(value);
+        device->SignalFence(fence, value);
+    }
+
+    void Queue::SubmitNow(const std::vector<CommandBuffer*>& commands) {
+        // The command buffers that weren't submitted before are lowered in parallel, the GL
+        // calls all stay on this thread. A command buffer can be in the list more than once.
+        std::vector<CommandBuffer*> toLower;
+        std::unordered_set<CommandBuffer*> seen;
+        for (CommandBuffer* commandBuffer : commands) {
+            if (!commandBuffer->IsLowered() && seen.insert(commandBuffer).second) {
+                toLower.push_back(commandBuffer);
+            }
+        }
+
+        if (!toLower.empty()) {
+            size_t alignment = device->GetStorageBufferOffsetAlignment();
+            device->GetWorkerPool()->ParallelFor(toLower.size(), [&](size_t i) {
+                toLower[i]->Lower(alignment);
+            });
+        }
+
+        for (CommandBuffer* commandBuffer : commands) {
+            commandBuffer->Execute();
         }
     }
 
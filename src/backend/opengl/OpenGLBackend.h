@@ -8,15 +8,30 @@
 #include "nxt/nxtcpp.h"
 
 #include "common/Buffer.h"
+#include "common/BarrierTracker.h"
 #include "common/BindGroup.h"
 #include "common/BindGroupLayout.h"
 #include "common/Device.h"
+#include "common/Fence.h"
+#include "common/FenceSignalTracker.h"
 #include "common/InputState.h"
 #include "common/Queue.h"
+#include "common/TaskThread.h"
 #include "common/ToBackend.h"
+#include "common/WorkerPool.h"
+
+#include "RingBufferGL.h"
+#include "StateCacheGL.h"
 
 #include "glad/glad.h"
 
+#include <array>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <vector>
+
 namespace backend {
 namespace opengl {
 
@@ -25,10 +40,12 @@ namespace opengl {
     class Buffer;
     class BufferView;
     class CommandBuffer;
+    class Fence;
     class InputState;
     class Pipeline;
     class PipelineLayout;
     class Queue;
+    class RenderBundle;
     class Sampler;
     class ShaderModule;
     class Texture;
@@ -40,10 +57,12 @@ namespace opengl {
         using BufferType = Buffer;
         using BufferViewType = BufferView;
         using CommandBufferType = CommandBuffer;
+        using FenceType = Fence;
         using InputStateType = InputState;
         using PipelineType = Pipeline;
         using PipelineLayoutType = PipelineLayout;
         using QueueType = Queue;
+        using RenderBundleType = RenderBundle;
         using SamplerType = Sampler;
         using ShaderModuleType = ShaderModule;
         using TextureType = Texture;
@@ -63,26 +82,138 @@ namespace opengl {
             BufferBase* CreateBuffer(BufferBuilder* builder) override;
             BufferViewBase* CreateBufferView(BufferViewBuilder* builder) override;
             CommandBufferBase* CreateCommandBuffer(CommandBufferBuilder* builder) override;
+            FenceBase* CreateFence(FenceBuilder* builder) override;
             InputStateBase* CreateInputState(InputStateBuilder* builder) override;
             PipelineBase* CreatePipeline(PipelineBuilder* builder) override;
             PipelineLayoutBase* CreatePipelineLayout(PipelineLayoutBuilder* builder) override;
             QueueBase* CreateQueue(QueueBuilder* builder) override;
+            RenderBundleBase* CreateRenderBundle(RenderBundleBuilder* builder) override;
             SamplerBase* CreateSampler(SamplerBuilder* builder) override;
             ShaderModuleBase* CreateShaderModule(ShaderModuleBuilder* builder) override;
             TextureBase* CreateTexture(TextureBuilder* builder) override;
             TextureViewBase* CreateTextureView(TextureViewBuilder* builder) override;
 
+            void TickImpl() override;
+
             // NXT API
             void Reference();
             void Release();
+
+            // Opt-in lowering of runs of draws that only change push constants to instanced
+            // draws. It must be set before the pipelines are created.
+            void SetAutoInstancing(bool enabled);
+            bool IsAutoInstancingEnabled() const;
+
+            // Opt-in lowering of push constants to ranges of a streamed uniform buffer bound
+            // before each draw, instead of one glUniform call per value. It needs GL 4.4 for the
+            // persistently mapped buffer and must be set before the shader modules are created.
+            void SetStreamedPushConstants(bool enabled);
+            bool IsStreamedPushConstantsEnabled() const;
+            RingBuffer* GetPushConstantRingBuffer();
+            size_t GetUniformBufferOffsetAlignment();
+            size_t GetStorageBufferOffsetAlignment();
+
+            // Instrumentation of the sizes of the batches of draws submitted with a single
+            // glMultiDraw*Indirect call.
+            struct MultiDrawStats {
+                uint64_t batches = 0;
+                uint64_t batchedDraws = 0;
+                uint32_t largestBatch = 0;
+                // Bucket i counts the batches with a size in [2^i, 2^(i+1)).
+                std::array<uint64_t, 32> batchSizeHistogram = {};
+            };
+            const MultiDrawStats& GetMultiDrawStats() const;
+            void RecordMultiDrawBatch(uint32_t size);
+
+            // Threads that lower the command buffers of a submit in addition to the GL thread,
+            // 0 by default. The pool is only used on the GL thread, so GetWorkerPool must be
+            // called there too.
+            void SetLoweringThreads(uint32_t count);
+            WorkerPool* GetWorkerPool();
+
+            // Opt-in submission thread: the GL context is made current on a thread owned by the
+            // device with makeCurrent, after the application made it non-current on its thread.
+            // From then on all the GL calls are posted to that thread and the application thread
+            // only records and validates. It must be started before any object is created. The
+            // submission thread takes tasks from a single thread, so the device must then only be
+            // used by one thread, including RunOnSubmitThread and WaitForSubmitThreadIdle.
+            void StartSubmitThread(void (*makeCurrent)(void*), void* userData);
+            bool HasSubmitThread() const;
+            // Runs the GL calls of a task on the submission thread, keeping the objects it uses
+            // alive until then, or inline when there is no submission thread.
+            void RunGL(std::function<void()> task, std::vector<RefCounted*> references = {});
+            // Returns when the GL calls of everything posted so far were made.
+            void WaitForIdle();
+
+            // All the GL binding calls go through the state cache.
+            StateCache* GetStateCache();
+
+            // Shader storage writes aren't coherent, the tracker knows which buffers are written
+            // across command buffers. Returns the glMemoryBarrier bits needed by the reads that
+            // were given to the tracker, 0 if there is no hazard.
+            BarrierTracker* GetBarrierTracker();
+            GLbitfield AcquireMemoryBarrierBits();
+
+            // Inserts a GL sync after the commands submitted so far, the fence completes when
+            // the sync is signaled.
+            void SignalFence(FenceBase* fence, uint64_t value);
+
+        private:
+            bool autoInstancing = false;
+            bool streamedPushConstants = false;
+            std::unique_ptr<RingBuffer> pushConstantRingBuffer;
+            size_t uniformBufferOffsetAlignment = 0;
+            size_t storageBufferOffsetAlignment = 0;
+            MultiDrawStats multiDrawStats;
+            StateCache stateCache;
+            BarrierTracker barrierTracker;
+            std::unique_ptr<WorkerPool> workerPool;
+
+            // The fence signals are tracked on the application thread, their syncs on the GL
+            // thread. The GL thread publishes the serial of the last signaled sync.
+            FenceSignalTracker fenceSignalTracker;
+            uint64_t lastSignalSerial = 0;
+            struct SyncInFlight {
+                GLsync sync;
+                uint64_t serial;
+            };
+            std::deque<SyncInFlight> syncsInFlight;
+            std::atomic<uint64_t> completedSignalSerial{0};
+
+            // Last so that it is joined before the rest of the device is destroyed.
+            std::unique_ptr<TaskThread> submitThread;
     };
 
     class BindGroup : public BindGroupBase {
         public:
             BindGroup(Device* device, BindGroupBuilder* builder);
 
+            // Binds the group at this index of the pipeline's layout with a few multi-bind calls.
+            void ApplyNow(Pipeline* pipeline, uint32_t index);
+
+            // Give the buffers of the group to the barrier tracker for a draw or dispatch. All
+            // the storage buffers are considered written.
+            void ReadBuffers(BarrierTracker* tracker);
+            void WriteBuffers(BarrierTracker* tracker);
+
         private:
+            // The buffers of one type in binding order. The layout gives them consecutive indices
+            // so they are bound starting at the index of the first binding.
+            struct BufferBindings {
+                uint32_t firstBinding = 0;
+                std::vector<BufferBase*> objects;
+                std::vector<GLuint> buffers;
+                std::vector<GLintptr> offsets;
+                std::vector<GLsizeiptr> sizes;
+            };
+
             Device* device;
+            BufferBindings uniformBuffers;
+            BufferBindings storageBuffers;
+            // The handles of the samplers and textures, indexed by binding.
+            std::array<GLuint, kMaxBindingsPerGroup> samplers;
+            std::array<GLuint, kMaxBindingsPerGroup> textures;
+            std::array<GLenum, kMaxBindingsPerGroup> textureTargets;
     };
 
     class BindGroupLayout : public BindGroupLayoutBase {
@@ -96,11 +227,13 @@ namespace opengl {
     class Buffer : public BufferBase {
         public:
             Buffer(Device* device, BufferBuilder* builder);
+            ~Buffer();
 
             GLuint GetHandle() const;
 
         private:
             void SetSubDataImpl(uint32_t start, uint32_t count, const uint32_t* data) override;
+            void SetSubDataNow(uint32_t start, uint32_t count, const uint32_t* data);
 
             Device* device;
             GLuint buffer = 0;
@@ -114,14 +247,27 @@ namespace opengl {
             Device* device;
     };
 
+    class Fence : public FenceBase {
+        public:
+            Fence(Device* device, FenceBuilder* builder);
+
+        private:
+            Device* device;
+    };
+
     class InputState : public InputStateBase {
         public:
             InputState(Device* device, InputStateBuilder* builder);
             GLuint GetVAO();
 
+            // Binds buffers to the input slots of the VAO, which must be bound. With GL 4.3 the
+            // attribute formats are in the VAO so this is a single glBindVertexBuffers call.
+            void ApplyVertexBuffers(uint32_t startSlot, uint32_t count, BufferBase* const* buffers, const uint32_t* offsets);
+
         private:
             Device* device;
             GLuint vertexArrayObject;
+            bool separateAttribFormat;
     };
 
     class Queue : public QueueBase {
@@ -130,8 +276,11 @@ namespace opengl {
 
             // NXT API
             void Submit(uint32_t numCommands, CommandBuffer* const * commands);
+            void Signal(Fence* fence, uint64_t value);
 
         private:
+            void SubmitNow(const std::vector<CommandBuffer*>& commands);
+
             Device* device;
     };
 
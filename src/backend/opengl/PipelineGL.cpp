@@ -8,6 +8,7 @@
 #include "PipelineLayoutGL.h"
 #include "ShaderModuleGL.h"
 
+#include <algorithm>
 #include <iostream>
 #include <set>
 
@@ -30,6 +31,22 @@ namespace opengl {
     }
 
     Pipeline::Pipeline(Device* device, PipelineBuilder* builder) : PipelineBase(builder), device(device) {
+        // The builder is gone when the GL calls run on the submission thread, so they get the
+        // modules and keep them alive instead.
+        PerStage<const ShaderModule*> modules;
+        std::vector<RefCounted*> references = {this};
+        for (auto stage : IterateStages(GetStageMask())) {
+            const ShaderModule* module = ToBackend(builder->GetStageInfo(stage).module.Get());
+            modules[stage] = module;
+            references.push_back(const_cast<ShaderModule*>(module));
+        }
+
+        device->RunGL([this, modules]() {
+            CreatePrograms(modules);
+        }, std::move(references));
+    }
+
+    void Pipeline::CreatePrograms(const PerStage<const ShaderModule*>& modules) {
         auto CreateShader = [](GLenum type, const char* source) -> GLuint {
             GLuint shader = glCreateShader(type);
             glShaderSource(shader, 1, &source, nullptr);
@@ -74,129 +91,226 @@ namespace opengl {
             }
         };
 
-        program = glCreateProgram();
+        auto CreateProgram = [&](bool instanced) -> GLuint {
+            GLuint program = glCreateProgram();
 
-        for (auto stage : IterateStages(GetStageMask())) {
-            const ShaderModule* module = ToBackend(builder->GetStageInfo(stage).module.Get());
+            for (auto stage : IterateStages(GetStageMask())) {
+                const ShaderModule* module = modules[stage];
+                const char* source = module->GetSource();
+                if (instanced && stage == nxt::ShaderStage::Vertex) {
+                    source = module->GetInstancedSource();
+                }
 
-            GLuint shader = CreateShader(GLShaderType(stage), module->GetSource());
-            glAttachShader(program, shader);
-        }
+                GLuint shader = CreateShader(GLShaderType(stage), source);
+                glAttachShader(program, shader);
+            }
 
-        glLinkProgram(program);
+            glLinkProgram(program);
 
-        GLint linkStatus = GL_FALSE;
-        glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
-        if (linkStatus == GL_FALSE) {
-            GLint infoLogLength = 0;
-            glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
+            GLint linkStatus = GL_FALSE;
+            glGetProgramiv(program, GL_LINK_STATUS, &linkStatus);
+            if (linkStatus == GL_FALSE) {
+                GLint infoLogLength = 0;
+                glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
 
-            if (infoLogLength > 1) {
-                std::vector<char> buffer(infoLogLength);
-                glGetProgramInfoLog(program, infoLogLength, nullptr, &buffer[0]);
-                std::cout << "Program link failed:\n";
-                std::cout << buffer.data() << std::endl;
+                if (infoLogLength > 1) {
+                    std::vector<char> buffer(infoLogLength);
+                    glGetProgramInfoLog(program, infoLogLength, nullptr, &buffer[0]);
+                    std::cout << "Program link failed:\n";
+                    std::cout << buffer.data() << std::endl;
+                }
             }
-        }
-
-        for (auto stage : IterateStages(GetStageMask())) {
-            const ShaderModule* module = ToBackend(builder->GetStageInfo(stage).module.Get());
-            FillPushConstants(module, &glPushConstants[stage], program);
-        }
+            return program;
+        };
 
-        glUseProgram(program);
+        program = CreateProgram(false);
 
-        // The uniforms are part of the program state so we can pre-bind buffer units, texture units etc.
         const auto& layout = ToBackend(GetLayout());
         const auto& indices = layout->GetBindingIndexInfo();
 
-        for (uint32_t group = 0; group < kMaxBindGroups; ++group) {
-            const auto& groupInfo = layout->GetBindGroupLayout(group)->GetBindingInfo();
+        for (auto stage : IterateStages(kAllStages)) {
+            pushConstantsBlockSizes[stage] = 0;
+            pushConstantsBlockBindings[stage] = 0;
+        }
 
-            for (uint32_t binding = 0; binding < kMaxBindingsPerGroup; ++binding) {
-                if (!groupInfo.mask[binding]) {
-                    continue;
-                }
+        for (auto stage : IterateStages(GetStageMask())) {
+            const ShaderModule* module = modules[stage];
+            FillPushConstants(module, &glPushConstants[stage], program);
 
-                std::string name = GetBindingName(group, binding);
-                switch (groupInfo.types[binding]) {
-                    case nxt::BindingType::UniformBuffer:
-                        {
-                            GLint location = glGetUniformBlockIndex(program, name.c_str());
-                            glUniformBlockBinding(program, location, indices[group][binding]);
-                        }
-                        break;
-
-                    case nxt::BindingType::StorageBuffer:
-                        {
-                            GLuint location = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, name.c_str());
-                            glShaderStorageBlockBinding(program, location, indices[group][binding]);
-                        }
-                        break;
-
-                    case nxt::BindingType::Sampler:
-                    case nxt::BindingType::SampledTexture:
-                        // These binding types are handled in the separate sampler and texture emulation
-                        break;
+            // Streamed push constant blocks use the uniform buffer bindings after the ones of
+            // the layout, one per stage.
+            if (module->GetPushConstantsBlockSize() != 0) {
+                GLuint binding = static_cast<GLuint>(layout->GetNumUniformBuffers()) + static_cast<GLuint>(stage);
+                GLuint blockIndex = glGetUniformBlockIndex(program, GetPushConstantsBlockName(stage).c_str());
+                glUniformBlockBinding(program, blockIndex, binding);
 
-                }
+                pushConstantsBlockSizes[stage] = module->GetPushConstantsBlockSize();
+                pushConstantsBlockBindings[stage] = binding;
             }
         }
 
-        // Compute links between stages for combined samplers, then bind them to texture units
+        // Compute links between stages for combined samplers, then assign them texture units
+        std::vector<std::pair<std::string, GLuint>> combinedSamplerUnits;
         {
             std::set<CombinedSampler> combinedSamplersSet;
             for (auto stage : IterateStages(GetStageMask())) {
-                const auto& module = ToBackend(builder->GetStageInfo(stage).module);
+                const ShaderModule* module = modules[stage];
 
                 for (const auto& combined : module->GetCombinedSamplerInfo()) {
                     combinedSamplersSet.insert(combined);
                 }
             }
 
-            unitsForSamplers.resize(layout->GetNumSamplers());
-            unitsForTextures.resize(layout->GetNumSampledTextures());
-
+            // Units are given in increasing order so the units of each group are sorted.
             GLuint textureUnit = layout->GetTextureUnitsUsed();
             for (const auto& combined : combinedSamplersSet) {
-                std::string name = combined.GetName();
-                GLint location = glGetUniformLocation(program, name.c_str());
-                glUniform1i(location, textureUnit);
+                combinedSamplerUnits.emplace_back(combined.GetName(), textureUnit);
 
-                GLuint samplerIndex = indices[combined.samplerLocation.group][combined.samplerLocation.binding];
-                unitsForSamplers[samplerIndex].push_back(textureUnit);
+                const auto& sampler = combined.samplerLocation;
+                samplerUnits[sampler.group].push_back({textureUnit, sampler.binding});
 
-                GLuint textureIndex = indices[combined.textureLocation.group][combined.textureLocation.binding];
-                unitsForTextures[textureIndex].push_back(textureUnit);
+                const auto& texture = combined.textureLocation;
+                textureUnits[texture.group].push_back({textureUnit, texture.binding});
 
                 textureUnit ++;
             }
         }
+
+        // The uniforms are part of the program state so we can pre-bind buffer units, texture units etc.
+        auto InitializeBindings = [&](GLuint program) {
+            device->GetStateCache()->UseProgram(program);
+
+            for (uint32_t group = 0; group < kMaxBindGroups; ++group) {
+                const auto& groupInfo = layout->GetBindGroupLayout(group)->GetBindingInfo();
+
+                for (uint32_t binding = 0; binding < kMaxBindingsPerGroup; ++binding) {
+                    if (!groupInfo.mask[binding]) {
+                        continue;
+                    }
+
+                    std::string name = GetBindingName(group, binding);
+                    switch (groupInfo.types[binding]) {
+                        case nxt::BindingType::UniformBuffer:
+                            {
+                                GLint location = glGetUniformBlockIndex(program, name.c_str());
+                                glUniformBlockBinding(program, location, indices[group][binding]);
+                            }
+                            break;
+
+                        case nxt::BindingType::StorageBuffer:
+                            {
+                                GLuint location = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, name.c_str());
+                                glShaderStorageBlockBinding(program, location, indices[group][binding]);
+                            }
+                            break;
+
+                        case nxt::BindingType::Sampler:
+                        case nxt::BindingType::SampledTexture:
+                            // These binding types are handled in the separate sampler and texture emulation
+                            break;
+
+                    }
+                }
+            }
+
+            for (const auto& combined : combinedSamplerUnits) {
+                GLint location = glGetUniformLocation(program, combined.first.c_str());
+                glUniform1i(location, combined.second);
+            }
+        };
+
+        // The instanced program can only be used when the vertex stage is the only one reading
+        // push constants, because the other stages don't know which instance they are part of.
+        if (!IsCompute()) {
+            const ShaderModule* vertexModule = modules[nxt::ShaderStage::Vertex];
+            const ShaderModule* fragmentModule = modules[nxt::ShaderStage::Fragment];
+
+            if (vertexModule->HasInstancedSource() && fragmentModule->GetPushConstants().mask.none()) {
+                instancedProgram = CreateProgram(true);
+                instancedPushConstantCount = vertexModule->GetInstancedPushConstantCount();
+
+                // Use the first storage buffer binding after the ones of the layout.
+                instancedPushConstantBinding = layout->GetNumStorageBuffers();
+                GLuint location = glGetProgramResourceIndex(instancedProgram, GL_SHADER_STORAGE_BLOCK,
+                                                            kInstancedPushConstantsBlockName);
+                glShaderStorageBlockBinding(instancedProgram, location, instancedPushConstantBinding);
+
+                InitializeBindings(instancedProgram);
+            }
+        }
+
+        InitializeBindings(program);
     }
 
     const Pipeline::GLPushConstantInfo& Pipeline::GetGLPushConstants(nxt::ShaderStage stage) const {
         return glPushConstants[stage];
     }
 
-    const std::vector<GLuint>& Pipeline::GetTextureUnitsForSampler(GLuint index) const {
-        ASSERT(index >= 0 && index < unitsForSamplers.size());
-        return unitsForSamplers[index];
+    const std::vector<Pipeline::UnitBinding>& Pipeline::GetSamplerUnits(uint32_t group) const {
+        ASSERT(group < kMaxBindGroups);
+        return samplerUnits[group];
     }
 
-    const std::vector<GLuint>& Pipeline::GetTextureUnitsForTexture(GLuint index) const {
-        ASSERT(index >= 0 && index < unitsForSamplers.size());
-        return unitsForTextures[index];
+    const std::vector<Pipeline::UnitBinding>& Pipeline::GetTextureUnits(uint32_t group) const {
+        ASSERT(group < kMaxBindGroups);
+        return textureUnits[group];
     }
 
     GLuint Pipeline::GetProgramHandle() const {
         return program;
     }
 
+    bool Pipeline::HasInstancedProgram() const {
+        return instancedProgram != 0;
+    }
+
+    uint32_t Pipeline::GetInstancedPushConstantCount() const {
+        return instancedPushConstantCount;
+    }
+
+    void Pipeline::ApplyInstancedNow(GLuint buffer, GLintptr offset, GLsizeiptr size) {
+        ASSERT(HasInstancedProgram());
+        StateCache* stateCache = device->GetStateCache();
+        stateCache->UseProgram(instancedProgram);
+        stateCache->BindBufferRange(GL_SHADER_STORAGE_BUFFER, instancedPushConstantBinding, buffer, offset, size);
+    }
+
+    uint32_t Pipeline::GetPushConstantsBlockSize(nxt::ShaderStage stage) const {
+        return pushConstantsBlockSizes[stage];
+    }
+
+    GLuint Pipeline::GetPushConstantsBlockBinding(nxt::ShaderStage stage) const {
+        return pushConstantsBlockBindings[stage];
+    }
+
+    bool Pipeline::HasSameBindGroupBindings(Pipeline* other, uint32_t group) {
+        if (other == this) {
+            return true;
+        }
+
+        PipelineLayout* layout = ToBackend(GetLayout());
+        PipelineLayout* otherLayout = ToBackend(other->GetLayout());
+        if (layout->GetBindGroupLayout(group) != otherLayout->GetBindGroupLayout(group) ||
+            layout->GetBindingIndexInfo()[group] != otherLayout->GetBindingIndexInfo()[group]) {
+            return false;
+        }
+
+        auto SameUnits = [](const std::vector<UnitBinding>& a, const std::vector<UnitBinding>& b) {
+            return a.size() == b.size() && std::equal(a.begin(), a.end(), b.begin(),
+                [](const UnitBinding& x, const UnitBinding& y) {
+                    return x.unit == y.unit && x.binding == y.binding;
+                });
+        };
+        return SameUnits(samplerUnits[group], other->samplerUnits[group]) &&
+               SameUnits(textureUnits[group], other->textureUnits[group]);
+    }
+
     void Pipeline::ApplyNow() {
-        glUseProgram(program);
+        StateCache* stateCache = device->GetStateCache();
+        stateCache->UseProgram(program);
 
         auto inputState = ToBackend(GetInputState());
-        glBindVertexArray(inputState->GetVAO());
+        stateCache->BindVertexArray(inputState->GetVAO());
     }
 
 }
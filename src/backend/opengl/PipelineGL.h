@@ -25,17 +25,48 @@ namespace opengl {
             using BindingLocations = std::array<std::array<GLint, kMaxBindingsPerGroup>, kMaxBindGroups>;
 
             const GLPushConstantInfo& GetGLPushConstants(nxt::ShaderStage stage) const;
-            const std::vector<GLuint>& GetTextureUnitsForSampler(GLuint index) const;
-            const std::vector<GLuint>& GetTextureUnitsForTexture(GLuint index) const;
+
+            // The texture units used by the samplers and textures of a bind group, sorted by
+            // unit. Samplers and textures are combined so a binding can use several units.
+            struct UnitBinding {
+                GLuint unit;
+                uint32_t binding;
+            };
+            const std::vector<UnitBinding>& GetSamplerUnits(uint32_t group) const;
+            const std::vector<UnitBinding>& GetTextureUnits(uint32_t group) const;
             GLuint GetProgramHandle() const;
 
+            // Whether a bind group applied with the other pipeline is bound where this pipeline
+            // reads it: same layout for the group, same binding indices and same texture units.
+            bool HasSameBindGroupBindings(Pipeline* other, uint32_t group);
+
             void ApplyNow();
 
+            // Auto-instancing: the instanced program reads the push constants of each instance
+            // from a storage buffer. ApplyInstancedNow makes it current and binds that buffer,
+            // ApplyNow goes back to the regular program.
+            bool HasInstancedProgram() const;
+            uint32_t GetInstancedPushConstantCount() const;
+            void ApplyInstancedNow(GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+            // Streamed push constants: the stages whose push constants are in a uniform block
+            // get them from a range of the device's ring buffer bound at this binding. The size
+            // is 0 for the stages that use uniforms.
+            uint32_t GetPushConstantsBlockSize(nxt::ShaderStage stage) const;
+            GLuint GetPushConstantsBlockBinding(nxt::ShaderStage stage) const;
+
         private:
+            void CreatePrograms(const PerStage<const ShaderModule*>& modules);
+
             GLuint program;
+            GLuint instancedProgram = 0;
+            GLuint instancedPushConstantBinding = 0;
+            uint32_t instancedPushConstantCount = 0;
             PerStage<GLPushConstantInfo> glPushConstants;
-            std::vector<std::vector<GLuint>> unitsForSamplers;
-            std::vector<std::vector<GLuint>> unitsForTextures;
+            PerStage<uint32_t> pushConstantsBlockSizes;
+            PerStage<GLuint> pushConstantsBlockBindings;
+            std::array<std::vector<UnitBinding>, kMaxBindGroups> samplerUnits;
+            std::array<std::vector<UnitBinding>, kMaxBindGroups> textureUnits;
             Device* device;
     };
 
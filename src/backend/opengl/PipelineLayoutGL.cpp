@@ -46,8 +46,10 @@ namespace opengl {
             }
         }
 
+        numUniformBuffers = uboIndex;
         numSamplers = samplerIndex;
         numSampledTextures = sampledTextureIndex;
+        numStorageBuffers = ssboIndex;
     }
 
     const PipelineLayout::BindingIndexInfo& PipelineLayout::GetBindingIndexInfo() const {
@@ -58,6 +60,10 @@ namespace opengl {
         return 0;
     }
 
+    size_t PipelineLayout::GetNumUniformBuffers() const {
+        return numUniformBuffers;
+    }
+
     size_t PipelineLayout::GetNumSamplers() const {
         return numSamplers;
     }
@@ -66,5 +72,9 @@ namespace opengl {
         return numSampledTextures;
     }
 
+    size_t PipelineLayout::GetNumStorageBuffers() const {
+        return numStorageBuffers;
+    }
+
 }
 }
@@ -22,14 +22,18 @@ namespace opengl {
             const BindingIndexInfo& GetBindingIndexInfo() const;
 
             GLuint GetTextureUnitsUsed() const;
+            size_t GetNumUniformBuffers() const;
             size_t GetNumSamplers() const;
             size_t GetNumSampledTextures() const;
+            size_t GetNumStorageBuffers() const;
 
         private:
             Device* device;
             BindingIndexInfo indexInfo;
+            size_t numUniformBuffers;
             size_t numSamplers;
             size_t numSampledTextures;
+            size_t numStorageBuffers;
     };
 
 }
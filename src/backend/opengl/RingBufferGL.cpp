@@ -0,0 +1,79 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "RingBufferGL.h"
+
+#include <cassert>
+#include <cstring>
+
+#define ASSERT assert
+
+namespace backend {
+namespace opengl {
+
+    RingBuffer::RingBuffer(size_t size)
+        : size(size), regionSize(size / kNumRegions) {
+        regionFences.fill(nullptr);
+
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+        glBufferStorage(GL_COPY_WRITE_BUFFER, size, nullptr, flags);
+        mappedData = static_cast<uint8_t*>(glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, size, flags));
+        ASSERT(mappedData != nullptr);
+    }
+
+    RingBuffer::~RingBuffer() {
+        for (GLsync fence : regionFences) {
+            if (fence != nullptr) {
+                glDeleteSync(fence);
+            }
+        }
+        glDeleteBuffers(1, &buffer);
+    }
+
+    GLuint RingBuffer::GetHandle() const {
+        return buffer;
+    }
+
+    size_t RingBuffer::Write(const void* data, size_t dataSize, size_t alignment) {
+        ASSERT(dataSize > 0 && dataSize <= regionSize);
+
+        size_t offset = (nextOffset + alignment - 1) / alignment * alignment;
+        if (offset + dataSize > size) {
+            offset = 0;
+        }
+
+        // Fence the regions that are left, and wait until the GPU is done with the regions
+        // that are entered.
+        uint32_t lastRegion = static_cast<uint32_t>((offset + dataSize - 1) / regionSize);
+        while (currentRegion != lastRegion) {
+            regionFences[currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            currentRegion = (currentRegion + 1) % kNumRegions;
+            WaitForRegion(currentRegion);
+        }
+
+        memcpy(mappedData + offset, data, dataSize);
+        nextOffset = offset + dataSize;
+        return offset;
+    }
+
+    void RingBuffer::WaitForRegion(uint32_t region) {
+        GLsync fence = regionFences[region];
+        if (fence == nullptr) {
+            return;
+        }
+
+        // The first wait flushes the commands so that the fence is guaranteed to signal.
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        const GLuint64 kTimeout = 1000000000;
+        while (glClientWaitSync(fence, flags, kTimeout) == GL_TIMEOUT_EXPIRED) {
+            flags = 0;
+        }
+        glDeleteSync(fence);
+        regionFences[region] = nullptr;
+    }
+
+}
+}
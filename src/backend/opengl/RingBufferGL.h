@@ -0,0 +1,48 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_OPENGL_RINGBUFFERGL_H_
+#define BACKEND_OPENGL_RINGBUFFERGL_H_
+
+#include "glad/glad.h"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace backend {
+namespace opengl {
+
+    // A persistently mapped buffer written linearly that wraps around when it is full. It is
+    // split in regions: a fence is inserted when writes leave a region and waited on before
+    // writing to it again, so that data the GPU might still read isn't overwritten.
+    // Needs GL 4.4 for glBufferStorage.
+    class RingBuffer {
+        public:
+            RingBuffer(size_t size);
+            ~RingBuffer();
+
+            GLuint GetHandle() const;
+
+            // Copies the data at the next offset with this alignment and returns the offset.
+            size_t Write(const void* data, size_t size, size_t alignment);
+
+        private:
+            static constexpr uint32_t kNumRegions = 4;
+
+            void WaitForRegion(uint32_t region);
+
+            GLuint buffer = 0;
+            uint8_t* mappedData = nullptr;
+            size_t size;
+            size_t regionSize;
+            size_t nextOffset = 0;
+            uint32_t currentRegion = 0;
+            std::array<GLsync, kNumRegions> regionFences;
+    };
+
+}
+}
+
+#endif // BACKEND_OPENGL_RINGBUFFERGL_H_
@@ -4,6 +4,8 @@
 
 #include "SamplerGL.h"
 
+#include "OpenGLBackend.h"
+
 namespace backend {
 namespace opengl {
 
@@ -39,9 +41,14 @@ namespace opengl {
 
     Sampler::Sampler(Device* device, SamplerBuilder* builder)
         : SamplerBase(builder), device(device) {
-        glGenSamplers(1, &handle);
-        glSamplerParameteri(handle, GL_TEXTURE_MAG_FILTER, MagFilterMode(builder->GetMagFilter()));
-        glSamplerParameteri(handle, GL_TEXTURE_MIN_FILTER, MinFilterMode(builder->GetMinFilter(), builder->GetMipMapFilter()));
+        GLenum magFilter = MagFilterMode(builder->GetMagFilter());
+        GLenum minFilter = MinFilterMode(builder->GetMinFilter(), builder->GetMipMapFilter());
+
+        device->RunGL([this, magFilter, minFilter]() {
+            glGenSamplers(1, &handle);
+            glSamplerParameteri(handle, GL_TEXTURE_MAG_FILTER, magFilter);
+            glSamplerParameteri(handle, GL_TEXTURE_MIN_FILTER, minFilter);
+        }, {this});
     }
 
     GLuint Sampler::GetHandle() const {
@@ -4,6 +4,8 @@
 
 #include "ShaderModuleGL.h"
 
+#include "OpenGLBackend.h"
+
 #include <spirv-cross/spirv_glsl.hpp>
 
 #include <sstream>
@@ -17,6 +19,12 @@ namespace opengl {
         return o.str();
     }
 
+    std::string GetPushConstantsBlockName(nxt::ShaderStage stage) {
+        std::ostringstream o;
+        o << "nxt_push_constants_block_" << static_cast<uint32_t>(stage);
+        return o.str();
+    }
+
     bool operator < (const BindingLocation& a, const BindingLocation& b) {
         return std::tie(a.group, a.binding) < std::tie(b.group, b.binding);
     }
@@ -33,6 +41,53 @@ namespace opengl {
         return o.str();
     }
 
+    namespace {
+
+        // spirv-cross emits push constants as a uniform struct. These names are given to the
+        // struct and the uniform so that the instanced variant can find the declaration.
+        const char* kPushConstantsTypeName = "nxt_PushConstants";
+        const char* kPushConstantsName = "nxt_push_constants";
+
+        // Returns the number of push constants if they are all scalars packed from offset 0,
+        // which is when their std430 layout matches the layout of the push constant data.
+        uint32_t GetPackedScalarPushConstantCount(const ShaderModuleBase::PushConstantInfo& info) {
+            uint32_t count = static_cast<uint32_t>(info.mask.count());
+            for (uint32_t i = 0; i < count; ++i) {
+                if (!info.mask[i] || info.sizes[i] != 1) {
+                    return 0;
+                }
+            }
+            return count;
+        }
+
+        // Returns the size of the push constants in a std140 uniform block, or 0 if the std140
+        // offsets of the members aren't their offsets in the push constant data. Only scalars and
+        // vectors are handled because matrices and arrays have a stride of 16 bytes in std140.
+        uint32_t GetStd140PushConstantsSize(const spirv_cross::Compiler& compiler, const spirv_cross::Resource& block) {
+            const auto& blockType = compiler.get_type(block.type_id);
+
+            uint32_t end = 0;
+            for (uint32_t i = 0; i < blockType.member_types.size(); i++) {
+                const auto& memberType = compiler.get_type(blockType.member_types[i]);
+                if (memberType.columns != 1 || !memberType.array.empty()) {
+                    return 0;
+                }
+
+                // vec3 are aligned like vec4
+                uint32_t alignment = (memberType.vecsize == 3 ? 4 : memberType.vecsize) * sizeof(uint32_t);
+                uint32_t offset = compiler.get_member_decoration(blockType.self, i, spv::DecorationOffset);
+                if (offset != (end + alignment - 1) / alignment * alignment) {
+                    return 0;
+                }
+                end = offset + memberType.vecsize * sizeof(uint32_t);
+            }
+
+            // The size of a structure is rounded up to the size of a vec4.
+            return (end + 15) / 16 * 16;
+        }
+
+    }
+
     ShaderModule::ShaderModule(Device* device, ShaderModuleBuilder* builder)
         : ShaderModuleBase(builder), device(device) {
         spirv_cross::CompilerGLSL compiler(builder->AcquireSpirv());
@@ -46,6 +101,22 @@ namespace opengl {
 #endif
         compiler.set_options(options);
 
+        // Instancing reads push constants from a shader storage buffer, which needs GLSL 430.
+        bool prepareInstancing = device->IsAutoInstancingEnabled() && options.version >= 430;
+        uint32_t streamedBlockSize = 0;
+        if (prepareInstancing || device->IsStreamedPushConstantsEnabled()) {
+            const auto& resources = compiler.get_shader_resources();
+            if (resources.push_constant_buffers.size() > 0) {
+                const auto& block = resources.push_constant_buffers[0];
+                compiler.set_name(block.base_type_id, kPushConstantsTypeName);
+                compiler.set_name(block.id, kPushConstantsName);
+
+                if (device->IsStreamedPushConstantsEnabled()) {
+                    streamedBlockSize = GetStd140PushConstantsSize(compiler, block);
+                }
+            }
+        }
+
         ExtractSpirvInfo(compiler);
 
         const auto& bindingInfo = GetBindingInfo();
@@ -81,6 +152,59 @@ namespace opengl {
         }
 
         glslSource = compiler.compile();
+
+        // The instanced variant is made from the source that still declares the uniforms.
+        if (prepareInstancing && GetExecutionModel() == nxt::ShaderStage::Vertex) {
+            PrepareInstancedSource();
+        }
+        if (streamedBlockSize != 0) {
+            PrepareStreamedSource(streamedBlockSize);
+        }
+    }
+
+    void ShaderModule::PrepareInstancedSource() {
+        uint32_t count = GetPackedScalarPushConstantCount(GetPushConstants());
+        if (count == 0) {
+            return;
+        }
+
+        std::string declaration = std::string("uniform ") + kPushConstantsTypeName + " " + kPushConstantsName + ";";
+        size_t position = glslSource.find(declaration);
+        if (position == std::string::npos) {
+            return;
+        }
+
+        // Each instance reads its own copy of the push constants, every access to the uniform is
+        // redirected to the array element of the instance.
+        std::ostringstream replacement;
+        replacement << "layout(std430) readonly buffer " << kInstancedPushConstantsBlockName << " {\n";
+        replacement << "    " << kPushConstantsTypeName << " nxt_instanced_push_constants[];\n";
+        replacement << "};\n";
+        replacement << "#define " << kPushConstantsName << " nxt_instanced_push_constants[gl_InstanceID]";
+
+        instancedSource = glslSource;
+        instancedSource.replace(position, declaration.size(), replacement.str());
+        instancedPushConstantCount = count;
+    }
+
+    void ShaderModule::PrepareStreamedSource(uint32_t blockSize) {
+        std::string declaration = std::string("uniform ") + kPushConstantsTypeName + " " + kPushConstantsName + ";";
+        size_t position = glslSource.find(declaration);
+        if (position == std::string::npos) {
+            return;
+        }
+
+        // The struct is the only member of the block so it starts at offset 0, accesses to the
+        // uniform are redirected to the member. The block name depends on the stage so that
+        // the blocks of the stages of a program are bound separately.
+        std::ostringstream replacement;
+        replacement << "layout(std140) uniform " << GetPushConstantsBlockName(GetExecutionModel()) << " {\n";
+        replacement << "    " << kPushConstantsTypeName << " data;\n";
+        replacement << "} nxt_streamed_push_constants;\n";
+        replacement << "#define " << kPushConstantsName << " nxt_streamed_push_constants.data";
+
+        glslSource.replace(position, declaration.size(), replacement.str());
+        pushConstantsBlockSize = blockSize;
     }
 
     const char* ShaderModule::GetSource() const {
@@ -91,5 +215,22 @@ namespace opengl {
         return combinedInfo;
     }
 
+    bool ShaderModule::HasInstancedSource() const {
+        return instancedPushConstantCount != 0;
+    }
+
+    const char* ShaderModule::GetInstancedSource() const {
+        ASSERT(HasInstancedSource());
+        return instancedSource.c_str();
+    }
+
+    uint32_t ShaderModule::GetInstancedPushConstantCount() const {
+        return instancedPushConstantCount;
+    }
+
+    uint32_t ShaderModule::GetPushConstantsBlockSize() const {
+        return pushConstantsBlockSize;
+    }
+
 }
 }
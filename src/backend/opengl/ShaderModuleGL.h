@@ -16,6 +16,13 @@ namespace opengl {
 
     std::string GetBindingName(uint32_t group, uint32_t binding);
 
+    // Name of the shader storage block holding the per-instance push constants in instanced
+    // variants of vertex shaders.
+    constexpr const char* kInstancedPushConstantsBlockName = "nxt_instanced_push_constants_block";
+
+    // Name of the uniform block holding the push constants of a stage when they are streamed.
+    std::string GetPushConstantsBlockName(nxt::ShaderStage stage);
+
     struct BindingLocation {
         uint32_t group;
         uint32_t binding;
@@ -38,10 +45,27 @@ namespace opengl {
             const char* GetSource() const;
             const CombinedSamplerInfo& GetCombinedSamplerInfo() const;
 
+            // When auto-instancing is enabled, vertex shaders whose push constants are packed
+            // scalars get a variant that reads them from a per-instance storage buffer instead.
+            bool HasInstancedSource() const;
+            const char* GetInstancedSource() const;
+            uint32_t GetInstancedPushConstantCount() const;
+
+            // When push constants are streamed, they are moved to a std140 uniform block if its
+            // layout matches the layout of the push constant data. Returns the size of the block
+            // in bytes, or 0 if the push constants are uniforms.
+            uint32_t GetPushConstantsBlockSize() const;
+
         private:
+            void PrepareInstancedSource();
+            void PrepareStreamedSource(uint32_t blockSize);
+
             Device* device;
             CombinedSamplerInfo combinedInfo;
             std::string glslSource;
+            std::string instancedSource;
+            uint32_t instancedPushConstantCount = 0;
+            uint32_t pushConstantsBlockSize = 0;
     };
 
 }
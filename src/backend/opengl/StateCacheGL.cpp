@@ -0,0 +1,271 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "StateCacheGL.h"
+
+#include <limits>
+
+namespace backend {
+namespace opengl {
+
+    namespace {
+        // A name that GL never returns, for state that isn't known.
+        constexpr GLuint kUnknown = std::numeric_limits<GLuint>::max();
+        constexpr GLenum kUnknownTarget = 0;
+    }
+
+    StateCache::StateCache() {
+        Invalidate();
+    }
+
+    const StateCache::Counters& StateCache::GetCounters() const {
+        return counters;
+    }
+
+    StateCache::BufferTarget StateCache::GetBufferTarget(GLenum target) {
+        switch (target) {
+            case GL_ARRAY_BUFFER:
+                return BUFFER_TARGET_ARRAY;
+            case GL_ELEMENT_ARRAY_BUFFER:
+                return BUFFER_TARGET_ELEMENT_ARRAY;
+            case GL_PIXEL_UNPACK_BUFFER:
+                return BUFFER_TARGET_PIXEL_UNPACK;
+            case GL_DRAW_INDIRECT_BUFFER:
+                return BUFFER_TARGET_DRAW_INDIRECT;
+            case GL_DISPATCH_INDIRECT_BUFFER:
+                return BUFFER_TARGET_DISPATCH_INDIRECT;
+            case GL_UNIFORM_BUFFER:
+                return BUFFER_TARGET_UNIFORM;
+            case GL_SHADER_STORAGE_BUFFER:
+                return BUFFER_TARGET_SHADER_STORAGE;
+            default:
+                return BUFFER_TARGET_NONE;
+        }
+    }
+
+    std::vector<StateCache::BufferRange>* StateCache::GetBufferRanges(GLenum target) {
+        switch (target) {
+            case GL_UNIFORM_BUFFER:
+                return &uniformRanges;
+            case GL_SHADER_STORAGE_BUFFER:
+                return &storageRanges;
+            default:
+                return nullptr;
+        }
+    }
+
+    bool StateCache::Elide(bool unchanged) {
+        if (unchanged) {
+            counters.elided++;
+        } else {
+            counters.issued++;
+        }
+        return unchanged;
+    }
+
+    void StateCache::UseProgram(GLuint program) {
+        if (Elide(program == this->program)) {
+            return;
+        }
+        glUseProgram(program);
+        this->program = program;
+    }
+
+    void StateCache::BindVertexArray(GLuint vertexArray) {
+        if (Elide(vertexArray == this->vertexArray)) {
+            return;
+        }
+        glBindVertexArray(vertexArray);
+        this->vertexArray = vertexArray;
+
+        // The index buffer binding is part of the vertex array object.
+        buffers[BUFFER_TARGET_ELEMENT_ARRAY] = kUnknown;
+    }
+
+    void StateCache::BindBuffer(GLenum target, GLuint buffer) {
+        BufferTarget cachedTarget = GetBufferTarget(target);
+        if (cachedTarget == BUFFER_TARGET_NONE) {
+            counters.issued++;
+            glBindBuffer(target, buffer);
+            return;
+        }
+
+        if (Elide(buffers[cachedTarget] == buffer)) {
+            return;
+        }
+        glBindBuffer(target, buffer);
+        buffers[cachedTarget] = buffer;
+    }
+
+    void StateCache::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+        std::vector<BufferRange>* ranges = GetBufferRanges(target);
+        if (ranges == nullptr) {
+            counters.issued++;
+            glBindBufferRange(target, index, buffer, offset, size);
+            return;
+        }
+
+        if (index >= ranges->size()) {
+            ranges->resize(index + 1, {kUnknown, 0, 0});
+        }
+        BufferRange& range = (*ranges)[index];
+        if (Elide(range.buffer == buffer && range.offset == offset && range.size == size)) {
+            return;
+        }
+        glBindBufferRange(target, index, buffer, offset, size);
+        range = {buffer, offset, size};
+
+        // Indexed binds also change the generic binding point.
+        buffers[GetBufferTarget(target)] = buffer;
+    }
+
+    void StateCache::BindTexture(GLuint unit, GLenum target, GLuint texture) {
+        if (unit >= textures.size()) {
+            textures.resize(unit + 1, {kUnknownTarget, kUnknown});
+        }
+        TextureBinding& binding = textures[unit];
+        if (Elide(binding.target == target && binding.texture == texture)) {
+            return;
+        }
+
+        if (!Elide(unit == activeTextureUnit)) {
+            glActiveTexture(GL_TEXTURE0 + unit);
+            activeTextureUnit = unit;
+        }
+        glBindTexture(target, texture);
+        // Only the last target is remembered, binding another target on the unit is a miss.
+        binding = {target, texture};
+    }
+
+    void StateCache::BindSampler(GLuint unit, GLuint sampler) {
+        if (unit >= samplers.size()) {
+            samplers.resize(unit + 1, kUnknown);
+        }
+        if (Elide(samplers[unit] == sampler)) {
+            return;
+        }
+        glBindSampler(unit, sampler);
+        samplers[unit] = sampler;
+    }
+
+    void StateCache::BindBuffersRange(GLenum target, GLuint first, GLsizei count, const GLuint* buffers,
+                                      const GLintptr* offsets, const GLsizeiptr* sizes) {
+        std::vector<BufferRange>* ranges = GetBufferRanges(target);
+        if (ranges == nullptr || !GLAD_GL_VERSION_4_4) {
+            for (GLsizei i = 0; i < count; ++i) {
+                BindBufferRange(target, first + i, buffers[i], offsets[i], sizes[i]);
+            }
+            return;
+        }
+
+        if (first + count > ranges->size()) {
+            ranges->resize(first + count, {kUnknown, 0, 0});
+        }
+        bool unchanged = true;
+        for (GLsizei i = 0; i < count; ++i) {
+            const BufferRange& range = (*ranges)[first + i];
+            unchanged = unchanged && range.buffer == buffers[i] && range.offset == offsets[i] &&
+                        range.size == sizes[i];
+        }
+        if (Elide(unchanged)) {
+            return;
+        }
+
+        glBindBuffersRange(target, first, count, buffers, offsets, sizes);
+        for (GLsizei i = 0; i < count; ++i) {
+            (*ranges)[first + i] = {buffers[i], offsets[i], sizes[i]};
+        }
+    }
+
+    void StateCache::BindTextures(GLuint first, GLsizei count, const GLenum* targets, const GLuint* textures) {
+        if (!GLAD_GL_VERSION_4_4) {
+            for (GLsizei i = 0; i < count; ++i) {
+                BindTexture(first + i, targets[i], textures[i]);
+            }
+            return;
+        }
+
+        if (first + count > this->textures.size()) {
+            this->textures.resize(first + count, {kUnknownTarget, kUnknown});
+        }
+        bool unchanged = true;
+        for (GLsizei i = 0; i < count; ++i) {
+            const TextureBinding& binding = this->textures[first + i];
+            unchanged = unchanged && binding.target == targets[i] && binding.texture == textures[i];
+        }
+        if (Elide(unchanged)) {
+            return;
+        }
+
+        glBindTextures(first, count, textures);
+        for (GLsizei i = 0; i < count; ++i) {
+            this->textures[first + i] = {targets[i], textures[i]};
+        }
+    }
+
+    void StateCache::BindSamplers(GLuint first, GLsizei count, const GLuint* samplers) {
+        if (!GLAD_GL_VERSION_4_4) {
+            for (GLsizei i = 0; i < count; ++i) {
+                BindSampler(first + i, samplers[i]);
+            }
+            return;
+        }
+
+        if (first + count > this->samplers.size()) {
+            this->samplers.resize(first + count, kUnknown);
+        }
+        bool unchanged = true;
+        for (GLsizei i = 0; i < count; ++i) {
+            unchanged = unchanged && this->samplers[first + i] == samplers[i];
+        }
+        if (Elide(unchanged)) {
+            return;
+        }
+
+        glBindSamplers(first, count, samplers);
+        for (GLsizei i = 0; i < count; ++i) {
+            this->samplers[first + i] = samplers[i];
+        }
+    }
+
+    void StateCache::RestoreExternalState() {
+        for (GLuint unit = 0; unit < samplers.size(); ++unit) {
+            if (samplers[unit] != kUnknown) {
+                BindSampler(unit, 0);
+            }
+        }
+    }
+
+    void StateCache::DeleteBuffers(GLsizei count, const GLuint* buffers) {
+        glDeleteBuffers(count, buffers);
+
+        for (GLsizei i = 0; i < count; ++i) {
+            for (GLuint& binding : this->buffers) {
+                if (binding == buffers[i]) {
+                    binding = kUnknown;
+                }
+            }
+            for (auto* ranges : {&uniformRanges, &storageRanges}) {
+                for (BufferRange& range : *ranges) {
+                    if (range.buffer == buffers[i]) {
+                        range = {kUnknown, 0, 0};
+                    }
+                }
+            }
+        }
+    }
+
+    void StateCache::Invalidate() {
+        program = kUnknown;
+        vertexArray = kUnknown;
+        buffers.fill(kUnknown);
+        uniformRanges.clear();
+        storageRanges.clear();
+        activeTextureUnit = kUnknown;
+        textures.clear();
+        samplers.clear();
+    }
+
+}
+}
@@ -0,0 +1,106 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef BACKEND_OPENGL_STATECACHEGL_H_
+#define BACKEND_OPENGL_STATECACHEGL_H_
+
+#include "glad/glad.h"
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+namespace backend {
+namespace opengl {
+
+    // Shadows the GL bindings that the backend changes so that calls that wouldn't change
+    // anything are skipped. All the binding calls of the backend must go through the cache of
+    // the device, otherwise it has to be invalidated.
+    class StateCache {
+        public:
+            StateCache();
+
+            // Number of binding calls given to GL and of calls that were skipped.
+            struct Counters {
+                uint64_t issued = 0;
+                uint64_t elided = 0;
+            };
+            const Counters& GetCounters() const;
+
+            void UseProgram(GLuint program);
+            void BindVertexArray(GLuint vertexArray);
+            void BindBuffer(GLenum target, GLuint buffer);
+            void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+            // Also changes the active texture unit if needed.
+            void BindTexture(GLuint unit, GLenum target, GLuint texture);
+            void BindSampler(GLuint unit, GLuint sampler);
+
+            // Bind consecutive indices or units with the GL 4.4 multi-bind entry points when they
+            // are available, and skip the call if none of the bindings change. Unlike the calls
+            // above they don't change the generic buffer binding nor the active texture unit.
+            void BindBuffersRange(GLenum target, GLuint first, GLsizei count, const GLuint* buffers,
+                                  const GLintptr* offsets, const GLsizeiptr* sizes);
+            // GL takes the target from the textures, the targets are only used for the cache.
+            void BindTextures(GLuint first, GLsizei count, const GLenum* targets, const GLuint* textures);
+            void BindSamplers(GLuint first, GLsizei count, const GLuint* samplers);
+
+            // GL unbinds deleted buffers, this forgets the bindings to them so that a new buffer
+            // reusing the name isn't considered bound.
+            void DeleteBuffers(GLsizei count, const GLuint* buffers);
+
+            // Unbinds the samplers: code sharing the context doesn't expect them to be set, for
+            // example in Chromium with virtualized contexts.
+            void RestoreExternalState();
+            // Forgets everything, for when GL state was changed outside of the cache.
+            void Invalidate();
+
+        private:
+            // Generic binding points that are shadowed, the other targets aren't cached.
+            enum BufferTarget {
+                BUFFER_TARGET_ARRAY,
+                BUFFER_TARGET_ELEMENT_ARRAY,
+                BUFFER_TARGET_PIXEL_UNPACK,
+                BUFFER_TARGET_DRAW_INDIRECT,
+                BUFFER_TARGET_DISPATCH_INDIRECT,
+                BUFFER_TARGET_UNIFORM,
+                BUFFER_TARGET_SHADER_STORAGE,
+
+                BUFFER_TARGET_COUNT,
+                BUFFER_TARGET_NONE = BUFFER_TARGET_COUNT,
+            };
+            static BufferTarget GetBufferTarget(GLenum target);
+
+            struct BufferRange {
+                GLuint buffer;
+                GLintptr offset;
+                GLsizeiptr size;
+            };
+
+            struct TextureBinding {
+                GLenum target;
+                GLuint texture;
+            };
+
+            // The indexed bindings of the target, or nullptr if they aren't cached.
+            std::vector<BufferRange>* GetBufferRanges(GLenum target);
+
+            // Returns true if the call can be skipped, and counts it.
+            bool Elide(bool unchanged);
+
+            Counters counters;
+
+            GLuint program;
+            GLuint vertexArray;
+            std::array<GLuint, BUFFER_TARGET_COUNT> buffers;
+            std::vector<BufferRange> uniformRanges;
+            std::vector<BufferRange> storageRanges;
+            GLuint activeTextureUnit;
+            std::vector<TextureBinding> textures;
+            std::vector<GLuint> samplers;
+    };
+
+}
+}
+
+#endif // BACKEND_OPENGL_STATECACHEGL_H_
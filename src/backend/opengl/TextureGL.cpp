@@ -4,6 +4,8 @@
 
 #include "TextureGL.h"
 
+#include "OpenGLBackend.h"
+
 #include <algorithm>
 #include <vector>
 
@@ -40,18 +42,20 @@ namespace opengl {
 
         auto formatInfo = GetGLFormatInfo(GetFormat());
 
-        glGenTextures(1, &handle);
-        glBindTexture(target, handle);
+        device->RunGL([this, device, width, height, levels, formatInfo]() mutable {
+            glGenTextures(1, &handle);
+            device->GetStateCache()->BindTexture(0, target, handle);
 
-        for (uint32_t i = 0; i < levels; ++i) {
-            glTexImage2D(target, i, formatInfo.internalFormat, width, height, 0, formatInfo.format, formatInfo.type, nullptr);
-            width = std::max(uint32_t(1), width / 2);
-            height = std::max(uint32_t(1), height / 2);
-        }
+            for (uint32_t i = 0; i < levels; ++i) {
+                glTexImage2D(target, i, formatInfo.internalFormat, width, height, 0, formatInfo.format, formatInfo.type, nullptr);
+                width = std::max(uint32_t(1), width / 2);
+                height = std::max(uint32_t(1), height / 2);
+            }
 
-        // The texture is not complete if it uses mipmapping and not all levels up to
-        // MAX_LEVEL have been defined.
-        glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+            // The texture is not complete if it uses mipmapping and not all levels up to
+            // MAX_LEVEL have been defined.
+            glTexParameteri(target, GL_TEXTURE_MAX_LEVEL, levels - 1);
+        }, {this});
     }
 
     GLuint Texture::GetHandle() const {
@@ -0,0 +1,147 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "common/BarrierTracker.h"
+
+#include <vector>
+
+using namespace backend;
+
+namespace {
+
+    // The tracker only uses the buffers as keys
+    BufferBase* FakeBuffer(uintptr_t id) {
+        return reinterpret_cast<BufferBase*>(id * 16);
+    }
+
+    constexpr nxt::BufferUsageBit kNone = static_cast<nxt::BufferUsageBit>(0);
+
+    // A buffer with its usage bits
+    struct Buffer {
+        BufferBase* buffer;
+        nxt::BufferUsageBit usages;
+    };
+
+    // Records the barriers needed by a sequence of commands, the way a backend does.
+    class CommandSequence {
+        public:
+            void Dispatch(std::vector<Buffer> storageBuffers) {
+                for (const auto& storage : storageBuffers) {
+                    tracker.Read(storage.buffer, nxt::BufferUsageBit::Storage);
+                }
+                barriers.push_back(tracker.AcquireBarrier());
+                for (const auto& storage : storageBuffers) {
+                    tracker.WriteStorage(storage.buffer, storage.usages);
+                }
+            }
+
+            void Draw(std::vector<BufferBase*> vertexBuffers, BufferBase* indirectBuffer = nullptr) {
+                for (auto buffer : vertexBuffers) {
+                    tracker.Read(buffer, nxt::BufferUsageBit::Vertex);
+                }
+                if (indirectBuffer != nullptr) {
+                    tracker.Read(indirectBuffer, nxt::BufferUsageBit::Indirect);
+                }
+                barriers.push_back(tracker.AcquireBarrier());
+            }
+
+            BarrierTracker tracker;
+            std::vector<nxt::BufferUsageBit> barriers;
+    };
+
+}
+
+// Test that commands that don't read buffers written as storage don't need barriers
+TEST(BarrierTracker, NoBarrierWithoutHazard) {
+    CommandSequence commands;
+    nxt::BufferUsageBit usages = nxt::BufferUsageBit::Storage | nxt::BufferUsageBit::Vertex;
+    Buffer a = {FakeBuffer(1), usages};
+    Buffer b = {FakeBuffer(2), usages};
+    Buffer c = {FakeBuffer(3), usages};
+
+    commands.Draw({a.buffer});
+    commands.Dispatch({a});
+    // Independent dispatches and draws don't wait for the first dispatch
+    commands.Dispatch({b});
+    commands.Draw({c.buffer});
+
+    std::vector<nxt::BufferUsageBit> expected = {kNone, kNone, kNone, kNone};
+    ASSERT_EQ(commands.barriers, expected);
+}
+
+// Test the barriers of ComputeBoids: each frame a dispatch reads the particles of the last frame
+// and writes the new ones, which are then drawn as vertex buffers.
+TEST(BarrierTracker, ComputeBoidsPingPong) {
+    CommandSequence commands;
+    nxt::BufferUsageBit usages = nxt::BufferUsageBit::Storage | nxt::BufferUsageBit::Vertex;
+    Buffer particles[2] = {{FakeBuffer(1), usages}, {FakeBuffer(2), usages}};
+
+    for (int frame = 0; frame < 3; ++frame) {
+        commands.Dispatch({particles[frame % 2], particles[(frame + 1) % 2]});
+        commands.Draw({particles[(frame + 1) % 2].buffer});
+    }
+
+    // The first dispatch doesn't wait on anything, then each dispatch waits for the storage
+    // writes of the last one and each draw only waits for vertex reads.
+    std::vector<nxt::BufferUsageBit> expected = {
+        kNone, nxt::BufferUsageBit::Vertex,
+        nxt::BufferUsageBit::Storage, nxt::BufferUsageBit::Vertex,
+        nxt::BufferUsageBit::Storage, nxt::BufferUsageBit::Vertex,
+    };
+    ASSERT_EQ(commands.barriers, expected);
+}
+
+// Test the barriers of ComputeIndirect: a dispatch resets the arguments of an indirect draw,
+// another one culls particles and counts them in the arguments, then the visible particles
+// are drawn indirectly.
+TEST(BarrierTracker, ComputeIndirect) {
+    CommandSequence commands;
+    Buffer particles = {FakeBuffer(1), nxt::BufferUsageBit::Storage};
+    Buffer visible = {FakeBuffer(2), nxt::BufferUsageBit::Storage | nxt::BufferUsageBit::Vertex};
+    Buffer args = {FakeBuffer(3), nxt::BufferUsageBit::Storage | nxt::BufferUsageBit::Indirect};
+
+    // Both dispatches use the same bind group
+    commands.Dispatch({particles, visible, args});
+    commands.Dispatch({particles, visible, args});
+    commands.Draw({visible.buffer}, args.buffer);
+
+    std::vector<nxt::BufferUsageBit> expected = {
+        kNone,
+        nxt::BufferUsageBit::Storage,
+        nxt::BufferUsageBit::Vertex | nxt::BufferUsageBit::Indirect,
+    };
+    ASSERT_EQ(commands.barriers, expected);
+
+    // The dispatches of the next frame still have to wait for the storage writes
+    ASSERT_TRUE(commands.tracker.HasPendingWrites(nxt::BufferUsageBit::Storage));
+    ASSERT_FALSE(commands.tracker.HasPendingWrites(nxt::BufferUsageBit::Vertex));
+}
+
+// Test that a barrier only synchronizes the usages it was needed for
+TEST(BarrierTracker, BarrierPerUsage) {
+    BarrierTracker tracker;
+    BufferBase* buffer = FakeBuffer(1);
+    tracker.WriteStorage(buffer, nxt::BufferUsageBit::Storage | nxt::BufferUsageBit::Uniform |
+                                 nxt::BufferUsageBit::Vertex);
+
+    tracker.Read(buffer, nxt::BufferUsageBit::Uniform);
+    ASSERT_EQ(tracker.AcquireBarrier(), nxt::BufferUsageBit::Uniform);
+
+    tracker.Read(buffer, nxt::BufferUsageBit::Uniform);
+    ASSERT_EQ(tracker.AcquireBarrier(), kNone);
+
+    tracker.Read(buffer, nxt::BufferUsageBit::Vertex);
+    ASSERT_EQ(tracker.AcquireBarrier(), nxt::BufferUsageBit::Vertex);
+
+    // Usages that aren't in the usage bits of the buffer never need a barrier
+    ASSERT_FALSE(tracker.HasPendingWrites(nxt::BufferUsageBit::Index));
+    ASSERT_TRUE(tracker.HasPendingWrites(nxt::BufferUsageBit::Storage));
+
+    // Forgotten buffers don't need barriers either
+    tracker.Forget(buffer);
+    tracker.Read(buffer, nxt::BufferUsageBit::Storage);
+    ASSERT_EQ(tracker.AcquireBarrier(), kNone);
+}
@@ -349,3 +349,251 @@ TEST(CommandAllocator, EmptyIterator) {
         iterator2.DataWasDestroyed();
     }
 }
+
+// Records commandCount small commands in an allocator using the pool and frees them.
+static void RecordAndFreeWithPool(CommandBlockPool* pool, int commandCount) {
+    CommandAllocator allocator(pool);
+    for (int i = 0; i < commandCount; i++) {
+        CommandSmall* small = allocator.Allocate<CommandSmall>(CommandType::Small);
+        small->data = static_cast<uint16_t>(i);
+    }
+
+    CommandIterator iterator(std::move(allocator));
+    iterator.DataWasDestroyed();
+}
+
+// Test that blocks are recycled by the pool after the first recording
+TEST(CommandBlockPool, SteadyStateRecycling) {
+    CommandBlockPool pool;
+
+    RecordAndFreeWithPool(&pool, 10000);
+    uint64_t misses = pool.GetMisses();
+    ASSERT_GT(misses, 0u);
+    ASSERT_EQ(pool.GetHits(), 0u);
+    ASSERT_GT(pool.GetBytesRetained(), 0u);
+
+    for (int i = 0; i < 10; i++) {
+        RecordAndFreeWithPool(&pool, 10000);
+    }
+    ASSERT_EQ(pool.GetMisses(), misses);
+    ASSERT_EQ(pool.GetHits(), 10 * misses);
+}
+
+// Test that the pool doesn't retain more than its high-water mark
+TEST(CommandBlockPool, HighWaterMark) {
+    CommandBlockPool pool(0);
+
+    RecordAndFreeWithPool(&pool, 10000);
+    ASSERT_EQ(pool.GetBytesRetained(), 0u);
+
+    RecordAndFreeWithPool(&pool, 10000);
+    ASSERT_EQ(pool.GetHits(), 0u);
+}
+
+// Test trimming the pool and lowering its high-water mark
+TEST(CommandBlockPool, Trim) {
+    CommandBlockPool pool;
+
+    RecordAndFreeWithPool(&pool, 10000);
+    size_t retained = pool.GetBytesRetained();
+    ASSERT_GT(retained, 0u);
+
+    pool.Trim(retained);
+    ASSERT_EQ(pool.GetBytesRetained(), retained);
+
+    pool.SetHighWaterMark(retained / 2);
+    ASSERT_LE(pool.GetBytesRetained(), retained / 2);
+
+    pool.Trim(0);
+    ASSERT_EQ(pool.GetBytesRetained(), 0u);
+}
+
+// Test that large commands that don't fit in any bucket still work with a pool
+TEST(CommandBlockPool, LargeCommands) {
+    CommandBlockPool pool;
+
+    for (int i = 0; i < 2; i++) {
+        CommandAllocator allocator(&pool);
+        CommandBig* big = allocator.Allocate<CommandBig>(CommandType::Big);
+        big->buffer[kBigBufferSize - 1] = 42;
+
+        CommandIterator iterator(std::move(allocator));
+        CommandType type;
+        ASSERT_TRUE(iterator.NextCommandId(&type));
+        ASSERT_EQ(iterator.NextCommand<CommandBig>()->buffer[kBigBufferSize - 1], 42u);
+        ASSERT_FALSE(iterator.NextCommandId(&type));
+        iterator.DataWasDestroyed();
+    }
+}
+
+static void RecordSmallCommands(CommandAllocator* allocator, int commandCount) {
+    for (int i = 0; i < commandCount; i++) {
+        CommandSmall* small = allocator->Allocate<CommandSmall>(CommandType::Small);
+        small->data = static_cast<uint16_t>(i);
+    }
+}
+
+// Test that re-recording after a Reset uses a single block that is recycled by the pool
+TEST(CommandAllocator, ResetReusesMemory) {
+    CommandBlockPool pool;
+    CommandAllocator allocator(&pool);
+
+    // The first recording grows block by block, the second uses a block sized after the first.
+    for (int i = 0; i < 2; i++) {
+        RecordSmallCommands(&allocator, 10000);
+        {
+            CommandIterator iterator(std::move(allocator));
+            iterator.DataWasDestroyed();
+        }
+        allocator.Reset();
+    }
+
+    uint64_t misses = pool.GetMisses();
+    uint64_t hits = pool.GetHits();
+    for (int i = 0; i < 10; i++) {
+        RecordSmallCommands(&allocator, 10000);
+
+        CommandIterator iterator(std::move(allocator));
+        CommandType type;
+        for (int j = 0; j < 10000; j++) {
+            ASSERT_TRUE(iterator.NextCommandId(&type));
+            ASSERT_EQ(iterator.NextCommand<CommandSmall>()->data, static_cast<uint16_t>(j));
+        }
+        ASSERT_FALSE(iterator.NextCommandId(&type));
+        iterator.DataWasDestroyed();
+
+        allocator.Reset();
+    }
+    ASSERT_EQ(pool.GetMisses(), misses);
+    ASSERT_EQ(pool.GetHits(), hits + 10);
+}
+
+// Test resetting an allocator that still owns its blocks
+TEST(CommandAllocator, ResetWithoutAcquiringBlocks) {
+    CommandBlockPool pool;
+    CommandAllocator allocator(&pool);
+
+    RecordSmallCommands(&allocator, 10000);
+    size_t usedSize = allocator.GetUsedSize();
+    ASSERT_GE(usedSize, 10000 * sizeof(CommandSmall));
+
+    allocator.Reset();
+    ASSERT_EQ(allocator.GetUsedSize(), 0u);
+    ASSERT_GT(pool.GetBytesRetained(), 0u);
+
+    RecordSmallCommands(&allocator, 10);
+    CommandIterator iterator(std::move(allocator));
+    CommandType type;
+    for (int i = 0; i < 10; i++) {
+        ASSERT_TRUE(iterator.NextCommandId(&type));
+        ASSERT_EQ(iterator.NextCommand<CommandSmall>()->data, static_cast<uint16_t>(i));
+    }
+    ASSERT_FALSE(iterator.NextCommandId(&type));
+    iterator.DataWasDestroyed();
+}
+
+// Test that compacting commands spanning many blocks keeps them and their data intact
+TEST(CommandAllocator, Compact) {
+    CommandAllocator allocator;
+
+    const int kCommandCount = 5000;
+    for (int i = 0; i < kCommandCount; i++) {
+        CommandPipeline* pipeline = allocator.Allocate<CommandPipeline>(CommandType::Pipeline);
+        pipeline->pipeline = 0xDEADBEEF00000000 + i;
+        pipeline->attachmentPoint = i;
+
+        CommandPushConstants* pushConstants = allocator.Allocate<CommandPushConstants>(CommandType::PushConstants);
+        pushConstants->size = i % 7;
+        pushConstants->offset = 0;
+        uint8_t* data = allocator.AllocateData<uint8_t>(pushConstants->size);
+        for (int j = 0; j < pushConstants->size; j++) {
+            data[j] = static_cast<uint8_t>(i + j);
+        }
+    }
+    size_t usedSize = allocator.GetUsedSize();
+    allocator.Compact();
+    ASSERT_GE(allocator.GetUsedSize(), usedSize);
+
+    // Commands can still be allocated after the compaction
+    CommandDraw* draw = allocator.Allocate<CommandDraw>(CommandType::Draw);
+    draw->first = 42;
+    draw->count = 16;
+
+    CommandIterator iterator(std::move(allocator));
+    CommandType type;
+    for (int i = 0; i < kCommandCount; i++) {
+        ASSERT_TRUE(iterator.NextCommandId(&type));
+        ASSERT_EQ(type, CommandType::Pipeline);
+        CommandPipeline* pipeline = iterator.NextCommand<CommandPipeline>();
+        ASSERT_EQ(pipeline->pipeline, 0xDEADBEEF00000000 + i);
+        ASSERT_EQ(pipeline->attachmentPoint, static_cast<uint32_t>(i));
+
+        ASSERT_TRUE(iterator.NextCommandId(&type));
+        ASSERT_EQ(type, CommandType::PushConstants);
+        CommandPushConstants* pushConstants = iterator.NextCommand<CommandPushConstants>();
+        ASSERT_EQ(pushConstants->size, i % 7);
+        uint8_t* data = iterator.NextData<uint8_t>(pushConstants->size);
+        for (int j = 0; j < pushConstants->size; j++) {
+            ASSERT_EQ(data[j], static_cast<uint8_t>(i + j));
+        }
+    }
+
+    ASSERT_TRUE(iterator.NextCommandId(&type));
+    ASSERT_EQ(type, CommandType::Draw);
+    draw = iterator.NextCommand<CommandDraw>();
+    ASSERT_EQ(draw->first, 42u);
+    ASSERT_EQ(draw->count, 16u);
+    ASSERT_FALSE(iterator.NextCommandId(&type));
+
+    iterator.DataWasDestroyed();
+}
+
+// Test that compacting gives all the blocks back to the pool and uses only one
+TEST(CommandAllocator, CompactWithPool) {
+    CommandBlockPool pool;
+    CommandAllocator allocator(&pool);
+
+    RecordSmallCommands(&allocator, 10000);
+    uint64_t blockCount = pool.GetMisses();
+    ASSERT_GT(blockCount, 1u);
+
+    allocator.Compact();
+    ASSERT_EQ(pool.GetMisses() + pool.GetHits(), blockCount + 1);
+    ASSERT_GT(pool.GetBytesRetained(), 0u);
+
+    CommandIterator iterator(std::move(allocator));
+    CommandType type;
+    for (int i = 0; i < 10000; i++) {
+        ASSERT_TRUE(iterator.NextCommandId(&type));
+        ASSERT_EQ(iterator.NextCommand<CommandSmall>()->data, static_cast<uint16_t>(i));
+    }
+    ASSERT_FALSE(iterator.NextCommandId(&type));
+    iterator.DataWasDestroyed();
+}
+
+// Test that a size hint makes the recording use a single block
+TEST(CommandAllocator, SizeHint) {
+    CommandBlockPool pool;
+    CommandAllocator allocator(&pool);
+
+    // Each small command is an id and the command, aligned to the id.
+    allocator.SetSizeHint(10000 * 2 * sizeof(uint32_t));
+    RecordSmallCommands(&allocator, 10000);
+    ASSERT_EQ(pool.GetMisses(), 1u);
+
+    CommandIterator iterator(std::move(allocator));
+    iterator.DataWasDestroyed();
+}
+
+// Test that blocks grow past the old 16k limit when nothing is known about the recording
+TEST(CommandAllocator, AdaptiveGrowth) {
+    CommandBlockPool pool;
+    CommandAllocator allocator(&pool);
+
+    // 1MB of commands would have needed more than 64 blocks of 16k.
+    RecordSmallCommands(&allocator, 128 * 1024);
+    ASSERT_LE(pool.GetMisses(), 10u);
+
+    CommandIterator iterator(std::move(allocator));
+    iterator.DataWasDestroyed();
+}
@@ -0,0 +1,68 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "common/CommandReferences.h"
+#include "common/RefCounted.h"
+
+using namespace backend;
+
+struct RCObject : public RefCounted {
+};
+
+// Test that a single internal reference is taken per unique object
+TEST(CommandReferences, OneReferencePerObject) {
+    RCObject* a = new RCObject;
+    RCObject* b = new RCObject;
+
+    CommandReferences references;
+    references.Add(a);
+    references.Add(a);
+    references.Add(b);
+    references.Add(a);
+
+    ASSERT_EQ(a->GetInternalRefs(), 2u);
+    ASSERT_EQ(b->GetInternalRefs(), 2u);
+
+    references.ReleaseAll();
+    ASSERT_EQ(a->GetInternalRefs(), 1u);
+    ASSERT_EQ(b->GetInternalRefs(), 1u);
+
+    a->Release();
+    b->Release();
+}
+
+// Test that the references keep the objects alive until they are released
+TEST(CommandReferences, KeepsObjectsAlive) {
+    RCObject* object = new RCObject;
+
+    CommandReferences references;
+    references.Add(object);
+    object->Release();
+    ASSERT_EQ(object->GetExternalRefs(), 0u);
+    ASSERT_EQ(object->GetInternalRefs(), 1u);
+
+    references.ReleaseAll();
+}
+
+// Test that moving the references transfers them without touching the refcounts
+TEST(CommandReferences, Move) {
+    RCObject* object = new RCObject;
+
+    CommandReferences references;
+    references.Add(object);
+
+    CommandReferences moved(std::move(references));
+    ASSERT_EQ(object->GetInternalRefs(), 2u);
+
+    // The moved-from references are empty and can be used again
+    references.Add(object);
+    ASSERT_EQ(object->GetInternalRefs(), 3u);
+    references.ReleaseAll();
+
+    moved.ReleaseAll();
+    ASSERT_EQ(object->GetInternalRefs(), 1u);
+    object->Release();
+}
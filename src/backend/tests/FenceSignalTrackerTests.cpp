@@ -0,0 +1,63 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "common/Fence.h"
+#include "common/FenceSignalTracker.h"
+
+using namespace backend;
+
+// Test that signals complete the fence values in the order of their serials
+TEST(FenceSignalTracker, CompletesInSerialOrder) {
+    FenceBuilder builder(nullptr);
+    builder.SetInitialValue(1);
+    FenceBase* fence = new FenceBase(&builder);
+    FenceSignalTracker tracker;
+
+    fence->SetSignaledValue(2);
+    tracker.AddSignal(fence, 2, 1);
+    fence->SetSignaledValue(5);
+    tracker.AddSignal(fence, 5, 3);
+    ASSERT_EQ(fence->GetCompletedValue(), 1u);
+
+    tracker.CompleteSignals(0);
+    ASSERT_EQ(fence->GetCompletedValue(), 1u);
+
+    tracker.CompleteSignals(2);
+    ASSERT_EQ(fence->GetCompletedValue(), 2u);
+
+    tracker.CompleteSignals(3);
+    ASSERT_EQ(fence->GetCompletedValue(), 5u);
+    ASSERT_EQ(fence->GetSignaledValue(), 5u);
+
+    fence->Release();
+}
+
+struct DeletionRecorderFence : public FenceBase {
+    DeletionRecorderFence(FenceBuilder* builder, bool* deleted)
+        : FenceBase(builder), deleted(deleted) {
+    }
+    ~DeletionRecorderFence() override {
+        *deleted = true;
+    }
+
+    bool* deleted;
+};
+
+// Test that the tracker keeps the fences alive until their signals complete
+TEST(FenceSignalTracker, KeepsFencesAlive) {
+    FenceBuilder builder(nullptr);
+    bool deleted = false;
+    FenceBase* fence = new DeletionRecorderFence(&builder, &deleted);
+    FenceSignalTracker tracker;
+
+    fence->SetSignaledValue(1);
+    tracker.AddSignal(fence, 1, 1);
+    fence->Release();
+    ASSERT_FALSE(deleted);
+
+    tracker.CompleteSignals(1);
+    ASSERT_TRUE(deleted);
+}
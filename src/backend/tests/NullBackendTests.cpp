@@ -0,0 +1,156 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "nxt/nxt.h"
+#include "null/NullBackend.h"
+
+#include <string>
+#include <vector>
+
+namespace backend {
+namespace null {
+    void Init(nxtProcTable* procs, nxtDevice* device);
+}
+}
+
+class NullBackendTests : public testing::Test {
+    protected:
+        void SetUp() override {
+            backend::null::Init(&procs, &device);
+        }
+
+        nxtProcTable procs;
+        nxtDevice device;
+};
+
+static void RecordCompletion(nxtCallbackUserdata userdata) {
+    auto completed = reinterpret_cast<std::vector<int>*>(static_cast<uintptr_t>(userdata));
+    completed->push_back(static_cast<int>(completed->size()));
+}
+
+// Test that fences signaled after a submit complete on the next tick
+TEST_F(NullBackendTests, SubmitThenFenceCompletesOnTick) {
+    nxtQueueBuilder queueBuilder = procs.deviceCreateQueueBuilder(device);
+    nxtQueue queue = procs.queueBuilderGetResult(queueBuilder);
+
+    nxtCommandBufferBuilder commandsBuilder = procs.deviceCreateCommandBufferBuilder(device);
+    nxtCommandBuffer commands = procs.commandBufferBuilderGetResult(commandsBuilder);
+
+    nxtFenceBuilder fenceBuilder = procs.deviceCreateFenceBuilder(device);
+    nxtFence fence = procs.fenceBuilderGetResult(fenceBuilder);
+
+    std::vector<int> completed;
+    auto userdata = static_cast<nxtCallbackUserdata>(reinterpret_cast<uintptr_t>(&completed));
+
+    procs.queueSubmit(queue, 1, &commands);
+    procs.queueSignal(queue, fence, 1);
+    procs.fenceOnCompletion(fence, 1, RecordCompletion, userdata);
+    ASSERT_TRUE(completed.empty());
+
+    procs.deviceTick(device);
+    ASSERT_EQ(completed.size(), 1u);
+
+    procs.deviceTick(device);
+    ASSERT_EQ(completed.size(), 1u);
+
+    procs.fenceRelease(fence);
+    procs.fenceBuilderRelease(fenceBuilder);
+    procs.commandBufferRelease(commands);
+    procs.commandBufferBuilderRelease(commandsBuilder);
+    procs.queueRelease(queue);
+    procs.queueBuilderRelease(queueBuilder);
+}
+
+namespace backend {
+    void RegisterSynchronousErrorCallback(nxtDevice device, void(*)(const char*, void*), void* userData);
+}
+
+static void RecordError(const char* message, void* userData) {
+    reinterpret_cast<std::vector<std::string>*>(userData)->push_back(message);
+}
+
+// Test that indexed indirect draws reject an index buffer offset, which OpenGL can't apply
+TEST_F(NullBackendTests, IndexedIndirectDrawRejectsIndexBufferOffset) {
+    std::vector<std::string> errors;
+    backend::RegisterSynchronousErrorCallback(device, RecordError, &errors);
+
+    nxtBufferBuilder bufferBuilder = procs.deviceCreateBufferBuilder(device);
+    procs.bufferBuilderSetUsage(bufferBuilder, static_cast<nxtBufferUsageBit>(NXT_BUFFER_USAGE_BIT_INDEX | NXT_BUFFER_USAGE_BIT_INDIRECT));
+    procs.bufferBuilderSetSize(bufferBuilder, 256);
+    nxtBuffer buffer = procs.bufferBuilderGetResult(bufferBuilder);
+
+    nxtCommandBufferBuilder builder = procs.deviceCreateCommandBufferBuilder(device);
+    procs.commandBufferBuilderSetIndexBuffer(builder, buffer, 4, NXT_INDEX_FORMAT_UINT32);
+    procs.commandBufferBuilderDrawElementsIndirect(builder, buffer, 0);
+    ASSERT_EQ(errors, std::vector<std::string>({"Indexed indirect draws require an index buffer offset of 0"}));
+    procs.commandBufferBuilderRelease(builder);
+
+    // With an offset of 0 the draw fails for the missing pipeline instead
+    errors.clear();
+    builder = procs.deviceCreateCommandBufferBuilder(device);
+    procs.commandBufferBuilderSetIndexBuffer(builder, buffer, 0, NXT_INDEX_FORMAT_UINT32);
+    procs.commandBufferBuilderDrawElementsIndirect(builder, buffer, 0);
+    ASSERT_EQ(errors, std::vector<std::string>({"Some draw state is missing"}));
+    procs.commandBufferBuilderRelease(builder);
+
+    procs.bufferRelease(buffer);
+    procs.bufferBuilderRelease(bufferBuilder);
+}
+
+// Test that the commands of a recording spanning many blocks are packed in a single block by
+// GetResult, through the validating procs like applications use them
+TEST_F(NullBackendTests, CommandBufferCommandsArePacked) {
+    nxtCommandBufferBuilder builder = procs.deviceCreateCommandBufferBuilder(device);
+    for (uint32_t i = 0; i < 10000; ++i) {
+        procs.commandBufferBuilderSetPushConstants(builder, NXT_SHADER_STAGE_BIT_VERTEX, 0, 1, &i);
+    }
+    nxtCommandBuffer commands = procs.commandBufferBuilderGetResult(builder);
+    ASSERT_NE(commands, nullptr);
+
+    auto backendCommands = reinterpret_cast<backend::null::CommandBuffer*>(commands);
+    ASSERT_EQ(backendCommands->GetCommands()->GetBlockCount(), 1u);
+
+    procs.commandBufferRelease(commands);
+    procs.commandBufferBuilderRelease(builder);
+}
+
+// Test the same for render bundles
+TEST_F(NullBackendTests, RenderBundleCommandsArePacked) {
+    nxtRenderBundleBuilder builder = procs.deviceCreateRenderBundleBuilder(device);
+    for (uint32_t i = 0; i < 10000; ++i) {
+        procs.renderBundleBuilderSetPushConstants(builder, NXT_SHADER_STAGE_BIT_VERTEX, 0, 1, &i);
+    }
+    nxtRenderBundle bundle = procs.renderBundleBuilderGetResult(builder);
+    ASSERT_NE(bundle, nullptr);
+
+    auto backendBundle = reinterpret_cast<backend::null::RenderBundle*>(bundle);
+    ASSERT_EQ(backendBundle->GetCommands()->GetBlockCount(), 1u);
+
+    procs.renderBundleRelease(bundle);
+    procs.renderBundleBuilderRelease(builder);
+}
+
+// Test the completed value of a fence can be polled after ticks
+TEST_F(NullBackendTests, FenceCompletedValue) {
+    nxtQueueBuilder queueBuilder = procs.deviceCreateQueueBuilder(device);
+    nxtQueue queue = procs.queueBuilderGetResult(queueBuilder);
+
+    nxtFenceBuilder fenceBuilder = procs.deviceCreateFenceBuilder(device);
+    procs.fenceBuilderSetInitialValue(fenceBuilder, 1);
+    nxtFence fence = procs.fenceBuilderGetResult(fenceBuilder);
+    ASSERT_EQ(procs.fenceGetCompletedValue(fence), 1u);
+
+    procs.queueSignal(queue, fence, 2);
+    ASSERT_EQ(procs.fenceGetCompletedValue(fence), 1u);
+
+    procs.deviceTick(device);
+    ASSERT_EQ(procs.fenceGetCompletedValue(fence), 2u);
+
+    procs.fenceRelease(fence);
+    procs.fenceBuilderRelease(fenceBuilder);
+    procs.queueRelease(queue);
+    procs.queueBuilderRelease(queueBuilder);
+}
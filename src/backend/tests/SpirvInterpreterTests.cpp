@@ -0,0 +1,582 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "common/WorkerPool.h"
+#include "cpu/SpirvInterpreterCPU.h"
+
+#include <spirv-cross/GLSL.std.450.h>
+#include <spirv-cross/spirv.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+using namespace backend;
+using namespace backend::cpu;
+
+// Writes SPIR-V modules one instruction at a time, the tests put them in the order of the
+// logical layout.
+class SpirvAssembler {
+    public:
+        uint32_t Id() {
+            return nextId++;
+        }
+
+        void Op(spv::Op opcode, std::vector<uint32_t> operands) {
+            body.push_back(static_cast<uint32_t>(operands.size() + 1) << spv::WordCountShift | opcode);
+            body.insert(body.end(), operands.begin(), operands.end());
+        }
+
+        static std::vector<uint32_t> String(const char* string) {
+            std::vector<uint32_t> words(strlen(string) / 4 + 1, 0);
+            memcpy(words.data(), string, strlen(string));
+            return words;
+        }
+
+        static uint32_t Float(float value) {
+            uint32_t result;
+            memcpy(&result, &value, sizeof(result));
+            return result;
+        }
+
+        std::vector<uint32_t> GetSpirv() const {
+            std::vector<uint32_t> spirv = {spv::MagicNumber, 0x00010000, 0, nextId, 0};
+            spirv.insert(spirv.end(), body.begin(), body.end());
+            return spirv;
+        }
+
+    private:
+        uint32_t nextId = 1;
+        std::vector<uint32_t> body;
+};
+
+// Imports GLSL.std.450 as the glslStd450 id when it isn't 0.
+static void AddHeader(SpirvAssembler* a, uint32_t main, std::vector<uint32_t> interface, uint32_t localSize,
+                      uint32_t glslStd450 = 0) {
+    a->Op(spv::OpCapability, {1});
+    if (glslStd450 != 0) {
+        std::vector<uint32_t> import = {glslStd450};
+        auto name = SpirvAssembler::String("GLSL.std.450");
+        import.insert(import.end(), name.begin(), name.end());
+        a->Op(spv::OpExtInstImport, import);
+    }
+    a->Op(spv::OpMemoryModel, {0, 1});
+
+    std::vector<uint32_t> entryPoint = {spv::ExecutionModelGLCompute, main};
+    auto name = SpirvAssembler::String("main");
+    entryPoint.insert(entryPoint.end(), name.begin(), name.end());
+    entryPoint.insert(entryPoint.end(), interface.begin(), interface.end());
+    a->Op(spv::OpEntryPoint, entryPoint);
+    a->Op(spv::OpExecutionMode, {main, spv::ExecutionModeLocalSize, localSize, 1, 1});
+}
+
+// The compute shader of HelloCompute, optionally with an atomic operation
+//   layout(set = 0, binding = 0) buffer myBlock {
+//       int a;
+//       float b;
+//   } myStorage;
+//   void main() {
+//       myStorage.a = (myStorage.a + 1) % 256;
+//       myStorage.b = mod((myStorage.b + 0.02), 1.0);
+//   }
+static std::vector<uint32_t> HelloComputeSpirv(bool withAtomic) {
+    SpirvAssembler a;
+    uint32_t main = a.Id();
+    uint32_t voidType = a.Id(), functionType = a.Id(), intType = a.Id(), floatType = a.Id();
+    uint32_t block = a.Id(), blockPointer = a.Id(), storage = a.Id(), intPointer = a.Id(), floatPointer = a.Id();
+    uint32_t zero = a.Id(), one = a.Id(), c256 = a.Id(), step = a.Id(), oneFloat = a.Id();
+    uint32_t label = a.Id();
+
+    AddHeader(&a, main, {}, 1);
+    a.Op(spv::OpMemberDecorate, {block, 0, spv::DecorationOffset, 0});
+    a.Op(spv::OpMemberDecorate, {block, 1, spv::DecorationOffset, 4});
+    a.Op(spv::OpDecorate, {block, spv::DecorationBufferBlock});
+    a.Op(spv::OpDecorate, {storage, spv::DecorationDescriptorSet, 0});
+    a.Op(spv::OpDecorate, {storage, spv::DecorationBinding, 0});
+
+    a.Op(spv::OpTypeVoid, {voidType});
+    a.Op(spv::OpTypeFunction, {functionType, voidType});
+    a.Op(spv::OpTypeInt, {intType, 32, 1});
+    a.Op(spv::OpTypeFloat, {floatType, 32});
+    a.Op(spv::OpTypeStruct, {block, intType, floatType});
+    a.Op(spv::OpTypePointer, {blockPointer, spv::StorageClassUniform, block});
+    a.Op(spv::OpVariable, {blockPointer, storage, spv::StorageClassUniform});
+    a.Op(spv::OpTypePointer, {intPointer, spv::StorageClassUniform, intType});
+    a.Op(spv::OpTypePointer, {floatPointer, spv::StorageClassUniform, floatType});
+    a.Op(spv::OpConstant, {intType, zero, 0});
+    a.Op(spv::OpConstant, {intType, one, 1});
+    a.Op(spv::OpConstant, {intType, c256, 256});
+    a.Op(spv::OpConstant, {floatType, step, SpirvAssembler::Float(0.02f)});
+    a.Op(spv::OpConstant, {floatType, oneFloat, SpirvAssembler::Float(1.0f)});
+
+    a.Op(spv::OpFunction, {voidType, main, 0, functionType});
+    a.Op(spv::OpLabel, {label});
+    uint32_t aPointer = a.Id(), aValue = a.Id(), aAdd = a.Id(), aMod = a.Id();
+    a.Op(spv::OpAccessChain, {intPointer, aPointer, storage, zero});
+    a.Op(spv::OpLoad, {intType, aValue, aPointer});
+    a.Op(spv::OpIAdd, {intType, aAdd, aValue, one});
+    a.Op(spv::OpSMod, {intType, aMod, aAdd, c256});
+    a.Op(spv::OpStore, {aPointer, aMod});
+    uint32_t bPointer = a.Id(), bValue = a.Id(), bAdd = a.Id(), bMod = a.Id();
+    a.Op(spv::OpAccessChain, {floatPointer, bPointer, storage, one});
+    a.Op(spv::OpLoad, {floatType, bValue, bPointer});
+    a.Op(spv::OpFAdd, {floatType, bAdd, bValue, step});
+    a.Op(spv::OpFMod, {floatType, bMod, bAdd, oneFloat});
+    a.Op(spv::OpStore, {bPointer, bMod});
+    if (withAtomic) {
+        a.Op(spv::OpAtomicIAdd, {intType, a.Id(), aPointer, one, zero, one});
+    }
+    a.Op(spv::OpReturn, {});
+    a.Op(spv::OpFunctionEnd, {});
+
+    return a.GetSpirv();
+}
+
+// Each invocation sums the integers below its value, with a loop that runs a different number
+// of iterations in each lane
+//   layout(local_size_x = 8) in;
+//   layout(set = 0, binding = 0) buffer myBlock {
+//       uint values[];
+//   };
+//   void main() {
+//       uint i = gl_GlobalInvocationID.x;
+//       uint sum = 0;
+//       for (uint k = 0; k < values[i]; k++) {
+//           sum += k;
+//       }
+//       values[i] = sum;
+//   }
+static std::vector<uint32_t> DivergentLoopSpirv() {
+    SpirvAssembler a;
+    uint32_t main = a.Id(), invocationId = a.Id();
+    uint32_t voidType = a.Id(), functionType = a.Id(), uintType = a.Id(), boolType = a.Id(), uvec3Type = a.Id();
+    uint32_t inputPointer = a.Id(), inputUintPointer = a.Id();
+    uint32_t array = a.Id(), block = a.Id(), blockPointer = a.Id(), storage = a.Id(), uintPointer = a.Id();
+    uint32_t zero = a.Id(), one = a.Id();
+    uint32_t entry = a.Id(), header = a.Id(), body = a.Id(), continueTarget = a.Id(), merge = a.Id();
+
+    AddHeader(&a, main, {invocationId}, 8);
+    a.Op(spv::OpDecorate, {invocationId, spv::DecorationBuiltIn, spv::BuiltInGlobalInvocationId});
+    a.Op(spv::OpDecorate, {array, spv::DecorationArrayStride, 4});
+    a.Op(spv::OpMemberDecorate, {block, 0, spv::DecorationOffset, 0});
+    a.Op(spv::OpDecorate, {block, spv::DecorationBufferBlock});
+    a.Op(spv::OpDecorate, {storage, spv::DecorationDescriptorSet, 0});
+    a.Op(spv::OpDecorate, {storage, spv::DecorationBinding, 0});
+
+    a.Op(spv::OpTypeVoid, {voidType});
+    a.Op(spv::OpTypeFunction, {functionType, voidType});
+    a.Op(spv::OpTypeInt, {uintType, 32, 0});
+    a.Op(spv::OpTypeBool, {boolType});
+    a.Op(spv::OpTypeVector, {uvec3Type, uintType, 3});
+    a.Op(spv::OpTypePointer, {inputPointer, spv::StorageClassInput, uvec3Type});
+    a.Op(spv::OpVariable, {inputPointer, invocationId, spv::StorageClassInput});
+    a.Op(spv::OpTypePointer, {inputUintPointer, spv::StorageClassInput, uintType});
+    a.Op(spv::OpTypeRuntimeArray, {array, uintType});
+    a.Op(spv::OpTypeStruct, {block, array});
+    a.Op(spv::OpTypePointer, {blockPointer, spv::StorageClassUniform, block});
+    a.Op(spv::OpVariable, {blockPointer, storage, spv::StorageClassUniform});
+    a.Op(spv::OpTypePointer, {uintPointer, spv::StorageClassUniform, uintType});
+    a.Op(spv::OpConstant, {uintType, zero, 0});
+    a.Op(spv::OpConstant, {uintType, one, 1});
+
+    uint32_t xPointer = a.Id(), x = a.Id(), valuePointer = a.Id(), count = a.Id();
+    uint32_t k = a.Id(), sum = a.Id(), condition = a.Id(), nextSum = a.Id(), nextK = a.Id();
+
+    a.Op(spv::OpFunction, {voidType, main, 0, functionType});
+    a.Op(spv::OpLabel, {entry});
+    a.Op(spv::OpAccessChain, {inputUintPointer, xPointer, invocationId, zero});
+    a.Op(spv::OpLoad, {uintType, x, xPointer});
+    a.Op(spv::OpAccessChain, {uintPointer, valuePointer, storage, zero, x});
+    a.Op(spv::OpLoad, {uintType, count, valuePointer});
+    a.Op(spv::OpBranch, {header});
+
+    a.Op(spv::OpLabel, {header});
+    a.Op(spv::OpPhi, {uintType, k, zero, entry, nextK, continueTarget});
+    a.Op(spv::OpPhi, {uintType, sum, zero, entry, nextSum, continueTarget});
+    a.Op(spv::OpULessThan, {boolType, condition, k, count});
+    a.Op(spv::OpLoopMerge, {merge, continueTarget, 0});
+    a.Op(spv::OpBranchConditional, {condition, body, merge});
+
+    a.Op(spv::OpLabel, {body});
+    a.Op(spv::OpIAdd, {uintType, nextSum, sum, k});
+    a.Op(spv::OpBranch, {continueTarget});
+
+    a.Op(spv::OpLabel, {continueTarget});
+    a.Op(spv::OpIAdd, {uintType, nextK, k, one});
+    a.Op(spv::OpBranch, {header});
+
+    a.Op(spv::OpLabel, {merge});
+    a.Op(spv::OpStore, {valuePointer, sum});
+    a.Op(spv::OpReturn, {});
+    a.Op(spv::OpFunctionEnd, {});
+
+    return a.GetSpirv();
+}
+
+// Each invocation gives its value to the previous invocation of its workgroup through
+// workgroup memory
+//   layout(local_size_x = 8) in;
+//   layout(set = 0, binding = 0) buffer myBlock {
+//       uint values[];
+//   };
+//   shared uint exchange[8];
+//   void main() {
+//       uint local = gl_LocalInvocationID.x;
+//       uint global = gl_GlobalInvocationID.x;
+//       exchange[local] = values[global];
+//       barrier();
+//       values[global] = exchange[(local + 1) % 8];
+//   }
+static std::vector<uint32_t> WorkgroupExchangeSpirv() {
+    SpirvAssembler a;
+    uint32_t main = a.Id(), localId = a.Id(), globalId = a.Id();
+    uint32_t voidType = a.Id(), functionType = a.Id(), uintType = a.Id(), uvec3Type = a.Id();
+    uint32_t inputPointer = a.Id(), inputUintPointer = a.Id();
+    uint32_t array = a.Id(), block = a.Id(), blockPointer = a.Id(), storage = a.Id(), uintPointer = a.Id();
+    uint32_t sharedArray = a.Id(), sharedPointer = a.Id(), exchange = a.Id(), sharedUintPointer = a.Id();
+    uint32_t zero = a.Id(), one = a.Id(), eight = a.Id(), workgroupScope = a.Id(), semantics = a.Id();
+    uint32_t entry = a.Id();
+
+    AddHeader(&a, main, {localId, globalId}, 8);
+    a.Op(spv::OpDecorate, {localId, spv::DecorationBuiltIn, spv::BuiltInLocalInvocationId});
+    a.Op(spv::OpDecorate, {globalId, spv::DecorationBuiltIn, spv::BuiltInGlobalInvocationId});
+    a.Op(spv::OpDecorate, {array, spv::DecorationArrayStride, 4});
+    a.Op(spv::OpMemberDecorate, {block, 0, spv::DecorationOffset, 0});
+    a.Op(spv::OpDecorate, {block, spv::DecorationBufferBlock});
+    a.Op(spv::OpDecorate, {storage, spv::DecorationDescriptorSet, 0});
+    a.Op(spv::OpDecorate, {storage, spv::DecorationBinding, 0});
+
+    a.Op(spv::OpTypeVoid, {voidType});
+    a.Op(spv::OpTypeFunction, {functionType, voidType});
+    a.Op(spv::OpTypeInt, {uintType, 32, 0});
+    a.Op(spv::OpTypeVector, {uvec3Type, uintType, 3});
+    a.Op(spv::OpTypePointer, {inputPointer, spv::StorageClassInput, uvec3Type});
+    a.Op(spv::OpVariable, {inputPointer, localId, spv::StorageClassInput});
+    a.Op(spv::OpVariable, {inputPointer, globalId, spv::StorageClassInput});
+    a.Op(spv::OpTypePointer, {inputUintPointer, spv::StorageClassInput, uintType});
+    a.Op(spv::OpTypeRuntimeArray, {array, uintType});
+    a.Op(spv::OpTypeStruct, {block, array});
+    a.Op(spv::OpTypePointer, {blockPointer, spv::StorageClassUniform, block});
+    a.Op(spv::OpVariable, {blockPointer, storage, spv::StorageClassUniform});
+    a.Op(spv::OpTypePointer, {uintPointer, spv::StorageClassUniform, uintType});
+    a.Op(spv::OpConstant, {uintType, zero, 0});
+    a.Op(spv::OpConstant, {uintType, one, 1});
+    a.Op(spv::OpConstant, {uintType, eight, 8});
+    a.Op(spv::OpConstant, {uintType, workgroupScope, spv::ScopeWorkgroup});
+    a.Op(spv::OpConstant, {uintType, semantics, spv::MemorySemanticsAcquireReleaseMask | spv::MemorySemanticsWorkgroupMemoryMask});
+    a.Op(spv::OpTypeArray, {sharedArray, uintType, eight});
+    a.Op(spv::OpTypePointer, {sharedPointer, spv::StorageClassWorkgroup, sharedArray});
+    a.Op(spv::OpVariable, {sharedPointer, exchange, spv::StorageClassWorkgroup});
+    a.Op(spv::OpTypePointer, {sharedUintPointer, spv::StorageClassWorkgroup, uintType});
+
+    uint32_t localPointer = a.Id(), local = a.Id(), globalPointer = a.Id(), global = a.Id();
+    uint32_t valuePointer = a.Id(), value = a.Id(), slot = a.Id();
+    uint32_t next = a.Id(), neighbor = a.Id(), neighborSlot = a.Id(), neighborValue = a.Id();
+
+    a.Op(spv::OpFunction, {voidType, main, 0, functionType});
+    a.Op(spv::OpLabel, {entry});
+    a.Op(spv::OpAccessChain, {inputUintPointer, localPointer, localId, zero});
+    a.Op(spv::OpLoad, {uintType, local, localPointer});
+    a.Op(spv::OpAccessChain, {inputUintPointer, globalPointer, globalId, zero});
+    a.Op(spv::OpLoad, {uintType, global, globalPointer});
+    a.Op(spv::OpAccessChain, {uintPointer, valuePointer, storage, zero, global});
+    a.Op(spv::OpLoad, {uintType, value, valuePointer});
+    a.Op(spv::OpAccessChain, {sharedUintPointer, slot, exchange, local});
+    a.Op(spv::OpStore, {slot, value});
+    a.Op(spv::OpControlBarrier, {workgroupScope, workgroupScope, semantics});
+    a.Op(spv::OpIAdd, {uintType, next, local, one});
+    a.Op(spv::OpUMod, {uintType, neighbor, next, eight});
+    a.Op(spv::OpAccessChain, {sharedUintPointer, neighborSlot, exchange, neighbor});
+    a.Op(spv::OpLoad, {uintType, neighborValue, neighborSlot});
+    a.Op(spv::OpStore, {valuePointer, neighborValue});
+    a.Op(spv::OpReturn, {});
+    a.Op(spv::OpFunctionEnd, {});
+
+    return a.GetSpirv();
+}
+
+// The velocity clamp and kinematic update of ComputeBoids, with a pull toward the center instead
+// of the flocking rules
+//   layout(local_size_x = 4) in;
+//   struct Particle {
+//       vec2 pos;
+//       vec2 vel;
+//   };
+//   layout(std140, set = 0, binding = 0) buffer ParticlesA {
+//       Particle particlesA[];
+//   };
+//   layout(std140, set = 0, binding = 1) buffer ParticlesB {
+//       Particle particlesB[];
+//   };
+//   void main() {
+//       uint index = gl_GlobalInvocationID.x;
+//       vec2 vPos = particlesA[index].pos;
+//       vec2 vVel = particlesA[index].vel;
+//       vVel += normalize(-vPos) * (length(vPos) * 0.01);
+//       vVel = normalize(vVel) * clamp(length(vVel), 0.0, 0.1);
+//       vPos += vVel * 0.04;
+//       particlesB[index].pos = vPos;
+//       particlesB[index].vel = vVel;
+//   }
+static std::vector<uint32_t> BoidsUpdateSpirv() {
+    SpirvAssembler a;
+    uint32_t main = a.Id(), invocationId = a.Id(), glsl = a.Id();
+    uint32_t voidType = a.Id(), functionType = a.Id(), uintType = a.Id(), floatType = a.Id();
+    uint32_t uvec3Type = a.Id(), vec2Type = a.Id(), inputPointer = a.Id(), inputUintPointer = a.Id();
+    uint32_t particle = a.Id(), array = a.Id(), block = a.Id(), blockPointer = a.Id(), vec2Pointer = a.Id();
+    uint32_t particlesA = a.Id(), particlesB = a.Id();
+    uint32_t zero = a.Id(), one = a.Id(), zeroFloat = a.Id(), pullScale = a.Id(), maxSpeed = a.Id(), deltaT = a.Id();
+    uint32_t entry = a.Id();
+
+    AddHeader(&a, main, {invocationId}, 4, glsl);
+    a.Op(spv::OpDecorate, {invocationId, spv::DecorationBuiltIn, spv::BuiltInGlobalInvocationId});
+    a.Op(spv::OpMemberDecorate, {particle, 0, spv::DecorationOffset, 0});
+    a.Op(spv::OpMemberDecorate, {particle, 1, spv::DecorationOffset, 8});
+    a.Op(spv::OpDecorate, {array, spv::DecorationArrayStride, 16});
+    a.Op(spv::OpMemberDecorate, {block, 0, spv::DecorationOffset, 0});
+    a.Op(spv::OpDecorate, {block, spv::DecorationBufferBlock});
+    a.Op(spv::OpDecorate, {particlesA, spv::DecorationDescriptorSet, 0});
+    a.Op(spv::OpDecorate, {particlesA, spv::DecorationBinding, 0});
+    a.Op(spv::OpDecorate, {particlesB, spv::DecorationDescriptorSet, 0});
+    a.Op(spv::OpDecorate, {particlesB, spv::DecorationBinding, 1});
+
+    a.Op(spv::OpTypeVoid, {voidType});
+    a.Op(spv::OpTypeFunction, {functionType, voidType});
+    a.Op(spv::OpTypeInt, {uintType, 32, 0});
+    a.Op(spv::OpTypeFloat, {floatType, 32});
+    a.Op(spv::OpTypeVector, {uvec3Type, uintType, 3});
+    a.Op(spv::OpTypeVector, {vec2Type, floatType, 2});
+    a.Op(spv::OpTypePointer, {inputPointer, spv::StorageClassInput, uvec3Type});
+    a.Op(spv::OpVariable, {inputPointer, invocationId, spv::StorageClassInput});
+    a.Op(spv::OpTypePointer, {inputUintPointer, spv::StorageClassInput, uintType});
+    a.Op(spv::OpTypeStruct, {particle, vec2Type, vec2Type});
+    a.Op(spv::OpTypeRuntimeArray, {array, particle});
+    a.Op(spv::OpTypeStruct, {block, array});
+    a.Op(spv::OpTypePointer, {blockPointer, spv::StorageClassUniform, block});
+    a.Op(spv::OpVariable, {blockPointer, particlesA, spv::StorageClassUniform});
+    a.Op(spv::OpVariable, {blockPointer, particlesB, spv::StorageClassUniform});
+    a.Op(spv::OpTypePointer, {vec2Pointer, spv::StorageClassUniform, vec2Type});
+    a.Op(spv::OpConstant, {uintType, zero, 0});
+    a.Op(spv::OpConstant, {uintType, one, 1});
+    a.Op(spv::OpConstant, {floatType, zeroFloat, SpirvAssembler::Float(0.0f)});
+    a.Op(spv::OpConstant, {floatType, pullScale, SpirvAssembler::Float(0.01f)});
+    a.Op(spv::OpConstant, {floatType, maxSpeed, SpirvAssembler::Float(0.1f)});
+    a.Op(spv::OpConstant, {floatType, deltaT, SpirvAssembler::Float(0.04f)});
+
+    uint32_t indexPointer = a.Id(), index = a.Id(), posPointer = a.Id(), velPointer = a.Id(), pos = a.Id(), vel = a.Id();
+    uint32_t negatedPos = a.Id(), toCenter = a.Id(), distance = a.Id(), pullWeight = a.Id(), pull = a.Id(), pulledVel = a.Id();
+    uint32_t speed = a.Id(), clampedSpeed = a.Id(), direction = a.Id(), newVel = a.Id(), step = a.Id(), newPos = a.Id();
+    uint32_t outPosPointer = a.Id(), outVelPointer = a.Id();
+
+    a.Op(spv::OpFunction, {voidType, main, 0, functionType});
+    a.Op(spv::OpLabel, {entry});
+    a.Op(spv::OpAccessChain, {inputUintPointer, indexPointer, invocationId, zero});
+    a.Op(spv::OpLoad, {uintType, index, indexPointer});
+    a.Op(spv::OpAccessChain, {vec2Pointer, posPointer, particlesA, zero, index, zero});
+    a.Op(spv::OpAccessChain, {vec2Pointer, velPointer, particlesA, zero, index, one});
+    a.Op(spv::OpLoad, {vec2Type, pos, posPointer});
+    a.Op(spv::OpLoad, {vec2Type, vel, velPointer});
+    a.Op(spv::OpFNegate, {vec2Type, negatedPos, pos});
+    a.Op(spv::OpExtInst, {vec2Type, toCenter, glsl, GLSLstd450Normalize, negatedPos});
+    a.Op(spv::OpExtInst, {floatType, distance, glsl, GLSLstd450Length, pos});
+    a.Op(spv::OpFMul, {floatType, pullWeight, distance, pullScale});
+    a.Op(spv::OpVectorTimesScalar, {vec2Type, pull, toCenter, pullWeight});
+    a.Op(spv::OpFAdd, {vec2Type, pulledVel, vel, pull});
+    a.Op(spv::OpExtInst, {floatType, speed, glsl, GLSLstd450Length, pulledVel});
+    a.Op(spv::OpExtInst, {floatType, clampedSpeed, glsl, GLSLstd450FClamp, speed, zeroFloat, maxSpeed});
+    a.Op(spv::OpExtInst, {vec2Type, direction, glsl, GLSLstd450Normalize, pulledVel});
+    a.Op(spv::OpVectorTimesScalar, {vec2Type, newVel, direction, clampedSpeed});
+    a.Op(spv::OpVectorTimesScalar, {vec2Type, step, newVel, deltaT});
+    a.Op(spv::OpFAdd, {vec2Type, newPos, pos, step});
+    a.Op(spv::OpAccessChain, {vec2Pointer, outPosPointer, particlesB, zero, index, zero});
+    a.Op(spv::OpAccessChain, {vec2Pointer, outVelPointer, particlesB, zero, index, one});
+    a.Op(spv::OpStore, {outPosPointer, newPos});
+    a.Op(spv::OpStore, {outVelPointer, newVel});
+    a.Op(spv::OpReturn, {});
+    a.Op(spv::OpFunctionEnd, {});
+
+    return a.GetSpirv();
+}
+
+// Test the compute shader of HelloCompute gives the results of the same computation in C++
+TEST(SpirvInterpreter, HelloCompute) {
+    SpirvProgram program;
+    std::string error;
+    ASSERT_TRUE(program.Initialize(HelloComputeSpirv(false), &error)) << error;
+    int entryPoint = program.FindEntryPoint("main");
+    ASSERT_EQ(entryPoint, 0);
+
+    struct {
+        int32_t a;
+        float b;
+    } data = {250, 0.5f}, expected = data;
+
+    SpirvResources resources;
+    resources.buffers[0][0].data = reinterpret_cast<uint8_t*>(&data);
+    resources.buffers[0][0].size = sizeof(data);
+
+    for (int i = 0; i < 100; ++i) {
+        program.Dispatch(entryPoint, resources, 1, 1, 1, nullptr);
+
+        expected.a = (expected.a + 1) % 256;
+        float b = expected.b + 0.02f;
+        expected.b = b - 1.0f * std::floor(b / 1.0f);
+
+        ASSERT_EQ(data.a, expected.a);
+        ASSERT_EQ(memcmp(&data.b, &expected.b, sizeof(float)), 0);
+    }
+}
+
+// Test lanes that run a loop a different number of times each get their result, that accesses
+// past the end of the buffer are dropped, and that the result doesn't depend on the threads.
+TEST(SpirvInterpreter, DivergentLoop) {
+    SpirvProgram program;
+    std::string error;
+    ASSERT_TRUE(program.Initialize(DivergentLoopSpirv(), &error)) << error;
+
+    constexpr uint32_t kValues = 20;
+    constexpr uint32_t kSentinel = 0xDEADBEEF;
+    std::vector<uint32_t> initial(kValues + 4, kSentinel);
+    for (uint32_t i = 0; i < kValues; ++i) {
+        initial[i] = (i * 7) % 13;
+    }
+
+    WorkerPool pool(3);
+    for (WorkerPool* usedPool : {static_cast<WorkerPool*>(nullptr), &pool}) {
+        std::vector<uint32_t> values = initial;
+        SpirvResources resources;
+        resources.buffers[0][0].data = reinterpret_cast<uint8_t*>(values.data());
+        resources.buffers[0][0].size = kValues * sizeof(uint32_t);
+
+        // 3 workgroups of 8 invocations, the last 4 are out of bounds.
+        program.Dispatch(program.FindEntryPoint("main"), resources, 3, 1, 1, usedPool);
+
+        for (uint32_t i = 0; i < kValues; ++i) {
+            uint32_t n = initial[i];
+            ASSERT_EQ(values[i], n * (n - 1) / 2);
+        }
+        for (uint32_t i = kValues; i < values.size(); ++i) {
+            ASSERT_EQ(values[i], kSentinel);
+        }
+    }
+}
+
+// Test lanes see the workgroup memory written by the other lanes of their workgroup before the
+// barrier, and that workgroups using workgroup memory don't see each other's.
+TEST(SpirvInterpreter, WorkgroupMemoryBarrier) {
+    SpirvProgram program;
+    std::string error;
+    ASSERT_TRUE(program.Initialize(WorkgroupExchangeSpirv(), &error)) << error;
+
+    constexpr uint32_t kWorkgroups = 3;
+    constexpr uint32_t kLocalSize = 8;
+    std::vector<uint32_t> initial(kWorkgroups * kLocalSize);
+    for (uint32_t i = 0; i < initial.size(); ++i) {
+        initial[i] = 1000 + i * 3;
+    }
+
+    WorkerPool pool(3);
+    for (WorkerPool* usedPool : {static_cast<WorkerPool*>(nullptr), &pool}) {
+        std::vector<uint32_t> values = initial;
+        SpirvResources resources;
+        resources.buffers[0][0].data = reinterpret_cast<uint8_t*>(values.data());
+        resources.buffers[0][0].size = values.size() * sizeof(uint32_t);
+
+        program.Dispatch(program.FindEntryPoint("main"), resources, kWorkgroups, 1, 1, usedPool);
+
+        for (uint32_t workgroup = 0; workgroup < kWorkgroups; ++workgroup) {
+            for (uint32_t local = 0; local < kLocalSize; ++local) {
+                uint32_t neighbor = workgroup * kLocalSize + (local + 1) % kLocalSize;
+                ASSERT_EQ(values[workgroup * kLocalSize + local], initial[neighbor]);
+            }
+        }
+    }
+}
+
+// Test a ComputeBoids-style update gives the results of the same computation in C++. The
+// workgroups of 4 invocations don't use workgroup memory so several of them run in the same
+// batch of lanes, and the results must not depend on that or on the threads.
+TEST(SpirvInterpreter, BoidsUpdate) {
+    SpirvProgram program;
+    std::string error;
+    ASSERT_TRUE(program.Initialize(BoidsUpdateSpirv(), &error)) << error;
+
+    struct Particle {
+        float pos[2];
+        float vel[2];
+    };
+
+    // 38 workgroups, the last 2 invocations are out of bounds.
+    constexpr uint32_t kParticles = 150;
+    constexpr uint32_t kWorkgroups = (kParticles + 3) / 4;
+    constexpr uint32_t kSteps = 20;
+
+    std::vector<Particle> initial(kParticles + 2);
+    for (uint32_t i = 0; i < initial.size(); ++i) {
+        initial[i].pos[0] = (i % 13) / 13.0f - 0.45f;
+        initial[i].pos[1] = (i % 7) / 7.0f - 0.4f;
+        initial[i].vel[0] = (i % 5) * 0.03f - 0.06f;
+        initial[i].vel[1] = (i % 3) * 0.05f - 0.04f;
+    }
+
+    std::vector<Particle> expected = initial;
+    for (uint32_t step = 0; step < kSteps; ++step) {
+        for (uint32_t i = 0; i < kParticles; ++i) {
+            Particle& p = expected[i];
+            float distance = std::sqrt(p.pos[0] * p.pos[0] + p.pos[1] * p.pos[1]);
+            float pullWeight = distance * 0.01f;
+            float vel[2];
+            for (int c = 0; c < 2; ++c) {
+                vel[c] = p.vel[c] + (-p.pos[c] / distance) * pullWeight;
+            }
+            float speed = std::sqrt(vel[0] * vel[0] + vel[1] * vel[1]);
+            float clampedSpeed = std::min(std::max(speed, 0.0f), 0.1f);
+            for (int c = 0; c < 2; ++c) {
+                p.vel[c] = vel[c] / speed * clampedSpeed;
+                p.pos[c] += p.vel[c] * 0.04f;
+            }
+        }
+    }
+
+    std::vector<std::vector<Particle>> results;
+    WorkerPool pool(3);
+    for (WorkerPool* usedPool : {static_cast<WorkerPool*>(nullptr), &pool}) {
+        std::vector<Particle> particlesA = initial;
+        std::vector<Particle> particlesB = initial;
+        for (uint32_t step = 0; step < kSteps; ++step) {
+            SpirvResources resources;
+            resources.buffers[0][0].data = reinterpret_cast<uint8_t*>(particlesA.data());
+            resources.buffers[0][0].size = kParticles * sizeof(Particle);
+            resources.buffers[0][1].data = reinterpret_cast<uint8_t*>(particlesB.data());
+            resources.buffers[0][1].size = kParticles * sizeof(Particle);
+
+            program.Dispatch(program.FindEntryPoint("main"), resources, kWorkgroups, 1, 1, usedPool);
+            std::swap(particlesA, particlesB);
+        }
+
+        for (uint32_t i = 0; i < kParticles; ++i) {
+            for (int c = 0; c < 2; ++c) {
+                ASSERT_FLOAT_EQ(particlesA[i].pos[c], expected[i].pos[c]);
+                ASSERT_FLOAT_EQ(particlesA[i].vel[c], expected[i].vel[c]);
+            }
+        }
+        for (uint32_t i = kParticles; i < initial.size(); ++i) {
+            ASSERT_EQ(memcmp(&particlesA[i], &initial[i], sizeof(Particle)), 0);
+        }
+        results.push_back(particlesA);
+    }
+
+    ASSERT_EQ(memcmp(results[0].data(), results[1].data(), kParticles * sizeof(Particle)), 0);
+}
+
+// Test modules with instructions the interpreter doesn't support are rejected
+TEST(SpirvInterpreter, RejectsUnsupportedInstructions) {
+    SpirvProgram program;
+    std::string error;
+    ASSERT_FALSE(program.Initialize(HelloComputeSpirv(true), &error));
+    ASSERT_NE(error.find("isn't supported"), std::string::npos);
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "common/RefCounted.h"
+#include "common/TaskThread.h"
+
+#include <vector>
+
+using namespace backend;
+
+struct DeletionRecorder : public RefCounted {
+    ~DeletionRecorder() override {
+        *deletedOn = std::this_thread::get_id();
+        *deleted = true;
+    }
+
+    bool* deleted = nullptr;
+    std::thread::id* deletedOn = nullptr;
+};
+
+// Test that the tasks run in order on another thread
+TEST(TaskThread, RunsInOrderOnItsThread) {
+    TaskThread thread;
+    ASSERT_FALSE(thread.IsCurrentThread());
+
+    std::vector<int> order;
+    bool allOnThread = true;
+    for (int i = 0; i < 100; ++i) {
+        thread.Post([&, i]() {
+            allOnThread = allOnThread && thread.IsCurrentThread();
+            order.push_back(i);
+        });
+    }
+    thread.WaitForIdle();
+
+    ASSERT_TRUE(allOnThread);
+    ASSERT_EQ(order.size(), 100u);
+    for (int i = 0; i < 100; ++i) {
+        ASSERT_EQ(order[i], i);
+    }
+}
+
+// Test that more tasks than the size of the ring can be posted
+TEST(TaskThread, MoreTasksThanCapacity) {
+    TaskThread thread;
+
+    uint32_t count = 0;
+    for (int i = 0; i < 10000; ++i) {
+        thread.Post([&count]() {
+            count++;
+        });
+    }
+    thread.WaitForIdle();
+
+    ASSERT_EQ(count, 10000u);
+}
+
+// Test that references keep objects alive until the task ran, and that they are released on the
+// posting thread
+TEST(TaskThread, ReferencesReleasedOnPostingThread) {
+    TaskThread thread;
+
+    bool deleted = false;
+    std::thread::id deletedOn;
+    auto object = new DeletionRecorder;
+    object->deleted = &deleted;
+    object->deletedOn = &deletedOn;
+
+    bool sawAlive = false;
+    thread.Post([&sawAlive, &deleted]() {
+        sawAlive = !deleted;
+    }, {object});
+    object->Release();
+
+    thread.WaitForIdle();
+    ASSERT_TRUE(sawAlive);
+    ASSERT_TRUE(deleted);
+    ASSERT_EQ(deletedOn, std::this_thread::get_id());
+}
+
+// Test that the destructor runs the remaining tasks
+TEST(TaskThread, DestructorRunsPendingTasks) {
+    uint32_t count = 0;
+    {
+        TaskThread thread;
+        for (int i = 0; i < 10; ++i) {
+            thread.Post([&count]() {
+                count++;
+            });
+        }
+    }
+    ASSERT_EQ(count, 10u);
+}
@@ -0,0 +1,62 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gtest/gtest.h>
+
+#include "common/WorkerPool.h"
+
+#include <atomic>
+#include <vector>
+
+using namespace backend;
+
+// Test that each iteration runs once
+TEST(WorkerPool, EachIterationOnce) {
+    WorkerPool pool(3);
+    ASSERT_EQ(pool.GetNumThreads(), 3u);
+
+    std::vector<std::atomic<int>> calls(1000);
+    for (auto& count : calls) {
+        count = 0;
+    }
+
+    pool.ParallelFor(calls.size(), [&](size_t i) {
+        calls[i]++;
+    });
+
+    for (auto& count : calls) {
+        ASSERT_EQ(count, 1);
+    }
+}
+
+// Test that a pool without threads runs the loop on the calling thread
+TEST(WorkerPool, NoThreads) {
+    WorkerPool pool(0);
+    ASSERT_EQ(pool.GetNumThreads(), 0u);
+
+    std::thread::id caller = std::this_thread::get_id();
+    std::vector<size_t> order;
+    pool.ParallelFor(4, [&](size_t i) {
+        ASSERT_EQ(std::this_thread::get_id(), caller);
+        order.push_back(i);
+    });
+
+    ASSERT_EQ(order, std::vector<size_t>({0, 1, 2, 3}));
+}
+
+// Test that the pool can run many loops, including empty ones
+TEST(WorkerPool, ManyLoops) {
+    WorkerPool pool(2);
+
+    std::atomic<size_t> total(0);
+    size_t expected = 0;
+    for (size_t count = 0; count < 100; ++count) {
+        pool.ParallelFor(count, [&](size_t i) {
+            total += i + 1;
+        });
+        expected += count * (count + 1) / 2;
+    }
+
+    ASSERT_EQ(total, expected);
+}
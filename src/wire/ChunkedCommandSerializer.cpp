@@ -0,0 +1,92 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ChunkedCommandSerializer.h"
+
+#include <algorithm>
+
+constexpr size_t ChunkedCommandSerializer::kDefaultChunkSize;
+constexpr size_t ChunkedCommandSerializer::kDefaultMaxBytes;
+
+ChunkedCommandSerializer::ChunkedCommandSerializer(server::CommandHandler* handler, size_t chunkSize, size_t maxBytes)
+    : handler(handler), chunkSize(chunkSize), maxBytes(maxBytes) {
+}
+
+ChunkedCommandSerializer::~ChunkedCommandSerializer() {
+}
+
+void* ChunkedCommandSerializer::GetCmdSpace(size_t size) {
+    if (static_cast<size_t>(end - cursor) < size) {
+        StartChunk(size);
+    }
+
+    uint8_t* result = cursor;
+    cursor += size;
+    return result;
+}
+
+void ChunkedCommandSerializer::Flush() {
+    FinishChunk();
+
+    size_t flushBytes = 0;
+    bool failed = false;
+
+    for (auto& chunk : chunks) {
+        // The commands after a command the server failed to read can't be read either.
+        if (chunk.used > 0 && !failed) {
+            failed = handler->HandleCommands(chunk.data.get(), chunk.used) == nullptr;
+            flushBytes += chunk.used;
+            stats.chunks++;
+        }
+
+        // Chunks of oversized commands are freed, the others are reused. Freeing them too
+        // would make the next frames allocate and page fault them all over again.
+        if (chunk.size == chunkSize) {
+            chunk.used = 0;
+            recycledChunks.push_back(std::move(chunk));
+        }
+    }
+    chunks.clear();
+    chunksBytes = 0;
+    cursor = nullptr;
+    end = nullptr;
+
+    stats.flushes++;
+    stats.bytes += flushBytes;
+    stats.lastFlushBytes = flushBytes;
+    stats.largestFlushBytes = std::max(stats.largestFlushBytes, flushBytes);
+}
+
+const ChunkedCommandSerializer::Stats& ChunkedCommandSerializer::GetStats() const {
+    return stats;
+}
+
+void ChunkedCommandSerializer::StartChunk(size_t size) {
+    size_t newChunkSize = std::max(size, chunkSize);
+    if (!chunks.empty() && chunksBytes + newChunkSize > maxBytes) {
+        Flush();
+    }
+    FinishChunk();
+    chunksBytes += newChunkSize;
+
+    if (size <= chunkSize && !recycledChunks.empty()) {
+        chunks.push_back(std::move(recycledChunks.back()));
+        recycledChunks.pop_back();
+    } else {
+        Chunk chunk;
+        chunk.size = newChunkSize;
+        chunk.data.reset(new uint8_t[chunk.size]);
+        chunks.push_back(std::move(chunk));
+        stats.allocatedChunks++;
+    }
+
+    cursor = chunks.back().data.get();
+    end = cursor + chunks.back().size;
+}
+
+void ChunkedCommandSerializer::FinishChunk() {
+    if (!chunks.empty()) {
+        chunks.back().used = static_cast<size_t>(cursor - chunks.back().data.get());
+    }
+}
@@ -0,0 +1,70 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WIRE_CHUNKED_COMMAND_SERIALIZER_H_
+#define WIRE_CHUNKED_COMMAND_SERIALIZER_H_
+
+#include <memory>
+#include <vector>
+
+#include "Wire.h"
+
+// A CommandSerializer that writes commands in a list of chunks that grows until the next Flush.
+// Flush gives each chunk to the handler in place, then keeps them for the next commands. A
+// command never spans two chunks: when it doesn't fit in the rest of the current chunk a new
+// chunk is started, and commands bigger than a chunk get a chunk of their own. The list is
+// flushed early when its chunks would take more than maxBytes, like TerribleCommandBuffer does
+// when its buffer is full, so memory stays bounded however many commands are recorded between
+// flushes. The default is above the size of TerribleCommandBuffer so frames it could hold are
+// never split.
+class ChunkedCommandSerializer : public client::CommandSerializer {
+    public:
+        static constexpr size_t kDefaultChunkSize = 256 * 1024;
+        static constexpr size_t kDefaultMaxBytes = 16 * 1024 * 1024;
+
+        ChunkedCommandSerializer(server::CommandHandler* handler, size_t chunkSize = kDefaultChunkSize,
+                                 size_t maxBytes = kDefaultMaxBytes);
+        ~ChunkedCommandSerializer();
+
+        void* GetCmdSpace(size_t size) override;
+        void Flush() override;
+
+        struct Stats {
+            uint64_t flushes = 0;
+            uint64_t bytes = 0;
+            uint64_t chunks = 0;
+            uint64_t allocatedChunks = 0;
+            size_t lastFlushBytes = 0;
+            size_t largestFlushBytes = 0;
+        };
+        const Stats& GetStats() const;
+
+    private:
+        struct Chunk {
+            std::unique_ptr<uint8_t[]> data;
+            size_t size = 0;
+            size_t used = 0;
+        };
+
+        // Starts a new current chunk with room for at least size bytes.
+        void StartChunk(size_t size);
+        // Records how much of the current chunk was written.
+        void FinishChunk();
+
+        server::CommandHandler* handler = nullptr;
+        size_t chunkSize;
+        size_t maxBytes;
+
+        // The chunks filled since the last flush, the last one is the one being written from
+        // cursor to end.
+        std::vector<Chunk> chunks;
+        size_t chunksBytes = 0;
+        uint8_t* cursor = nullptr;
+        uint8_t* end = nullptr;
+        std::vector<Chunk> recycledChunks;
+
+        Stats stats;
+};
+
+#endif // WIRE_CHUNKED_COMMAND_SERIALIZER_H_
@@ -0,0 +1,427 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "SharedMemoryTransport.h"
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <new>
+
+#include <linux/futex.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace {
+
+    // The header is on its own page so that the messages are page aligned.
+    constexpr size_t kHeaderSize = 4096;
+    constexpr uint64_t kMinCapacity = 4096;
+    constexpr uint64_t kRingMagic = 0x4E58545752494E47; // "NXTWRING"
+
+    // Waiting spins a little before sleeping because the other side is often about to make
+    // progress.
+    constexpr int kSpinCount = 1000;
+    // Sleeps time out so that each side notices when the other one died.
+    constexpr long kSleepTimeoutNs = 100 * 1000 * 1000;
+
+    struct MessageHeader {
+        uint32_t size;
+        uint32_t type;
+    };
+    static_assert(sizeof(MessageHeader) == 8, "");
+
+    enum MessageType : uint32_t {
+        MessageCommands = 0,
+        // The rest of the ring is unused, the next message is at the start.
+        MessageWrap = 1,
+    };
+
+    uint64_t AlignMessage(uint64_t offset) {
+        return (offset + sizeof(MessageHeader) - 1) & ~uint64_t(sizeof(MessageHeader) - 1);
+    }
+
+}
+
+// The ring is shared between processes so it only contains lock-free atomics and a
+// process-shared mutex. The fields written by each side are on separate cache lines.
+struct SharedMemoryRing::Header {
+    uint64_t magic;
+    uint64_t capacity;
+
+    // Robust mutexes held by each side while it uses the ring. The kernel releases them with
+    // EOWNERDEAD when the thread holding them exits, which tells the other side that its peer
+    // died even when the process wasn't reaped yet.
+    pthread_mutex_t clientAlive;
+    pthread_mutex_t serverAlive;
+
+    alignas(64) std::atomic<uint64_t> writeOffset;
+    // Futex incremented when writeOffset changes or the ring is closed.
+    std::atomic<uint32_t> writeSignal;
+    // Set by the client when it closes the ring, or by the server when the client died.
+    std::atomic<uint32_t> closed;
+
+    alignas(64) std::atomic<uint64_t> readOffset;
+    // Futex incremented when readOffset changes.
+    std::atomic<uint32_t> readSignal;
+
+    alignas(64) std::atomic<uint32_t> readerSleeping;
+    std::atomic<uint32_t> writerSleeping;
+};
+
+namespace {
+
+    void FutexWait(std::atomic<uint32_t>* futex, uint32_t value) {
+        timespec timeout = {0, kSleepTimeoutNs};
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(futex), FUTEX_WAIT, value, &timeout, nullptr, 0);
+    }
+
+    void FutexWake(std::atomic<uint32_t>* futex) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(futex), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+    }
+
+    // Waits until ready() returns true, ready is checked again each time the signal changes or
+    // the sleep times out, after calling slept(). The other side only wakes the futex when a
+    // sleeping counter is set.
+    template<typename Ready, typename Slept>
+    void WaitFor(std::atomic<uint32_t>* signal, std::atomic<uint32_t>* sleeping, Ready ready, Slept slept) {
+        for (int i = 0; i < kSpinCount; ++i) {
+            if (ready()) {
+                return;
+            }
+        }
+
+        while (true) {
+            uint32_t value = signal->load();
+            if (ready()) {
+                return;
+            }
+
+            sleeping->fetch_add(1);
+            FutexWait(signal, value);
+            sleeping->fetch_sub(1);
+            slept();
+        }
+    }
+
+    void Signal(std::atomic<uint32_t>* signal, std::atomic<uint32_t>* sleeping) {
+        signal->fetch_add(1);
+        if (sleeping->load() != 0) {
+            FutexWake(signal);
+        }
+    }
+
+    void LockAlive(pthread_mutex_t* alive) {
+        // A previous user of the ring on this side died, this one takes over.
+        if (pthread_mutex_lock(alive) == EOWNERDEAD) {
+            pthread_mutex_consistent(alive);
+        }
+    }
+
+    // Returns false if the peer died while holding its alive mutex. A mutex nobody holds belongs
+    // to a peer that didn't start yet or is done with the ring.
+    bool IsPeerAlive(pthread_mutex_t* alive) {
+        int result = pthread_mutex_trylock(alive);
+        if (result == EBUSY) {
+            return true;
+        }
+        if (result == EOWNERDEAD) {
+            pthread_mutex_consistent(alive);
+            pthread_mutex_unlock(alive);
+            return false;
+        }
+        if (result == 0) {
+            pthread_mutex_unlock(alive);
+        }
+        return true;
+    }
+
+    bool InitAliveMutex(pthread_mutex_t* alive) {
+        pthread_mutexattr_t attributes;
+        pthread_mutexattr_init(&attributes);
+        pthread_mutexattr_setpshared(&attributes, PTHREAD_PROCESS_SHARED);
+        pthread_mutexattr_setrobust(&attributes, PTHREAD_MUTEX_ROBUST);
+        int result = pthread_mutex_init(alive, &attributes);
+        pthread_mutexattr_destroy(&attributes);
+        return result == 0;
+    }
+
+}
+
+// SharedMemoryRing
+
+SharedMemoryRing* SharedMemoryRing::Create(size_t requestedCapacity) {
+    static_assert(sizeof(Header) <= kHeaderSize, "");
+
+    uint64_t capacity = kMinCapacity;
+    while (capacity < requestedCapacity) {
+        capacity *= 2;
+    }
+
+    int fd = static_cast<int>(syscall(SYS_memfd_create, "nxt-wire-ring", 0));
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    size_t mappedSize = kHeaderSize + capacity;
+    if (ftruncate(fd, mappedSize) != 0) {
+        close(fd);
+        return nullptr;
+    }
+
+    void* memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+
+    // The file starts zeroed so only the constants and the mutexes are set.
+    Header* header = new (memory) Header;
+    header->magic = kRingMagic;
+    header->capacity = capacity;
+
+    if (!InitAliveMutex(&header->clientAlive) || !InitAliveMutex(&header->serverAlive)) {
+        munmap(memory, mappedSize);
+        close(fd);
+        return nullptr;
+    }
+
+    return new SharedMemoryRing(fd, static_cast<uint8_t*>(memory), mappedSize, capacity);
+}
+
+SharedMemoryRing* SharedMemoryRing::Open(int sharedFd) {
+    int fd = dup(sharedFd);
+    if (fd < 0) {
+        return nullptr;
+    }
+
+    struct stat fileStat;
+    if (fstat(fd, &fileStat) != 0 || fileStat.st_size <= static_cast<off_t>(kHeaderSize)) {
+        close(fd);
+        return nullptr;
+    }
+
+    size_t mappedSize = static_cast<size_t>(fileStat.st_size);
+    void* memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (memory == MAP_FAILED) {
+        close(fd);
+        return nullptr;
+    }
+
+    // Positions in the ring are computed with capacity - 1 as a mask.
+    Header* header = static_cast<Header*>(memory);
+    uint64_t capacity = header->capacity;
+    bool isPowerOfTwo = (capacity & (capacity - 1)) == 0;
+    if (header->magic != kRingMagic || capacity != mappedSize - kHeaderSize ||
+        capacity < kMinCapacity || !isPowerOfTwo) {
+        munmap(memory, mappedSize);
+        close(fd);
+        return nullptr;
+    }
+
+    return new SharedMemoryRing(fd, static_cast<uint8_t*>(memory), mappedSize, capacity);
+}
+
+SharedMemoryRing::SharedMemoryRing(int fd, uint8_t* memory, size_t mappedSize, uint64_t capacity)
+    : fd(fd), memory(memory), mappedSize(mappedSize), capacity(capacity) {
+    header = reinterpret_cast<Header*>(memory);
+    data = memory + kHeaderSize;
+}
+
+SharedMemoryRing::~SharedMemoryRing() {
+    munmap(memory, mappedSize);
+    close(fd);
+}
+
+int SharedMemoryRing::GetFd() const {
+    return fd;
+}
+
+// SharedMemoryCommandSerializer
+
+SharedMemoryCommandSerializer::SharedMemoryCommandSerializer(SharedMemoryRing* ring)
+    : ring(ring) {
+    LockAlive(&ring->header->clientAlive);
+}
+
+SharedMemoryCommandSerializer::~SharedMemoryCommandSerializer() {
+    Close();
+}
+
+void* SharedMemoryCommandSerializer::GetCmdSpace(size_t size) {
+    // Half of the ring so that a message always fits in the ring with the end of the ring it
+    // skips.
+    uint64_t maxPayload = ring->capacity / 2 - sizeof(MessageHeader);
+    if (size > maxPayload || closed || serverDied) {
+        return nullptr;
+    }
+
+    if (messageOpen) {
+        uint64_t payload = writeOffset - messageOffset - sizeof(MessageHeader);
+        uint64_t messageEnd = (messageOffset & (ring->capacity - 1)) + sizeof(MessageHeader) + payload + size;
+        if (payload + size > maxPayload || messageEnd > ring->capacity) {
+            PublishMessage();
+        }
+    }
+    if (!messageOpen && !OpenMessage(size)) {
+        return nullptr;
+    }
+
+    if (!WaitForSpace(writeOffset + size)) {
+        return nullptr;
+    }
+    uint8_t* result = ring->data + (writeOffset & (ring->capacity - 1));
+    writeOffset += size;
+    return result;
+}
+
+void SharedMemoryCommandSerializer::Flush() {
+    if (messageOpen && !serverDied) {
+        PublishMessage();
+    }
+}
+
+void SharedMemoryCommandSerializer::Close() {
+    if (closed) {
+        return;
+    }
+
+    Flush();
+    closed = true;
+    ring->header->closed.store(1);
+    Signal(&ring->header->writeSignal, &ring->header->readerSleeping);
+    pthread_mutex_unlock(&ring->header->clientAlive);
+}
+
+bool SharedMemoryCommandSerializer::OpenMessage(size_t size) {
+    uint64_t position = writeOffset & (ring->capacity - 1);
+
+    // Messages are contiguous, skip to the start of the ring if this one would wrap. The
+    // skipped bytes count as written so the server must have read their previous contents. The
+    // skip is published right away so that the server frees the end of the ring.
+    if (position + sizeof(MessageHeader) + size > ring->capacity) {
+        if (!WaitForSpace(writeOffset + ring->capacity - position)) {
+            return false;
+        }
+        MessageHeader* wrap = reinterpret_cast<MessageHeader*>(ring->data + position);
+        wrap->size = 0;
+        wrap->type = MessageWrap;
+
+        writeOffset += ring->capacity - position;
+        ring->header->writeOffset.store(writeOffset, std::memory_order_release);
+        Signal(&ring->header->writeSignal, &ring->header->readerSleeping);
+    }
+
+    if (!WaitForSpace(writeOffset + sizeof(MessageHeader))) {
+        return false;
+    }
+    messageOffset = writeOffset;
+    writeOffset += sizeof(MessageHeader);
+    messageOpen = true;
+    return true;
+}
+
+void SharedMemoryCommandSerializer::PublishMessage() {
+    MessageHeader* message = reinterpret_cast<MessageHeader*>(ring->data + (messageOffset & (ring->capacity - 1)));
+    message->size = static_cast<uint32_t>(writeOffset - messageOffset - sizeof(MessageHeader));
+    message->type = MessageCommands;
+
+    writeOffset = AlignMessage(writeOffset);
+    ring->header->writeOffset.store(writeOffset, std::memory_order_release);
+    Signal(&ring->header->writeSignal, &ring->header->readerSleeping);
+
+    messageOpen = false;
+}
+
+bool SharedMemoryCommandSerializer::WaitForSpace(uint64_t end) {
+    if (end - readOffset <= ring->capacity) {
+        return true;
+    }
+
+    // The server will never free space once it died, the commands are dropped from then on.
+    SharedMemoryRing::Header* header = ring->header;
+    WaitFor(&header->readSignal, &header->writerSleeping, [&]() {
+        readOffset = header->readOffset.load(std::memory_order_acquire);
+        return end - readOffset <= ring->capacity || serverDied;
+    }, [&]() {
+        if (!IsPeerAlive(&header->serverAlive)) {
+            serverDied = true;
+        }
+    });
+    return !serverDied;
+}
+
+// SharedMemoryServer
+
+SharedMemoryServer::SharedMemoryServer(SharedMemoryRing* ring, server::CommandHandler* handler)
+    : ring(ring), handler(handler) {
+    LockAlive(&ring->header->serverAlive);
+}
+
+SharedMemoryServer::~SharedMemoryServer() {
+    pthread_mutex_unlock(&ring->header->serverAlive);
+}
+
+bool SharedMemoryServer::PumpMessages() {
+    SharedMemoryRing::Header* header = ring->header;
+
+    uint64_t writeOffset = 0;
+    WaitFor(&header->writeSignal, &header->readerSleeping, [&]() {
+        // Closing happens after the last message is published.
+        bool closed = header->closed.load(std::memory_order_acquire) != 0;
+        writeOffset = header->writeOffset.load(std::memory_order_acquire);
+        return writeOffset != readOffset || closed;
+    }, [&]() {
+        // The ring is closed for the client when it died, the messages it published before
+        // are still handled.
+        if (!IsPeerAlive(&header->clientAlive)) {
+            header->closed.store(1);
+        }
+    });
+
+    if (writeOffset == readOffset) {
+        return false;
+    }
+
+    while (readOffset != writeOffset) {
+        // The client is in another process, so its messages are checked before being read.
+        uint64_t position = readOffset & (ring->capacity - 1);
+        uint64_t available = writeOffset - readOffset;
+        if (available < sizeof(MessageHeader) || available > ring->capacity) {
+            return false;
+        }
+
+        MessageHeader message = *reinterpret_cast<const MessageHeader*>(ring->data + position);
+        if (message.type == MessageWrap) {
+            readOffset += ring->capacity - position;
+        } else {
+            uint64_t messageSize = AlignMessage(sizeof(MessageHeader) + uint64_t(message.size));
+            if (message.type != MessageCommands || messageSize > available || position + messageSize > ring->capacity) {
+                return false;
+            }
+
+            // The client can still write in the ring, so the commands are copied before being
+            // read to make sure they don't change between the checks and the uses of the
+            // handler. Commands the server can't read are reported by the handler, the next
+            // messages can still be read.
+            commands.resize(message.size);
+            memcpy(commands.data(), ring->data + position + sizeof(MessageHeader), message.size);
+            handler->HandleCommands(commands.data(), message.size);
+            readOffset += messageSize;
+        }
+
+        header->readOffset.store(readOffset, std::memory_order_release);
+        Signal(&header->readSignal, &header->writerSleeping);
+    }
+
+    return true;
+}
+
+void SharedMemoryServer::Run() {
+    while (PumpMessages()) {
+    }
+}
@@ -0,0 +1,113 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WIRE_SHARED_MEMORY_TRANSPORT_H_
+#define WIRE_SHARED_MEMORY_TRANSPORT_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "Wire.h"
+
+// A transport for the wire between two processes, Linux only. The client process writes the
+// commands in a ring in shared memory and the server process copies each message out of the
+// ring before handling it, so that the client can't change commands after they were checked.
+// The ring has a single producer and a single consumer that sleep on futexes when it is full or
+// empty. A client that dies without closing the ring closes it implicitly, and a client whose
+// server died drops its commands.
+//
+// Commands are grouped in messages that are contiguous in the ring, a message is published when
+// the client flushes or when the next command doesn't fit in it.
+
+class SharedMemoryRing {
+    public:
+        // Creates the shared memory with room for capacity bytes of messages, rounded up to a
+        // power of two. Returns nullptr on failure.
+        static SharedMemoryRing* Create(size_t capacity);
+
+        // Maps the shared memory of a ring created in another process, from the file
+        // descriptor of that ring passed over fork or a UNIX socket. Returns nullptr if the file
+        // isn't a ring.
+        static SharedMemoryRing* Open(int fd);
+
+        ~SharedMemoryRing();
+
+        int GetFd() const;
+
+    private:
+        friend class SharedMemoryCommandSerializer;
+        friend class SharedMemoryServer;
+
+        struct Header;
+
+        // The capacity is the one that was checked, the header can be changed by the other
+        // process at any time.
+        SharedMemoryRing(int fd, uint8_t* memory, size_t mappedSize, uint64_t capacity);
+
+        int fd;
+        uint8_t* memory;
+        size_t mappedSize;
+
+        Header* header;
+        uint8_t* data;
+        uint64_t capacity;
+};
+
+// The serializer must be created, closed and destroyed on the same thread, the server considers
+// the client dead when that thread exits.
+class SharedMemoryCommandSerializer : public client::CommandSerializer {
+    public:
+        SharedMemoryCommandSerializer(SharedMemoryRing* ring);
+        ~SharedMemoryCommandSerializer();
+
+        // Returns nullptr for commands bigger than half of the ring, and once the server died.
+        // Waits for the server when the ring is full.
+        void* GetCmdSpace(size_t size) override;
+        void Flush() override;
+
+        // Flushes and tells the server that no more commands will come.
+        void Close();
+
+    private:
+        // Return false when the server died.
+        bool OpenMessage(size_t size);
+        void PublishMessage();
+        bool WaitForSpace(uint64_t end);
+
+        SharedMemoryRing* ring;
+
+        // The offsets count bytes since the creation of the ring, positions in the ring are the
+        // offsets modulo its capacity.
+        uint64_t writeOffset = 0;
+        uint64_t readOffset = 0;
+        uint64_t messageOffset = 0;
+        bool messageOpen = false;
+        bool closed = false;
+        bool serverDied = false;
+};
+
+// Like the serializer, the server must be created and destroyed on the same thread.
+class SharedMemoryServer {
+    public:
+        SharedMemoryServer(SharedMemoryRing* ring, server::CommandHandler* handler);
+        ~SharedMemoryServer();
+
+        // Handles the published messages, waiting for one if there are none. Returns false when
+        // the client closed the ring or died and all its messages were handled, or when a message
+        // is corrupted.
+        bool PumpMessages();
+
+        // Pumps messages until the client closes the ring.
+        void Run();
+
+    private:
+        SharedMemoryRing* ring;
+        server::CommandHandler* handler;
+        uint64_t readOffset = 0;
+        // The copy of the message being handled.
+        std::vector<uint8_t> commands;
+};
+
+#endif // WIRE_SHARED_MEMORY_TRANSPORT_H_
@@ -35,7 +35,7 @@ class TerribleCommandBuffer : public client::CommandSerializer {
 
     private:
         server::CommandHandler* handler = nullptr;
-        size_t offset;
+        size_t offset = 0;
         uint8_t buffer[10000000];
 };
 
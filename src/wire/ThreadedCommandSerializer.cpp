@@ -0,0 +1,148 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "ThreadedCommandSerializer.h"
+
+#include <algorithm>
+
+constexpr size_t ThreadedCommandSerializer::kDefaultChunkSize;
+constexpr uint64_t ThreadedCommandSerializer::kChunkCount;
+
+ThreadedCommandSerializer::ThreadedCommandSerializer(server::CommandHandler* handler, size_t chunkSize)
+    : handler(handler), chunkSize(chunkSize), chunks(kChunkCount), published(0), handled(0),
+      serverSleeping(false), clientWaiting(false) {
+    thread = std::thread(&ThreadedCommandSerializer::ServerMain, this);
+}
+
+ThreadedCommandSerializer::~ThreadedCommandSerializer() {
+    Flush();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+    thread.join();
+}
+
+void* ThreadedCommandSerializer::GetCmdSpace(size_t size) {
+    if (static_cast<size_t>(end - cursor) < size) {
+        if (cursor != nullptr) {
+            PublishChunk();
+        }
+        StartChunk(size);
+    }
+
+    uint8_t* result = cursor;
+    cursor += size;
+    return result;
+}
+
+void ThreadedCommandSerializer::Flush() {
+    uint64_t serial = published.load(std::memory_order_relaxed);
+    if (cursor != nullptr && cursor != chunks[serial % kChunkCount].data.get()) {
+        PublishChunk();
+    }
+}
+
+void ThreadedCommandSerializer::WaitForIdle() {
+    Flush();
+    WaitForHandled(published.load(std::memory_order_relaxed));
+}
+
+void ThreadedCommandSerializer::RunOnServerThread(std::function<void()> task) {
+    // The task goes with the current chunk, even if it is empty.
+    if (cursor == nullptr) {
+        StartChunk(0);
+    }
+
+    uint64_t serial = published.load(std::memory_order_relaxed);
+    chunks[serial % kChunkCount].task = std::move(task);
+    PublishChunk();
+}
+
+void ThreadedCommandSerializer::StartChunk(size_t size) {
+    // The chunk is free once the server thread handled the chunk that used it a lap ago.
+    uint64_t serial = published.load(std::memory_order_relaxed);
+    if (serial >= kChunkCount) {
+        WaitForHandled(serial - kChunkCount + 1);
+    }
+
+    // Chunks grown for an oversized command go back to the normal size.
+    Chunk& chunk = chunks[serial % kChunkCount];
+    size_t neededSize = std::max(size, chunkSize);
+    if (chunk.size != neededSize) {
+        chunk.size = neededSize;
+        chunk.data.reset(new uint8_t[chunk.size]);
+    }
+
+    cursor = chunk.data.get();
+    end = cursor + chunk.size;
+}
+
+void ThreadedCommandSerializer::PublishChunk() {
+    uint64_t serial = published.load(std::memory_order_relaxed);
+    Chunk& chunk = chunks[serial % kChunkCount];
+    chunk.used = static_cast<size_t>(cursor - chunk.data.get());
+    cursor = nullptr;
+    end = nullptr;
+
+    // Sequentially consistent with the load of serverSleeping so that either the server thread
+    // sees the chunk before going to sleep, or this thread sees it sleeping and wakes it up.
+    published.store(serial + 1);
+    if (serverSleeping.load()) {
+        std::lock_guard<std::mutex> lock(mutex);
+        condition.notify_all();
+    }
+}
+
+void ThreadedCommandSerializer::WaitForHandled(uint64_t serial) {
+    if (handled.load(std::memory_order_acquire) >= serial) {
+        return;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    clientWaiting.store(true);
+    condition.wait(lock, [this, serial]() {
+        return handled.load() >= serial;
+    });
+    clientWaiting.store(false);
+}
+
+void ThreadedCommandSerializer::ServerMain() {
+    while (true) {
+        uint64_t serial = handled.load(std::memory_order_relaxed);
+
+        if (published.load(std::memory_order_acquire) == serial) {
+            std::unique_lock<std::mutex> lock(mutex);
+            serverSleeping.store(true);
+            condition.wait(lock, [this, serial]() {
+                return published.load() != serial || stopping;
+            });
+            serverSleeping.store(false);
+
+            // The destructor publishes the last chunk before stopping.
+            if (published.load() == serial) {
+                return;
+            }
+            continue;
+        }
+
+        // Commands the server fails to read are reported by the handler, the next chunks are
+        // still handled.
+        Chunk& chunk = chunks[serial % kChunkCount];
+        if (chunk.used > 0) {
+            handler->HandleCommands(chunk.data.get(), chunk.used);
+        }
+        if (chunk.task) {
+            chunk.task();
+            chunk.task = nullptr;
+        }
+
+        handled.store(serial + 1);
+        if (clientWaiting.load()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            condition.notify_all();
+        }
+    }
+}
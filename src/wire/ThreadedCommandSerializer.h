@@ -0,0 +1,85 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#ifndef WIRE_THREADED_COMMAND_SERIALIZER_H_
+#define WIRE_THREADED_COMMAND_SERIALIZER_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Wire.h"
+
+// A CommandSerializer that gives the commands to a handler running on a thread of its own. The
+// server thread is then the only one that calls the backend, and other backend calls have to
+// go through RunOnServerThread.
+//
+// Commands are written in chunks that go through a fixed size ring, a chunk is handed to the
+// server thread when it is full or on Flush. The client waits for the server thread when all
+// the chunks are in use. Like in ChunkedCommandSerializer a command never spans two chunks and
+// commands bigger than a chunk get a bigger chunk.
+class ThreadedCommandSerializer : public client::CommandSerializer {
+    public:
+        static constexpr size_t kDefaultChunkSize = 64 * 1024;
+        static constexpr uint64_t kChunkCount = 16;
+
+        ThreadedCommandSerializer(server::CommandHandler* handler, size_t chunkSize = kDefaultChunkSize);
+        // Handles the remaining commands then joins the server thread.
+        ~ThreadedCommandSerializer();
+
+        void* GetCmdSpace(size_t size) override;
+        // Hands the commands to the server thread without waiting for them.
+        void Flush() override;
+
+        // Flushes and returns when the server thread handled all the commands.
+        void WaitForIdle();
+
+        // Flushes and makes the server thread run task once it handled the commands. Backend
+        // calls that must be ordered with the commands, like presenting a frame, go through
+        // here so that only the server thread calls the backend.
+        void RunOnServerThread(std::function<void()> task);
+
+    private:
+        void StartChunk(size_t size);
+        void PublishChunk();
+        // Waits until the chunks before serial were handled.
+        void WaitForHandled(uint64_t serial);
+        void ServerMain();
+
+        struct Chunk {
+            std::unique_ptr<uint8_t[]> data;
+            size_t size = 0;
+            size_t used = 0;
+            // Ran by the server thread after the commands of the chunk.
+            std::function<void()> task;
+        };
+
+        server::CommandHandler* handler = nullptr;
+        size_t chunkSize;
+
+        // Serials of chunks, a chunk is in chunks[serial % kChunkCount]. The chunks in
+        // [handled, published) wait for the server thread, the client writes in the chunk at
+        // published from cursor to end.
+        std::vector<Chunk> chunks;
+        std::atomic<uint64_t> published;
+        std::atomic<uint64_t> handled;
+        uint8_t* cursor = nullptr;
+        uint8_t* end = nullptr;
+
+        // The server thread sleeps when there are no chunks to handle, the client thread sleeps
+        // when it waits for chunks to be handled.
+        std::mutex mutex;
+        std::condition_variable condition;
+        std::atomic<bool> serverSleeping;
+        std::atomic<bool> clientWaiting;
+        bool stopping = false;
+
+        std::thread thread;
+};
+
+#endif // WIRE_THREADED_COMMAND_SERIALIZER_H_
@@ -13,11 +13,17 @@ namespace client {
     class CommandSerializer {
         public:
             virtual ~CommandSerializer() = default;
+            // Returns nullptr when the commands can't be sent, the client then drops them.
             virtual void* GetCmdSpace(size_t size) = 0;
             virtual void Flush() = 0;
     };
 
     void NewClientDevice(nxtProcTable* procs, nxtDevice* device, CommandSerializer* serializer);
+
+    // Errors found on the client side, like calls to the methods the wire doesn't forward, are
+    // given to the callback of the client device.
+    using ErrorCallback = void (*)(const char* message, void* userData);
+    void RegisterSynchronousErrorCallback(nxtDevice device, ErrorCallback callback, void* userData);
 }
 
 namespace server {
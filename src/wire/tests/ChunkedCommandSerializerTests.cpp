@@ -0,0 +1,140 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gtest/gtest.h"
+
+#include "ChunkedCommandSerializer.h"
+
+#include <cstring>
+#include <vector>
+
+// Records the buffers given to HandleCommands
+class RecordingCommandHandler : public server::CommandHandler {
+    public:
+        const uint8_t* HandleCommands(const uint8_t* commands, size_t size) override {
+            buffers.push_back(commands);
+            data.insert(data.end(), commands, commands + size);
+            sizes.push_back(size);
+            return failAfter-- == 0 ? nullptr : commands + size;
+        }
+
+        void OnSynchronousError() override {
+        }
+
+        std::vector<const uint8_t*> buffers;
+        std::vector<size_t> sizes;
+        std::vector<uint8_t> data;
+        int failAfter = -1;
+};
+
+static void WriteCommand(ChunkedCommandSerializer* serializer, size_t size, uint8_t value) {
+    void* space = serializer->GetCmdSpace(size);
+    ASSERT_NE(space, nullptr);
+    memset(space, value, size);
+}
+
+// Test commands are only handled on flush, in order, from the chunks they were written in
+TEST(ChunkedCommandSerializer, HandledInOrderOnFlush) {
+    RecordingCommandHandler handler;
+    ChunkedCommandSerializer serializer(&handler, 64);
+
+    std::vector<uint8_t> expected;
+    for (uint8_t i = 0; i < 10; ++i) {
+        WriteCommand(&serializer, 24, i);
+        expected.insert(expected.end(), 24, i);
+    }
+    ASSERT_TRUE(handler.buffers.empty());
+
+    serializer.Flush();
+    ASSERT_EQ(handler.data, expected);
+
+    // Two commands fit in each chunk
+    ASSERT_EQ(handler.sizes, std::vector<size_t>(5, 48));
+    ASSERT_EQ(serializer.GetStats().lastFlushBytes, 240u);
+    ASSERT_EQ(serializer.GetStats().chunks, 5u);
+}
+
+// Test a command bigger than a chunk gets a chunk of its own
+TEST(ChunkedCommandSerializer, CommandBiggerThanChunk) {
+    RecordingCommandHandler handler;
+    ChunkedCommandSerializer serializer(&handler, 64);
+
+    WriteCommand(&serializer, 16, 1);
+    WriteCommand(&serializer, 1000, 2);
+    WriteCommand(&serializer, 16, 3);
+    serializer.Flush();
+
+    ASSERT_EQ(handler.sizes, std::vector<size_t>({16, 1000, 16}));
+    ASSERT_EQ(handler.data[16], 2);
+    ASSERT_EQ(handler.data[1015], 2);
+    ASSERT_EQ(handler.data[1016], 3);
+}
+
+// Test chunks are reused by the commands after a flush
+TEST(ChunkedCommandSerializer, ChunksAreRecycled) {
+    RecordingCommandHandler handler;
+    ChunkedCommandSerializer serializer(&handler, 64);
+
+    WriteCommand(&serializer, 32, 1);
+    serializer.Flush();
+    WriteCommand(&serializer, 32, 2);
+    serializer.Flush();
+
+    ASSERT_EQ(handler.buffers[0], handler.buffers[1]);
+    ASSERT_EQ(serializer.GetStats().allocatedChunks, 1u);
+    ASSERT_EQ(serializer.GetStats().flushes, 2u);
+    ASSERT_EQ(serializer.GetStats().bytes, 64u);
+}
+
+// Test the chunks after one the server failed to read are dropped
+TEST(ChunkedCommandSerializer, StopsAfterError) {
+    RecordingCommandHandler handler;
+    ChunkedCommandSerializer serializer(&handler, 64);
+    handler.failAfter = 0;
+
+    WriteCommand(&serializer, 64, 1);
+    WriteCommand(&serializer, 64, 2);
+    serializer.Flush();
+    ASSERT_EQ(handler.sizes.size(), 1u);
+
+    // The next flush starts over
+    WriteCommand(&serializer, 64, 3);
+    serializer.Flush();
+    ASSERT_EQ(handler.sizes.size(), 2u);
+    ASSERT_EQ(handler.data.back(), 3);
+}
+
+// Test the chunks are flushed early when they would take more than the maximum size
+TEST(ChunkedCommandSerializer, FlushesAtMaxBytes) {
+    RecordingCommandHandler handler;
+    ChunkedCommandSerializer serializer(&handler, 64, 16 * 64);
+
+    for (uint8_t i = 0; i < 16; ++i) {
+        WriteCommand(&serializer, 64, i);
+    }
+    ASSERT_TRUE(handler.buffers.empty());
+
+    // The next chunk flushes the previous ones, then reuses one of them
+    WriteCommand(&serializer, 64, 42);
+    ASSERT_EQ(handler.sizes.size(), 16u);
+    ASSERT_EQ(serializer.GetStats().flushes, 1u);
+
+    serializer.Flush();
+    ASSERT_EQ(handler.data.back(), 42);
+    ASSERT_EQ(serializer.GetStats().allocatedChunks, 16u);
+}
+
+// Test the default maximum size holds frames as big as TerribleCommandBuffer's without flushing
+TEST(ChunkedCommandSerializer, DefaultMaxBytesHoldsBigFrames) {
+    RecordingCommandHandler handler;
+    ChunkedCommandSerializer serializer(&handler);
+
+    for (uint32_t i = 0; i < 10 * 1024; ++i) {
+        WriteCommand(&serializer, 1024, static_cast<uint8_t>(i));
+    }
+    ASSERT_TRUE(handler.buffers.empty());
+
+    serializer.Flush();
+    ASSERT_EQ(serializer.GetStats().lastFlushBytes, 10u * 1024 * 1024);
+}
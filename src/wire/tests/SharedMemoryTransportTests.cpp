@@ -0,0 +1,194 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gtest/gtest.h"
+
+#include "SharedMemoryTransport.h"
+
+#include <memory>
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Hashes the stream of commands it receives, whatever messages they were split in
+class HashingCommandHandler : public server::CommandHandler {
+    public:
+        const uint8_t* HandleCommands(const uint8_t* commands, size_t size) override {
+            for (size_t i = 0; i < size; ++i) {
+                hash = (hash ^ commands[i]) * 1099511628211ull;
+            }
+            bytes += size;
+            return commands + size;
+        }
+
+        void OnSynchronousError() override {
+        }
+
+        uint64_t hash = 14695981039346656037ull;
+        uint64_t bytes = 0;
+};
+
+// Test commands written in a small ring reach a server in another process, in order. The ring
+// wraps and fills up many times so both sides have to wait for each other.
+TEST(SharedMemoryTransport, TwoProcesses) {
+    std::unique_ptr<SharedMemoryRing> ring(SharedMemoryRing::Create(4096));
+    ASSERT_NE(ring, nullptr);
+
+    int results[2];
+    ASSERT_EQ(pipe(results), 0);
+
+    pid_t pid = fork();
+    ASSERT_NE(pid, -1);
+    if (pid == 0) {
+        // Map the ring again from its file descriptor like an unrelated process would.
+        std::unique_ptr<SharedMemoryRing> serverRing(SharedMemoryRing::Open(ring->GetFd()));
+        if (serverRing == nullptr) {
+            _exit(1);
+        }
+
+        HashingCommandHandler handler;
+        SharedMemoryServer server(serverRing.get(), &handler);
+        server.Run();
+
+        uint64_t result[2] = {handler.hash, handler.bytes};
+        ssize_t written = write(results[1], result, sizeof(result));
+        _exit(written == sizeof(result) ? 0 : 1);
+    }
+    close(results[1]);
+
+    SharedMemoryCommandSerializer serializer(ring.get());
+    HashingCommandHandler expected;
+
+    // Commands too big for a message are refused
+    ASSERT_EQ(serializer.GetCmdSpace(4096), nullptr);
+
+    for (uint32_t i = 0; i < 20000; ++i) {
+        size_t size = 1 + (i * 37) % 1000;
+        uint8_t* command = reinterpret_cast<uint8_t*>(serializer.GetCmdSpace(size));
+        ASSERT_NE(command, nullptr);
+        for (size_t j = 0; j < size; ++j) {
+            command[j] = static_cast<uint8_t>(i + j);
+        }
+        expected.HandleCommands(command, size);
+
+        if (i % 16 == 0) {
+            serializer.Flush();
+        }
+    }
+    serializer.Close();
+
+    uint64_t result[2] = {0, 0};
+    ASSERT_EQ(read(results[0], result, sizeof(result)), static_cast<ssize_t>(sizeof(result)));
+    close(results[0]);
+
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(WEXITSTATUS(status), 0);
+
+    ASSERT_EQ(result[0], expected.hash);
+    ASSERT_EQ(result[1], expected.bytes);
+}
+
+// Test the server stops when the client closes the ring
+TEST(SharedMemoryTransport, CloseStopsServer) {
+    std::unique_ptr<SharedMemoryRing> ring(SharedMemoryRing::Create(4096));
+    ASSERT_NE(ring, nullptr);
+
+    HashingCommandHandler handler;
+    SharedMemoryServer server(ring.get(), &handler);
+    SharedMemoryCommandSerializer serializer(ring.get());
+
+    serializer.GetCmdSpace(100);
+    serializer.Flush();
+    ASSERT_TRUE(server.PumpMessages());
+    ASSERT_EQ(handler.bytes, 100u);
+
+    serializer.GetCmdSpace(20);
+    serializer.Close();
+    ASSERT_TRUE(server.PumpMessages());
+    ASSERT_EQ(handler.bytes, 120u);
+    ASSERT_FALSE(server.PumpMessages());
+    ASSERT_EQ(serializer.GetCmdSpace(20), nullptr);
+}
+
+// Test a file that isn't a ring is rejected
+TEST(SharedMemoryTransport, OpenRejectsOtherFiles) {
+    int fds[2];
+    ASSERT_EQ(pipe(fds), 0);
+    ASSERT_EQ(SharedMemoryRing::Open(fds[0]), nullptr);
+    close(fds[0]);
+    close(fds[1]);
+}
+
+// Test the server stops when the client dies without closing the ring, even before the client
+// process is reaped
+TEST(SharedMemoryTransport, ClientDeathStopsServer) {
+    std::unique_ptr<SharedMemoryRing> ring(SharedMemoryRing::Create(4096));
+    ASSERT_NE(ring, nullptr);
+
+    pid_t pid = fork();
+    ASSERT_NE(pid, -1);
+    if (pid == 0) {
+        SharedMemoryCommandSerializer* serializer = new SharedMemoryCommandSerializer(ring.get());
+        serializer->GetCmdSpace(100);
+        serializer->Flush();
+        _exit(0);
+    }
+
+    HashingCommandHandler handler;
+    SharedMemoryServer server(ring.get(), &handler);
+    server.Run();
+    ASSERT_EQ(handler.bytes, 100u);
+
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+}
+
+// Test the client stops waiting for space and drops its commands when the server died
+TEST(SharedMemoryTransport, ServerDeathStopsClient) {
+    std::unique_ptr<SharedMemoryRing> ring(SharedMemoryRing::Create(4096));
+    ASSERT_NE(ring, nullptr);
+
+    // The server starts but never reads the ring
+    pid_t pid = fork();
+    ASSERT_NE(pid, -1);
+    if (pid == 0) {
+        HashingCommandHandler handler;
+        new SharedMemoryServer(ring.get(), &handler);
+        _exit(0);
+    }
+    int status = 0;
+    ASSERT_EQ(waitpid(pid, &status, 0), pid);
+
+    SharedMemoryCommandSerializer serializer(ring.get());
+    void* space = nullptr;
+    for (int i = 0; i < 100; ++i) {
+        space = serializer.GetCmdSpace(1000);
+        if (space == nullptr) {
+            break;
+        }
+        serializer.Flush();
+    }
+    ASSERT_EQ(space, nullptr);
+    ASSERT_EQ(serializer.GetCmdSpace(8), nullptr);
+}
+
+// Test rings with a capacity that isn't a power of two are rejected
+TEST(SharedMemoryTransport, OpenRejectsBadCapacity) {
+    std::unique_ptr<SharedMemoryRing> ring(SharedMemoryRing::Create(4096));
+    ASSERT_NE(ring, nullptr);
+
+    // Grow the file so that the capacity still matches its size, but isn't a power of two
+    ASSERT_EQ(ftruncate(ring->GetFd(), 4096 + 6000), 0);
+    uint64_t capacity = 6000;
+    ASSERT_EQ(pwrite(ring->GetFd(), &capacity, sizeof(capacity), sizeof(uint64_t)), static_cast<ssize_t>(sizeof(capacity)));
+    ASSERT_EQ(SharedMemoryRing::Open(ring->GetFd()), nullptr);
+
+    // The same for a capacity smaller than the minimum
+    ASSERT_EQ(ftruncate(ring->GetFd(), 4096 + 1024), 0);
+    capacity = 1024;
+    ASSERT_EQ(pwrite(ring->GetFd(), &capacity, sizeof(capacity), sizeof(uint64_t)), static_cast<ssize_t>(sizeof(capacity)));
+    ASSERT_EQ(SharedMemoryRing::Open(ring->GetFd()), nullptr);
+}
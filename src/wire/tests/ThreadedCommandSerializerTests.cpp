@@ -0,0 +1,134 @@
+// Copyright (c) 2017 The Chromium Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "gtest/gtest.h"
+
+#include "ThreadedCommandSerializer.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+// Records the commands it receives and the thread they are received on. The handler can be
+// blocked to fill the ring.
+class BlockingCommandHandler : public server::CommandHandler {
+    public:
+        const uint8_t* HandleCommands(const uint8_t* commands, size_t size) override {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this]() {
+                return !blocked;
+            });
+
+            data.insert(data.end(), commands, commands + size);
+            threadId = std::this_thread::get_id();
+            return commands + size;
+        }
+
+        void OnSynchronousError() override {
+        }
+
+        void SetBlocked(bool block) {
+            std::lock_guard<std::mutex> lock(mutex);
+            blocked = block;
+            condition.notify_all();
+        }
+
+        std::vector<uint8_t> data;
+        std::thread::id threadId;
+
+    private:
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool blocked = false;
+};
+
+static void WriteCommand(ThreadedCommandSerializer* serializer, size_t size, uint8_t value) {
+    void* space = serializer->GetCmdSpace(size);
+    ASSERT_NE(space, nullptr);
+    memset(space, value, size);
+}
+
+// Test commands are handled in order on the server thread, WaitForIdle waits for all of them
+TEST(ThreadedCommandSerializer, HandledInOrderOnServerThread) {
+    BlockingCommandHandler handler;
+    ThreadedCommandSerializer serializer(&handler, 64);
+
+    std::vector<uint8_t> expected;
+    for (uint32_t i = 0; i < 1000; ++i) {
+        // Some commands are bigger than a chunk
+        size_t size = i % 100 == 0 ? 200 : 24;
+        WriteCommand(&serializer, size, static_cast<uint8_t>(i));
+        expected.insert(expected.end(), size, static_cast<uint8_t>(i));
+    }
+
+    serializer.WaitForIdle();
+    ASSERT_EQ(handler.data, expected);
+    ASSERT_NE(handler.threadId, std::this_thread::get_id());
+}
+
+// Test the client waits for the server thread when all the chunks are in use
+TEST(ThreadedCommandSerializer, Backpressure) {
+    BlockingCommandHandler handler;
+    handler.SetBlocked(true);
+
+    std::atomic<uint32_t> written(0);
+    const uint32_t kCommandCount = 4 * ThreadedCommandSerializer::kChunkCount;
+    {
+        ThreadedCommandSerializer serializer(&handler, 64);
+
+        std::thread client([&serializer, &written]() {
+            for (uint32_t i = 0; i < kCommandCount; ++i) {
+                WriteCommand(&serializer, 64, static_cast<uint8_t>(i));
+                written++;
+            }
+            serializer.WaitForIdle();
+        });
+
+        // The handler holds one chunk and the client can fill the others and start the next.
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        ASSERT_LE(written.load(), ThreadedCommandSerializer::kChunkCount + 1);
+
+        handler.SetBlocked(false);
+        client.join();
+        ASSERT_EQ(written.load(), kCommandCount);
+    }
+    ASSERT_EQ(handler.data.size(), kCommandCount * 64);
+}
+
+// Test the commands left at destruction are handled
+TEST(ThreadedCommandSerializer, DestructionHandlesCommands) {
+    BlockingCommandHandler handler;
+    {
+        ThreadedCommandSerializer serializer(&handler, 64);
+        WriteCommand(&serializer, 16, 1);
+    }
+    ASSERT_EQ(handler.data, std::vector<uint8_t>(16, 1));
+}
+
+// Test tasks run on the server thread after the commands written before them
+TEST(ThreadedCommandSerializer, RunOnServerThread) {
+    BlockingCommandHandler handler;
+    ThreadedCommandSerializer serializer(&handler, 64);
+
+    size_t handledBytes = 0;
+    std::thread::id taskThreadId;
+    WriteCommand(&serializer, 16, 1);
+    serializer.RunOnServerThread([&]() {
+        handledBytes = handler.data.size();
+        taskThreadId = std::this_thread::get_id();
+    });
+
+    // Tasks also run when no commands were written since the last flush
+    bool ranEmpty = false;
+    serializer.RunOnServerThread([&ranEmpty]() {
+        ranEmpty = true;
+    });
+
+    serializer.WaitForIdle();
+    ASSERT_EQ(handledBytes, 16u);
+    ASSERT_EQ(taskThreadId, handler.threadId);
+    ASSERT_TRUE(ranEmpty);
+}
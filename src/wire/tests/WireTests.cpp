@@ -5,9 +5,12 @@
 #include "gtest/gtest.h"
 #include "mock/mock_nxt.h"
 
-#include "TerribleCommandBuffer.h"
+#include "ChunkedCommandSerializer.h"
 #include "Wire.h"
 
+#include <string>
+#include <vector>
+
 using namespace testing;
 
 class WireTests : public Test {
@@ -19,7 +22,7 @@ class WireTests : public Test {
 
             wireServer = server::CreateCommandHandler(mockDevice, mockProcs);
 
-            cmdBuf = new TerribleCommandBuffer(wireServer);
+            cmdBuf = new ChunkedCommandSerializer(wireServer);
 
             nxtDevice clientDevice;
             nxtProcTable clientProcs;
@@ -43,10 +46,10 @@ class WireTests : public Test {
         MockProcTable api;
         nxtDevice apiDevice;
         nxtDevice device;
+        server::CommandHandler* wireServer = nullptr;
 
     private:
-        server::CommandHandler* wireServer = nullptr;
-        TerribleCommandBuffer* cmdBuf = nullptr;
+        ChunkedCommandSerializer* cmdBuf = nullptr;
 };
 
 // One call gets forwarded correctly.
@@ -164,8 +167,104 @@ TEST_F(WireTests, OneObjectAsPointerArgument) {
     Flush();
 }
 
+// Test that an errored builder is usable again after a reset
+TEST_F(WireTests, ResetRecoversErroredBuilder) {
+    nxtCommandBufferBuilder builder = nxtDeviceCreateCommandBufferBuilder(device);
+    nxtCommandBufferBuilderGetResult(builder);
+    nxtCommandBufferBuilderReset(builder);
+    nxtCommandBufferBuilderSetCommandCountHint(builder, 10);
+    nxtCommandBufferBuilderGetResult(builder);
+
+    InSequence sequence;
+
+    nxtCommandBufferBuilder apiCmdBufBuilder = api.GetNewCommandBufferBuilder();
+    EXPECT_CALL(api, DeviceCreateCommandBufferBuilder(apiDevice))
+        .WillOnce(Return(apiCmdBufBuilder));
+
+    // The first GetResult reports an error, which marks the builder invalid
+    EXPECT_CALL(api, CommandBufferBuilderGetResult(apiCmdBufBuilder))
+        .WillOnce(DoAll(InvokeWithoutArgs([this]() {
+            wireServer->OnSynchronousError();
+        }), Return(nullptr)));
+
+    EXPECT_CALL(api, CommandBufferBuilderReset(apiCmdBufBuilder));
+    EXPECT_CALL(api, CommandBufferBuilderSetCommandCountHint(apiCmdBufBuilder, 10));
+
+    nxtCommandBuffer apiCmdBuf = api.GetNewCommandBuffer();
+    EXPECT_CALL(api, CommandBufferBuilderGetResult(apiCmdBufBuilder))
+        .WillOnce(Return(apiCmdBuf));
+
+    Flush();
+}
+
+static void FakeFenceCallback(nxtCallbackUserdata) {
+}
+
+static void RecordError(const char* message, void* userData) {
+    reinterpret_cast<std::vector<std::string>*>(userData)->push_back(message);
+}
+
+// Test fence queries aren't sent to the server, which has no way to answer the client, and
+// report an error on the client instead
+TEST_F(WireTests, FenceQueriesNotForwarded) {
+    std::vector<std::string> errors;
+    client::RegisterSynchronousErrorCallback(device, RecordError, &errors);
+
+    nxtFenceBuilder fenceBuilder = nxtDeviceCreateFenceBuilder(device);
+    nxtFence fence = nxtFenceBuilderGetResult(fenceBuilder);
+    nxtFenceOnCompletion(fence, 1, FakeFenceCallback, 0);
+    ASSERT_EQ(nxtFenceGetCompletedValue(fence), 0u);
+    nxtDeviceTick(device);
+
+    ASSERT_EQ(errors, std::vector<std::string>({
+        "nxtFenceOnCompletion isn't forwarded by the wire",
+        "nxtFenceGetCompletedValue isn't forwarded by the wire",
+    }));
+
+    nxtFenceBuilder apiFenceBuilder = api.GetNewFenceBuilder();
+    EXPECT_CALL(api, DeviceCreateFenceBuilder(apiDevice))
+        .WillOnce(Return(apiFenceBuilder));
+
+    nxtFence apiFence = api.GetNewFence();
+    EXPECT_CALL(api, FenceBuilderGetResult(apiFenceBuilder))
+        .WillOnce(Return(apiFence));
+
+    EXPECT_CALL(api, FenceOnCompletion(_, _, _, _)).Times(0);
+    EXPECT_CALL(api, FenceGetCompletedValue(_)).Times(0);
+    EXPECT_CALL(api, DeviceTick(apiDevice));
+
+    Flush();
+}
+
 // TODO
 //  - Test values work
 //  - Test multiple objects as value work
 //  - Object creation, then calls do nothing after error on builder
 //  - Object creation then error then create object, then should do nothing.
+
+// Refuses all the commands, like a transport whose server died
+class FailingCommandSerializer : public client::CommandSerializer {
+    public:
+        void* GetCmdSpace(size_t) override {
+            return nullptr;
+        }
+        void Flush() override {
+        }
+};
+
+// Test the client drops the commands a serializer can't take and reports it once
+TEST(WireClientTests, FailingSerializerDropsCommands) {
+    FailingCommandSerializer serializer;
+    nxtDevice device;
+    nxtProcTable procs;
+    client::NewClientDevice(&procs, &device, &serializer);
+
+    std::vector<std::string> errors;
+    client::RegisterSynchronousErrorCallback(device, RecordError, &errors);
+
+    nxtCommandBufferBuilder builder = procs.deviceCreateCommandBufferBuilder(device);
+    procs.commandBufferBuilderDispatch(builder, 1, 1, 1);
+    procs.commandBufferBuilderRelease(builder);
+
+    ASSERT_EQ(errors, std::vector<std::string>({"The command serializer failed, commands are dropped"}));
+}